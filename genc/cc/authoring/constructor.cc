@@ -15,7 +15,9 @@ limitations under the License
 
 #include "genc/cc/authoring/constructor.h"
 
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -121,6 +123,37 @@ absl::StatusOr<v0::Value> CreateLlamaCppConfig(std::string model_path,
   return model_config_pb;
 }
 
+absl::StatusOr<v0::Value> CreateLlamaCppConfig(
+    std::string model_path, int num_threads, int max_tokens,
+    const LlamaCppConfigOptions& options) {
+  v0::Value model_config_pb = GENC_TRY(
+      CreateLlamaCppConfig(std::move(model_path), num_threads, max_tokens));
+  v0::Struct* args = model_config_pb.mutable_struct_();
+  *args->add_element() =
+      CreateLabeledValue("num_slots", ToValue(options.num_slots));
+  *args->add_element() = CreateLabeledValue("n_ctx", ToValue(options.n_ctx));
+  *args->add_element() =
+      CreateLabeledValue("n_batch", ToValue(options.n_batch));
+  *args->add_element() =
+      CreateLabeledValue("n_ubatch", ToValue(options.n_ubatch));
+  *args->add_element() =
+      CreateLabeledValue("temperature", ToValue(options.temperature));
+  *args->add_element() = CreateLabeledValue("top_k", ToValue(options.top_k));
+  *args->add_element() = CreateLabeledValue("top_p", ToValue(options.top_p));
+  *args->add_element() = CreateLabeledValue(
+      "repetition_penalty", ToValue(options.repetition_penalty));
+  *args->add_element() = CreateLabeledValue(
+      "repetition_last_n", ToValue(options.repetition_last_n));
+  *args->add_element() = CreateLabeledValue("seed", ToValue(options.seed));
+  if (!options.draft_model_path.empty()) {
+    *args->add_element() = CreateLabeledValue(
+        "draft_model_path", ToValue(options.draft_model_path));
+    *args->add_element() = CreateLabeledValue(
+        "num_draft_tokens", ToValue(options.num_draft_tokens));
+  }
+  return model_config_pb;
+}
+
 // TODO(b/325090417): merge into CreateModelInference with nullable config.
 absl::StatusOr<v0::Value> CreateModelInferenceWithConfig(
     absl::string_view model_uri, v0::Value model_config) {
@@ -144,6 +177,47 @@ absl::StatusOr<v0::Value> CreateModelInferenceWithConfig(
   return model_pb;
 }
 
+absl::StatusOr<v0::Value> CreateEmbed(absl::string_view model_uri,
+                                      v0::Value model_config) {
+  v0::Value embed_pb;
+  v0::Intrinsic* const intrinsic_pb = embed_pb.mutable_intrinsic();
+  intrinsic_pb->set_uri(std::string(intrinsics::kEmbed));
+  v0::Struct* args =
+      intrinsic_pb->mutable_static_parameter()->mutable_struct_();
+  v0::Value* model_uri_pb = args->add_element();
+  model_uri_pb->set_label("model_uri");
+  model_uri_pb->set_str(std::string(model_uri));
+
+  if (model_config.has_struct_() || model_config.has_str()) {
+    model_config.set_label("model_config");
+    *args->add_element() = std::move(model_config);
+  }
+  return embed_pb;
+}
+
+absl::StatusOr<v0::Value> CreateSimilarity(absl::string_view metric) {
+  v0::Value similarity_pb;
+  v0::Intrinsic* const intrinsic_pb = similarity_pb.mutable_intrinsic();
+  intrinsic_pb->set_uri(std::string(intrinsics::kSimilarity));
+  intrinsic_pb->mutable_static_parameter()->set_str(std::string(metric));
+  return similarity_pb;
+}
+
+absl::StatusOr<v0::Value> CreateTopK(int k, absl::string_view metric) {
+  v0::Value top_k_pb;
+  v0::Intrinsic* const intrinsic_pb = top_k_pb.mutable_intrinsic();
+  intrinsic_pb->set_uri(std::string(intrinsics::kTopK));
+  v0::Struct* args =
+      intrinsic_pb->mutable_static_parameter()->mutable_struct_();
+  v0::Value* k_pb = args->add_element();
+  k_pb->set_label("k");
+  k_pb->set_int_32(k);
+  v0::Value* metric_pb = args->add_element();
+  metric_pb->set_label("metric");
+  metric_pb->set_str(std::string(metric));
+  return top_k_pb;
+}
+
 absl::StatusOr<v0::Value> CreateCustomFunction(absl::string_view fn_uri) {
   v0::Value fn_pb;
   v0::Intrinsic* const intrinsic_pb = fn_pb.mutable_intrinsic();
@@ -217,6 +291,26 @@ absl::StatusOr<v0::Value> CreateRegexPartialMatch(
   return value_pb;
 }
 
+absl::StatusOr<v0::Value> CreateRegexRouter(
+    std::vector<std::pair<std::string, v0::Value>> routes,
+    std::optional<v0::Value> default_fn) {
+  v0::Value router_pb;
+  v0::Intrinsic* const intrinsic_pb = router_pb.mutable_intrinsic();
+  intrinsic_pb->set_uri(std::string(intrinsics::kRegexRouter));
+  v0::Struct* args =
+      intrinsic_pb->mutable_static_parameter()->mutable_struct_();
+  for (const auto& [pattern, branch_fn] : routes) {
+    v0::Value* route_pb = args->add_element();
+    route_pb->set_label("route");
+    route_pb->mutable_struct_()->add_element()->set_str(pattern);
+    *route_pb->mutable_struct_()->add_element() = branch_fn;
+  }
+  if (default_fn.has_value()) {
+    *args->add_element() = CreateLabeledValue("default", *default_fn);
+  }
+  return router_pb;
+}
+
 absl::StatusOr<v0::Value> CreateLogicalNot() {
   v0::Value value_pb;
   v0::Intrinsic* const intrinsic_pb = value_pb.mutable_intrinsic();
@@ -16,7 +16,9 @@ limitations under the License
 #ifndef GENC_CC_AUTHORING_CONSTRUCTOR_H_
 #define GENC_CC_AUTHORING_CONSTRUCTOR_H_
 
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/statusor.h"
@@ -79,13 +81,63 @@ absl::StatusOr<v0::Value> CreateRestModelConfigWithJsonRequestTemplate(
     std::string endpoint, std::string api_key,
     std::string json_request_template);
 
+// Returns a model config for the LlamaCpp backend. `max_tokens` bounds the
+// number of generated tokens, not counting the prompt.
 absl::StatusOr<v0::Value> CreateLlamaCppConfig(std::string model_path,
                                                int num_threads = 1,
                                                int max_tokens = 32);
+
+// Additional settings for models served by the LlamaCpp backend.
+struct LlamaCppConfigOptions {
+  // Number of concurrent requests decoded together in one batch.
+  int num_slots = 1;
+
+  // Context size of each request (prompt plus generated tokens), maximum
+  // number of tokens decoded per step, and maximum number of prompt tokens a
+  // request prefills per step.
+  int n_ctx = 1024;
+  int n_batch = 512;
+  int n_ubatch = 512;
+
+  // Sampling parameters. A temperature of zero selects greedy decoding.
+  float temperature = 0.0f;
+  int top_k = 0;
+  float top_p = 1.0f;
+  float repetition_penalty = 1.0f;
+  int repetition_last_n = 64;
+  int seed = 1234;
+
+  // Smaller model with the same vocabulary for speculative decoding, and the
+  // number of tokens it proposes per step. Empty disables it.
+  std::string draft_model_path;
+  int num_draft_tokens = 4;
+};
+
+// Returns a model config for the LlamaCpp backend with additional settings.
+absl::StatusOr<v0::Value> CreateLlamaCppConfig(
+    std::string model_path, int num_threads, int max_tokens,
+    const LlamaCppConfigOptions& options);
+
 // Returns a model inference proto with the given model URI and model config.
 absl::StatusOr<v0::Value> CreateModelInferenceWithConfig(
     absl::string_view model_uri, v0::Value model_config);
 
+// Returns an embedding computation for the model with the given URI and
+// config, which maps a string (or a struct of strings) to a float tensor (or a
+// struct of float tensors).
+absl::StatusOr<v0::Value> CreateEmbed(absl::string_view model_uri,
+                                      v0::Value model_config = v0::Value());
+
+// Returns a computation that scores the similarity of a struct of two float
+// tensors under `metric`, which is one of "cosine", "dot" or "l2".
+absl::StatusOr<v0::Value> CreateSimilarity(absl::string_view metric = "cosine");
+
+// Returns a computation that takes a struct of a query tensor and a struct of
+// candidate tensors, and returns the indices and scores of the `k` candidates
+// most similar to the query under `metric`, most similar first.
+absl::StatusOr<v0::Value> CreateTopK(int k,
+                                     absl::string_view metric = "cosine");
+
 // Creates a parallel map that applies map_fn to a all input values.
 absl::StatusOr<v0::Value> CreateParallelMap(v0::Value map_fn);
 
@@ -108,6 +160,13 @@ absl::StatusOr<v0::Value> CreateReference(absl::string_view arg_name);
 absl::StatusOr<v0::Value> CreateRegexPartialMatch(
     absl::string_view pattern_str);
 
+// Creates a router that applies to its string input the branch of the first
+// route whose pattern finds a partial match in it, or `default_fn` if none
+// does. All patterns are matched together in a single pass over the input.
+absl::StatusOr<v0::Value> CreateRegexRouter(
+    std::vector<std::pair<std::string, v0::Value>> routes,
+    std::optional<v0::Value> default_fn = std::nullopt);
+
 // Returns a repeat proto which will repeat body_fn for num_steps, sequentially,
 // the output of the current step is the input to next iteration.
 absl::StatusOr<v0::Value> CreateRepeat(int num_steps, v0::Value body_fn);
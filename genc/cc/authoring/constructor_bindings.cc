@@ -56,6 +56,19 @@ PYBIND11_MODULE(constructor_bindings, m) {
         "Creates a model computation with the given model URI and model "
         "configuration.");
 
+  m.def("create_embed", &CreateEmbed, py::arg("model_uri"),
+        py::arg("model_config") = v0::Value(),
+        "Creates an embedding computation with the given model URI and "
+        "optional model configuration.");
+
+  m.def("create_similarity", &CreateSimilarity, py::arg("metric") = "cosine",
+        "Creates a computation that scores the similarity of two tensors.");
+
+  m.def("create_top_k", &CreateTopK, py::arg("k"),
+        py::arg("metric") = "cosine",
+        "Creates a computation that finds the k candidate tensors most "
+        "similar to a query tensor.");
+
   m.def(
       "create_prompt_template", &CreatePromptTemplate,
       "Creates a prompt template computation with the given template string.");
@@ -69,6 +82,11 @@ PYBIND11_MODULE(constructor_bindings, m) {
   m.def("create_regex_partial_match", &CreateRegexPartialMatch,
         "Creates a regular expression partial match with the given pattern.");
 
+  m.def("create_regex_router", &CreateRegexRouter, py::arg("routes"),
+        py::arg("default_fn") = py::none(),
+        "Creates a router that dispatches its input to the branch of the "
+        "first matching (pattern, branch) route.");
+
   m.def("create_reference", &CreateReference,
         "Constructs a reference to `name`.");
 
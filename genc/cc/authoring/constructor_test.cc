@@ -60,6 +60,36 @@ TEST(CreateModelInferenceTest, ReturnsCorrectModelInferenceProto) {
   EXPECT_EQ(model_pb.intrinsic().static_parameter().str(), test_model_uri);
 }
 
+TEST(CreateEmbedTest, ReturnsCorrectEmbedProto) {
+  v0::Value model_config_pb;
+  v0::Value* model_path = model_config_pb.mutable_struct_()->add_element();
+  model_path->set_label("model_path");
+  model_path->set_str("/tmp/model.gguf");
+
+  v0::Value embed_pb = CreateEmbed("/device/llamacpp", model_config_pb).value();
+  EXPECT_EQ(embed_pb.intrinsic().uri(), "embed");
+  const v0::Struct& params = embed_pb.intrinsic().static_parameter().struct_();
+  ASSERT_EQ(params.element_size(), 2);
+  EXPECT_EQ(params.element(0).str(), "/device/llamacpp");
+  EXPECT_EQ(params.element(1).label(), "model_config");
+  EXPECT_EQ(params.element(1).struct_().element(0).str(), "/tmp/model.gguf");
+}
+
+TEST(CreateEmbedTest, OmitsMissingConfig) {
+  v0::Value embed_pb = CreateEmbed("test_model").value();
+  EXPECT_EQ(
+      embed_pb.intrinsic().static_parameter().struct_().element_size(), 1);
+}
+
+TEST(CreateTopKTest, ReturnsCorrectTopKProto) {
+  v0::Value top_k_pb = CreateTopK(3, "l2").value();
+  EXPECT_EQ(top_k_pb.intrinsic().uri(), "top_k");
+  const v0::Struct& params = top_k_pb.intrinsic().static_parameter().struct_();
+  ASSERT_EQ(params.element_size(), 2);
+  EXPECT_EQ(params.element(0).int_32(), 3);
+  EXPECT_EQ(params.element(1).str(), "l2");
+}
+
 TEST(CreateModelInferenceWithConfigTest,
      ReturnsCorrectModelInferenceWithStructConfigProto) {
   std::string test_model_uri = "test_model_uri";
@@ -133,6 +163,22 @@ TEST(CreateWhileTest, ReturnsCorrectRegexPartialMatchProto) {
   EXPECT_EQ(regex_pb.intrinsic().static_parameter().str(), test_regex_pattern);
 }
 
+TEST(CreateRegexRouterTest, ReturnsCorrectRegexRouterProto) {
+  v0::Value foo_fn = CreateModelInference("foo_model").value();
+  v0::Value bar_fn = CreateModelInference("bar_model").value();
+  v0::Value router_pb =
+      CreateRegexRouter({{"foo", foo_fn}}, /*default_fn=*/bar_fn).value();
+  EXPECT_EQ(router_pb.intrinsic().uri(), "regex_router");
+  absl::flat_hash_map<std::string, v0::Value> kwargs =
+      ExtractStaticParameters(router_pb).value();
+
+  EXPECT_EQ(kwargs.at("route").struct_().element(0).str(), "foo");
+  EXPECT_EQ(kwargs.at("route").struct_().element(1).intrinsic().uri(),
+            "model_inference");
+  EXPECT_EQ(kwargs.at("default").intrinsic().static_parameter().str(),
+            "bar_model");
+}
+
 TEST(CreateWhileTest, ReturnsCorrectWhileProto) {
   v0::Value test_condition_fn =
       CreateRegexPartialMatch("stop_keyword: Finish").value();
@@ -194,6 +240,28 @@ TEST(CreateRestModelConfig, WhenApiKeyAbsentReturnsCorrectConfigProto) {
   EXPECT_EQ(model_config_pb.str(), test_endpoint);
 }
 
+TEST(CreateLlamaCppConfig, ReturnsCorrectConfigProtoWithOptions) {
+  LlamaCppConfigOptions options;
+  options.num_slots = 4;
+  options.temperature = 0.7f;
+  options.top_k = 40;
+  options.n_ctx = 8192;
+  v0::Value config_pb =
+      CreateLlamaCppConfig("/tmp/model.gguf", 2, 128, options).value();
+  absl::flat_hash_map<std::string, v0::Value> kwargs;
+  for (const auto& arg : config_pb.struct_().element()) {
+    kwargs.insert({arg.label(), arg});
+  }
+  EXPECT_EQ(kwargs.at("model_path").str(), "/tmp/model.gguf");
+  EXPECT_EQ(kwargs.at("max_tokens").int_32(), 128);
+  EXPECT_EQ(kwargs.at("num_slots").int_32(), 4);
+  EXPECT_EQ(kwargs.at("n_ctx").int_32(), 8192);
+  EXPECT_EQ(kwargs.at("n_batch").int_32(), 512);
+  EXPECT_FLOAT_EQ(kwargs.at("temperature").float_32(), 0.7f);
+  EXPECT_EQ(kwargs.at("top_k").int_32(), 40);
+  EXPECT_FLOAT_EQ(kwargs.at("top_p").float_32(), 1.0f);
+}
+
 TEST(ToValueTest, HandlesInt) {
   int test_int = 123;
   v0::Value result = ToValue(test_int);
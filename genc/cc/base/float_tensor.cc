@@ -0,0 +1,172 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/base/float_tensor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace genc {
+namespace {
+
+using ::google::protobuf::internal::WireFormatLite;
+
+constexpr char kTensorProtoTypeUrl[] =
+    "type.googleapis.com/tensorflow.TensorProto";
+
+// Field numbers of `tensorflow.TensorProto`, `TensorShapeProto` and its `Dim`.
+constexpr int kDtypeField = 1;
+constexpr int kTensorShapeField = 2;
+constexpr int kTensorContentField = 4;
+constexpr int kFloatValField = 5;
+constexpr int kShapeDimField = 2;
+constexpr int kDimSizeField = 1;
+
+// `tensorflow.DataType.DT_FLOAT`.
+constexpr int kDtFloat = 1;
+
+// Returns the `TensorShapeProto` of a rank-1 tensor with `size` elements.
+std::string RankOneShape(int64_t size) {
+  std::string dim;
+  {
+    google::protobuf::io::StringOutputStream stream(&dim);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    WireFormatLite::WriteInt64(kDimSizeField, size, &output);
+  }
+  std::string shape;
+  {
+    google::protobuf::io::StringOutputStream stream(&shape);
+    google::protobuf::io::CodedOutputStream output(&stream);
+    WireFormatLite::WriteBytes(kShapeDimField, dim, &output);
+  }
+  return shape;
+}
+
+// Appends the little-endian floats of a length-delimited field to `values`,
+// given the `total_size` of the input.
+bool ReadFloats(google::protobuf::io::CodedInputStream& input,
+                size_t total_size, std::vector<float>* values) {
+  uint32_t size;
+  if (!input.ReadVarint32(&size) || size % sizeof(float) != 0) {
+    return false;
+  }
+  // Check the size before allocating for it, as it comes from the input.
+  if (size > total_size - input.CurrentPosition()) {
+    return false;
+  }
+  if (size == 0) {
+    return true;
+  }
+  // TensorProto stores floats in little-endian order, which is the native
+  // order on all supported platforms.
+  const size_t offset = values->size();
+  values->resize(offset + size / sizeof(float));
+  return input.ReadRaw(values->data() + offset, size);
+}
+
+}  // namespace
+
+v0::Value CreateFloatTensor(absl::Span<const float> values) {
+  v0::Value value;
+  google::protobuf::Any* tensor = value.mutable_tensor();
+  tensor->set_type_url(kTensorProtoTypeUrl);
+  {
+    google::protobuf::io::StringOutputStream stream(tensor->mutable_value());
+    google::protobuf::io::CodedOutputStream output(&stream);
+    WireFormatLite::WriteEnum(kDtypeField, kDtFloat, &output);
+    WireFormatLite::WriteBytes(kTensorShapeField, RankOneShape(values.size()),
+                               &output);
+    WireFormatLite::WriteTag(kTensorContentField,
+                             WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                             &output);
+    output.WriteVarint32(values.size() * sizeof(float));
+    output.WriteRaw(values.data(), values.size() * sizeof(float));
+  }
+
+  v0::TensorType* type = value.mutable_type()->mutable_tensor();
+  type->set_scalar(v0::SCALAR_TYPE_FLOAT);
+  type->add_dims(values.size());
+  return value;
+}
+
+absl::Status AppendFloatTensor(const v0::Value& value,
+                               std::vector<float>* values) {
+  if (!value.has_tensor() || value.tensor().type_url() != kTensorProtoTypeUrl) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected a tensor value, got: ", value.DebugString()));
+  }
+  const std::string& serialized = value.tensor().value();
+  google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(serialized.data()), serialized.size());
+  uint32_t dtype = 0;
+  bool ok = true;
+  while (ok) {
+    const uint32_t tag = input.ReadTag();
+    if (tag == 0) {
+      break;
+    }
+    const int field = WireFormatLite::GetTagFieldNumber(tag);
+    const WireFormatLite::WireType wire_type =
+        WireFormatLite::GetTagWireType(tag);
+    if (field == kDtypeField && wire_type == WireFormatLite::WIRETYPE_VARINT) {
+      ok = input.ReadVarint32(&dtype);
+    } else if ((field == kTensorContentField || field == kFloatValField) &&
+               wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      // Packed `float_val` has the same layout as `tensor_content`.
+      ok = ReadFloats(input, serialized.size(), values);
+    } else if (field == kFloatValField &&
+               wire_type == WireFormatLite::WIRETYPE_FIXED32) {
+      // Writers may also emit `float_val` unpacked, one element at a time.
+      float value;
+      ok = WireFormatLite::ReadPrimitive<float, WireFormatLite::TYPE_FLOAT>(
+          &input, &value);
+      if (ok) {
+        values->push_back(value);
+      }
+    } else {
+      ok = WireFormatLite::SkipField(&input, tag);
+    }
+  }
+  if (!ok ||
+      static_cast<size_t>(input.CurrentPosition()) != serialized.size()) {
+    return absl::InvalidArgumentError("Malformed tensor.");
+  }
+  if (dtype != kDtFloat) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected a float tensor, got dtype ", dtype));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<float>> GetFloatTensor(const v0::Value& value) {
+  std::vector<float> values;
+  GENC_TRY(AppendFloatTensor(value, &values));
+  return values;
+}
+
+}  // namespace genc
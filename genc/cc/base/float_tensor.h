@@ -0,0 +1,46 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_BASE_FLOAT_TENSOR_H_
+#define GENC_CC_BASE_FLOAT_TENSOR_H_
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+// Returns a `tensor` value holding `values` as a rank-1 float tensor.
+//
+// The tensor is a `tensorflow.TensorProto` packed in the value's `Any`, as
+// the proto requires, with the floats in `tensor_content`. It is encoded by
+// hand, so that there is no dependency on TensorFlow. The value's `type` is
+// set to the matching `TensorType`.
+v0::Value CreateFloatTensor(absl::Span<const float> values);
+
+// Appends the elements of the float tensor in `value` to `values`, flattened.
+// Accepts tensors with the elements either in `tensor_content` or `float_val`.
+absl::Status AppendFloatTensor(const v0::Value& value,
+                               std::vector<float>* values);
+
+// Returns the elements of the float tensor in `value`, flattened.
+absl::StatusOr<std::vector<float>> GetFloatTensor(const v0::Value& value);
+
+}  // namespace genc
+
+#endif  // GENC_CC_BASE_FLOAT_TENSOR_H_
@@ -0,0 +1,81 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/base/float_tensor.h"
+
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+TEST(FloatTensorTest, RoundTrips) {
+  std::vector<float> values = {1.5f, -2.0f, 0.0f, 3.25f};
+  v0::Value value = CreateFloatTensor(values);
+  EXPECT_TRUE(value.has_tensor());
+  EXPECT_EQ(value.type().tensor().scalar(), v0::SCALAR_TYPE_FLOAT);
+  EXPECT_THAT(value.type().tensor().dims(), ::testing::ElementsAre(4));
+  EXPECT_THAT(GetFloatTensor(value).value(),
+              ::testing::ElementsAreArray(values));
+}
+
+TEST(FloatTensorTest, RoundTripsEmpty) {
+  v0::Value value = CreateFloatTensor({});
+  EXPECT_TRUE(GetFloatTensor(value).value().empty());
+}
+
+TEST(FloatTensorTest, AppendsToExistingValues) {
+  std::vector<float> values = {7.0f};
+  ASSERT_TRUE(AppendFloatTensor(CreateFloatTensor({8.0f, 9.0f}), &values).ok());
+  EXPECT_THAT(values, ::testing::ElementsAre(7.0f, 8.0f, 9.0f));
+}
+
+TEST(FloatTensorTest, ReadsUnpackedFloatVal) {
+  v0::Value value = CreateFloatTensor({});
+  // A float dtype, and `float_val` as two unpacked elements, 1.5 and -2.
+  *value.mutable_tensor()->mutable_value() = std::string(
+      "\x08\x01\x2d\x00\x00\xc0\x3f\x2d\x00\x00\x00\xc0", 12);
+  EXPECT_THAT(GetFloatTensor(value).value(),
+              ::testing::ElementsAre(1.5f, -2.0f));
+}
+
+TEST(FloatTensorTest, RejectsNonTensorValues) {
+  v0::Value value;
+  value.set_str("not a tensor");
+  EXPECT_FALSE(GetFloatTensor(value).ok());
+}
+
+TEST(FloatTensorTest, RejectsMalformedTensors) {
+  v0::Value value = CreateFloatTensor({1.0f, 2.0f});
+  value.mutable_tensor()->mutable_value()->pop_back();
+  EXPECT_FALSE(GetFloatTensor(value).ok());
+}
+
+TEST(FloatTensorTest, RejectsSizesPastTheEndWithoutAllocating) {
+  v0::Value value = CreateFloatTensor({});
+  // A float dtype, and tensor content that claims 1 GiB but holds 8 bytes.
+  *value.mutable_tensor()->mutable_value() = std::string(
+      "\x08\x01\x22\x80\x80\x80\x80\x04\0\0\0\0\0\0\0\0", 16);
+  std::vector<float> values;
+  EXPECT_FALSE(AppendFloatTensor(value, &values).ok());
+  EXPECT_LT(values.capacity(), 1024);
+}
+
+}  // namespace
+}  // namespace genc
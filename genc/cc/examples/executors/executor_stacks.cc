@@ -15,16 +15,19 @@ limitations under the License
 
 #include "genc/cc/examples/executors/executor_stacks.h"
 
+#include <cstdlib>
 #include <memory>
 #include <utility>
 
 #include "absl/base/call_once.h"
+#include "absl/log/log.h"
 #include "absl/status/statusor.h"
 #include "genc/cc/interop/backends/google_ai.h"
 #include "genc/cc/intrinsics/handler_sets.h"
 #include "genc/cc/modules/agents/react.h"
 #include "genc/cc/modules/parsers/gemini_parser.h"
 #include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/cc/modules/retrieval/value_cache_log.h"
 #include "genc/cc/modules/tools/wolfram_alpha.h"
 #include "genc/cc/runtime/concurrency.h"
 #include "genc/cc/runtime/executor.h"
@@ -39,9 +42,14 @@ namespace genc {
 // Stateful context that holds state (e.g. memory), which need to remain
 // alive after initialization.
 struct ExecutorStacksContext {
-  ExecutorStacksContext(std::unique_ptr<LocalValueCache> local_cache)
-      : local_cache_(std::move(local_cache)) {}
+  ExecutorStacksContext(std::unique_ptr<LocalValueCache> local_cache,
+                        std::unique_ptr<ValueCacheLog> local_cache_log)
+      : local_cache_(std::move(local_cache)),
+        local_cache_log_(std::move(local_cache_log)) {}
   std::unique_ptr<LocalValueCache> local_cache_;
+  // Persists local_cache_, if enabled; declared after it so that it is
+  // destroyed first.
+  std::unique_ptr<ValueCacheLog> local_cache_log_;
 };
 
 namespace {
@@ -50,37 +58,38 @@ constexpr absl::string_view kLlamaCppModelUri = "/device/llamacpp";
 
 static absl::once_flag context_init_flag;
 static ExecutorStacksContext* executor_stacks_context = nullptr;
-LlamaCpp* llama_cpp_client = nullptr;
 constexpr int MAX_CACHE_SIZE_PER_KEY = 200;
+// If set, names a directory the local cache is persisted to, so that memory
+// survives restarts of the process.
+constexpr char kLocalCacheDirEnv[] = "GENC_LOCAL_CACHE_DIR";
 
 // Initializes the executor stacks context.
 static void InitExecutorStacksContext() {
   // Allocate memory for local_cache.
   auto local_cache = std::make_unique<LocalValueCache>(MAX_CACHE_SIZE_PER_KEY);
-  // Transfer its ownership to a global context.
-  executor_stacks_context = new ExecutorStacksContext(std::move(local_cache));
+  std::unique_ptr<ValueCacheLog> local_cache_log;
+  if (const char* dir = std::getenv(kLocalCacheDirEnv); dir && *dir) {
+    ValueCacheLog::Options options;
+    options.directory = dir;
+    absl::StatusOr<std::unique_ptr<ValueCacheLog>> log =
+        ValueCacheLog::Open(options, *local_cache);
+    if (log.ok()) {
+      local_cache_log = std::move(*log);
+    } else {
+      LOG(ERROR) << "Local cache is not persisted: " << log.status();
+    }
+  }
+  // Transfer their ownership to a global context.
+  executor_stacks_context = new ExecutorStacksContext(
+      std::move(local_cache), std::move(local_cache_log));
 }
 
 void SetLlamaCppModelInferenceHandler(intrinsics::HandlerSetConfig* config,
                                       absl::string_view model_uri) {
+  // Models are loaded on first use, and kept per model path and context
+  // parameters by the process-wide registry.
   config->model_inference_with_config_map[std::string(model_uri)] =
-      [](v0::Intrinsic intrinsic, v0::Value arg) -> absl::StatusOr<v0::Value> {
-    v0::Value model_inference;
-    if (!llama_cpp_client) {
-      llama_cpp_client = new LlamaCpp();
-    }
-    if (!llama_cpp_client->is_initialized()) {
-      // If the model hasn't been initialized, parse the config from
-      // the intrinsic and create the model.
-      const v0::Value& config =
-          intrinsic.static_parameter().struct_().element(1);
-      absl::Status status = llama_cpp_client->InitModel(config);
-      if (!status.ok()) {
-        return status;
-      }
-    }
-    return llama_cpp_client->LlamaCppCall(arg);
-  };
+      GetLlamaCppInferenceFn();
 }
 
 }  // namespace
@@ -111,6 +120,8 @@ CreateDefaultExecutorWithConcurrencyInterface(
 
   SetLlamaCppModelInferenceHandler(&config, kGemmaModelUri);
   SetLlamaCppModelInferenceHandler(&config, kLlamaCppModelUri);
+  config.embedding_map[std::string(kLlamaCppModelUri)] =
+      GetLlamaCppEmbeddingFn();
 
   // Set access to local cache or other types of memory.
   GENC_TRY(SetCustomFunctionsForLocalValueCache(
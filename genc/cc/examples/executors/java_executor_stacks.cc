@@ -54,7 +54,6 @@ constexpr absl::string_view kLlamaCppModelUri = "/device/llamacpp";
 
 static absl::once_flag context_init_flag;
 static ExecutorStacksContext* executor_stacks_context = nullptr;
-LlamaCpp* llama_cpp_client = nullptr;
 constexpr int MAX_CACHE_SIZE_PER_KEY = 200;
 
 static void InitExecutorStacksContext() {
@@ -93,24 +92,10 @@ void SetGoogleAiModelInferenceHandler(intrinsics::HandlerSetConfig* config,
 
 void SetLlamaCppModelInferenceHandler(intrinsics::HandlerSetConfig* config,
                                       absl::string_view model_uri) {
+  // Models are loaded on first use, and kept per model path and context
+  // parameters by the process-wide registry.
   config->model_inference_with_config_map[std::string(model_uri)] =
-      [](v0::Intrinsic intrinsic, v0::Value arg) -> absl::StatusOr<v0::Value> {
-    v0::Value model_inference;
-    if (!llama_cpp_client) {
-      llama_cpp_client = new LlamaCpp();
-    }
-    if (!llama_cpp_client->is_initialized()) {
-      // If the model hasn't been initialized, parse the config from
-      // the intrinsic and create the model.
-      const v0::Value& config =
-          intrinsic.static_parameter().struct_().element(1);
-      absl::Status status = llama_cpp_client->InitModel(config);
-      if (!status.ok()) {
-        return status;
-      }
-    }
-    return llama_cpp_client->LlamaCppCall(arg);
-  };
+      GetLlamaCppInferenceFn();
 }
 
 void SetWolframAlphaIntrinsicHandler(intrinsics::HandlerSetConfig* config,
@@ -136,6 +121,8 @@ absl::StatusOr<std::shared_ptr<Executor>> CreateDefaultExecutor(
 
   SetLlamaCppModelInferenceHandler(&config, kGemmaModelUri);
   SetLlamaCppModelInferenceHandler(&config, kLlamaCppModelUri);
+  config.embedding_map[std::string(kLlamaCppModelUri)] =
+      GetLlamaCppEmbeddingFn();
 
   SetWolframAlphaIntrinsicHandler(&config, jvm, wolfram_alpha_client);
 
@@ -32,6 +32,7 @@ limitations under the License
 #include "genc/cc/runtime/threading.h"
 #include "genc/proto/v0/executor.grpc.pb.h"
 #include "genc/proto/v0/executor.pb.h"
+#include "include/grpc/compression.h"
 #include "include/grpcpp/channel.h"
 #include "include/grpcpp/client_context.h"
 #include "include/grpcpp/create_channel.h"
@@ -61,6 +62,8 @@ ABSL_FLAG(std::string, target_override, "", "The expected target name.");
 ABSL_FLAG(bool, debug, false, "Whether to print debug output.");
 ABSL_FLAG(std::string, image_reference, "", "The container image reference.");
 ABSL_FLAG(std::string, image_digest, "", "The container image digest.");
+ABSL_FLAG(bool, compress, false,
+          "Whether to gzip-compress large values sent to the server.");
 
 namespace genc {
 
@@ -132,8 +135,13 @@ absl::Status RunClient() {
   } else {
     executor_stub = v0::Executor::NewStub(channel);
   }
+  RemoteExecutorOptions options;
+  if (absl::GetFlag(FLAGS_compress)) {
+    options.compression = GRPC_COMPRESS_GZIP;
+  }
   std::shared_ptr<Executor> executor = GENC_TRY(CreateRemoteExecutor(
-      std::move(executor_stub), CreateThreadBasedConcurrencyManager()));
+      std::move(executor_stub), CreateThreadBasedConcurrencyManager(),
+      options));
   Runner runner = GENC_TRY(Runner::Create(func, executor));
   v0::Value result = GENC_TRY(runner.Run(arg));
   std::cout << "\n" << result.DebugString() << "\n\n";
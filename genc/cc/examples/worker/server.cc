@@ -25,6 +25,7 @@ limitations under the License
 #include "genc/cc/modules/worker/run_server.h"
 #include "genc/cc/runtime/executor.h"
 #include "genc/cc/runtime/status_macros.h"
+#include "include/grpc/compression.h"
 
 // An example worker binary that hosts a gRPC service endpoint.
 //
@@ -48,6 +49,8 @@ ABSL_FLAG(std::string, key, "", "Path to the private key for SSL/TLS.");
 ABSL_FLAG(std::string, cert, "", "Path to the certificate for SSL/TLS.");
 ABSL_FLAG(bool, oak, false, "Whether to use project Oak for communication.");
 ABSL_FLAG(bool, debug, false, "Whether to print debug output.");
+ABSL_FLAG(bool, compress, false,
+          "Whether to gzip-compress large values sent to clients.");
 
 namespace genc {
 
@@ -63,6 +66,9 @@ absl::Status RunServer() {
   }
   options.use_oak = absl::GetFlag(FLAGS_oak);
   options.debug = absl::GetFlag(FLAGS_debug);
+  if (absl::GetFlag(FLAGS_compress)) {
+    options.executor_service.compression = GRPC_COMPRESS_GZIP;
+  }
   return modules::worker::RunServer(executor, options);
 }
 
@@ -15,13 +15,22 @@ limitations under the License
 
 #include "genc/cc/interop/backends/google_ai.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/strings/substitute.h"
 #include "genc/cc/intrinsics/model_inference_with_config.h"
 #include "genc/cc/modules/parsers/gemini_parser.h"
+#include "genc/cc/modules/parsers/sse_parser.h"
 #include "genc/cc/modules/tools/curl_client.h"
 #include "genc/cc/runtime/status_macros.h"
 #include "genc/proto/v0/computation.pb.h"
@@ -32,6 +41,85 @@ namespace genc {
 namespace {
 
 constexpr char kGeminiOnAIStudio[] = "/cloud/gemini";
+constexpr char kGeminiStreamOnAIStudio[] = "/cloud/gemini/stream";
+
+constexpr char kGenerateContent[] = ":generateContent";
+constexpr char kStreamGenerateContent[] = ":streamGenerateContent";
+
+// Most bytes of a failed response quoted in the error.
+constexpr size_t kMaxErrorBytes = 1024;
+
+struct GeminiConfig {
+  std::string endpoint;
+  std::string api_key;
+  // Names the call to the receiver of its streamed text.
+  std::string call_id;
+  std::string json_request_template = R"pb(
+      {
+        "contents":
+        [ {
+          "parts":
+          [ { "text": "$0" }]
+        }]
+      }
+    )pb";
+};
+
+GeminiConfig ParseConfig(const v0::Intrinsic& intrinsic) {
+  const v0::Value& config = intrinsic.static_parameter().struct_().element(1);
+  GeminiConfig result;
+  for (const v0::Value& param : config.struct_().element()) {
+    if (param.label() == "endpoint") {
+      result.endpoint = param.str();
+    } else if (param.label() == "api_key") {
+      result.api_key = param.str();
+    } else if (param.label() == "call_id") {
+      result.call_id = param.str();
+    } else if (param.label() == "json_request_template" &&
+               !param.str().empty()) {
+      result.json_request_template = param.str();
+    }
+  }
+  return result;
+}
+
+// Returns the text of the top candidate in one streamed response chunk, as
+// GeminiParser::GetTopCandidateAsText() would, but parsing the chunk once.
+absl::StatusOr<std::string> GetTextDelta(const std::string& chunk_json) {
+  const nlohmann::json chunk = nlohmann::json::parse(
+      chunk_json, /*cb=*/nullptr, /*allow_exceptions=*/false);
+  if (!chunk.is_object()) {
+    return absl::InternalError(
+        absl::StrCat("Failed parsing json output from Gemini: ", chunk_json));
+  }
+  if (chunk.contains("error")) {
+    return absl::InternalError(
+        absl::StrCat("Gemini streaming failed: ", chunk["error"].dump()));
+  }
+  std::string text;
+  const auto candidates = chunk.find("candidates");
+  if (candidates == chunk.end() || !candidates->is_array() ||
+      candidates->empty() || !candidates->front().is_object()) {
+    return text;
+  }
+  const nlohmann::json& candidate = candidates->front();
+  const auto content = candidate.find("content");
+  if (content == candidate.end() || !content->is_object()) {
+    return text;
+  }
+  const auto parts = content->find("parts");
+  if (parts == content->end() || !parts->is_array()) {
+    return text;
+  }
+  for (const nlohmann::json& part : *parts) {
+    if (!part.is_object()) continue;
+    const auto part_text = part.find("text");
+    if (part_text != part.end() && part_text->is_string()) {
+      text += part_text->get_ref<const std::string&>();
+    }
+  }
+  return text;
+}
 }  // namespace
 
 absl::StatusOr<std::string> updateJsonRequest(
@@ -69,52 +157,97 @@ absl::StatusOr<std::string> updateJsonRequest(
   return request_template.dump();
 }
 
+absl::StatusOr<std::string> GoogleAI::StreamGenerateContent(
+    const std::string& endpoint, const std::string& api_key,
+    const std::string& json_request, const TextDeltaFn& on_delta) {
+  std::string stream_endpoint(endpoint);
+  if (absl::EndsWith(stream_endpoint, kGenerateContent)) {
+    stream_endpoint.resize(stream_endpoint.size() -
+                           std::strlen(kGenerateContent));
+    stream_endpoint += kStreamGenerateContent;
+  }
+  const std::string endpoint_url = absl::StrCat(
+      stream_endpoint, absl::StrContains(stream_endpoint, '?') ? "&" : "?",
+      "alt=sse&key=", api_key);
+
+  std::string text;
+  absl::Status event_status;
+  // The start of the response, to explain an error that isn't an event.
+  std::string response_start;
+  SseParser parser;
+  const SseParser::EventFn on_event = [&](const SseParser::Event& event) {
+    absl::StatusOr<std::string> delta = GetTextDelta(event.data);
+    if (!delta.ok()) {
+      event_status = delta.status();
+      return false;
+    }
+    if (delta->empty()) return true;
+    text += *delta;
+    return on_delta == nullptr || on_delta(*delta);
+  };
+  absl::Status status = CurlClient::PostAndStream(
+      /*api_key=*/"", endpoint_url, json_request,
+      [&](absl::string_view data) {
+        const size_t room = kMaxErrorBytes - response_start.size();
+        absl::StrAppend(&response_start, data.substr(0, room));
+        return parser.Feed(data, on_event);
+      });
+  if (!event_status.ok()) {
+    return event_status;
+  }
+  if (!status.ok()) {
+    return absl::Status(status.code(),
+                        absl::StrCat(status.message(), ": ", response_start));
+  }
+  return text;
+}
+
 absl::Status GoogleAI::SetInferenceMap(
-    intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map) {
+    intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map,
+    CallTextDeltaFn on_delta) {
   inference_map[kGeminiOnAIStudio] =
       [](v0::Intrinsic intrinsic, v0::Value arg) -> absl::StatusOr<v0::Value> {
-    const v0::Value& config = intrinsic.static_parameter().struct_().element(1);
-
-    std::string endpoint;
-    std::string api_key;
-    std::string json_request_template = R"pb(
-      {
-        "contents":
-        [ {
-          "parts":
-          [ { "text": "$0" }]
-        }]
-      }
-    )pb";
-
-    for (const v0::Value& param : config.struct_().element()) {
-      if (param.label() == "endpoint") {
-        endpoint = param.str();
-      } else if (param.label() == "api_key") {
-        api_key = param.str();
-      } else if (param.label() == "json_request_template" &&
-                 !param.str().empty()) {
-        json_request_template = param.str();
-      }
-    }
-
+    GeminiConfig config = ParseConfig(intrinsic);
     absl::StatusOr<std::string> input_json =
-        updateJsonRequest(json_request_template, arg.str());
+        updateJsonRequest(config.json_request_template, arg.str());
     if (!input_json.ok()) {
       return input_json.status();
     }
 
-    const std::string& endpointUrl = endpoint + "?key=" + api_key;
+    const std::string& endpointUrl = config.endpoint + "?key=" + config.api_key;
 
     // Don't send api_key to Curl client as it has been incorporated in the
     // endpointUrl as query param
-    api_key = "";
-    v0::Value response_json =
-        GENC_TRY(CurlClient::Post(api_key, endpointUrl, input_json.value()));
+    v0::Value response_json = GENC_TRY(
+        CurlClient::Post(/*api_key=*/"", endpointUrl, input_json.value()));
 
     // Extract text out of JSON
     return GeminiParser::GetTopCandidateAsText(response_json);
-    return absl::OkStatus();
+  };
+
+  inference_map[kGeminiStreamOnAIStudio] =
+      [on_delta](v0::Intrinsic intrinsic,
+                 v0::Value arg) -> absl::StatusOr<v0::Value> {
+    GeminiConfig config = ParseConfig(intrinsic);
+    absl::StatusOr<std::string> input_json =
+        updateJsonRequest(config.json_request_template, arg.str());
+    if (!input_json.ok()) {
+      return input_json.status();
+    }
+    if (config.call_id.empty()) {
+      static std::atomic<int64_t> num_calls = 0;
+      config.call_id = absl::StrCat(kGeminiStreamOnAIStudio, "/", ++num_calls);
+    }
+    TextDeltaFn on_call_delta;
+    if (on_delta != nullptr) {
+      on_call_delta = [&](absl::string_view delta) {
+        return on_delta(config.call_id, delta);
+      };
+    }
+    v0::Value result;
+    result.set_str(GENC_TRY(StreamGenerateContent(
+        config.endpoint, config.api_key, input_json.value(), on_call_delta)));
+    return result;
   };
   return absl::OkStatus();
 }
@@ -16,7 +16,12 @@ limitations under the License
 #ifndef GENC_CC_INTEROP_BACKENDS_GOOGLE_AI_H_
 #define GENC_CC_INTEROP_BACKENDS_GOOGLE_AI_H_
 
+#include <functional>
+#include <string>
+
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "genc/cc/intrinsics/model_inference_with_config.h"
 #include "genc/proto/v0/computation.pb.h"
 namespace genc {
@@ -33,9 +38,33 @@ class GoogleAI final {
   GoogleAI(const GoogleAI&) = delete;
   GoogleAI& operator=(const GoogleAI&) = delete;
 
+  // Receives each piece of text as a model streams it. Returns false to
+  // cancel the call.
+  using TextDeltaFn = std::function<bool(absl::string_view delta)>;
+
+  // Calls the streamGenerateContent variant of the Gemini generateContent
+  // `endpoint` with server-sent events, and hands each piece of the top
+  // candidate's text to `on_delta`, if given, as soon as it arrives, so that
+  // the first piece doesn't wait for the whole generation. Returns the whole
+  // text.
+  static absl::StatusOr<std::string> StreamGenerateContent(
+      const std::string& endpoint, const std::string& api_key,
+      const std::string& json_request, const TextDeltaFn& on_delta);
+
+  // Receives each piece of text streamed by the model call `call_id`.
+  // Returns false to cancel that call.
+  using CallTextDeltaFn =
+      std::function<bool(absl::string_view call_id, absl::string_view delta)>;
+
   // Sets the inference map to process model calls.
+  // Models "/cloud/gemini/stream" take the same config as "/cloud/gemini",
+  // plus an optional "call_id", but stream their output, and hand each piece
+  // to `on_delta`, if given, with the "call_id" of the call. Calls without
+  // one get an id unique in the process. `on_delta` may be called from
+  // concurrent model calls.
   static absl::Status SetInferenceMap(
-      intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map);
+      intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map,
+      CallTextDeltaFn on_delta = nullptr);
 
  private:
   // Do not hold states in this class.
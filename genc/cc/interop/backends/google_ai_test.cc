@@ -0,0 +1,188 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/google_ai.h"
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/intrinsics/model_inference_with_config.h"
+#include "genc/cc/testing/http_test_server.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+using ::genc::testing::HttpTestServer;
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+
+constexpr absl::Duration kInterval = absl::Milliseconds(200);
+
+std::string Chunk(absl::string_view text) {
+  return absl::StrCat(
+      "data: {\"candidates\": [{\"content\": {\"parts\": [{\"text\": \"", text,
+      "\"}], \"role\": \"model\"}}]}\r\n\r\n");
+}
+
+// Streams "Once upon a time" in three chunks, `kInterval` apart.
+std::unique_ptr<HttpTestServer> StartGemini(std::vector<std::string>* targets,
+                                            absl::Mutex* mutex) {
+  return HttpTestServer::Start([=](const HttpTestServer::Request& request) {
+           {
+             absl::MutexLock lock(mutex);
+             targets->push_back(request.target);
+           }
+           HttpTestServer::Response response;
+           response.headers.emplace_back("Content-Type", "text/event-stream");
+           response.stream = {Chunk("Once"), Chunk(" upon a"),
+                              Chunk(" time")};
+           response.stream_interval = kInterval;
+           return response;
+         })
+      .value();
+}
+
+TEST(GoogleAITest, StreamsTextDeltasAsTheyArrive) {
+  absl::Mutex mutex;
+  std::vector<std::string> targets;
+  auto server = StartGemini(&targets, &mutex);
+
+  const absl::Time start = absl::Now();
+  std::vector<std::string> deltas;
+  absl::Duration first_delta_latency;
+  std::string text =
+      GoogleAI::StreamGenerateContent(
+          server->Url("/v1beta/models/gemini-pro:generateContent"), "secret",
+          "{}",
+          [&](absl::string_view delta) {
+            if (deltas.empty()) first_delta_latency = absl::Now() - start;
+            deltas.emplace_back(delta);
+            return true;
+          })
+          .value();
+  const absl::Duration latency = absl::Now() - start;
+
+  EXPECT_EQ(text, "Once upon a time");
+  EXPECT_THAT(deltas, ElementsAre("Once", " upon a", " time"));
+  // The first piece arrives long before the last.
+  EXPECT_LT(first_delta_latency, kInterval);
+  EXPECT_GE(latency, 2 * kInterval);
+  EXPECT_THAT(targets,
+              ElementsAre("/v1beta/models/gemini-pro:streamGenerateContent"
+                          "?alt=sse&key=secret"));
+}
+
+TEST(GoogleAITest, CancelsWhenTheReceiverStops) {
+  absl::Mutex mutex;
+  std::vector<std::string> targets;
+  auto server = StartGemini(&targets, &mutex);
+  EXPECT_EQ(GoogleAI::StreamGenerateContent(
+                server->Url("/m:generateContent"), "key", "{}",
+                [](absl::string_view) { return false; })
+                .status()
+                .code(),
+            absl::StatusCode::kCancelled);
+}
+
+TEST(GoogleAITest, ReportsErrors) {
+  auto server = HttpTestServer::Start([](const HttpTestServer::Request&) {
+                  HttpTestServer::Response response;
+                  response.status = 400;
+                  response.body = "{\"error\": {\"message\": \"Bad key\"}}";
+                  return response;
+                }).value();
+  absl::Status status =
+      GoogleAI::StreamGenerateContent(server->Url("/m:generateContent"),
+                                      "key", "{}", nullptr)
+          .status();
+  EXPECT_EQ(status.code(), absl::StatusCode::kInternal);
+  EXPECT_THAT(status.message(), HasSubstr("400"));
+  EXPECT_THAT(status.message(), HasSubstr("Bad key"));
+}
+
+// A "/cloud/gemini/stream" model call to `endpoint`, named `call_id` if not
+// empty.
+v0::Intrinsic StreamIntrinsic(const std::string& endpoint,
+                              const std::string& call_id) {
+  v0::Intrinsic intrinsic;
+  v0::Struct* parameters =
+      intrinsic.mutable_static_parameter()->mutable_struct_();
+  parameters->add_element()->set_str("/cloud/gemini/stream");
+  v0::Struct* config = parameters->add_element()->mutable_struct_();
+  v0::Value* endpoint_param = config->add_element();
+  endpoint_param->set_label("endpoint");
+  endpoint_param->set_str(endpoint);
+  if (!call_id.empty()) {
+    v0::Value* call_id_param = config->add_element();
+    call_id_param->set_label("call_id");
+    call_id_param->set_str(call_id);
+  }
+  return intrinsic;
+}
+
+TEST(GoogleAITest, StreamsFromTheInferenceMapByCall) {
+  absl::Mutex mutex;
+  std::vector<std::string> targets;
+  auto server = StartGemini(&targets, &mutex);
+  intrinsics::ModelInferenceWithConfig::InferenceMap inference_map;
+  absl::flat_hash_map<std::string, std::string> streamed;
+  ASSERT_TRUE(GoogleAI::SetInferenceMap(
+                  inference_map,
+                  [&](absl::string_view call_id, absl::string_view delta) {
+                    absl::MutexLock lock(&mutex);
+                    absl::StrAppend(&streamed[call_id], delta, "|");
+                    return true;
+                  })
+                  .ok());
+  v0::Value arg;
+  arg.set_str("Tell me a story");
+
+  // Concurrent calls, two of them without an id of their own.
+  const std::string url = server->Url("/m:generateContent");
+  std::vector<std::thread> threads;
+  for (const std::string call_id : {"a", "b", "", ""}) {
+    threads.emplace_back([&, call_id]() {
+      v0::Value result = inference_map.at("/cloud/gemini/stream")(
+                             StreamIntrinsic(url, call_id), arg)
+                             .value();
+      EXPECT_EQ(result.str(), "Once upon a time");
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(streamed.size(), 4);
+  EXPECT_EQ(streamed["a"], "Once| upon a| time|");
+  EXPECT_EQ(streamed["b"], "Once| upon a| time|");
+  for (const auto& [call_id, text] : streamed) {
+    EXPECT_EQ(text, "Once| upon a| time|") << call_id;
+  }
+}
+
+}  // namespace
+}  // namespace genc
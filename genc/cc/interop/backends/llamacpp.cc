@@ -14,40 +14,26 @@ limitations under the License
 ==============================================================================*/
 #include "genc/cc/interop/backends/llamacpp.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
-#include "absl/base/thread_annotations.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/strings/numbers.h"
-#include "absl/strings/str_join.h"
-#include "absl/synchronization/mutex.h"
+#include "absl/strings/str_cat.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/interop/backends/llamacpp_embedder.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+#include "genc/cc/interop/backends/llamacpp_registry.h"
 #include "genc/cc/intrinsics/model_inference.h"
+#include "genc/cc/runtime/status_macros.h"
 #include "genc/proto/v0/computation.pb.h"
-#include "llama.h"
-
-namespace genc {
-ABSL_CONST_INIT absl::Mutex client_mutex(absl::kConstInit);
-ABSL_CONST_INIT LlamaCpp* shared_client ABSL_GUARDED_BY(client_mutex) = nullptr;
-}  // namespace genc
 
 namespace {
-constexpr int kMaxTokenLength = 32;  // Max token length in characters.
-
-void llama_batch_add(struct llama_batch& batch, llama_token id, llama_pos pos,
-                     bool logits) {
-  batch.token[batch.n_tokens] = id;
-  batch.pos[batch.n_tokens] = pos;
-  batch.logits[batch.n_tokens] = logits;
-
-  // Only provide a simple seq_id of {0}
-  batch.n_seq_id[batch.n_tokens] = 1;
-  batch.seq_id[batch.n_tokens][0] = 0;
-
-  batch.n_tokens++;
-}
-
 absl::StatusOr<int> getIntParam(const genc::v0::Value& param) {
   if (param.has_int_32()) {
     return param.int_32();
@@ -64,184 +50,243 @@ absl::StatusOr<int> getIntParam(const genc::v0::Value& param) {
     return absl::InvalidArgumentError("Invalid param type");
   }
 }
+
+absl::StatusOr<float> getFloatParam(const genc::v0::Value& param) {
+  if (param.has_float_32()) {
+    return param.float_32();
+  } else if (param.has_int_32()) {
+    return param.int_32();
+  } else if (param.has_str()) {
+    float temp;
+    if (absl::SimpleAtof(param.str(), &temp)) {
+      return temp;
+    } else {
+      return absl::InvalidArgumentError("Unable to parse param");
+    }
+  } else {
+    return absl::InvalidArgumentError("Invalid param type");
+  }
+}
 }  // namespace
 
 namespace genc {
+namespace {
 
-absl::Status LlamaCpp::InitModel(absl::string_view model_path,
-                                 int num_threads = 1, int max_tokens = 32) {
-  llama_backend_init();
-  llama_model_params model_params = llama_model_default_params();
-  model_ =
-      llama_load_model_from_file(std::string(model_path).c_str(), model_params);
-  if (!model_) {
-    return absl::InvalidArgumentError(absl::StrCat(
-        "LlamaCpp unable to load a model from file \"",
-        std::string(model_path),
-        "\" with the default params."));
-  }
-  llama_context_params ctx_params = llama_context_default_params();
-  ctx_params.seed = 1234;
-  ctx_params.n_ctx = 1024;
-  ctx_params.n_threads = num_threads;
-  context_ = llama_new_context_with_model(model_, ctx_params);
-  max_tokens_ = max_tokens;
-  return absl::OkStatus();
+// Settings parsed from a model config.
+struct LlamaCppConfig {
+  LlamaCppEngineOptions options;
+  std::vector<std::string> saved_prefixes;
+  // Budget for the models and contexts of the whole process, if set. Configs
+  // that set it must agree.
+  std::optional<int64_t> memory_budget_mb;
+};
+
+LlamaCppRequestOptions RequestOptions(const LlamaCppEngineOptions& options) {
+  LlamaCppRequestOptions request_options;
+  request_options.max_tokens = options.max_tokens;
+  request_options.sampling = options.sampling;
+  return request_options;
 }
 
-absl::Status LlamaCpp::InitModel(const v0::Value& config) {
-  std::string model_path;
-  int num_threads = 1;
-  int max_tokens = 32;
-  int temp;
+LlamaCppConfig ParseConfig(const v0::Value& config) {
+  LlamaCppConfig parsed;
+  LlamaCppEngineOptions& options = parsed.options;
+  std::vector<std::string>& saved_prefixes = parsed.saved_prefixes;
   absl::StatusOr<int> arg;
   for (const v0::Value& param : config.struct_().element()) {
     if (param.label() == "model_path") {
-      model_path = param.str();
+      options.model_path = param.str();
     } else if (param.label() == "num_threads") {
       // Support capturing either string or int, depending on how the
       // IR was written. If invalid format, use default.
       arg = getIntParam(param);
       if (arg.ok()) {
-        num_threads = arg.value();
+        options.num_threads = arg.value();
       }
     } else if (param.label() == "max_tokens") {
       arg = getIntParam(param);
       if (arg.ok()) {
-        max_tokens = arg.value();
+        options.max_tokens = arg.value();
+      }
+    } else if (param.label() == "n_ctx") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.n_ctx = arg.value();
+      }
+    } else if (param.label() == "n_batch") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.n_batch = arg.value();
+      }
+    } else if (param.label() == "n_ubatch") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.n_ubatch = arg.value();
+      }
+    } else if (param.label() == "num_slots") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.num_slots = arg.value();
       }
+    } else if (param.label() == "prefix_cache_size") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.prefix_cache_size = arg.value();
+      }
+    } else if (param.label() == "temperature") {
+      absl::StatusOr<float> value = getFloatParam(param);
+      if (value.ok()) {
+        options.sampling.temperature = value.value();
+      }
+    } else if (param.label() == "top_k") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.sampling.top_k = arg.value();
+      }
+    } else if (param.label() == "top_p") {
+      absl::StatusOr<float> value = getFloatParam(param);
+      if (value.ok()) {
+        options.sampling.top_p = value.value();
+      }
+    } else if (param.label() == "repetition_penalty") {
+      absl::StatusOr<float> value = getFloatParam(param);
+      if (value.ok()) {
+        options.sampling.repetition_penalty = value.value();
+      }
+    } else if (param.label() == "repetition_last_n") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.sampling.repetition_last_n = arg.value();
+      }
+    } else if (param.label() == "seed") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.sampling.seed = arg.value();
+      }
+    } else if (param.label() == "draft_model_path") {
+      options.draft_model_path = param.str();
+    } else if (param.label() == "num_draft_tokens") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.num_draft_tokens = arg.value();
+      }
+    } else if (param.label() == "memory_budget_mb") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        parsed.memory_budget_mb = arg.value();
+      }
+    } else if (param.label() == "saved_prefix") {
+      saved_prefixes.push_back(param.str());
     }
   }
-  return InitModel(model_path, num_threads, max_tokens);
-}
-
-absl::StatusOr<v0::Value> LlamaCpp::CreateRequest(std::string prompt) {
-  v0::Value request;
-  request.set_label("prompt");
-  request.set_str(prompt);
-  return request;
+  options.prefix_cache_size = std::max<int>(options.prefix_cache_size,
+                                           saved_prefixes.size());
+  return parsed;
 }
 
-absl::StatusOr<v0::Value> LlamaCpp::LlamaCppCall(const v0::Value& input) {
-  v0::Value response;
-  std::string prompt;
-
-  prompt = input.str();
-
-  if (!context_ || !model_) {
-    return absl::InternalError("LlamaCpp wasn't initialized.");
-  }
-
-  LOG(INFO) << "Initial Prompt: " << prompt;
-
-  // Clears KV cache to prevent previous runs from influencing this one.
-  llama_kv_cache_clear(context_);
-
-  // Tokenizes prompt.
-  int n_tokens = prompt.size() + 1;  // Max token size, plus one for BOS.
-  std::vector<llama_token> tokenized_prompt(n_tokens);
-  n_tokens = llama_tokenize(model_, prompt.c_str(), prompt.length(),
-                            tokenized_prompt.data(), tokenized_prompt.size(),
-                            /*add_bos=*/true, /*special=*/true);
-
-  // If a negative token length is returned, resize to a larger container.
-  // If not, just resize to the new size.
-  if (n_tokens < 0) {
-    tokenized_prompt.resize(-n_tokens);
-    n_tokens = llama_tokenize(model_, prompt.c_str(), prompt.length(),
-                              tokenized_prompt.data(), tokenized_prompt.size(),
-                              /*add_bos=*/true, /*special=*/true);
-  } else {
-    tokenized_prompt.resize(n_tokens);
-  }
-
-  const int n_ctx = llama_n_ctx(context_);
-  if (tokenized_prompt.size() > n_ctx) {
-    return absl::InternalError("Prompt length is too large for context");
+// Returns the engine for `parsed` from the process-wide registry, and saves
+// the configured prefixes into it if it was just created.
+absl::StatusOr<std::shared_ptr<LlamaCppEngine>> GetOrCreateEngine(
+    const LlamaCppConfig& parsed) {
+  LlamaCppModelRegistry& registry = LlamaCppModelRegistry::Global();
+  if (parsed.memory_budget_mb.has_value()) {
+    GENC_TRY(registry.RequireMemoryBudget(*parsed.memory_budget_mb << 20));
   }
-
-  llama_batch batch = llama_batch_init(llama_n_batch(context_), 0, 1);
-
-  // Add initial prompt to batch.
-  for (size_t i = 0; i < tokenized_prompt.size(); ++i) {
-    llama_batch_add(batch, tokenized_prompt[i], i, false);
-  }
-
-  // Set the last token to output logits.
-  batch.logits[batch.n_tokens - 1] = true;
-
-  if (llama_decode(context_, batch)) {
-    return absl::InternalError("llama_decode() of initial prompt failed");
+  bool created = false;
+  std::shared_ptr<LlamaCppEngine> engine =
+      GENC_TRY(registry.GetOrCreate(parsed.options, &created));
+  if (created) {
+    for (const std::string& prefix : parsed.saved_prefixes) {
+      GENC_TRY(engine->SavePrefix(prefix));
+    }
   }
+  return engine;
+}
 
-  // Main prediction loop
-  int n_current = batch.n_tokens;
-  int n_decoded = 0;
-  std::vector<std::string> result;
-
-  const auto start = absl::Now();
-
-  // Allow tokens up to provided length, including prompt.
-  // Can still break early on EOS.
-  while (n_current <= max_tokens_) {
-    int32_t n_vocab = llama_n_vocab(model_);
-    float* logits = llama_get_logits_ith(context_, batch.n_tokens - 1);
-    std::vector<llama_token_data> candidates(n_vocab);
-
-    for (llama_token id = 0; id < n_vocab; ++id) {
-      candidates.emplace_back(llama_token_data{id, logits[id], 0.0f});
+absl::StatusOr<LlamaCppEmbedderOptions> ParseEmbedderConfig(
+    const v0::Value& config) {
+  LlamaCppEmbedderOptions options;
+  absl::StatusOr<int> arg;
+  for (const v0::Value& param : config.struct_().element()) {
+    if (param.label() == "model_path") {
+      options.model_path = param.str();
+    } else if (param.label() == "num_threads") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.num_threads = arg.value();
+      }
+    } else if (param.label() == "n_batch") {
+      arg = getIntParam(param);
+      if (arg.ok()) {
+        options.n_batch = arg.value();
+      }
+    } else if (param.label() == "pooling") {
+      if (param.str() == "mean") {
+        options.pooling = LlamaCppEmbedderOptions::Pooling::kMean;
+      } else if (param.str() == "last") {
+        options.pooling = LlamaCppEmbedderOptions::Pooling::kLast;
+      } else {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Unsupported pooling: ", param.str()));
+      }
+    } else if (param.label() == "normalize") {
+      options.normalize = param.has_boolean() ? param.boolean()
+                                              : param.str() != "false";
     }
+  }
+  return options;
+}
 
-    llama_token_data_array candidates_arr = {candidates.data(),
-                                             candidates.size(), false};
-
-    const llama_token new_token_id =
-        llama_sample_token_greedy(context_, &candidates_arr);
-    if (new_token_id == llama_token_eos(model_)) {
-      break;
-    }
+}  // namespace
 
-    std::vector<char> piece(kMaxTokenLength);
-    const int n_chars =
-        llama_token_to_piece(model_, new_token_id, piece.data(), piece.size());
-    if (n_chars < 0) {
-      piece.resize(-n_chars);
-      int n_chars_after_resize = llama_token_to_piece(
-          model_, new_token_id, piece.data(), piece.size());
-    } else {
-      piece.resize(n_chars);
-    }
-    result.push_back(std::string(piece.data(), piece.size()));
+absl::Status LlamaCpp::InitModel(absl::string_view model_path,
+                                 int num_threads = 1, int max_tokens = 32) {
+  LlamaCppEngineOptions options;
+  options.model_path = std::string(model_path);
+  options.num_threads = num_threads;
+  options.max_tokens = max_tokens;
+  return InitModel(options);
+}
 
-#if !defined(NDEBUG)
-    LOG(INFO) << result.back();
-#endif
+absl::Status LlamaCpp::InitModel(const LlamaCppEngineOptions& options) {
+  engine_ = GENC_TRY(LlamaCppModelRegistry::Global().GetOrCreate(options));
+  request_options_ = RequestOptions(options);
+  return absl::OkStatus();
+}
 
-    // Clear the batch
-    batch.n_tokens = 0;
+absl::Status LlamaCpp::InitModel(const v0::Value& config) {
+  const LlamaCppConfig parsed = ParseConfig(config);
+  engine_ = GENC_TRY(GetOrCreateEngine(parsed));
+  request_options_ = RequestOptions(parsed.options);
+  return absl::OkStatus();
+}
 
-    // Add new token to batch
-    llama_batch_add(batch, new_token_id, n_current, true);
-    n_decoded++;
-    n_current++;
+absl::StatusOr<v0::Value> LlamaCpp::CreateRequest(std::string prompt) {
+  v0::Value request;
+  request.set_label("prompt");
+  request.set_str(prompt);
+  return request;
+}
 
-    // Evaluate the current batch
-    if (llama_decode(context_, batch)) {
-      return absl::InternalError("Failed to eval batch");
-    }
+absl::StatusOr<v0::Value> LlamaCpp::LlamaCppCall(const v0::Value& input) {
+  if (!engine_) {
+    return absl::InternalError("LlamaCpp wasn't initialized.");
   }
 
-  const auto end = absl::Now();
-  const std::string result_str = absl::StrJoin(result, "");
-  const absl::Duration duration = (end - start);
-  LOG(INFO) << result_str;
-  LOG(INFO) << "\n\nDecoded " << n_decoded << " tokens in " << duration
-            << ", speed: " << n_decoded / absl::ToDoubleSeconds(duration)
-            << " t/s";
-  response.set_str(result_str);
+  LOG(INFO) << "Initial Prompt: " << input.str();
+  v0::Value response;
+  response.set_str(GENC_TRY(engine_->Generate(input.str(), request_options_)));
+  LOG(INFO) << response.str();
   return response;
 }
 
+absl::Status LlamaCpp::SavePrefix(absl::string_view prefix) {
+  if (!engine_) {
+    return absl::InternalError("LlamaCpp wasn't initialized.");
+  }
+  return engine_->SavePrefix(prefix);
+}
+
 absl::Status LlamaCpp::SetInferenceMap(
     intrinsics::ModelInference::InferenceMap& inference_map,
     absl::string_view model_uri) {
@@ -253,17 +298,16 @@ absl::Status LlamaCpp::SetInferenceMap(
 
 absl::StatusOr<v0::Value> CallLlamaCpp(
     const v0::Value& config, const v0::Value& arg) {
-  absl::MutexLock l(&client_mutex);
-  if (!shared_client) {
-    shared_client = new LlamaCpp();
-  }
-  if (!shared_client->is_initialized()) {
-    absl::Status status = shared_client->InitModel(config);
-    if (!status.ok()) {
-      return status;
-    }
-  }
-  return shared_client->LlamaCppCall(arg);
+  // Holding the engine for the duration of the call keeps the registry from
+  // evicting it or its model. Concurrent calls with the same context shape share
+  // the engine, and are batched together by it, whatever their sampling
+  // options.
+  const LlamaCppConfig parsed = ParseConfig(config);
+  std::shared_ptr<LlamaCppEngine> engine = GENC_TRY(GetOrCreateEngine(parsed));
+  v0::Value response;
+  response.set_str(GENC_TRY(
+      engine->Generate(arg.str(), RequestOptions(parsed.options))));
+  return response;
 }
 
 std::function<absl::StatusOr<v0::Value>(v0::Intrinsic, v0::Value)>
@@ -274,4 +318,39 @@ GetLlamaCppInferenceFn() {
   };
 }
 
+std::function<absl::StatusOr<v0::Value>(v0::Intrinsic, v0::Value)>
+GetLlamaCppEmbeddingFn() {
+  return [](v0::Intrinsic intrinsic, v0::Value arg) ->
+      absl::StatusOr<v0::Value> {
+    const v0::Struct& params = intrinsic.static_parameter().struct_();
+    if (params.element_size() < 2) {
+      return absl::InvalidArgumentError("Missing model_config.");
+    }
+    LlamaCppEmbedderOptions options =
+        GENC_TRY(ParseEmbedderConfig(params.element(1)));
+    std::shared_ptr<LlamaCppEmbedder> embedder = GENC_TRY(
+        LlamaCppModelRegistry::Global().GetOrCreateEmbedder(options));
+
+    std::vector<std::string> texts;
+    if (arg.has_struct_()) {
+      for (const v0::Value& element : arg.struct_().element()) {
+        texts.push_back(element.str());
+      }
+    } else {
+      texts.push_back(arg.str());
+    }
+    std::vector<std::vector<float>> embeddings =
+        GENC_TRY(embedder->Embed(texts));
+
+    if (!arg.has_struct_()) {
+      return CreateFloatTensor(embeddings[0]);
+    }
+    v0::Value result;
+    for (const std::vector<float>& embedding : embeddings) {
+      *result.mutable_struct_()->add_element() = CreateFloatTensor(embedding);
+    }
+    return result;
+  };
+}
+
 }  // namespace genc
@@ -15,35 +15,47 @@ limitations under the License
 #ifndef GENC_GOOGLE_CC_INTEROP_BACKENDS_LLAMACPP_H_
 #define GENC_GOOGLE_CC_INTEROP_BACKENDS_LLAMACPP_H_
 
+#include <functional>
 #include <memory>
+#include <string>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
 #include "genc/cc/intrinsics/model_inference.h"
 #include "genc/proto/v0/computation.pb.h"
-#include "llama.h"
 
 namespace genc {
 
+// A client for a llama.cpp model. Clients initialized with the same model and
+// context shape share one engine from `LlamaCppModelRegistry::Global()`, which
+// keeps it, while idle too, until it is evicted under the memory budget. Each
+// client samples with its own options.
 class LlamaCpp {
  public:
   LlamaCpp() = default;
   ~LlamaCpp() = default;
 
-  bool is_initialized() const {
-    return (context_ != nullptr) && (model_ != nullptr);
-  }
+  bool is_initialized() const { return engine_ != nullptr; }
 
   absl::Status InitModel(absl::string_view model_path, int num_threads,
                          int max_tokens);
   absl::Status InitModel(const v0::Value& config);
+  absl::Status InitModel(const LlamaCppEngineOptions& options);
   absl::StatusOr<v0::Value> CreateRequest(std::string prompt);
   absl::Status SetInferenceMap(
       intrinsics::ModelInference::InferenceMap& inference_map,
       absl::string_view model_uri);
+  // Thread-safe; concurrent calls are decoded together in shared batches when
+  // the model was initialized with more than one slot.
   absl::StatusOr<v0::Value> LlamaCppCall(const v0::Value& input);
 
+  // Decodes `prefix` (e.g., a system prompt) into the saved prefix store, so
+  // that calls whose prompts start with it skip decoding it again. Requires
+  // the model to have been initialized with a non-zero `prefix_cache_size`.
+  absl::Status SavePrefix(absl::string_view prefix);
+
   // Disallow copy and assign.
   LlamaCpp(const LlamaCpp&) = delete;
   LlamaCpp& operator=(const LlamaCpp&) = delete;
@@ -51,17 +63,30 @@ class LlamaCpp {
   LlamaCpp& operator=(LlamaCpp&&) = delete;
 
  private:
-  struct llama_model* model_;
-  struct llama_context* context_;
-  int max_tokens_;
+  std::shared_ptr<LlamaCppEngine> engine_;
+  LlamaCppRequestOptions request_options_;
 };
 
+// Serves `arg` with the engine for `config` from the process-wide registry,
+// loading the model on first use. Configs naming different models are served
+// side by side, subject to the registry's memory budget (settable with the
+// `memory_budget_mb` config entry, on which all configs that set it must
+// agree). Idle engines stay in the registry, with their KV caches and saved
+// prefixes, for the next calls with the same shape.
 absl::StatusOr<v0::Value> CallLlamaCpp(
     const v0::Value& config, const v0::Value& arg);
 
 std::function<absl::StatusOr<v0::Value>(v0::Intrinsic, v0::Value)>
 GetLlamaCppInferenceFn();
 
+// Returns an embedding function for `intrinsics::Embed::EmbeddingMap`, which
+// embeds a string or a struct of strings with the model in the intrinsic's
+// config (`model_path`, and optionally `num_threads`, `n_batch`, `pooling` of
+// "mean" or "last", and `normalize`). Embedders come from the process-wide
+// registry, which counts them in its memory budget.
+std::function<absl::StatusOr<v0::Value>(v0::Intrinsic, v0::Value)>
+GetLlamaCppEmbeddingFn();
+
 }  // namespace genc
 
 #endif  // GENC_GOOGLE_CC_INTEROP_BACKENDS_LLAMACPP_H_
@@ -0,0 +1,117 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_batching.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace genc {
+
+std::vector<int> PlanBatch(absl::Span<const SequenceWork> sequences,
+                           int n_batch, int n_ubatch) {
+  std::vector<int> n_tokens(sequences.size(), 0);
+  int n_used = 0;
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    if (sequences[i].generating) {
+      n_tokens[i] = 1 + sequences[i].n_drafts;
+      n_used += n_tokens[i];
+    }
+  }
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    if (sequences[i].generating || sequences[i].n_pending == 0) {
+      continue;
+    }
+    n_tokens[i] = std::max(
+        std::min({sequences[i].n_pending, n_ubatch, n_batch - n_used}), 0);
+    n_used += n_tokens[i];
+  }
+  return n_tokens;
+}
+
+int CommonPrefixLength(absl::Span<const int32_t> a,
+                       absl::Span<const int32_t> b) {
+  const size_t n = std::min(a.size(), b.size());
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+PrefixMatch MatchPrefix(absl::Span<const CachedSequence> sequences,
+                        absl::Span<const int32_t> prompt) {
+  PrefixMatch match;
+  int best_length = -1;
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    if (sequences[i].is_saved_prefix || sequences[i].busy) {
+      continue;
+    }
+    const int length = CommonPrefixLength(sequences[i].tokens, prompt);
+    if (length > best_length) {
+      match.sequence = i;
+      best_length = length;
+    }
+  }
+  if (match.sequence < 0) {
+    return match;
+  }
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    if (!sequences[i].is_saved_prefix || sequences[i].busy) {
+      continue;
+    }
+    const int length = CommonPrefixLength(sequences[i].tokens, prompt);
+    if (length > best_length) {
+      match.saved_prefix = i;
+      best_length = length;
+    }
+  }
+  match.n_reuse = std::min<int>(best_length, prompt.size() - 1);
+  return match;
+}
+
+int ChooseSavedPrefixSequence(absl::Span<const CachedSequence> sequences,
+                              absl::Span<const int32_t> prefix) {
+  auto eviction_rank = [](const CachedSequence& sequence) {
+    return sequence.tokens.empty() ? -1 : sequence.last_used;
+  };
+  int target = -1;
+  for (size_t i = 0; i < sequences.size(); ++i) {
+    if (!sequences[i].is_saved_prefix || sequences[i].busy) {
+      continue;
+    }
+    if (sequences[i].tokens == prefix) {
+      return i;
+    }
+    if (target < 0 ||
+        eviction_rank(sequences[i]) < eviction_rank(sequences[target])) {
+      target = i;
+    }
+  }
+  return target;
+}
+
+int NumDraftTokens(int num_draft_tokens, int max_tokens, int num_generated,
+                   int n_ctx, int n_cached) {
+  return std::max(std::min({num_draft_tokens, max_tokens - num_generated - 1,
+                            n_ctx - n_cached - 1}),
+                  0);
+}
+
+}  // namespace genc
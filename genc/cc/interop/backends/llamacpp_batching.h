@@ -0,0 +1,141 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_BACKENDS_LLAMACPP_BATCHING_H_
+#define GENC_CC_INTEROP_BACKENDS_LLAMACPP_BATCHING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace genc {
+
+// The bookkeeping of LlamaCppEngine that doesn't involve llama.cpp itself,
+// kept apart so that it can be tested without model weights.
+
+// What a sequence of the KV cache has to decode in the next step.
+struct SequenceWork {
+  // Whether the sequence is generating, in which case it decodes its last
+  // sampled token followed by `n_drafts` draft tokens.
+  bool generating = false;
+  int n_drafts = 0;
+
+  // Number of prompt tokens not yet decoded, for a sequence still prefilling.
+  int n_pending = 0;
+};
+
+// Returns the number of tokens each of `sequences` decodes in the next batch
+// of at most `n_batch` tokens. Generating sequences always decode all of their
+// tokens, and the caller makes sure that these fit. Prefilling sequences
+// share what is left, in order, at most `n_ubatch` tokens each.
+std::vector<int> PlanBatch(absl::Span<const SequenceWork> sequences,
+                           int n_batch, int n_ubatch);
+
+// Returns the number of leading tokens that `a` and `b` have in common.
+int CommonPrefixLength(absl::Span<const int32_t> a,
+                       absl::Span<const int32_t> b);
+
+// A sequence of the KV cache, as seen when admitting a new request.
+struct CachedSequence {
+  // Tokens of the sequence held in the KV cache, in order.
+  absl::Span<const int32_t> tokens;
+
+  // Whether the sequence belongs to the saved prefix store.
+  bool is_saved_prefix = false;
+
+  // Whether a request is using the sequence.
+  bool busy = false;
+
+  // Step at which a saved prefix was last used, for LRU eviction.
+  int64_t last_used = 0;
+};
+
+// Where to admit a prompt, and how much of it is already in the KV cache.
+struct PrefixMatch {
+  // Index of the free generation sequence to admit the prompt into, or -1 if
+  // there is none.
+  int sequence = -1;
+
+  // Index of the saved prefix to seed the sequence from, or -1 to keep the
+  // tokens it already holds.
+  int saved_prefix = -1;
+
+  // Number of leading prompt tokens taken from the cache instead of decoded.
+  // At least the last prompt token is always decoded again, for its logits.
+  int n_reuse = 0;
+};
+
+// Matches `prompt` against the free generation sequences, and the saved
+// prefixes that are not being decoded. A saved prefix is only used if it
+// covers more of the prompt than the best generation sequence holds.
+PrefixMatch MatchPrefix(absl::Span<const CachedSequence> sequences,
+                        absl::Span<const int32_t> prompt);
+
+// Returns the index of the saved prefix sequence to decode `prefix` into: the
+// one already holding it, else an empty one, else the least recently used.
+// Returns -1 if they are all busy.
+int ChooseSavedPrefixSequence(absl::Span<const CachedSequence> sequences,
+                              absl::Span<const int32_t> prefix);
+
+// Returns the number of tokens to draft for a sequence that has generated
+// `num_generated` of its `max_tokens`, and holds `n_cached` of the `n_ctx`
+// tokens its KV cache fits. Each step emits at least one token besides the
+// drafts, and the last sampled token takes up a cell of the cache either way.
+int NumDraftTokens(int num_draft_tokens, int max_tokens, int num_generated,
+                   int n_ctx, int n_cached);
+
+// The outcome of verifying draft tokens against the target model.
+struct DraftVerification {
+  // Number of draft tokens accepted, whose cache cells stay.
+  int n_accepted = 0;
+
+  // The last token sampled by the target model, to decode in the next step.
+  int32_t last_token = 0;
+
+  // Whether the sequence ended, on the end-of-sequence token or because
+  // `emit` said so.
+  bool finished = false;
+};
+
+// Verifies `drafts`, whose logits were decoded in one batch after the last
+// sampled token. `sample(k)` samples the target model's token from the logits
+// following `k` accepted drafts, which holds as long as the sampled tokens
+// are the drafts themselves. `emit(token, k)` is called with each sampled
+// token other than `eos`, and returns false to end the sequence there. The
+// emitted tokens are thus the same as without drafts.
+template <typename SampleFn, typename EmitFn>
+DraftVerification VerifyDrafts(absl::Span<const int32_t> drafts, int32_t eos,
+                               SampleFn sample, EmitFn emit) {
+  DraftVerification verification;
+  while (true) {
+    const int32_t token = sample(verification.n_accepted);
+    verification.last_token = token;
+    if (token == eos || !emit(token, verification.n_accepted)) {
+      verification.finished = true;
+      return verification;
+    }
+    if (static_cast<size_t>(verification.n_accepted) == drafts.size() ||
+        token != drafts[verification.n_accepted]) {
+      return verification;
+    }
+    ++verification.n_accepted;
+  }
+}
+
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_BACKENDS_LLAMACPP_BATCHING_H_
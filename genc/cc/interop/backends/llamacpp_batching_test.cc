@@ -0,0 +1,254 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_batching.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace genc {
+namespace {
+
+using ::testing::ElementsAre;
+
+SequenceWork Generating(int n_drafts = 0) {
+  SequenceWork work;
+  work.generating = true;
+  work.n_drafts = n_drafts;
+  return work;
+}
+
+SequenceWork Prefilling(int n_pending) {
+  SequenceWork work;
+  work.n_pending = n_pending;
+  return work;
+}
+
+TEST(PlanBatchTest, IdleSequencesDecodeNothing) {
+  EXPECT_THAT(PlanBatch({SequenceWork(), SequenceWork()}, 8, 8),
+              ElementsAre(0, 0));
+}
+
+TEST(PlanBatchTest, GeneratingSequencesDecodeTheirLastTokenAndDrafts) {
+  EXPECT_THAT(PlanBatch({Generating(), Generating(3), SequenceWork()}, 8, 8),
+              ElementsAre(1, 4, 0));
+}
+
+TEST(PlanBatchTest, NewPromptsJoinTheRunningBatch) {
+  // The prompt admitted into the second slot is decoded in the same batch as
+  // the tokens of the sequences that are already generating.
+  EXPECT_THAT(
+      PlanBatch({Generating(), Prefilling(3), Generating(1)}, 16, 16),
+      ElementsAre(1, 3, 2));
+}
+
+TEST(PlanBatchTest, GeneratingSequencesComeBeforePrefills) {
+  // Only what the generating sequences leave of the batch goes to prefills,
+  // whatever their order.
+  EXPECT_THAT(PlanBatch({Prefilling(10), Generating(2), Generating()}, 8, 16),
+              ElementsAre(4, 3, 1));
+}
+
+TEST(PlanBatchTest, LongPromptsArePrefilledInChunks) {
+  EXPECT_THAT(PlanBatch({Prefilling(1000)}, 512, 128), ElementsAre(128));
+  EXPECT_THAT(PlanBatch({Prefilling(100)}, 512, 128), ElementsAre(100));
+  EXPECT_THAT(PlanBatch({Prefilling(1000)}, 64, 128), ElementsAre(64));
+}
+
+TEST(PlanBatchTest, PrefillsShareWhatIsLeftOfTheBatchInOrder) {
+  EXPECT_THAT(PlanBatch({Prefilling(100), Generating(), Prefilling(100),
+                         Prefilling(100)},
+                        64, 32),
+              ElementsAre(32, 1, 31, 0));
+}
+
+CachedSequence Cached(const std::vector<int32_t>& tokens,
+                      bool is_saved_prefix = false, bool busy = false,
+                      int64_t last_used = 0) {
+  CachedSequence sequence;
+  sequence.tokens = tokens;
+  sequence.is_saved_prefix = is_saved_prefix;
+  sequence.busy = busy;
+  sequence.last_used = last_used;
+  return sequence;
+}
+
+TEST(CommonPrefixLengthTest, CountsLeadingMatches) {
+  EXPECT_EQ(CommonPrefixLength({}, {1, 2}), 0);
+  EXPECT_EQ(CommonPrefixLength({1, 2, 3}, {1, 2, 4}), 2);
+  EXPECT_EQ(CommonPrefixLength({1, 2}, {1, 2, 3}), 2);
+  EXPECT_EQ(CommonPrefixLength({0, 2}, {1, 2}), 0);
+}
+
+TEST(MatchPrefixTest, PicksTheFreeSequenceSharingTheLongestPrefix) {
+  const std::vector<int32_t> a = {1, 2, 3, 4};
+  const std::vector<int32_t> b = {1, 2, 3, 9};
+  const std::vector<int32_t> c = {1, 2};
+  const std::vector<int32_t> prompt = {1, 2, 3, 9, 10};
+  const PrefixMatch match = MatchPrefix(
+      {Cached(a), Cached(prompt, false, /*busy=*/true), Cached(b), Cached(c)},
+      prompt);
+  EXPECT_EQ(match.sequence, 2);
+  EXPECT_EQ(match.saved_prefix, -1);
+  EXPECT_EQ(match.n_reuse, 4);
+}
+
+TEST(MatchPrefixTest, DecodesTheLastPromptTokenAgain) {
+  const std::vector<int32_t> prompt = {1, 2, 3};
+  const PrefixMatch match = MatchPrefix({Cached(prompt)}, prompt);
+  EXPECT_EQ(match.sequence, 0);
+  EXPECT_EQ(match.n_reuse, 2);
+}
+
+TEST(MatchPrefixTest, SeedsFromALongerSavedPrefix) {
+  const std::vector<int32_t> slot = {1, 2};
+  const std::vector<int32_t> short_prefix = {1, 2, 3};
+  const std::vector<int32_t> long_prefix = {1, 2, 3, 4};
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5};
+  const PrefixMatch match =
+      MatchPrefix({Cached(slot), Cached(short_prefix, /*is_saved_prefix=*/true),
+                   Cached(long_prefix, /*is_saved_prefix=*/true)},
+                  prompt);
+  EXPECT_EQ(match.sequence, 0);
+  EXPECT_EQ(match.saved_prefix, 2);
+  EXPECT_EQ(match.n_reuse, 4);
+}
+
+TEST(MatchPrefixTest, SkipsSavedPrefixesNotLongerOrBeingDecoded) {
+  const std::vector<int32_t> slot = {1, 2, 3};
+  const std::vector<int32_t> same = {1, 2, 3};
+  const std::vector<int32_t> longer = {1, 2, 3, 4};
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5};
+  const PrefixMatch match = MatchPrefix(
+      {Cached(slot), Cached(same, /*is_saved_prefix=*/true),
+       Cached(longer, /*is_saved_prefix=*/true, /*busy=*/true)},
+      prompt);
+  EXPECT_EQ(match.sequence, 0);
+  EXPECT_EQ(match.saved_prefix, -1);
+  EXPECT_EQ(match.n_reuse, 3);
+}
+
+TEST(MatchPrefixTest, FailsWithoutAFreeSequence) {
+  const std::vector<int32_t> prompt = {1, 2};
+  EXPECT_EQ(MatchPrefix({Cached(prompt, false, /*busy=*/true),
+                         Cached(prompt, /*is_saved_prefix=*/true)},
+                        prompt)
+                .sequence,
+            -1);
+}
+
+TEST(ChooseSavedPrefixSequenceTest, PrefersHolderThenEmptyThenLeastRecent) {
+  const std::vector<int32_t> empty;
+  const std::vector<int32_t> a = {1, 2};
+  const std::vector<int32_t> b = {3, 4};
+  const std::vector<int32_t> c = {5, 6};
+  EXPECT_EQ(ChooseSavedPrefixSequence(
+                {Cached(a), Cached(empty, true), Cached(b, true, false, 1)}, b),
+            2);
+  EXPECT_EQ(ChooseSavedPrefixSequence(
+                {Cached(a, true, false, 1), Cached(empty, true)}, c),
+            1);
+  EXPECT_EQ(ChooseSavedPrefixSequence(
+                {Cached(a, true, false, 5), Cached(b, true, false, 2),
+                 Cached(empty, true, /*busy=*/true)},
+                c),
+            1);
+  EXPECT_EQ(ChooseSavedPrefixSequence({Cached(a), Cached(b, true, true)}, c),
+            -1);
+}
+
+TEST(NumDraftTokensTest, LeavesRoomForTheTargetsOwnToken) {
+  EXPECT_EQ(NumDraftTokens(4, /*max_tokens=*/32, /*num_generated=*/0,
+                           /*n_ctx=*/64, /*n_cached=*/10),
+            4);
+  EXPECT_EQ(NumDraftTokens(4, 32, 29, 64, 10), 2);
+  EXPECT_EQ(NumDraftTokens(4, 32, 0, 64, 61), 2);
+  EXPECT_EQ(NumDraftTokens(4, 32, 31, 64, 10), 0);
+  EXPECT_EQ(NumDraftTokens(4, 32, 32, 64, 10), 0);
+}
+
+constexpr int32_t kEos = 0;
+
+// Verifies `drafts` against a target model that samples `samples` in order,
+// and records the emitted tokens, up to `max_emitted`.
+DraftVerification Verify(const std::vector<int32_t>& drafts,
+                         const std::vector<int32_t>& samples,
+                         std::vector<int32_t>* emitted,
+                         size_t max_emitted = 100) {
+  return VerifyDrafts(
+      drafts, kEos,
+      [&](int n_accepted) {
+        // The target only ever samples after the drafts it accepted.
+        EXPECT_EQ(static_cast<size_t>(n_accepted), emitted->size());
+        return samples[n_accepted];
+      },
+      [&](int32_t token, int) {
+        emitted->push_back(token);
+        return emitted->size() < max_emitted;
+      });
+}
+
+TEST(VerifyDraftsTest, AcceptsAllMatchingDraftsAndOneMoreToken) {
+  std::vector<int32_t> emitted;
+  const DraftVerification verification =
+      Verify({5, 6, 7}, {5, 6, 7, 8}, &emitted);
+  EXPECT_EQ(verification.n_accepted, 3);
+  EXPECT_EQ(verification.last_token, 8);
+  EXPECT_FALSE(verification.finished);
+  EXPECT_THAT(emitted, ElementsAre(5, 6, 7, 8));
+}
+
+TEST(VerifyDraftsTest, StopsAtTheFirstMismatch) {
+  std::vector<int32_t> emitted;
+  const DraftVerification verification =
+      Verify({5, 6, 7}, {5, 9, 7, 8}, &emitted);
+  EXPECT_EQ(verification.n_accepted, 1);
+  EXPECT_EQ(verification.last_token, 9);
+  EXPECT_FALSE(verification.finished);
+  EXPECT_THAT(emitted, ElementsAre(5, 9));
+}
+
+TEST(VerifyDraftsTest, WithoutDraftsSamplesOneToken) {
+  std::vector<int32_t> emitted;
+  const DraftVerification verification = Verify({}, {3}, &emitted);
+  EXPECT_EQ(verification.n_accepted, 0);
+  EXPECT_EQ(verification.last_token, 3);
+  EXPECT_THAT(emitted, ElementsAre(3));
+}
+
+TEST(VerifyDraftsTest, FinishesOnEndOfSequence) {
+  std::vector<int32_t> emitted;
+  const DraftVerification verification =
+      Verify({5, 6, 7}, {5, kEos, 7, 8}, &emitted);
+  EXPECT_EQ(verification.n_accepted, 1);
+  EXPECT_TRUE(verification.finished);
+  EXPECT_THAT(emitted, ElementsAre(5));
+}
+
+TEST(VerifyDraftsTest, FinishesWhenOutOfBudget) {
+  std::vector<int32_t> emitted;
+  const DraftVerification verification =
+      Verify({5, 6, 7}, {5, 6, 7, 8}, &emitted, /*max_emitted=*/2);
+  EXPECT_EQ(verification.n_accepted, 1);
+  EXPECT_TRUE(verification.finished);
+  EXPECT_THAT(emitted, ElementsAre(5, 6));
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,209 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_embedder.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "llama.h"
+
+namespace genc {
+namespace {
+
+absl::StatusOr<std::vector<llama_token>> Tokenize(const llama_model* model,
+                                                  const std::string& text) {
+  // Max token size, plus one for BOS.
+  std::vector<llama_token> tokens(text.size() + 1);
+  int n_tokens =
+      llama_tokenize(model, text.data(), text.size(), tokens.data(),
+                     tokens.size(), /*add_bos=*/true, /*special=*/false);
+  if (n_tokens < 0) {
+    tokens.resize(-n_tokens);
+    n_tokens =
+        llama_tokenize(model, text.data(), text.size(), tokens.data(),
+                       tokens.size(), /*add_bos=*/true, /*special=*/false);
+  }
+  if (n_tokens < 0) {
+    return absl::InternalError("Unable to tokenize the text.");
+  }
+  tokens.resize(n_tokens);
+  return tokens;
+}
+
+void Normalize(std::vector<float>& embedding) {
+  double norm = 0.0;
+  for (float x : embedding) {
+    norm += x * x;
+  }
+  if (norm > 0.0) {
+    const float scale = 1.0 / std::sqrt(norm);
+    for (float& x : embedding) {
+      x *= scale;
+    }
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<LlamaCppEmbedder>> LlamaCppEmbedder::Create(
+    const LlamaCppEmbedderOptions& options) {
+  std::shared_ptr<llama_model> model =
+      GENC_TRY(LlamaCppEngine::LoadModel(options.model_path));
+  return Create(options, std::move(model));
+}
+
+absl::StatusOr<std::unique_ptr<LlamaCppEmbedder>> LlamaCppEmbedder::Create(
+    const LlamaCppEmbedderOptions& options,
+    std::shared_ptr<llama_model> model) {
+  if (options.n_batch < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid batch size: ", options.n_batch));
+  }
+  llama_context_params ctx_params = llama_context_default_params();
+  // The cache is cleared before every batch, so it only needs to hold one.
+  ctx_params.n_ctx = options.n_batch;
+  ctx_params.n_batch = options.n_batch;
+  ctx_params.n_threads = options.num_threads;
+  ctx_params.n_threads_batch = options.num_threads;
+  ctx_params.embedding = true;
+  // Pool here rather than in llama.cpp, which only pools for models that
+  // declare a pooling type, so that causal models work too.
+  ctx_params.do_pooling = false;
+  llama_context* context =
+      llama_new_context_with_model(model.get(), ctx_params);
+  if (!context) {
+    return absl::InternalError("LlamaCpp unable to create a context.");
+  }
+  return absl::WrapUnique(
+      new LlamaCppEmbedder(options, std::move(model), context));
+}
+
+LlamaCppEmbedder::LlamaCppEmbedder(const LlamaCppEmbedderOptions& options,
+                                   std::shared_ptr<llama_model> model,
+                                   llama_context* context)
+    : options_(options),
+      model_(std::move(model)),
+      context_(context),
+      batch_(llama_batch_init(options.n_batch, 0, 1)) {}
+
+LlamaCppEmbedder::~LlamaCppEmbedder() {
+  llama_batch_free(batch_);
+  llama_free(context_);
+}
+
+int64_t LlamaCppEmbedder::memory_size() const {
+  return llama_get_state_size(context_);
+}
+
+absl::StatusOr<std::vector<std::vector<float>>> LlamaCppEmbedder::Embed(
+    absl::Span<const std::string> texts) {
+  const size_t n_batch = options_.n_batch;
+  std::vector<std::vector<llama_token>> tokens;
+  tokens.reserve(texts.size());
+  for (const std::string& text : texts) {
+    tokens.push_back(GENC_TRY(Tokenize(model_.get(), text)));
+    if (tokens.back().size() > n_batch) {
+      LOG(WARNING) << "Truncating text of " << tokens.back().size()
+                   << " tokens to the batch size of " << n_batch;
+      tokens.back().resize(n_batch);
+    }
+  }
+
+  std::vector<std::vector<float>> embeddings(texts.size());
+  absl::MutexLock lock(&mutex_);
+  // Pack as many consecutive texts into each batch as fit.
+  size_t begin = 0;
+  while (begin < tokens.size()) {
+    size_t end = begin;
+    size_t n_tokens = 0;
+    while (end < tokens.size() && n_tokens + tokens[end].size() <= n_batch) {
+      n_tokens += tokens[end].size();
+      ++end;
+    }
+    GENC_TRY(EmbedBatch(tokens, begin, end, embeddings));
+    begin = end;
+  }
+  return embeddings;
+}
+
+absl::Status LlamaCppEmbedder::EmbedBatch(
+    const std::vector<std::vector<llama_token>>& tokens, int begin, int end,
+    std::vector<std::vector<float>>& embeddings) {
+  llama_kv_cache_clear(context_);
+  batch_.n_tokens = 0;
+  for (int i = begin; i < end; ++i) {
+    const int n_tokens = tokens[i].size();
+    for (int pos = 0; pos < n_tokens; ++pos) {
+      const int j = batch_.n_tokens++;
+      batch_.token[j] = tokens[i][pos];
+      batch_.pos[j] = pos;
+      batch_.n_seq_id[j] = 1;
+      // Each text is its own sequence, so texts don't attend to each other.
+      batch_.seq_id[j][0] = i - begin;
+      batch_.logits[j] = (pos + 1 == n_tokens);
+    }
+  }
+  if (batch_.n_tokens > 0 && llama_decode(context_, batch_) != 0) {
+    return absl::InternalError("llama_decode() failed");
+  }
+
+  const int n_embd = llama_n_embd(model_.get());
+  int offset = 0;
+  for (int i = begin; i < end; ++i) {
+    const int n_tokens = tokens[i].size();
+    std::vector<float>& embedding = embeddings[i];
+    embedding.assign(n_embd, 0.0f);
+    if (n_tokens == 0) {
+      continue;
+    }
+    if (options_.pooling == LlamaCppEmbedderOptions::Pooling::kLast) {
+      const float* last =
+          llama_get_embeddings_ith(context_, offset + n_tokens - 1);
+      embedding.assign(last, last + n_embd);
+    } else {
+      for (int t = 0; t < n_tokens; ++t) {
+        const float* token = llama_get_embeddings_ith(context_, offset + t);
+        for (int d = 0; d < n_embd; ++d) {
+          embedding[d] += token[d];
+        }
+      }
+      for (float& x : embedding) {
+        x /= n_tokens;
+      }
+    }
+    if (options_.normalize) {
+      Normalize(embedding);
+    }
+    offset += n_tokens;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace genc
@@ -0,0 +1,105 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_BACKENDS_LLAMACPP_EMBEDDER_H_
+#define GENC_CC_INTEROP_BACKENDS_LLAMACPP_EMBEDDER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "llama.h"
+
+namespace genc {
+
+struct LlamaCppEmbedderOptions {
+  std::string model_path;
+  int num_threads = 1;
+
+  // Maximum number of tokens embedded in one decode, across texts. Texts
+  // longer than this are truncated.
+  int n_batch = 512;
+
+  // How the per-token embeddings of a text are reduced to one vector: their
+  // mean, or the embedding of the last token (for causal models, the only one
+  // that attends to the whole text).
+  enum class Pooling { kMean, kLast };
+  Pooling pooling = Pooling::kMean;
+
+  // Whether to scale embeddings to unit length, so that dot products are
+  // cosine similarities.
+  bool normalize = true;
+};
+
+// Computes text embeddings with a llama.cpp model.
+//
+// Many texts are embedded together: they are packed into one batch, each as
+// its own sequence, so that a single llama_decode call embeds all the texts
+// that fit in it.
+class LlamaCppEmbedder {
+ public:
+  static absl::StatusOr<std::unique_ptr<LlamaCppEmbedder>> Create(
+      const LlamaCppEmbedderOptions& options);
+
+  // Creates an embedder on top of an already loaded `model`, which may be
+  // shared. `options.model_path` is ignored.
+  static absl::StatusOr<std::unique_ptr<LlamaCppEmbedder>> Create(
+      const LlamaCppEmbedderOptions& options,
+      std::shared_ptr<llama_model> model);
+
+  ~LlamaCppEmbedder();
+
+  // Returns one embedding per text, in order. Thread-safe; concurrent calls
+  // are serialized.
+  absl::StatusOr<std::vector<std::vector<float>>> Embed(
+      absl::Span<const std::string> texts) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  int dimension() const { return llama_n_embd(model_.get()); }
+
+  // Size of the state of the embedder's context, in bytes. Doesn't count the
+  // weights of the model.
+  int64_t memory_size() const;
+
+  // Disallow copy and assign.
+  LlamaCppEmbedder(const LlamaCppEmbedder&) = delete;
+  LlamaCppEmbedder& operator=(const LlamaCppEmbedder&) = delete;
+
+ private:
+  LlamaCppEmbedder(const LlamaCppEmbedderOptions& options,
+                   std::shared_ptr<llama_model> model, llama_context* context);
+
+  // Decodes the texts of `tokens` from `begin` to `end` in one batch, and
+  // writes their embeddings into `embeddings`.
+  absl::Status EmbedBatch(const std::vector<std::vector<llama_token>>& tokens,
+                          int begin, int end,
+                          std::vector<std::vector<float>>& embeddings)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const LlamaCppEmbedderOptions options_;
+  const std::shared_ptr<llama_model> model_;
+
+  absl::Mutex mutex_;
+  llama_context* const context_ ABSL_PT_GUARDED_BY(mutex_);
+  llama_batch batch_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_BACKENDS_LLAMACPP_EMBEDDER_H_
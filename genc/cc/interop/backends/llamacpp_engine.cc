@@ -0,0 +1,697 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/interop/backends/llamacpp_batching.h"
+#include "genc/cc/interop/backends/llamacpp_sampler.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "llama.h"
+
+namespace genc {
+namespace {
+
+constexpr int kMaxTokenLength = 32;  // Max token length in characters.
+
+void AddToBatch(llama_batch& batch, llama_token id, llama_pos pos,
+                llama_seq_id seq_id, bool logits) {
+  batch.token[batch.n_tokens] = id;
+  batch.pos[batch.n_tokens] = pos;
+  batch.n_seq_id[batch.n_tokens] = 1;
+  batch.seq_id[batch.n_tokens][0] = seq_id;
+  batch.logits[batch.n_tokens] = logits;
+  batch.n_tokens++;
+}
+
+// Appends the text of `token` to `output` without intermediate allocations
+// for the common case of short pieces.
+void AppendTokenPiece(const llama_model* model, llama_token token,
+                      std::string* output) {
+  char piece[kMaxTokenLength];
+  int n_chars = llama_token_to_piece(model, token, piece, sizeof(piece));
+  if (n_chars >= 0) {
+    output->append(piece, n_chars);
+    return;
+  }
+  const size_t offset = output->size();
+  output->resize(offset - n_chars);
+  llama_token_to_piece(model, token, output->data() + offset, -n_chars);
+}
+
+// Offsets the seed by the slot, so that slots don't produce identical samples.
+LlamaCppSamplingOptions SlotSampling(LlamaCppSamplingOptions sampling,
+                                     int slot) {
+  sampling.seed += slot;
+  return sampling;
+}
+
+}  // namespace
+
+struct LlamaCppEngine::Request {
+  std::vector<llama_token> tokens;
+  LlamaCppRequestOptions options;
+  absl::Time start_time;
+  absl::StatusOr<std::string> result;
+  absl::Notification done;
+};
+
+absl::StatusOr<std::shared_ptr<llama_model>> LlamaCppEngine::LoadModel(
+    absl::string_view model_path) {
+  llama_backend_init();
+  llama_model_params model_params = llama_model_default_params();
+  // Map the weights rather than reading them, so that pages are shared with
+  // the page cache and can be reclaimed by the OS under memory pressure.
+  model_params.use_mmap = true;
+  const std::string path(model_path);
+  llama_model* model = llama_load_model_from_file(path.c_str(), model_params);
+  if (!model) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("LlamaCpp unable to load a model from file \"", path,
+                     "\" with the default params."));
+  }
+  return std::shared_ptr<llama_model>(model, llama_free_model);
+}
+
+absl::StatusOr<std::unique_ptr<LlamaCppEngine>> LlamaCppEngine::Create(
+    const LlamaCppEngineOptions& options) {
+  std::shared_ptr<llama_model> model = GENC_TRY(LoadModel(options.model_path));
+  return Create(options, std::move(model));
+}
+
+absl::StatusOr<std::unique_ptr<LlamaCppEngine>> LlamaCppEngine::Create(
+    const LlamaCppEngineOptions& options, std::shared_ptr<llama_model> model,
+    std::shared_ptr<llama_model> draft_model) {
+  if (options.num_slots < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid number of slots: ", options.num_slots));
+  }
+  if (options.prefix_cache_size < 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid prefix cache size: ", options.prefix_cache_size));
+  }
+  if (options.n_ctx < 2 || options.n_batch < 1 || options.n_ubatch < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid context or batch size: n_ctx=", options.n_ctx,
+        ", n_batch=", options.n_batch, ", n_ubatch=", options.n_ubatch));
+  }
+  const bool has_draft = !options.draft_model_path.empty();
+  if (has_draft && options.num_draft_tokens < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid number of draft tokens: ", options.num_draft_tokens));
+  }
+  llama_context_params ctx_params = llama_context_default_params();
+  ctx_params.seed = 1234;
+  ctx_params.n_ctx =
+      options.n_ctx * (options.num_slots + options.prefix_cache_size);
+  ctx_params.n_batch = options.n_batch;
+  ctx_params.n_threads = options.num_threads;
+  ctx_params.n_threads_batch = options.num_threads;
+  llama_context* context =
+      llama_new_context_with_model(model.get(), ctx_params);
+  if (!context) {
+    return absl::InternalError("LlamaCpp unable to create a context.");
+  }
+  // Each generating slot decodes its last token plus its draft tokens.
+  const int tokens_per_slot = has_draft ? options.num_draft_tokens + 1 : 1;
+  const int n_batch = llama_n_batch(context);
+  if (n_batch < options.num_slots * tokens_per_slot) {
+    llama_free(context);
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Number of slots ", options.num_slots, " times ", tokens_per_slot,
+        " tokens per slot exceeds the batch size ", n_batch));
+  }
+
+  llama_context* draft_context = nullptr;
+  if (!has_draft) {
+    draft_model = nullptr;
+  } else {
+    if (draft_model == nullptr) {
+      absl::StatusOr<std::shared_ptr<llama_model>> loaded =
+          LoadModel(options.draft_model_path);
+      if (!loaded.ok()) {
+        llama_free(context);
+        return loaded.status();
+      }
+      draft_model = *std::move(loaded);
+    }
+    if (llama_n_vocab(draft_model.get()) != llama_n_vocab(model.get())) {
+      llama_free(context);
+      return absl::InvalidArgumentError(
+          absl::StrCat("Draft model \"", options.draft_model_path,
+                       "\" has a different vocabulary than the target."));
+    }
+    // The draft model only holds the generation slots.
+    ctx_params.n_ctx = options.n_ctx * options.num_slots;
+    draft_context = llama_new_context_with_model(draft_model.get(), ctx_params);
+    if (!draft_context) {
+      llama_free(context);
+      return absl::InternalError(
+          "LlamaCpp unable to create a context for the draft model.");
+    }
+  }
+  return absl::WrapUnique(
+      new LlamaCppEngine(options, std::move(model), context,
+                         std::move(draft_model), draft_context));
+}
+
+LlamaCppEngine::LlamaCppEngine(const LlamaCppEngineOptions& options,
+                               std::shared_ptr<llama_model> model,
+                               llama_context* context,
+                               std::shared_ptr<llama_model> draft_model,
+                               llama_context* draft_context)
+    : options_(options),
+      model_(std::move(model)),
+      context_(context),
+      n_ctx_per_slot_(llama_n_ctx(context) /
+                      (options.num_slots + options.prefix_cache_size)),
+      draft_model_(std::move(draft_model)),
+      draft_context_(draft_context),
+      batch_(llama_batch_init(llama_n_batch(context), 0,
+                              options.num_slots + options.prefix_cache_size)),
+      draft_batch_(llama_batch_init(
+          draft_context ? llama_n_batch(draft_context) : 1, 0,
+          options.num_slots)),
+      slots_(options.num_slots + options.prefix_cache_size) {
+  if (draft_context_ != nullptr) {
+    // Drafts are always greedy; sampling only happens on the target model.
+    draft_sampler_ = std::make_unique<LlamaCppSampler>(
+        LlamaCppSamplingOptions(), llama_n_vocab(draft_model_.get()));
+  }
+  for (int i = 0; i < static_cast<int>(slots_.size()); ++i) {
+    slots_[i].seq_id = i;
+    slots_[i].is_saved_prefix = (i >= options.num_slots);
+    if (!slots_[i].is_saved_prefix) {
+      slots_[i].sampler = std::make_unique<LlamaCppSampler>(
+          SlotSampling(options.sampling, i), llama_n_vocab(model_.get()));
+    }
+  }
+  thread_ = std::thread([this]() { Run(); });
+}
+
+LlamaCppEngine::~LlamaCppEngine() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  thread_.join();
+  llama_batch_free(batch_);
+  llama_batch_free(draft_batch_);
+  llama_free(context_);
+  if (draft_context_ != nullptr) {
+    llama_free(draft_context_);
+  }
+}
+
+absl::StatusOr<std::vector<llama_token>> LlamaCppEngine::Tokenize(
+    absl::string_view prompt) const {
+  // Max token size, plus one for BOS.
+  std::vector<llama_token> tokens(prompt.size() + 1);
+  int n_tokens = llama_tokenize(model_.get(), prompt.data(), prompt.size(),
+                                tokens.data(), tokens.size(),
+                                /*add_bos=*/true, /*special=*/true);
+  // If a negative token length is returned, resize to a larger container.
+  if (n_tokens < 0) {
+    tokens.resize(-n_tokens);
+    n_tokens = llama_tokenize(model_.get(), prompt.data(), prompt.size(),
+                              tokens.data(), tokens.size(),
+                              /*add_bos=*/true, /*special=*/true);
+  }
+  if (n_tokens < 0) {
+    return absl::InternalError("Unable to tokenize the prompt.");
+  }
+  tokens.resize(n_tokens);
+  return tokens;
+}
+
+int64_t LlamaCppEngine::memory_size() const {
+  int64_t size = llama_get_state_size(context_);
+  if (draft_context_ != nullptr) {
+    size += llama_get_state_size(draft_context_);
+  }
+  return size;
+}
+
+absl::StatusOr<std::string> LlamaCppEngine::Generate(
+    absl::string_view prompt) {
+  LlamaCppRequestOptions options;
+  options.max_tokens = options_.max_tokens;
+  options.sampling = options_.sampling;
+  return Generate(prompt, options);
+}
+
+absl::StatusOr<std::string> LlamaCppEngine::Generate(
+    absl::string_view prompt, const LlamaCppRequestOptions& options) {
+  if (options.max_tokens < 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid max_tokens: ", options.max_tokens));
+  }
+  Request request;
+  request.tokens = GENC_TRY(Tokenize(prompt));
+  request.options = options;
+  GENC_TRY(EnqueueAndWait(request, /*save_prefix=*/false));
+  return std::move(request.result);
+}
+
+absl::Status LlamaCppEngine::SavePrefix(absl::string_view prefix) {
+  if (options_.prefix_cache_size == 0) {
+    return absl::FailedPreconditionError(
+        "LlamaCpp engine was created without a prefix cache.");
+  }
+  Request request;
+  request.tokens = GENC_TRY(Tokenize(prefix));
+  GENC_TRY(EnqueueAndWait(request, /*save_prefix=*/true));
+  return request.result.status();
+}
+
+absl::Status LlamaCppEngine::EnqueueAndWait(Request& request,
+                                            bool save_prefix) {
+  if (request.tokens.empty()) {
+    return absl::InvalidArgumentError("Empty prompt.");
+  }
+  // Leave room for at least one generated token.
+  if (request.tokens.size() >= static_cast<size_t>(n_ctx_per_slot_)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Prompt of ", request.tokens.size(),
+                     " tokens is too large for the context size of ",
+                     n_ctx_per_slot_, "."));
+  }
+  request.start_time = absl::Now();
+  {
+    absl::MutexLock lock(&mutex_);
+    if (stopping_) {
+      return absl::CancelledError("LlamaCpp engine is shutting down.");
+    }
+    (save_prefix ? save_prefix_queue_ : queue_).push_back(&request);
+  }
+  request.done.WaitForNotification();
+  return absl::OkStatus();
+}
+
+void LlamaCppEngine::Run() {
+  while (true) {
+    const int num_active = AdmitRequests();
+    {
+      absl::MutexLock lock(&mutex_);
+      if (stopping_) {
+        break;
+      }
+      if (num_active == 0) {
+        mutex_.Await(absl::Condition(
+            this, &LlamaCppEngine::HasQueuedRequestsOrStopping));
+        continue;
+      }
+    }
+    Step();
+  }
+
+  for (Slot& slot : slots_) {
+    if (slot.request != nullptr) {
+      FinishSlot(slot, absl::CancelledError("LlamaCpp engine shut down."));
+    }
+  }
+  absl::MutexLock lock(&mutex_);
+  for (std::deque<Request*>* queue : {&queue_, &save_prefix_queue_}) {
+    for (Request* request : *queue) {
+      request->result = absl::CancelledError("LlamaCpp engine shut down.");
+      request->done.Notify();
+    }
+    queue->clear();
+  }
+}
+
+int LlamaCppEngine::AdmitRequests() {
+  size_t num_free = 0;
+  size_t num_free_saved_prefixes = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.request == nullptr) {
+      ++(slot.is_saved_prefix ? num_free_saved_prefixes : num_free);
+    }
+  }
+
+  // Only pop the requests under the lock; matching them against the cache
+  // happens outside of it.
+  std::vector<Request*> generate_requests;
+  std::vector<Request*> save_prefix_requests;
+  {
+    absl::MutexLock lock(&mutex_);
+    while (!queue_.empty() && generate_requests.size() < num_free) {
+      generate_requests.push_back(queue_.front());
+      queue_.pop_front();
+    }
+    while (!save_prefix_queue_.empty() &&
+           save_prefix_requests.size() < num_free_saved_prefixes) {
+      save_prefix_requests.push_back(save_prefix_queue_.front());
+      save_prefix_queue_.pop_front();
+    }
+  }
+  // Saved prefixes are admitted first, so that generate requests admitted in
+  // the same step don't seed themselves from a prefix that is being replaced.
+  for (Request* request : save_prefix_requests) {
+    AdmitSavePrefixRequest(request);
+  }
+  for (Request* request : generate_requests) {
+    AdmitGenerateRequest(request);
+  }
+
+  int num_active = 0;
+  for (const Slot& slot : slots_) {
+    if (slot.request != nullptr) {
+      ++num_active;
+    }
+  }
+  return num_active;
+}
+
+std::vector<CachedSequence> LlamaCppEngine::CachedSequences() const {
+  std::vector<CachedSequence> sequences(slots_.size());
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    sequences[i].tokens = slots_[i].cached_tokens;
+    sequences[i].is_saved_prefix = slots_[i].is_saved_prefix;
+    sequences[i].busy = slots_[i].request != nullptr;
+    sequences[i].last_used = slots_[i].last_used;
+  }
+  return sequences;
+}
+
+void LlamaCppEngine::AdmitGenerateRequest(Request* request) {
+  const std::vector<llama_token>& tokens = request->tokens;
+  // There is a free slot for every admitted request.
+  const PrefixMatch match = MatchPrefix(CachedSequences(), tokens);
+  Slot& slot = slots_[match.sequence];
+  if (match.saved_prefix >= 0) {
+    // Sequences share the copied cells, so this doesn't copy any tensors.
+    Slot& saved_prefix = slots_[match.saved_prefix];
+    TruncateCache(slot, 0);
+    llama_kv_cache_seq_cp(context_, saved_prefix.seq_id, slot.seq_id, 0,
+                          match.n_reuse);
+    slot.cached_tokens.assign(tokens.begin(), tokens.begin() + match.n_reuse);
+    saved_prefix.last_used = num_steps_;
+  } else {
+    TruncateCache(slot, match.n_reuse);
+  }
+  slot.request = request;
+  slot.sampler->SetOptions(
+      SlotSampling(request->options.sampling, slot.seq_id));
+  slot.pending.assign(tokens.begin() + match.n_reuse, tokens.end());
+  slot.pending_offset = 0;
+  slot.output.clear();
+  slot.num_generated = 0;
+  slot.num_drafted = 0;
+  slot.num_accepted = 0;
+}
+
+void LlamaCppEngine::AdmitSavePrefixRequest(Request* request) {
+  // There is a free saved prefix slot for every admitted request.
+  Slot& target =
+      slots_[ChooseSavedPrefixSequence(CachedSequences(), request->tokens)];
+  target.last_used = num_steps_;
+  if (target.cached_tokens == request->tokens) {
+    request->result = std::string();
+    request->done.Notify();
+    return;
+  }
+  TruncateCache(target, 0);
+  target.request = request;
+  target.pending = request->tokens;
+  target.pending_offset = 0;
+}
+
+void LlamaCppEngine::TruncateCache(Slot& slot, int n_keep) {
+  if (static_cast<size_t>(n_keep) < slot.cached_tokens.size()) {
+    llama_kv_cache_seq_rm(context_, slot.seq_id, n_keep, -1);
+    slot.cached_tokens.resize(n_keep);
+  }
+}
+
+void LlamaCppEngine::TruncateDraftCache(Slot& slot, int n_keep) {
+  if (static_cast<size_t>(n_keep) < slot.draft_cached_tokens.size()) {
+    llama_kv_cache_seq_rm(draft_context_, slot.seq_id, n_keep, -1);
+    slot.draft_cached_tokens.resize(n_keep);
+  }
+}
+
+void LlamaCppEngine::Draft() {
+  for (Slot& slot : slots_) {
+    slot.drafts.clear();
+  }
+  if (draft_context_ == nullptr) {
+    return;
+  }
+  const int n_batch = llama_n_batch(draft_context_);
+  draft_batch_.n_tokens = 0;
+
+  // Slots being drafted for, the index of their logits in the draft batch,
+  // and the number of tokens to draft.
+  struct Drafting {
+    Slot* slot;
+    int i_batch;
+    int n_draft;
+  };
+  std::vector<Drafting> drafting;
+
+  // First bring the draft cache of each generating slot up to date with the
+  // target's, including the last sampled token. Slots with more missing
+  // tokens than fit in the batch catch up over several steps, and skip
+  // drafting until they have.
+  for (Slot& slot : slots_) {
+    if (slot.request == nullptr || !slot.pending.empty() ||
+        slot.is_saved_prefix) {
+      continue;
+    }
+    const int n_cached = slot.cached_tokens.size();
+    const int n_draft =
+        NumDraftTokens(options_.num_draft_tokens,
+                       slot.request->options.max_tokens,
+                       slot.num_generated, n_ctx_per_slot_, n_cached);
+    if (n_draft == 0) {
+      continue;
+    }
+    const int n_common =
+        CommonPrefixLength(slot.draft_cached_tokens, slot.cached_tokens);
+    TruncateDraftCache(slot, n_common);
+    const int n_room = n_batch - draft_batch_.n_tokens;
+    if (n_cached - n_common + 1 > n_room) {
+      for (int i = n_common; i < n_common + n_room && i < n_cached; ++i) {
+        AddToBatch(draft_batch_, slot.cached_tokens[i], i, slot.seq_id, false);
+        slot.draft_cached_tokens.push_back(slot.cached_tokens[i]);
+      }
+      continue;
+    }
+    for (int i = n_common; i < n_cached; ++i) {
+      AddToBatch(draft_batch_, slot.cached_tokens[i], i, slot.seq_id, false);
+      slot.draft_cached_tokens.push_back(slot.cached_tokens[i]);
+    }
+    AddToBatch(draft_batch_, slot.last_token,
+               slot.draft_cached_tokens.size(), slot.seq_id, true);
+    slot.draft_cached_tokens.push_back(slot.last_token);
+    drafting.push_back({&slot, draft_batch_.n_tokens - 1, n_draft});
+  }
+
+  // Then extend each of them one greedy token at a time, all in one batch.
+  while (draft_batch_.n_tokens > 0) {
+    if (llama_decode(draft_context_, draft_batch_) != 0) {
+      LOG(WARNING) << "llama_decode() failed for the draft model.";
+      for (Slot& slot : slots_) {
+        if (!slot.is_saved_prefix) {
+          TruncateDraftCache(slot, 0);
+          slot.drafts.clear();
+        }
+      }
+      return;
+    }
+    draft_batch_.n_tokens = 0;
+    std::vector<Drafting> next;
+    for (Drafting& entry : drafting) {
+      Slot& slot = *entry.slot;
+      const llama_token token = draft_sampler_->Sample(
+          llama_get_logits_ith(draft_context_, entry.i_batch), {});
+      if (token == llama_token_eos(model_.get())) {
+        continue;
+      }
+      slot.drafts.push_back(token);
+      if (static_cast<int>(slot.drafts.size()) == entry.n_draft) {
+        continue;
+      }
+      AddToBatch(draft_batch_, token, slot.draft_cached_tokens.size(),
+                 slot.seq_id, true);
+      slot.draft_cached_tokens.push_back(token);
+      next.push_back({&slot, draft_batch_.n_tokens - 1, entry.n_draft});
+    }
+    drafting = std::move(next);
+  }
+}
+
+void LlamaCppEngine::Step() {
+  ++num_steps_;
+  Draft();
+
+  // Sequences that are generating decode their last token each, followed by
+  // their draft tokens. There is always room for these, since the number of
+  // slots is capped by the batch size. Sequences still prefilling decode the
+  // next chunk of the uncached part of their prompt, as far as what is left of
+  // the batch allows.
+  std::vector<SequenceWork> work(slots_.size());
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    const Slot& slot = slots_[i];
+    if (slot.request == nullptr) {
+      continue;
+    }
+    if (slot.pending.empty()) {
+      work[i].generating = true;
+      work[i].n_drafts = slot.drafts.size();
+    } else {
+      work[i].n_pending = slot.pending.size() - slot.pending_offset;
+    }
+  }
+  const std::vector<int> n_tokens =
+      PlanBatch(work, llama_n_batch(context_), options_.n_ubatch);
+
+  batch_.n_tokens = 0;
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    Slot& slot = slots_[i];
+    slot.i_batch = -1;
+    slot.in_batch = n_tokens[i] > 0;
+    if (work[i].generating) {
+      AddToBatch(batch_, slot.last_token, slot.cached_tokens.size(),
+                 slot.seq_id, true);
+      slot.cached_tokens.push_back(slot.last_token);
+      slot.i_batch = batch_.n_tokens - 1;
+      for (llama_token token : slot.drafts) {
+        AddToBatch(batch_, token, slot.cached_tokens.size(), slot.seq_id,
+                   true);
+        slot.cached_tokens.push_back(token);
+      }
+      continue;
+    }
+    if (n_tokens[i] == 0) {
+      continue;
+    }
+    for (int j = 0; j < n_tokens[i]; ++j) {
+      AddToBatch(batch_, slot.pending[slot.pending_offset + j],
+                 slot.cached_tokens.size(), slot.seq_id, false);
+      slot.cached_tokens.push_back(slot.pending[slot.pending_offset + j]);
+    }
+    slot.pending_offset += n_tokens[i];
+    // Only the last chunk needs logits.
+    if (static_cast<size_t>(slot.pending_offset) == slot.pending.size()) {
+      slot.pending.clear();
+      slot.pending_offset = 0;
+      batch_.logits[batch_.n_tokens - 1] = true;
+      slot.i_batch = batch_.n_tokens - 1;
+    }
+  }
+
+  if (batch_.n_tokens == 0) {
+    return;
+  }
+  if (llama_decode(context_, batch_) != 0) {
+    for (Slot& slot : slots_) {
+      if (slot.in_batch) {
+        TruncateCache(slot, 0);
+        FinishSlot(slot, absl::InternalError("llama_decode() failed"));
+      }
+    }
+    return;
+  }
+  num_decoded_tokens_ += batch_.n_tokens;
+
+  for (Slot& slot : slots_) {
+    if (slot.i_batch < 0) {
+      continue;
+    }
+    if (slot.is_saved_prefix) {
+      FinishSlot(slot, std::string());
+      continue;
+    }
+    // Sample after the last verified token, and keep going for as long as the
+    // sampled token is the next draft token, whose logits are also in the
+    // batch.
+    const int n_drafts = slot.drafts.size();
+    const int n_verified = slot.cached_tokens.size() - n_drafts;
+    const DraftVerification verification = VerifyDrafts(
+        slot.drafts, llama_token_eos(model_.get()),
+        [&](int n_accepted) {
+          return slot.sampler->Sample(
+              llama_get_logits_ith(context_, slot.i_batch + n_accepted),
+              absl::MakeConstSpan(slot.cached_tokens.data(),
+                                  n_verified + n_accepted));
+        },
+        [&](llama_token token, int n_accepted) {
+          AppendTokenPiece(model_.get(), token, &slot.output);
+          ++slot.num_generated;
+          // The token would be decoded at position `n_past` next.
+          const int n_past = n_verified + n_accepted;
+          return slot.num_generated < slot.request->options.max_tokens &&
+                 n_past < n_ctx_per_slot_;
+        });
+    // Drop the rejected draft tokens from the cache.
+    TruncateCache(slot, n_verified + verification.n_accepted);
+    slot.num_drafted += n_drafts;
+    slot.num_accepted += verification.n_accepted;
+    if (verification.finished) {
+      FinishSlot(slot, std::move(slot.output));
+      continue;
+    }
+    slot.last_token = verification.last_token;
+  }
+}
+
+void LlamaCppEngine::FinishSlot(Slot& slot,
+                                absl::StatusOr<std::string> result) {
+  if (!slot.is_saved_prefix) {
+    const absl::Duration duration = absl::Now() - slot.request->start_time;
+    LOG(INFO) << "Slot " << slot.seq_id << " generated " << slot.num_generated
+              << " tokens in " << duration << ", speed: "
+              << slot.num_generated / absl::ToDoubleSeconds(duration)
+              << " t/s";
+    if (draft_context_ != nullptr && slot.num_drafted > 0) {
+      LOG(INFO) << "Slot " << slot.seq_id << " accepted "
+                << slot.num_accepted << " of " << slot.num_drafted
+                << " draft tokens ("
+                << 100.0 * slot.num_accepted / slot.num_drafted << "%).";
+    }
+  }
+
+  // The request may be destroyed as soon as it is notified. The tokens stay
+  // in the KV cache for the next request admitted into this slot to reuse.
+  slot.request->result = std::move(result);
+  slot.request->done.Notify();
+  slot.request = nullptr;
+  slot.pending.clear();
+  slot.pending_offset = 0;
+  slot.i_batch = -1;
+}
+
+}  // namespace genc
@@ -0,0 +1,277 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_BACKENDS_LLAMACPP_ENGINE_H_
+#define GENC_CC_INTEROP_BACKENDS_LLAMACPP_ENGINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "genc/cc/interop/backends/llamacpp_batching.h"
+#include "genc/cc/interop/backends/llamacpp_sampler.h"
+#include "llama.h"
+
+namespace genc {
+
+// Options of a single request, which may differ between the requests that
+// one engine serves.
+struct LlamaCppRequestOptions {
+  // Maximum number of tokens generated, not counting the prompt.
+  int max_tokens = 32;
+
+  LlamaCppSamplingOptions sampling;
+};
+
+struct LlamaCppEngineOptions {
+  std::string model_path;
+  int num_threads = 1;
+
+  // Options of the requests made with `Generate(prompt)`. Only these two
+  // don't shape the engine's context.
+  int max_tokens = 32;
+  LlamaCppSamplingOptions sampling;
+
+  // Size of the KV cache of each sequence, which bounds the prompt plus the
+  // generated tokens.
+  int n_ctx = 1024;
+
+  // Maximum number of tokens decoded together in one step, across sequences.
+  int n_batch = 512;
+
+  // Maximum number of prompt tokens a single sequence submits per step. Long
+  // prompts are prefilled over several steps, interleaved with the generation
+  // of the other sequences, so they never stall them for long.
+  int n_ubatch = 512;
+
+  // Number of sequences that can be decoded together in one batch. Each slot
+  // gets its own share of the KV cache.
+  int num_slots = 1;
+
+  // Number of additional KV cache sequences reserved for prefixes saved with
+  // `SavePrefix` (e.g., hot system prompts). Zero disables the store.
+  int prefix_cache_size = 0;
+
+  // Path to a smaller model with the same vocabulary for speculative
+  // decoding. Empty disables it.
+  std::string draft_model_path;
+
+  // Number of tokens the draft model proposes per step, which the target model
+  // then verifies in one decode.
+  int num_draft_tokens = 4;
+};
+
+// A continuous-batching inference engine for a single llama.cpp model.
+//
+// The engine keeps one llama_context whose KV cache is partitioned into
+// `num_slots` sequences. A background thread admits queued requests into free
+// slots between decode steps, and each step decodes the next token of every
+// active sequence (or the prompt of a newly admitted one) in a single
+// llama_decode call. Requests that arrive while others are mid-generation thus
+// join the running batch instead of waiting for it to drain.
+//
+// Slots keep their tokens in the KV cache after a request completes. A new
+// request is admitted into the free slot sharing the longest common prefix
+// with its prompt (or seeded from the longest matching saved prefix), only the
+// divergent tail is removed from the cache, and only the new tokens are
+// decoded. Multi-turn sessions that resend a long, mostly identical prompt
+// thus only pay for what changed since the previous turn.
+//
+// With a draft model, each step first lets the draft model greedily propose a
+// few tokens per generating sequence, then decodes them all with the target
+// model in the same batch. Proposed tokens are accepted for as long as they
+// match what the target model samples itself, so the output is the same as
+// without a draft model, but each step can commit several tokens.
+class LlamaCppEngine {
+ public:
+  static absl::StatusOr<std::unique_ptr<LlamaCppEngine>> Create(
+      const LlamaCppEngineOptions& options);
+
+  // Creates an engine on top of an already loaded `model`, which may be shared
+  // with other engines. `options.model_path` is ignored. The draft model is
+  // loaded from `options.draft_model_path`, unless `draft_model` is given.
+  static absl::StatusOr<std::unique_ptr<LlamaCppEngine>> Create(
+      const LlamaCppEngineOptions& options, std::shared_ptr<llama_model> model,
+      std::shared_ptr<llama_model> draft_model = nullptr);
+
+  // Loads the model at `model_path` with its weights memory-mapped. The model
+  // is freed when the last reference to it is released.
+  static absl::StatusOr<std::shared_ptr<llama_model>> LoadModel(
+      absl::string_view model_path);
+
+  // Fails any requests still in flight, and releases the context (and the
+  // model, if this engine holds the last reference to it).
+  ~LlamaCppEngine();
+
+  // Generates a completion for `prompt`. Blocks until the completion is ready.
+  // Thread-safe; concurrent calls are batched together, whatever their
+  // options.
+  absl::StatusOr<std::string> Generate(absl::string_view prompt);
+  absl::StatusOr<std::string> Generate(absl::string_view prompt,
+                                       const LlamaCppRequestOptions& options);
+
+  // Decodes `prefix` into the saved prefix store, so that later prompts that
+  // start with it can skip decoding it. Evicts the least recently used saved
+  // prefix if the store is full. Blocks until the prefix is decoded.
+  absl::Status SavePrefix(absl::string_view prefix);
+
+  // Size of the state of the engine's contexts, which is mostly their KV
+  // caches, in bytes. Doesn't count the weights of the models.
+  int64_t memory_size() const;
+
+  // Number of tokens decoded by the target model so far, whether of prompts,
+  // saved prefixes or generated tokens.
+  int64_t num_decoded_tokens() const { return num_decoded_tokens_; }
+
+  // Disallow copy and assign.
+  LlamaCppEngine(const LlamaCppEngine&) = delete;
+  LlamaCppEngine& operator=(const LlamaCppEngine&) = delete;
+
+ private:
+  struct Request;
+
+  // A sequence in the KV cache, and the request (if any) it is serving.
+  struct Slot {
+    llama_seq_id seq_id = 0;
+    Request* request = nullptr;
+
+    // Whether this slot belongs to the saved prefix store.
+    bool is_saved_prefix = false;
+
+    // Tokens of this sequence held in the KV cache, in order.
+    std::vector<llama_token> cached_tokens;
+
+    // Step at which a saved prefix was last used, for LRU eviction.
+    int64_t last_used = 0;
+
+    // Prompt tokens not yet submitted for decoding, from `pending_offset` on.
+    std::vector<llama_token> pending;
+    int pending_offset = 0;
+
+    // Whether this slot has tokens in the current batch.
+    bool in_batch = false;
+
+    // Number of tokens generated for the current request.
+    int num_generated = 0;
+
+    // The last sampled token, to be fed back in the next step.
+    llama_token last_token = 0;
+
+    // Sampler with buffers preallocated for the vocabulary, reused across
+    // requests. Null for slots of the saved prefix store.
+    std::unique_ptr<LlamaCppSampler> sampler;
+
+    // Index in the current batch whose logits belong to this slot, or -1.
+    // With draft tokens, the logits of the following indices too.
+    int i_batch = -1;
+
+    // Tokens of this sequence held in the draft model's KV cache, and the
+    // tokens it proposed for the current step.
+    std::vector<llama_token> draft_cached_tokens;
+    std::vector<llama_token> drafts;
+
+    // Number of draft tokens proposed and accepted for the current request.
+    int num_drafted = 0;
+    int num_accepted = 0;
+
+    std::string output;
+  };
+
+  LlamaCppEngine(const LlamaCppEngineOptions& options,
+                 std::shared_ptr<llama_model> model, llama_context* context,
+                 std::shared_ptr<llama_model> draft_model,
+                 llama_context* draft_context);
+
+  absl::StatusOr<std::vector<llama_token>> Tokenize(
+      absl::string_view prompt) const;
+
+  // Runs the scheduling loop until the engine is destroyed.
+  void Run();
+
+  // Moves queued requests into free slots. Returns the number of active slots.
+  int AdmitRequests() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns what the admission of a request needs to know of the slots.
+  std::vector<CachedSequence> CachedSequences() const;
+
+  // Assigns `request` to the free generation slot that can reuse the most of
+  // its prompt from the KV cache, and trims the slot's cache to that prefix.
+  void AdmitGenerateRequest(Request* request);
+
+  // Assigns `request` to a slot of the saved prefix store.
+  void AdmitSavePrefixRequest(Request* request);
+
+  // Keeps the first `n_keep` cached tokens of `slot`, and drops the rest.
+  void TruncateCache(Slot& slot, int n_keep);
+
+  // Fills the `drafts` of the generating slots with tokens proposed by the
+  // draft model, if any.
+  void Draft();
+
+  // Keeps the first `n_keep` tokens in the draft cache of `slot`.
+  void TruncateDraftCache(Slot& slot, int n_keep);
+
+  // Decodes one batch across all active slots, and samples their next tokens.
+  void Step();
+
+  // Completes the request in `slot` with `result`, and frees the slot.
+  void FinishSlot(Slot& slot, absl::StatusOr<std::string> result);
+
+  bool HasQueuedRequestsOrStopping() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return stopping_ || !queue_.empty() || !save_prefix_queue_.empty();
+  }
+
+  // Enqueues `request` and blocks until it completes.
+  absl::Status EnqueueAndWait(Request& request, bool save_prefix)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  const LlamaCppEngineOptions options_;
+  const std::shared_ptr<llama_model> model_;
+  llama_context* const context_;
+  const int n_ctx_per_slot_;
+
+  // Null without speculative decoding.
+  const std::shared_ptr<llama_model> draft_model_;
+  llama_context* const draft_context_;
+  std::unique_ptr<LlamaCppSampler> draft_sampler_;
+
+  // Owned by the scheduling thread. Generation slots come first, followed by
+  // the slots of the saved prefix store.
+  llama_batch batch_;
+  llama_batch draft_batch_;
+  std::vector<Slot> slots_;
+  int64_t num_steps_ = 0;
+  std::atomic<int64_t> num_decoded_tokens_{0};
+
+  absl::Mutex mutex_;
+  std::deque<Request*> queue_ ABSL_GUARDED_BY(mutex_);
+  std::deque<Request*> save_prefix_queue_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  std::thread thread_;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_BACKENDS_LLAMACPP_ENGINE_H_
@@ -0,0 +1,301 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_registry.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "genc/cc/interop/backends/llamacpp_embedder.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "llama.h"
+
+namespace genc {
+namespace {
+
+// Returns a key covering the model and every option that shapes the context
+// of an engine.
+std::string EngineKey(const LlamaCppEngineOptions& options) {
+  return absl::StrCat(options.model_path, ",", options.num_threads, ",",
+                      options.n_ctx, ",", options.n_batch, ",",
+                      options.n_ubatch, ",", options.num_slots, ",",
+                      options.prefix_cache_size, ",",
+                      options.draft_model_path, ",", options.num_draft_tokens);
+}
+
+std::string EmbedderKey(const LlamaCppEmbedderOptions& options) {
+  return absl::StrCat(options.model_path, ",", options.num_threads, ",",
+                      options.n_batch, ",", static_cast<int>(options.pooling),
+                      ",", options.normalize);
+}
+
+}  // namespace
+
+LlamaCppModelRegistry::LlamaCppModelRegistry(int64_t memory_budget_bytes)
+    : memory_budget_bytes_(memory_budget_bytes) {}
+
+LlamaCppModelRegistry& LlamaCppModelRegistry::Global() {
+  static LlamaCppModelRegistry* registry = new LlamaCppModelRegistry();
+  return *registry;
+}
+
+template <typename T>
+std::shared_ptr<T> LlamaCppModelRegistry::Find(const std::string& model_path,
+                                               const std::string& key) {
+  absl::MutexLock lock(&mutex_);
+  ContextMap<T>& contexts = Contexts(static_cast<const T*>(nullptr));
+  auto it = contexts.find(key);
+  if (it == contexts.end()) {
+    return nullptr;
+  }
+  it->second.last_used = ++num_lookups_;
+  models_[model_path].last_used = num_lookups_;
+  return it->second.context;
+}
+
+absl::StatusOr<std::shared_ptr<llama_model>>
+LlamaCppModelRegistry::GetOrLoadModel(const std::string& model_path) {
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = models_.find(model_path);
+    if (it != models_.end()) {
+      it->second.last_used = ++num_lookups_;
+      return it->second.model;
+    }
+  }
+  std::shared_ptr<llama_model> model =
+      GENC_TRY(LlamaCppEngine::LoadModel(model_path));
+  const int64_t size_bytes = llama_model_size(model.get());
+  absl::MutexLock lock(&mutex_);
+  if (!EvictUntilFits(size_bytes)) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "LlamaCpp model \"", model_path, "\" of ", size_bytes,
+        " bytes doesn't fit in the memory budget of ", memory_budget_bytes_,
+        " bytes, with ", memory_usage_,
+        " bytes held by models and contexts in use."));
+  }
+  ModelEntry& entry = models_[model_path];
+  entry.model = model;
+  entry.size_bytes = size_bytes;
+  entry.last_used = ++num_lookups_;
+  memory_usage_ += size_bytes;
+  LOG(INFO) << "Loaded LlamaCpp model " << model_path << " (" << size_bytes
+            << " bytes), " << memory_usage_ << " bytes in use by "
+            << models_.size() << " models.";
+  return model;
+}
+
+template <typename T>
+absl::StatusOr<std::shared_ptr<T>> LlamaCppModelRegistry::Register(
+    const std::string& key, std::unique_ptr<T> context) {
+  const int64_t size_bytes = context->memory_size();
+  absl::MutexLock lock(&mutex_);
+  if (!EvictUntilFits(size_bytes)) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "LlamaCpp context of ", size_bytes,
+        " bytes doesn't fit in the memory budget of ", memory_budget_bytes_,
+        " bytes, with ", memory_usage_,
+        " bytes held by models and contexts in use."));
+  }
+  memory_usage_ += size_bytes;
+  ContextEntry<T>& entry = Contexts(static_cast<const T*>(nullptr))[key];
+  entry.context = std::move(context);
+  entry.size_bytes = size_bytes;
+  entry.last_used = ++num_lookups_;
+  return entry.context;
+}
+
+template <typename T>
+typename LlamaCppModelRegistry::ContextMap<T>::iterator
+LlamaCppModelRegistry::FindLruIdle(ContextMap<T>& contexts) {
+  // The registry holds one reference to each context; any other means a
+  // caller still uses it.
+  auto lru = contexts.end();
+  for (auto it = contexts.begin(); it != contexts.end(); ++it) {
+    if (it->second.context.use_count() > 1) {
+      continue;
+    }
+    if (lru == contexts.end() ||
+        it->second.last_used < lru->second.last_used) {
+      lru = it;
+    }
+  }
+  return lru;
+}
+
+absl::StatusOr<std::shared_ptr<LlamaCppEngine>>
+LlamaCppModelRegistry::GetOrCreate(const LlamaCppEngineOptions& options,
+                                   bool* created) {
+  if (created != nullptr) {
+    *created = false;
+  }
+  const std::string key = EngineKey(options);
+  if (std::shared_ptr<LlamaCppEngine> engine =
+          Find<LlamaCppEngine>(options.model_path, key)) {
+    return engine;
+  }
+
+  absl::MutexLock load_lock(&load_mutex_);
+  // Another caller may have created it while this one waited.
+  if (std::shared_ptr<LlamaCppEngine> engine =
+          Find<LlamaCppEngine>(options.model_path, key)) {
+    return engine;
+  }
+  // Holding the models keeps them from being evicted for the next ones.
+  std::shared_ptr<llama_model> model =
+      GENC_TRY(GetOrLoadModel(options.model_path));
+  std::shared_ptr<llama_model> draft_model;
+  if (!options.draft_model_path.empty()) {
+    draft_model = GENC_TRY(GetOrLoadModel(options.draft_model_path));
+  }
+  std::unique_ptr<LlamaCppEngine> engine = GENC_TRY(LlamaCppEngine::Create(
+      options, std::move(model), std::move(draft_model)));
+  std::shared_ptr<LlamaCppEngine> shared =
+      GENC_TRY(Register(key, std::move(engine)));
+  if (created != nullptr) {
+    *created = true;
+  }
+  return shared;
+}
+
+absl::StatusOr<std::shared_ptr<LlamaCppEmbedder>>
+LlamaCppModelRegistry::GetOrCreateEmbedder(
+    const LlamaCppEmbedderOptions& options) {
+  const std::string key = EmbedderKey(options);
+  if (std::shared_ptr<LlamaCppEmbedder> embedder =
+          Find<LlamaCppEmbedder>(options.model_path, key)) {
+    return embedder;
+  }
+
+  absl::MutexLock load_lock(&load_mutex_);
+  if (std::shared_ptr<LlamaCppEmbedder> embedder =
+          Find<LlamaCppEmbedder>(options.model_path, key)) {
+    return embedder;
+  }
+  std::shared_ptr<llama_model> model =
+      GENC_TRY(GetOrLoadModel(options.model_path));
+  std::unique_ptr<LlamaCppEmbedder> embedder =
+      GENC_TRY(LlamaCppEmbedder::Create(options, std::move(model)));
+  return Register(key, std::move(embedder));
+}
+
+bool LlamaCppModelRegistry::EvictUntilFits(int64_t extra_bytes) {
+  if (memory_budget_bytes_ <= 0) {
+    return true;
+  }
+  while (memory_usage_ + extra_bytes > memory_budget_bytes_) {
+    // Idle contexts go first: they are cheaper to recreate than models, and
+    // each holds its model, which can only be evicted after it.
+    auto engine = FindLruIdle(engines_);
+    auto embedder = FindLruIdle(embedders_);
+    if (engine != engines_.end() &&
+        (embedder == embedders_.end() ||
+         engine->second.last_used < embedder->second.last_used)) {
+      LOG(INFO) << "Evicting idle LlamaCpp engine " << engine->first << " ("
+                << engine->second.size_bytes << " bytes).";
+      memory_usage_ -= engine->second.size_bytes;
+      engines_.erase(engine);
+      continue;
+    }
+    if (embedder != embedders_.end()) {
+      LOG(INFO) << "Evicting idle LlamaCpp embedder " << embedder->first
+                << " (" << embedder->second.size_bytes << " bytes).";
+      memory_usage_ -= embedder->second.size_bytes;
+      embedders_.erase(embedder);
+      continue;
+    }
+
+    // The registry holds one reference to each model; any other means an
+    // engine or embedder, or a caller loading one, still uses it.
+    auto lru = models_.end();
+    for (auto it = models_.begin(); it != models_.end(); ++it) {
+      if (it->second.model.use_count() > 1) {
+        continue;
+      }
+      if (lru == models_.end() ||
+          it->second.last_used < lru->second.last_used) {
+        lru = it;
+      }
+    }
+    if (lru == models_.end()) {
+      return false;
+    }
+    LOG(INFO) << "Evicting LlamaCpp model " << lru->first << " ("
+              << lru->second.size_bytes << " bytes).";
+    memory_usage_ -= lru->second.size_bytes;
+    models_.erase(lru);
+  }
+  return true;
+}
+
+void LlamaCppModelRegistry::SetMemoryBudget(int64_t memory_budget_bytes) {
+  // Don't evict a model between `GetOrCreate` loading it and creating an
+  // engine on it.
+  absl::MutexLock load_lock(&load_mutex_);
+  absl::MutexLock lock(&mutex_);
+  memory_budget_bytes_ = memory_budget_bytes;
+  if (!EvictUntilFits(0)) {
+    LOG(WARNING) << "LlamaCpp models and contexts in use take "
+                 << memory_usage_ << " bytes, over the budget of "
+                 << memory_budget_bytes_ << " bytes.";
+  }
+}
+
+absl::Status LlamaCppModelRegistry::RequireMemoryBudget(
+    int64_t memory_budget_bytes) {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (memory_budget_bytes_ == memory_budget_bytes) {
+      return absl::OkStatus();
+    }
+    if (memory_budget_bytes_ > 0) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Conflicting LlamaCpp memory budgets: ", memory_budget_bytes,
+          " bytes, while ", memory_budget_bytes_, " bytes are already set."));
+    }
+  }
+  SetMemoryBudget(memory_budget_bytes);
+  return absl::OkStatus();
+}
+
+int64_t LlamaCppModelRegistry::memory_budget_bytes() const {
+  absl::MutexLock lock(&mutex_);
+  return memory_budget_bytes_;
+}
+
+int64_t LlamaCppModelRegistry::memory_usage() const {
+  absl::MutexLock lock(&mutex_);
+  return memory_usage_;
+}
+
+int LlamaCppModelRegistry::num_models() const {
+  absl::MutexLock lock(&mutex_);
+  return models_.size();
+}
+
+int LlamaCppModelRegistry::num_contexts() const {
+  absl::MutexLock lock(&mutex_);
+  return engines_.size() + embedders_.size();
+}
+
+}  // namespace genc
@@ -0,0 +1,175 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_BACKENDS_LLAMACPP_REGISTRY_H_
+#define GENC_CC_INTEROP_BACKENDS_LLAMACPP_REGISTRY_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "genc/cc/interop/backends/llamacpp_embedder.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+#include "llama.h"
+
+namespace genc {
+
+// Serves llama.cpp engines and embedders for any number of models from one
+// process.
+//
+// Models are keyed by path and loaded (memory-mapped) on first use, whether as
+// the model of an engine or embedder or as the draft model of an engine. Each
+// model can back several engines, one per distinct context and batch shape
+// (slots, context size, threads, draft model, etc.), which share the model's
+// weights. Options that only affect single requests, the sampling options
+// and `max_tokens`, are not part of the shape: requests that differ in those
+// share an engine, and pass them to `LlamaCppEngine::Generate`.
+//
+// Engines and embedders stay registered while idle, with their KV caches and
+// saved prefixes, so that later calls with the same shape reuse them. Callers
+// hold a `shared_ptr` for as long as they use one. Models stay loaded as long
+// as any engine or embedder on them does.
+//
+// With a non-zero memory budget, loading a model or creating an engine or
+// embedder that would take the total size of the loaded weights and of the
+// contexts over the budget first evicts idle engines and embedders, least
+// recently used first, and then idle models, least recently used first.
+class LlamaCppModelRegistry {
+ public:
+  // Zero `memory_budget_bytes` means no budget.
+  explicit LlamaCppModelRegistry(int64_t memory_budget_bytes = 0);
+
+  // The process-wide registry, used by `CallLlamaCpp`.
+  static LlamaCppModelRegistry& Global();
+
+  // Returns the engine for the shape of `options`, loading its models and
+  // creating it if needed. If `created` is non-null, it is set to whether the
+  // engine was created by this call. Returns `ResourceExhaustedError` if the
+  // models or the engine do not fit in the budget even after evicting every
+  // idle context and model.
+  absl::StatusOr<std::shared_ptr<LlamaCppEngine>> GetOrCreate(
+      const LlamaCppEngineOptions& options, bool* created = nullptr)
+      ABSL_LOCKS_EXCLUDED(load_mutex_, mutex_);
+
+  // Returns the embedder for `options`, loading its model and creating it if
+  // needed, within the budget as above.
+  absl::StatusOr<std::shared_ptr<LlamaCppEmbedder>> GetOrCreateEmbedder(
+      const LlamaCppEmbedderOptions& options)
+      ABSL_LOCKS_EXCLUDED(load_mutex_, mutex_);
+
+  // Changes the budget. Idle contexts and models are evicted right away if
+  // over it.
+  void SetMemoryBudget(int64_t memory_budget_bytes)
+      ABSL_LOCKS_EXCLUDED(load_mutex_, mutex_);
+
+  // Sets the budget if none is set yet, and fails with
+  // `InvalidArgumentError` if a different one is. For budgets that come with
+  // each of many configs, which must then agree.
+  absl::Status RequireMemoryBudget(int64_t memory_budget_bytes)
+      ABSL_LOCKS_EXCLUDED(load_mutex_, mutex_);
+
+  int64_t memory_budget_bytes() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Total size of the weights of the loaded models, and of the state of the
+  // contexts of the registered engines and embedders, in bytes.
+  int64_t memory_usage() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  int num_models() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Number of registered engines and embedders, idle or not.
+  int num_contexts() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Disallow copy and assign.
+  LlamaCppModelRegistry(const LlamaCppModelRegistry&) = delete;
+  LlamaCppModelRegistry& operator=(const LlamaCppModelRegistry&) = delete;
+
+ private:
+  struct ModelEntry {
+    std::shared_ptr<llama_model> model;
+    int64_t size_bytes = 0;
+    int64_t last_used = 0;
+  };
+
+  template <typename T>
+  struct ContextEntry {
+    std::shared_ptr<T> context;
+    int64_t size_bytes = 0;
+    int64_t last_used = 0;
+  };
+
+  template <typename T>
+  using ContextMap = absl::flat_hash_map<std::string, ContextEntry<T>>;
+
+  // Returns the engines or embedders, picked by the type of the argument.
+  ContextMap<LlamaCppEngine>& Contexts(const LlamaCppEngine*)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return engines_;
+  }
+  ContextMap<LlamaCppEmbedder>& Contexts(const LlamaCppEmbedder*)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return embedders_;
+  }
+
+  // Returns the engine or embedder for `key` if it is registered, and marks it
+  // and its model as used.
+  template <typename T>
+  std::shared_ptr<T> Find(const std::string& model_path,
+                          const std::string& key) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the model at `model_path`, loading it if needed.
+  absl::StatusOr<std::shared_ptr<llama_model>> GetOrLoadModel(
+      const std::string& model_path)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(load_mutex_) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Accounts for the newly created `context` in the budget, and registers it
+  // under `key`. Fails if it doesn't fit.
+  template <typename T>
+  absl::StatusOr<std::shared_ptr<T>> Register(const std::string& key,
+                                              std::unique_ptr<T> context)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the least recently used idle engine or embedder of `contexts`, or
+  // `contexts.end()` if callers hold all of them.
+  template <typename T>
+  static typename ContextMap<T>::iterator FindLruIdle(ContextMap<T>& contexts);
+
+  // Evicts idle engines and embedders, and then idle models, least recently
+  // used first, until `extra_bytes` more fit in the budget. Returns whether
+  // they fit.
+  bool EvictUntilFits(int64_t extra_bytes)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Serializes loading models and creating engines, which are slow, without
+  // blocking lookups of the ones already loaded.
+  absl::Mutex load_mutex_ ABSL_ACQUIRED_BEFORE(mutex_);
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, ModelEntry> models_ ABSL_GUARDED_BY(mutex_);
+  // Keyed by model path and shape.
+  ContextMap<LlamaCppEngine> engines_ ABSL_GUARDED_BY(mutex_);
+  ContextMap<LlamaCppEmbedder> embedders_ ABSL_GUARDED_BY(mutex_);
+  int64_t memory_budget_bytes_ ABSL_GUARDED_BY(mutex_);
+  int64_t memory_usage_ ABSL_GUARDED_BY(mutex_) = 0;
+  int64_t num_lookups_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_BACKENDS_LLAMACPP_REGISTRY_H_
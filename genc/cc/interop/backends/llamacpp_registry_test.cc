@@ -0,0 +1,140 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_registry.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "genc/cc/interop/backends/llamacpp.h"
+#include "genc/cc/interop/backends/llamacpp_engine.h"
+#include "genc/proto/v0/computation.pb.h"
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace genc {
+namespace {
+
+// These tests need a GGUF model, e.g. a small one like TinyLlama, at the path
+// in `GENC_LLAMACPP_TEST_MODEL`, and are skipped without one.
+std::optional<std::string> TestModelPath() {
+  const char* path = std::getenv("GENC_LLAMACPP_TEST_MODEL");
+  if (path == nullptr || *path == '\0') {
+    return std::nullopt;
+  }
+  return path;
+}
+
+LlamaCppEngineOptions EngineOptions(const std::string& model_path,
+                                    int n_ctx) {
+  LlamaCppEngineOptions options;
+  options.model_path = model_path;
+  options.n_ctx = n_ctx;
+  options.max_tokens = 4;
+  return options;
+}
+
+TEST(LlamaCppModelRegistryTest, KeepsIdleEnginesForReuse) {
+  std::optional<std::string> model_path = TestModelPath();
+  if (!model_path.has_value()) {
+    GTEST_SKIP() << "GENC_LLAMACPP_TEST_MODEL is not set.";
+  }
+  LlamaCppModelRegistry registry;
+  bool created = false;
+  absl::StatusOr<std::shared_ptr<LlamaCppEngine>> engine =
+      registry.GetOrCreate(EngineOptions(*model_path, 256), &created);
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  EXPECT_TRUE(created);
+  const LlamaCppEngine* first = engine->get();
+  ASSERT_TRUE((*engine)->Generate("Hello").ok());
+  const int64_t num_decoded_tokens = (*engine)->num_decoded_tokens();
+  engine->reset();
+
+  engine = registry.GetOrCreate(EngineOptions(*model_path, 256), &created);
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  EXPECT_FALSE(created);
+  EXPECT_EQ(engine->get(), first);
+  EXPECT_EQ((*engine)->num_decoded_tokens(), num_decoded_tokens);
+  EXPECT_EQ(registry.num_contexts(), 1);
+}
+
+TEST(LlamaCppModelRegistryTest, EvictsIdleEnginesBeforeModels) {
+  std::optional<std::string> model_path = TestModelPath();
+  if (!model_path.has_value()) {
+    GTEST_SKIP() << "GENC_LLAMACPP_TEST_MODEL is not set.";
+  }
+  LlamaCppModelRegistry registry;
+  ASSERT_TRUE(registry.GetOrCreate(EngineOptions(*model_path, 512)).ok());
+  ASSERT_EQ(registry.num_contexts(), 1);
+  // The idle engine and its model fill the budget, and a smaller engine on the
+  // same model only fits in place of the idle one.
+  registry.SetMemoryBudget(registry.memory_usage());
+  EXPECT_EQ(registry.num_contexts(), 1);
+
+  absl::StatusOr<std::shared_ptr<LlamaCppEngine>> engine =
+      registry.GetOrCreate(EngineOptions(*model_path, 256));
+  ASSERT_TRUE(engine.ok()) << engine.status();
+  EXPECT_EQ(registry.num_models(), 1);
+  EXPECT_EQ(registry.num_contexts(), 1);
+  EXPECT_LE(registry.memory_usage(), registry.memory_budget_bytes());
+
+  // Nothing is idle while the engine is in use.
+  EXPECT_FALSE(registry.GetOrCreate(EngineOptions(*model_path, 512)).ok());
+}
+
+TEST(LlamaCppModelRegistryTest, DecodesSavedPrefixesOnce) {
+  std::optional<std::string> model_path = TestModelPath();
+  if (!model_path.has_value()) {
+    GTEST_SKIP() << "GENC_LLAMACPP_TEST_MODEL is not set.";
+  }
+  v0::Value config;
+  v0::Value* param = config.mutable_struct_()->add_element();
+  param->set_label("model_path");
+  param->set_str(*model_path);
+  param = config.mutable_struct_()->add_element();
+  param->set_label("n_ctx");
+  param->set_int_32(256);
+  param = config.mutable_struct_()->add_element();
+  param->set_label("saved_prefix");
+  param->set_str("You are a helpful assistant.");
+  LlamaCppEngineOptions options = EngineOptions(*model_path, 256);
+  options.prefix_cache_size = 1;
+
+  int64_t num_decoded_tokens = 0;
+  {
+    LlamaCpp client;
+    ASSERT_TRUE(client.InitModel(config).ok());
+    std::shared_ptr<LlamaCppEngine> engine =
+        *LlamaCppModelRegistry::Global().GetOrCreate(options);
+    // More decoding than the prefix alone, which a new engine would redo.
+    ASSERT_TRUE(engine->Generate("Hello").ok());
+    num_decoded_tokens = engine->num_decoded_tokens();
+  }
+
+  // No caller holds the engine between the two clients.
+  LlamaCpp client;
+  ASSERT_TRUE(client.InitModel(config).ok());
+  bool created = true;
+  std::shared_ptr<LlamaCppEngine> engine =
+      *LlamaCppModelRegistry::Global().GetOrCreate(options, &created);
+  EXPECT_FALSE(created);
+  EXPECT_EQ(engine->num_decoded_tokens(), num_decoded_tokens);
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,185 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#include "absl/types/span.h"
+
+namespace genc {
+namespace {
+
+// Tokens whose logit is more than this many temperature units below the
+// maximum have a probability under e^-16 (~1e-7) relative to the most likely
+// token, and are left out of the candidate set.
+constexpr float kLogitCutoff = 16.0f;
+
+// Number of independent accumulators in the reductions below. Splitting the
+// dependency chain lets the compiler keep them in one vector register.
+constexpr int kLanes = 8;
+
+float MaxLogit(const float* logits, int n) {
+  float lanes[kLanes];
+  std::fill(lanes, lanes + kLanes, logits[0]);
+  int i = 0;
+  for (; i + kLanes <= n; i += kLanes) {
+    for (int j = 0; j < kLanes; ++j) {
+      lanes[j] = logits[i + j] > lanes[j] ? logits[i + j] : lanes[j];
+    }
+  }
+  float max_logit = lanes[0];
+  for (int j = 1; j < kLanes; ++j) {
+    max_logit = std::max(max_logit, lanes[j]);
+  }
+  for (; i < n; ++i) {
+    max_logit = std::max(max_logit, logits[i]);
+  }
+  return max_logit;
+}
+
+int32_t ArgMax(const float* logits, int n) {
+  const float max_logit = MaxLogit(logits, n);
+  for (int32_t i = 0; i < n; ++i) {
+    if (logits[i] == max_logit) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+LlamaCppSampler::LlamaCppSampler(const LlamaCppSamplingOptions& options,
+                                 int n_vocab)
+    : options_(options),
+      n_vocab_(n_vocab),
+      rng_(options.seed),
+      logits_(n_vocab),
+      penalized_stamp_(n_vocab),
+      candidate_ids_(n_vocab),
+      candidate_probs_(n_vocab) {}
+
+void LlamaCppSampler::SetOptions(const LlamaCppSamplingOptions& options) {
+  if (options.temperature == options_.temperature &&
+      options.top_k == options_.top_k && options.top_p == options_.top_p &&
+      options.repetition_penalty == options_.repetition_penalty &&
+      options.repetition_last_n == options_.repetition_last_n &&
+      options.seed == options_.seed) {
+    return;
+  }
+  options_ = options;
+  rng_.seed(options.seed);
+}
+
+const float* LlamaCppSampler::ApplyRepetitionPenalty(
+    const float* logits, absl::Span<const int32_t> history) {
+  if (options_.repetition_penalty == 1.0f || options_.repetition_last_n <= 0 ||
+      history.empty()) {
+    return logits;
+  }
+  std::memcpy(logits_.data(), logits, n_vocab_ * sizeof(float));
+  if (history.size() > static_cast<size_t>(options_.repetition_last_n)) {
+    history.remove_prefix(history.size() - options_.repetition_last_n);
+  }
+  ++stamp_;
+  for (int32_t id : history) {
+    if (id < 0 || id >= n_vocab_ || penalized_stamp_[id] == stamp_) {
+      continue;
+    }
+    penalized_stamp_[id] = stamp_;
+    // Same convention as llama.cpp: shrink positive logits, and grow negative
+    // ones, so that the penalty always makes the token less likely.
+    float& logit = logits_[id];
+    logit = logit > 0 ? logit / options_.repetition_penalty
+                      : logit * options_.repetition_penalty;
+  }
+  return logits_.data();
+}
+
+void LlamaCppSampler::CollectCandidates(const float* logits,
+                                        float max_logit) {
+  const float threshold = max_logit - kLogitCutoff * options_.temperature;
+  int32_t* ids = candidate_ids_.data();
+  int n = 0;
+  // Branch-free compaction: every id is written, but the cursor only advances
+  // past those above the threshold.
+  for (int32_t id = 0; id < n_vocab_; ++id) {
+    ids[n] = id;
+    n += logits[id] >= threshold;
+  }
+  num_candidates_ = n;
+}
+
+int32_t LlamaCppSampler::Sample(const float* logits,
+                                absl::Span<const int32_t> history) {
+  const float* const penalized = ApplyRepetitionPenalty(logits, history);
+  if (options_.temperature <= 0.0f) {
+    return ArgMax(penalized, n_vocab_);
+  }
+
+  const float max_logit = MaxLogit(penalized, n_vocab_);
+  CollectCandidates(penalized, max_logit);
+  int32_t* const ids = candidate_ids_.data();
+  auto by_logit = [penalized](int32_t a, int32_t b) {
+    return penalized[a] > penalized[b];
+  };
+
+  int n = num_candidates_;
+  if (options_.top_k > 0 && n > options_.top_k) {
+    std::nth_element(ids, ids + options_.top_k - 1, ids + n, by_logit);
+    n = options_.top_k;
+  }
+  if (options_.top_p < 1.0f) {
+    std::sort(ids, ids + n, by_logit);
+  }
+
+  const float inv_temperature = 1.0f / options_.temperature;
+  float* const probs = candidate_probs_.data();
+  float total = 0.0f;
+  for (int i = 0; i < n; ++i) {
+    probs[i] = std::exp((penalized[ids[i]] - max_logit) * inv_temperature);
+    total += probs[i];
+  }
+
+  if (options_.top_p < 1.0f) {
+    const float target = options_.top_p * total;
+    float cumulative = 0.0f;
+    for (int i = 0; i < n; ++i) {
+      cumulative += probs[i];
+      if (cumulative >= target) {
+        n = i + 1;
+        break;
+      }
+    }
+    total = cumulative;
+  }
+
+  float r = std::uniform_real_distribution<float>(0.0f, total)(rng_);
+  for (int i = 0; i < n; ++i) {
+    r -= probs[i];
+    if (r < 0.0f) {
+      return ids[i];
+    }
+  }
+  return ids[n - 1];
+}
+
+}  // namespace genc
@@ -0,0 +1,101 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_BACKENDS_LLAMACPP_SAMPLER_H_
+#define GENC_CC_INTEROP_BACKENDS_LLAMACPP_SAMPLER_H_
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace genc {
+
+struct LlamaCppSamplingOptions {
+  // Softmax temperature. Zero or less selects greedy decoding, in which case
+  // `top_k` and `top_p` have no effect.
+  float temperature = 0.0f;
+
+  // Number of most likely tokens to sample among. Zero keeps all of them.
+  int top_k = 0;
+
+  // Smallest set of most likely tokens whose cumulative probability reaches
+  // `top_p` to sample among. One keeps all of them.
+  float top_p = 1.0f;
+
+  // Penalty applied to the logits of tokens among the last
+  // `repetition_last_n` of the sequence. One disables the penalty.
+  float repetition_penalty = 1.0f;
+  int repetition_last_n = 64;
+
+  uint32_t seed = 1234;
+};
+
+// Samples tokens from a model's logits with repetition penalty, temperature,
+// top-k and top-p.
+//
+// All working buffers are sized to the vocabulary once on construction, so
+// sampling a token doesn't allocate. Each pass over the vocabulary is a plain
+// loop over contiguous floats that the compiler can vectorize: the maximum
+// logit is found first, and only tokens whose probability is non-negligible
+// relative to it are compacted into the (typically small) candidate set that
+// top-k and top-p then sort and truncate.
+//
+// Not thread-safe; use one sampler per sequence.
+class LlamaCppSampler {
+ public:
+  LlamaCppSampler(const LlamaCppSamplingOptions& options, int n_vocab);
+
+  // Returns the next token given the `n_vocab` logits of the last position,
+  // and the tokens of the sequence so far for the repetition penalty.
+  int32_t Sample(const float* logits, absl::Span<const int32_t> history);
+
+  const LlamaCppSamplingOptions& options() const { return options_; }
+
+  // Samples with `options` from now on, keeping the buffers. The generator is
+  // only reseeded if they differ from the current ones.
+  void SetOptions(const LlamaCppSamplingOptions& options);
+
+ private:
+  // Returns `logits` with the repetition penalty applied, which is either
+  // `logits` itself if no penalty applies, or a penalized copy in `logits_`.
+  const float* ApplyRepetitionPenalty(const float* logits,
+                                      absl::Span<const int32_t> history);
+
+  // Fills the candidate buffers with the tokens within reach of `max_logit`.
+  void CollectCandidates(const float* logits, float max_logit);
+
+  LlamaCppSamplingOptions options_;
+  const int n_vocab_;
+  std::mt19937 rng_;
+
+  // Penalized copy of the logits, when a penalty applies.
+  std::vector<float> logits_;
+
+  // Per-token stamp of the last call that penalized it, so that repeated
+  // tokens in the history are only penalized once per call.
+  std::vector<uint32_t> penalized_stamp_;
+  uint32_t stamp_ = 0;
+
+  // Candidate tokens, and their unnormalized probabilities.
+  std::vector<int32_t> candidate_ids_;
+  std::vector<float> candidate_probs_;
+  int num_candidates_ = 0;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_BACKENDS_LLAMACPP_SAMPLER_H_
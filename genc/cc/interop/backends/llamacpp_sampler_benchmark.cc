@@ -0,0 +1,137 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Measures the per-token cost of sampling from a vocabulary-sized logits
+// vector, for the sampler used by the llama.cpp backend and, as a baseline,
+// for the previous approach of building a fresh candidate vector per token.
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/interop/backends/llamacpp_sampler.h"
+
+ABSL_FLAG(int, vocab_size, 32000, "Number of logits per token.");
+ABSL_FLAG(int, num_tokens, 2000, "Number of tokens to sample per config.");
+ABSL_FLAG(int, history_size, 256, "Number of tokens in the sequence so far.");
+
+namespace genc {
+namespace {
+
+struct Candidate {
+  int32_t id;
+  float logit;
+  float p;
+};
+
+// Mirrors the per-token work of the original greedy decode loop: a candidate
+// vector that is allocated for every token and filled with the whole
+// vocabulary, followed by a greedy scan.
+int32_t BaselineGreedy(const float* logits, int n_vocab) {
+  std::vector<Candidate> candidates;
+  candidates.reserve(n_vocab);
+  for (int32_t id = 0; id < n_vocab; ++id) {
+    candidates.push_back(Candidate{id, logits[id], 0.0f});
+  }
+  const Candidate* best = &candidates[0];
+  for (const Candidate& candidate : candidates) {
+    if (candidate.logit > best->logit) {
+      best = &candidate;
+    }
+  }
+  return best->id;
+}
+
+template <typename SampleFn>
+void Report(const std::string& name, int num_tokens, SampleFn sample) {
+  int64_t checksum = 0;
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < num_tokens; ++i) {
+    checksum += sample(i);
+  }
+  const absl::Duration per_token = (absl::Now() - start) / num_tokens;
+  std::cout << name << ": " << absl::ToDoubleMicroseconds(per_token)
+            << " us/token (checksum " << checksum << ")\n";
+}
+
+void Run() {
+  const int vocab_size = absl::GetFlag(FLAGS_vocab_size);
+  const int num_tokens = absl::GetFlag(FLAGS_num_tokens);
+
+  // A handful of distinct logit vectors shaped like real model output: most
+  // of the vocabulary is far below a few plausible tokens.
+  constexpr int kNumLogitVectors = 8;
+  std::mt19937 rng(42);
+  std::normal_distribution<float> noise(0.0f, 2.0f);
+  std::vector<std::vector<float>> logits(kNumLogitVectors);
+  for (std::vector<float>& vector : logits) {
+    vector.resize(vocab_size);
+    for (float& logit : vector) {
+      logit = noise(rng);
+    }
+    for (int i = 0; i < 20; ++i) {
+      vector[rng() % vocab_size] += 12.0f;
+    }
+  }
+  std::vector<int32_t> history(absl::GetFlag(FLAGS_history_size));
+  for (int32_t& token : history) {
+    token = rng() % vocab_size;
+  }
+
+  std::cout << "vocab_size=" << vocab_size << "\n";
+  Report("baseline greedy", num_tokens, [&](int i) {
+    return BaselineGreedy(logits[i % kNumLogitVectors].data(), vocab_size);
+  });
+
+  struct Config {
+    std::string name;
+    LlamaCppSamplingOptions options;
+  };
+  std::vector<Config> configs(5);
+  configs[0].name = "greedy";
+  configs[1].name = "greedy + repetition penalty";
+  configs[1].options.repetition_penalty = 1.1f;
+  configs[2].name = "temperature";
+  configs[2].options.temperature = 0.8f;
+  configs[3].name = "temperature + top-k 40";
+  configs[3].options.temperature = 0.8f;
+  configs[3].options.top_k = 40;
+  configs[4].name = "temperature + top-k 40 + top-p 0.95 + penalty";
+  configs[4].options.temperature = 0.8f;
+  configs[4].options.top_k = 40;
+  configs[4].options.top_p = 0.95f;
+  configs[4].options.repetition_penalty = 1.1f;
+  for (const Config& config : configs) {
+    LlamaCppSampler sampler(config.options, vocab_size);
+    Report(config.name, num_tokens, [&](int i) {
+      return sampler.Sample(logits[i % kNumLogitVectors].data(), history);
+    });
+  }
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
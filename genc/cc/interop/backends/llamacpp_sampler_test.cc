@@ -0,0 +1,126 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/backends/llamacpp_sampler.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace genc {
+namespace {
+
+constexpr int kVocabSize = 100;
+
+std::vector<float> CreateLogits() {
+  std::vector<float> logits(kVocabSize, -10.0f);
+  logits[7] = 5.0f;
+  logits[42] = 4.0f;
+  logits[99] = 3.0f;
+  return logits;
+}
+
+TEST(LlamaCppSamplerTest, GreedyPicksMostLikelyToken) {
+  LlamaCppSampler sampler({}, kVocabSize);
+  std::vector<float> logits = CreateLogits();
+  EXPECT_EQ(sampler.Sample(logits.data(), {}), 7);
+}
+
+TEST(LlamaCppSamplerTest, RepetitionPenaltyDemotesRecentTokens) {
+  LlamaCppSamplingOptions options;
+  options.repetition_penalty = 2.0f;
+  LlamaCppSampler sampler(options, kVocabSize);
+  std::vector<float> logits = CreateLogits();
+  std::vector<int32_t> history = {7, 7, 7};
+  EXPECT_EQ(sampler.Sample(logits.data(), history), 42);
+
+  // Only the last `repetition_last_n` tokens are penalized.
+  options.repetition_last_n = 2;
+  LlamaCppSampler short_window_sampler(options, kVocabSize);
+  history = {7, 1, 2};
+  EXPECT_EQ(short_window_sampler.Sample(logits.data(), history), 7);
+}
+
+TEST(LlamaCppSamplerTest, TopKOfOneIsGreedy) {
+  LlamaCppSamplingOptions options;
+  options.temperature = 10.0f;
+  options.top_k = 1;
+  LlamaCppSampler sampler(options, kVocabSize);
+  std::vector<float> logits = CreateLogits();
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(sampler.Sample(logits.data(), {}), 7);
+  }
+}
+
+TEST(LlamaCppSamplerTest, TopPKeepsSmallestSetReachingTarget) {
+  LlamaCppSamplingOptions options;
+  options.temperature = 1.0f;
+  options.top_p = 0.8f;
+  LlamaCppSampler sampler(options, kVocabSize);
+  std::vector<float> logits = CreateLogits();
+  for (int i = 0; i < 100; ++i) {
+    int32_t token = sampler.Sample(logits.data(), {});
+    EXPECT_TRUE(token == 7 || token == 42) << token;
+  }
+}
+
+TEST(LlamaCppSamplerTest, SamplesInProportionToProbabilities) {
+  LlamaCppSamplingOptions options;
+  options.temperature = 1.0f;
+  LlamaCppSampler sampler(options, kVocabSize);
+  std::vector<float> logits(kVocabSize, -100.0f);
+  logits[1] = 0.0f;
+  logits[2] = 0.0f;
+  int num_ones = 0;
+  constexpr int kNumSamples = 10000;
+  for (int i = 0; i < kNumSamples; ++i) {
+    int32_t token = sampler.Sample(logits.data(), {});
+    ASSERT_TRUE(token == 1 || token == 2) << token;
+    num_ones += (token == 1);
+  }
+  EXPECT_NEAR(num_ones, kNumSamples / 2, kNumSamples / 20);
+}
+
+TEST(LlamaCppSamplerTest, SetOptionsReseedsOnlyOnChange) {
+  LlamaCppSamplingOptions options;
+  options.temperature = 1.0f;
+  LlamaCppSampler sampler(options, kVocabSize);
+  LlamaCppSampler reference(options, kVocabSize);
+  std::vector<float> logits(kVocabSize, 0.0f);
+  std::vector<int32_t> samples;
+  for (int i = 0; i < 10; ++i) {
+    samples.push_back(reference.Sample(logits.data(), {}));
+  }
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(sampler.Sample(logits.data(), {}), samples[i]);
+  }
+  // The same options carry on with the same sequence.
+  sampler.SetOptions(options);
+  for (int i = 5; i < 10; ++i) {
+    EXPECT_EQ(sampler.Sample(logits.data(), {}), samples[i]);
+  }
+
+  sampler.SetOptions({});
+  EXPECT_EQ(sampler.Sample(CreateLogits().data(), {}), 7);
+  // Switching back starts over from the seed.
+  sampler.SetOptions(options);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(sampler.Sample(logits.data(), {}), samples[i]);
+  }
+}
+
+}  // namespace
+}  // namespace genc
@@ -13,108 +13,160 @@ See the License for the specific language governing permissions and
 limitations under the License
 ==============================================================================*/
 
-#include <cstddef>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
 #include <curl/curl.h>
 #include <curl/easy.h>
 #include "genc/cc/interop/networking/curl_based_http_client.h"
+#include "genc/cc/interop/networking/curl_handle_pool.h"
+#include "genc/cc/interop/networking/endpoint_limiter.h"
 #include "genc/cc/interop/networking/http_client_interface.h"
+#include "genc/cc/interop/networking/http_compression.h"
 
 namespace genc {
 namespace interop {
 namespace networking {
 namespace {
 
-size_t WriteCallback(
-    void* contents, size_t size, size_t nmemb, std::string* output) {
-  size_t totalSize = size * nmemb;
-  output->append(static_cast<char*>(contents), totalSize);
-  return totalSize;
-}
-
+// Safe to share between concurrent callers. Each call checks out an easy
+// handle of its own from CurlHandlePool::Default(), so no option set for one
+// call leaks into another. Calls go through the process-wide EndpointLimiter.
 class CurlBasedHttpClient : public HttpClientInterface {
  public:
   static absl::StatusOr<std::unique_ptr<CurlBasedHttpClient>> Create(
-      bool debug) {
-    CURL* curl = curl_easy_init();
-    if (curl == nullptr) {
-      return absl::InternalError(
-          "Unable to init CURL.");
-    }
-    if (debug) {
-      curl_easy_setopt(curl, CURLOPT_VERBOSE, 1);
+      bool debug, const HttpCompressionOptions& compression) {
+    absl::Status init = InitCurl();
+    if (!init.ok()) {
+      return init;
     }
-    return absl::WrapUnique<CurlBasedHttpClient>(new CurlBasedHttpClient(curl));
+    return absl::WrapUnique<CurlBasedHttpClient>(
+        new CurlBasedHttpClient(debug, compression));
   }
 
   absl::StatusOr<std::string> GetFromUrl(
       const std::string& url) override {
-    curl_easy_setopt(curl_, CURLOPT_HEADER, 0);
-    curl_easy_setopt(curl_, CURLOPT_HTTPGET, 1);
-    return CallInternal(url);
+    return CallInternal(url, /*socket_path=*/"", /*json_request=*/nullptr);
   }
 
   absl::StatusOr<std::string> PostJsonToUrl(
       const std::string& url,
       const std::string& json_request) override {
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, json_request.c_str());
-    absl::StatusOr<std::string> result = CallInternal(url);
-    curl_slist_free_all(headers);
-    return result;
+    return CallInternal(url, /*socket_path=*/"", &json_request);
   }
 
   absl::StatusOr<std::string> GetFromUrlAndSocket(
       const std::string& url,
       const std::string& socket_path) override {
-    curl_easy_setopt(curl_, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
-    return GetFromUrl(url);
+    return CallInternal(url, socket_path, /*json_request=*/nullptr);
   }
 
   absl::StatusOr<std::string> PostJsonToUrlAndSocket(
       const std::string& url,
       const std::string& socket_path,
       const std::string& json_request) override {
-    curl_easy_setopt(curl_, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
-    return PostJsonToUrl(url, json_request);
+    return CallInternal(url, socket_path, &json_request);
   }
 
-  ~CurlBasedHttpClient() override { curl_easy_cleanup(curl_); }
-
  protected:
-  explicit CurlBasedHttpClient(CURL* curl_arg) : curl_(curl_arg) {}
+  CurlBasedHttpClient(bool debug, const HttpCompressionOptions& compression)
+      : debug_(debug), compression_(compression) {}
+
+  // GETs `url`, or POSTs `json_request` to it if not null.
+  absl::StatusOr<std::string> CallInternal(const std::string& url,
+                                           const std::string& socket_path,
+                                           const std::string* json_request) {
+    std::string endpoint = EndpointLimiter::EndpointOf(url);
+    if (!socket_path.empty()) {
+      endpoint = absl::StrCat(socket_path, ":", endpoint);
+    }
+    // Compressed once for every attempt.
+    std::string compressed_request;
+    const bool compressed =
+        json_request != nullptr &&
+        MaybeCompressRequest(compression_, *json_request, &compressed_request,
+                             CompressionStats::Default());
+    return EndpointLimiter::Default().Call(endpoint, [&]() {
+      return AttemptCall(url, socket_path,
+                         compressed ? &compressed_request : json_request,
+                         compressed);
+    });
+  }
 
-  absl::StatusOr<std::string> CallInternal(const std::string& url) {
-    curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+ private:
+  // Makes one attempt at a call for CallInternal(), with `json_request`
+  // gzip-compressed if `compressed`.
+  EndpointLimiter::Attempt AttemptCall(const std::string& url,
+                                       const std::string& socket_path,
+                                       const std::string* json_request,
+                                       bool compressed) {
+    absl::StatusOr<PooledCurlHandle> pooled = AcquireCurlHandle();
+    if (!pooled.ok()) {
+      return {pooled.status()};
+    }
+    CURL* curl = pooled->get();
+    if (debug_) {
+      curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    if (!socket_path.empty()) {
+      curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
+    }
+    struct curl_slist* headers = nullptr;
+    if (json_request != nullptr) {
+      headers = curl_slist_append(headers, "Content-Type: application/json");
+      if (compressed) {
+        headers = curl_slist_append(headers, "Content-Encoding: gzip");
+      }
+      headers = SetPostBody(curl, *json_request, headers);
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    } else {
+      curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    }
+    AcceptCompressedResponses(compression_, curl);
     std::string response;
-    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response);
-    CURLcode curl_code = curl_easy_perform(curl_);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    CURLcode curl_code = curl_easy_perform(curl);
+    if (curl_code == CURLE_OK) {
+      RecordResponseCompression(curl, response.size(),
+                                CompressionStats::Default());
+    }
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_off_t retry_after = 0;
+    curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+    pooled->reset();
+    curl_slist_free_all(headers);
     if (curl_code != CURLE_OK) {
-      return absl::InternalError(absl::StrCat(
+      return {absl::InternalError(absl::StrCat(
           "Received an error from \"", url, "\": \"",
-          curl_easy_strerror(curl_code), "\"."));
+          curl_easy_strerror(curl_code), "\"."))};
     }
-    return response;
+    return {std::move(response), static_cast<int>(http_code),
+            absl::Seconds(retry_after)};
   }
 
- private:
-  CURL* const curl_;
+  const bool debug_;
+  const HttpCompressionOptions compression_;
 };
 
 }  // namespace
 
 absl::StatusOr<std::shared_ptr<HttpClientInterface>> CreateCurlBasedHttpClient(
     bool debug) {
-  return CurlBasedHttpClient::Create(debug);
+  return CurlBasedHttpClient::Create(debug, HttpCompressionOptions());
+}
+
+absl::StatusOr<std::shared_ptr<HttpClientInterface>> CreateCurlBasedHttpClient(
+    bool debug, const HttpCompressionOptions& compression) {
+  return CurlBasedHttpClient::Create(debug, compression);
 }
 
 }  // namespace networking
@@ -19,14 +19,25 @@ limitations under the License
 #include <memory>
 #include "absl/status/statusor.h"
 #include "genc/cc/interop/networking/http_client_interface.h"
+#include "genc/cc/interop/networking/http_compression.h"
 
 namespace genc {
 namespace interop {
 namespace networking {
 
+// Returns a client that is safe to share between concurrent callers. Calls
+// check out pooled CURL handles, which share DNS lookups, TLS sessions and
+// kept-alive connections. Calls to each endpoint are bounded, paced and
+// retried when throttled by the process-wide EndpointLimiter.
 absl::StatusOr<std::shared_ptr<HttpClientInterface>> CreateCurlBasedHttpClient(
      bool debug);
 
+// Returns a client like the one above, which compresses the bodies of calls
+// as `compression` says, and records the bytes saved in
+// CompressionStats::Default().
+absl::StatusOr<std::shared_ptr<HttpClientInterface>> CreateCurlBasedHttpClient(
+    bool debug, const HttpCompressionOptions& compression);
+
 }  // namespace networking
 }  // namespace interop
 }  // namespace genc
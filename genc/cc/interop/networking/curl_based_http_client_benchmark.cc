@@ -0,0 +1,151 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Measures the throughput and latency of HTTP clients shared by many threads
+// against a local HttpTestServer: the pooled CurlBasedHttpClient, the same
+// client behind one lock, as callers had to use the single-handle client it
+// replaces, and the event-loop CurlMultiHttpClient.
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/interop/networking/curl_based_http_client.h"
+#include "genc/cc/interop/networking/curl_multi_http_client.h"
+#include "genc/cc/interop/networking/http_client_interface.h"
+#include "genc/cc/testing/http_test_server.h"
+
+ABSL_FLAG(int, num_threads, 16, "Number of threads making calls.");
+ABSL_FLAG(int, num_calls, 200, "Number of calls per thread.");
+ABSL_FLAG(int, request_bytes, 1024, "Size of each posted JSON request.");
+ABSL_FLAG(int, response_bytes, 4096, "Size of each response.");
+ABSL_FLAG(int, server_delay_micros, 0, "Time the server takes per call.");
+
+namespace genc {
+namespace interop {
+namespace networking {
+namespace {
+
+using ::genc::testing::HttpTestServer;
+
+using CallFn = std::function<absl::StatusOr<std::string>(
+    const std::string& url, const std::string& json_request)>;
+
+void Measure(const std::string& name, const std::string& url,
+             const CallFn& call) {
+  const int num_threads = absl::GetFlag(FLAGS_num_threads);
+  const int num_calls = absl::GetFlag(FLAGS_num_calls);
+  const std::string json_request =
+      absl::StrCat("{\"text\": \"",
+                   std::string(absl::GetFlag(FLAGS_request_bytes), 'x'),
+                   "\"}");
+  std::vector<std::vector<absl::Duration>> latencies(num_threads);
+  int num_errors = 0;
+  absl::Mutex mutex;
+
+  const absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < num_calls; ++i) {
+        const absl::Time call_start = absl::Now();
+        if (!call(url, json_request).ok()) {
+          absl::MutexLock lock(&mutex);
+          ++num_errors;
+        }
+        latencies[t].push_back(absl::Now() - call_start);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+
+  std::vector<absl::Duration> all;
+  for (const std::vector<absl::Duration>& thread_latencies : latencies) {
+    all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::cout << name << ": " << all.size() / absl::ToDoubleSeconds(elapsed)
+            << " calls/s, p50 " << all[all.size() / 2] << ", p99 "
+            << all[all.size() * 99 / 100] << ", " << num_errors
+            << " errors\n";
+}
+
+void Run() {
+  const std::string response_body(absl::GetFlag(FLAGS_response_bytes), 'y');
+  const absl::Duration delay =
+      absl::Microseconds(absl::GetFlag(FLAGS_server_delay_micros));
+  std::unique_ptr<HttpTestServer> server =
+      HttpTestServer::Start([&](const HttpTestServer::Request&) {
+        HttpTestServer::Response response;
+        response.body = response_body;
+        response.delay = delay;
+        return response;
+      }).value();
+  const std::string url = server->Url("/v1/generate");
+  std::cout << "num_threads=" << absl::GetFlag(FLAGS_num_threads)
+            << " num_calls=" << absl::GetFlag(FLAGS_num_calls)
+            << " request_bytes=" << absl::GetFlag(FLAGS_request_bytes)
+            << " response_bytes=" << absl::GetFlag(FLAGS_response_bytes)
+            << " server_delay=" << delay << "\n";
+
+  std::shared_ptr<HttpClientInterface> pooled =
+      CreateCurlBasedHttpClient(false).value();
+  Measure("pooled", url, [&](const std::string& url, const std::string& json) {
+    return pooled->PostJsonToUrl(url, json);
+  });
+
+  absl::Mutex lock;
+  Measure("one lock", url,
+          [&](const std::string& url, const std::string& json) {
+            absl::MutexLock hold(&lock);
+            return pooled->PostJsonToUrl(url, json);
+          });
+
+  std::unique_ptr<CurlMultiHttpClient> multi =
+      CurlMultiHttpClient::Create({}).value();
+  Measure("event loop", url,
+          [&](const std::string& url, const std::string& json) {
+            return multi->PostJsonToUrl(url, json);
+          });
+
+  std::cout << "server: " << server->num_connections() << " connections, "
+            << server->num_requests() << " requests\n";
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::interop::networking::Run();
+  return 0;
+}
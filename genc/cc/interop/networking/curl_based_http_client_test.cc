@@ -0,0 +1,246 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/curl_based_http_client.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/interop/networking/endpoint_limiter.h"
+#include "genc/cc/interop/networking/http_client_interface.h"
+#include "genc/cc/interop/networking/http_compression.h"
+#include "genc/cc/testing/http_test_server.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+namespace {
+
+using ::genc::testing::HttpTestServer;
+
+// Replies with the name of the server, and what it was asked.
+HttpTestServer::Handler Echo(std::string name) {
+  return [name](const HttpTestServer::Request& request) {
+    HttpTestServer::Response response;
+    response.body = absl::StrCat(name, " ", request.method, " ",
+                                 request.target, " ", request.body);
+    return response;
+  };
+}
+
+std::string SocketPath(absl::string_view name) {
+  return absl::StrCat(::testing::TempDir(), "/", name, ".sock");
+}
+
+TEST(CurlBasedHttpClientTest, DoesNotCarryOptionsOverBetweenCalls) {
+  auto tcp_server = HttpTestServer::Start(Echo("tcp")).value();
+  auto socket_server =
+      HttpTestServer::Start(Echo("unix"), {.socket_path = SocketPath("carry")})
+          .value();
+  auto client = CreateCurlBasedHttpClient(false).value();
+
+  EXPECT_EQ(client
+                ->PostJsonToUrlAndSocket(socket_server->Url("/a"),
+                                         socket_server->socket_path(), "{}")
+                .value(),
+            "unix POST /a {}");
+  // Neither the socket path nor the body of the last call sticks.
+  EXPECT_EQ(client->GetFromUrl(tcp_server->Url("/b")).value(), "tcp GET /b ");
+  EXPECT_EQ(client->PostJsonToUrl(tcp_server->Url("/c"), "[1]").value(),
+            "tcp POST /c [1]");
+  EXPECT_EQ(client->GetFromUrl(tcp_server->Url("/d")).value(), "tcp GET /d ");
+  EXPECT_EQ(client
+                ->GetFromUrlAndSocket(socket_server->Url("/e"),
+                                      socket_server->socket_path())
+                .value(),
+            "unix GET /e ");
+  // Kept-alive connections are reused.
+  EXPECT_EQ(tcp_server->num_connections(), 1);
+  EXPECT_EQ(socket_server->num_connections(), 1);
+}
+
+TEST(CurlBasedHttpClientTest, IsSafeToShareBetweenThreads) {
+  auto tcp_server = HttpTestServer::Start(Echo("tcp")).value();
+  auto socket_server =
+      HttpTestServer::Start(Echo("unix"), {.socket_path = SocketPath("share")})
+          .value();
+  std::shared_ptr<HttpClientInterface> client =
+      CreateCurlBasedHttpClient(false).value();
+
+  constexpr int kNumThreads = 16;
+  constexpr int kNumCalls = 100;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kNumCalls; ++i) {
+        const std::string target = absl::StrCat("/", t, "/", i);
+        const std::string body = absl::StrCat("{\"call\": ", i, "}");
+        switch ((t + i) % 4) {
+          case 0:
+            EXPECT_EQ(client->GetFromUrl(tcp_server->Url(target)).value(),
+                      absl::StrCat("tcp GET ", target, " "));
+            break;
+          case 1:
+            EXPECT_EQ(
+                client->PostJsonToUrl(tcp_server->Url(target), body).value(),
+                absl::StrCat("tcp POST ", target, " ", body));
+            break;
+          case 2:
+            EXPECT_EQ(client
+                          ->GetFromUrlAndSocket(socket_server->Url(target),
+                                                socket_server->socket_path())
+                          .value(),
+                      absl::StrCat("unix GET ", target, " "));
+            break;
+          case 3:
+            EXPECT_EQ(client
+                          ->PostJsonToUrlAndSocket(socket_server->Url(target),
+                                                   socket_server->socket_path(),
+                                                   body)
+                          .value(),
+                      absl::StrCat("unix POST ", target, " ", body));
+            break;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(tcp_server->num_requests() + socket_server->num_requests(),
+            kNumThreads * kNumCalls);
+  // Far fewer connections than calls.
+  EXPECT_LE(tcp_server->num_connections(), kNumThreads);
+  EXPECT_LE(socket_server->num_connections(), kNumThreads);
+}
+
+TEST(CurlBasedHttpClientTest, FailsOnConnectionErrors) {
+  std::string url;
+  {
+    auto server = HttpTestServer::Start(Echo("gone")).value();
+    url = server->Url("/");
+  }
+  auto client = CreateCurlBasedHttpClient(false).value();
+  EXPECT_EQ(client->GetFromUrl(url).status().code(),
+            absl::StatusCode::kInternal);
+}
+
+TEST(CurlBasedHttpClientTest, RetriesThrottledCalls) {
+  std::atomic<int> num_calls{0};
+  auto server =
+      HttpTestServer::Start([&](const HttpTestServer::Request& request) {
+        HttpTestServer::Response response;
+        if (request.target == "/busy") {
+          response.status = 429;
+        } else if (++num_calls == 1) {
+          response.status = 429;
+          response.headers.emplace_back("Retry-After", "1");
+        } else {
+          response.body = "done";
+        }
+        return response;
+      }).value();
+  const std::string url = server->Url("/generate");
+  auto client = CreateCurlBasedHttpClient(false).value();
+
+  const absl::Time start = absl::Now();
+  EXPECT_EQ(client->PostJsonToUrl(absl::StrCat(url, "?key=k"), "{}").value(),
+            "done");
+  EXPECT_GE(absl::Now() - start, absl::Seconds(1));
+  EXPECT_EQ(num_calls, 2);
+  // Calls to every path of the server share its limits.
+  const std::string endpoint = EndpointLimiter::EndpointOf(url);
+  EndpointLimiter::Metrics metrics =
+      EndpointLimiter::Default().metrics().at(endpoint);
+  EXPECT_EQ(metrics.calls, 1);
+  EXPECT_EQ(metrics.throttled, 1);
+
+  // Fails once out of attempts.
+  EndpointLimiter::Options options;
+  options.initial_backoff = absl::Milliseconds(1);
+  options.max_attempts = 2;
+  ASSERT_TRUE(EndpointLimiter::Default().SetOptions(endpoint, options).ok());
+  EXPECT_EQ(client->GetFromUrl(server->Url("/busy")).status().code(),
+            absl::StatusCode::kResourceExhausted);
+  EXPECT_EQ(server->num_requests(), 4);
+}
+
+TEST(CurlBasedHttpClientTest, CompressesLargeBodies) {
+  const std::string large_response(100000, 'r');
+  // Decompresses requests, and compresses the responses of clients that
+  // accept it.
+  auto server =
+      HttpTestServer::Start([&](const HttpTestServer::Request& request) {
+        HttpTestServer::Response response;
+        std::string body = request.body;
+        if (request.header("Content-Encoding") == "gzip") {
+          body = absl::StrCat("gzip:", GzipDecompress(body).value());
+        }
+        response.body = absl::StrCat(body.size(), " ", body.substr(0, 5));
+        if (request.target == "/large") {
+          response.body = large_response;
+          if (absl::StrContains(request.header("Accept-Encoding"), "gzip")) {
+            response.headers.emplace_back("Content-Encoding", "gzip");
+            response.body = GzipCompress(large_response).value();
+          }
+        }
+        return response;
+      }).value();
+  HttpCompressionOptions options;
+  options.accept_compressed_responses = true;
+  options.compress_requests = true;
+  options.min_request_bytes = 1000;
+  auto client = CreateCurlBasedHttpClient(false, options).value();
+  const CompressionStats::Totals sent = CompressionStats::Default().sent();
+  const CompressionStats::Totals received =
+      CompressionStats::Default().received();
+
+  const std::string large_request(50000, 'q');
+  EXPECT_EQ(client->PostJsonToUrl(server->Url("/"), large_request).value(),
+            "50005 gzip:");
+  EXPECT_EQ(client->PostJsonToUrl(server->Url("/"), "{}").value(), "2 {}");
+  EXPECT_EQ(client->GetFromUrl(server->Url("/large")).value(),
+            large_response);
+  EXPECT_EQ(CompressionStats::Default().sent().bodies, sent.bodies + 1);
+  EXPECT_GT(CompressionStats::Default().sent().bytes_saved(),
+            sent.bytes_saved() + 40000);
+  EXPECT_EQ(CompressionStats::Default().received().bodies,
+            received.bodies + 1);
+  EXPECT_GT(CompressionStats::Default().received().bytes_saved(),
+            received.bytes_saved() + 90000);
+
+  // Clients that don't opt in get everything as is.
+  auto plain_client = CreateCurlBasedHttpClient(false).value();
+  EXPECT_EQ(plain_client->PostJsonToUrl(server->Url("/"), large_request)
+                .value(),
+            "50000 qqqqq");
+  EXPECT_EQ(plain_client->GetFromUrl(server->Url("/large")).value(),
+            large_response);
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,129 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/curl_handle_pool.h"
+
+#include <cstddef>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include <curl/curl.h>
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+absl::Status InitCurl() {
+  static const CURLcode global_init = curl_global_init(CURL_GLOBAL_DEFAULT);
+  if (global_init != CURLE_OK) {
+    return absl::InternalError(curl_easy_strerror(global_init));
+  }
+  return absl::OkStatus();
+}
+
+CurlHandlePool& CurlHandlePool::Default() {
+  // Never destroyed, as handles may be in use at exit.
+  static CurlHandlePool* const pool = new CurlHandlePool();
+  return *pool;
+}
+
+CurlHandlePool::CurlHandlePool() {
+  if (!InitCurl().ok()) return;
+  share_ = curl_share_init();
+  if (share_ == nullptr) return;
+  curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &CurlHandlePool::Lock);
+  curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &CurlHandlePool::Unlock);
+  curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+CURL* CurlHandlePool::Acquire() {
+  CURL* curl = nullptr;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!idle_.empty()) {
+      curl = idle_.back();
+      idle_.pop_back();
+    }
+  }
+  if (curl == nullptr) {
+    if (!InitCurl().ok()) return nullptr;
+    curl = curl_easy_init();
+    if (curl == nullptr) return nullptr;
+  }
+  curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+  curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, kMaxIdleConnections);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 60L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 30L);
+  // Signals can't be used for timeouts with handles on many threads.
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  return curl;
+}
+
+void CurlHandlePool::Release(CURL* curl) {
+  curl_easy_reset(curl);
+  {
+    absl::MutexLock lock(&mutex_);
+    if (idle_.size() < kMaxIdleHandles) {
+      idle_.push_back(curl);
+      return;
+    }
+  }
+  curl_easy_cleanup(curl);
+}
+
+void CurlHandlePool::Lock(CURL*, curl_lock_data data, curl_lock_access,
+                          void* pool) ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  static_cast<CurlHandlePool*>(pool)->share_mutexes_[data].Lock();
+}
+
+void CurlHandlePool::Unlock(CURL*, curl_lock_data data, void* pool)
+    ABSL_NO_THREAD_SAFETY_ANALYSIS {
+  static_cast<CurlHandlePool*>(pool)->share_mutexes_[data].Unlock();
+}
+
+absl::StatusOr<PooledCurlHandle> AcquireCurlHandle() {
+  PooledCurlHandle curl(CurlHandlePool::Default().Acquire());
+  if (curl == nullptr) return absl::InternalError("Unable to init CURL.");
+  return curl;
+}
+
+size_t AppendToString(void* contents, size_t size, size_t nmemb,
+                      std::string* output) {
+  size_t totalSize = size * nmemb;
+  output->append(static_cast<char*>(contents), totalSize);
+  return totalSize;
+}
+
+curl_slist* SetPostBody(CURL* curl, absl::string_view body,
+                        curl_slist* headers) {
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.data());
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                   static_cast<curl_off_t>(body.size()));
+  // Send the body right away, instead of waiting a round trip for a
+  // "100 Continue".
+  return curl_slist_append(headers, "Expect:");
+}
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,100 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_NETWORKING_CURL_HANDLE_POOL_H_
+#define GENC_CC_INTEROP_NETWORKING_CURL_HANDLE_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include <curl/curl.h>
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+// Runs curl_global_init() once per process, as curl_easy_init() would do it
+// in a racy way, and returns how it went.
+absl::Status InitCurl();
+
+// Easy handles for reuse, all attached to one process-wide share of DNS
+// lookups, TLS sessions and connections. A handle keeps its connections when
+// it goes back to the pool, and the share lets any handle pick up a
+// connection that another one left open, whichever client it serves.
+class CurlHandlePool final {
+ public:
+  // Most idle handles kept for reuse. Any more are cleaned up when released.
+  static constexpr size_t kMaxIdleHandles = 256;
+
+  // Most idle connections kept open. CURL's default of 5 would close the
+  // shared connections of all but a few concurrent callers.
+  static constexpr long kMaxIdleConnections = 64;
+
+  // The pool shared by every client in the process.
+  static CurlHandlePool& Default();
+
+  // Returns an idle handle, or a new one, set up with the options common to
+  // every call. Returns nullptr if CURL fails.
+  CURL* Acquire();
+
+  // Resets every option of `curl`, which keeps its connections, and keeps it
+  // for reuse. `curl` must not be attached to a multi handle.
+  void Release(CURL* curl);
+
+ private:
+  CurlHandlePool();
+
+  static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* pool);
+  static void Unlock(CURL*, curl_lock_data data, void* pool);
+
+  CURLSH* share_ = nullptr;
+  // One per kind of shared data, which CURL locks separately.
+  absl::Mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+  absl::Mutex mutex_;
+  std::vector<CURL*> idle_ ABSL_GUARDED_BY(mutex_);
+};
+
+struct CurlHandleReleaser {
+  void operator()(CURL* curl) const { CurlHandlePool::Default().Release(curl); }
+};
+
+// A handle of CurlHandlePool::Default(), which goes back to it when reset.
+using PooledCurlHandle = std::unique_ptr<CURL, CurlHandleReleaser>;
+
+// Returns a handle of CurlHandlePool::Default().
+absl::StatusOr<PooledCurlHandle> AcquireCurlHandle();
+
+// A CURLOPT_WRITEFUNCTION that appends the response to the std::string set
+// as CURLOPT_WRITEDATA.
+size_t AppendToString(void* contents, size_t size, size_t nmemb,
+                      std::string* output);
+
+// Sets up `curl` to POST `body`, which must outlive the request. Returns
+// `headers` with the one added for it, to set as CURLOPT_HTTPHEADER.
+curl_slist* SetPostBody(CURL* curl, absl::string_view body,
+                        curl_slist* headers);
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_NETWORKING_CURL_HANDLE_POOL_H_
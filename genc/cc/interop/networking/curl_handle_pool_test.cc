@@ -0,0 +1,90 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/curl_handle_pool.h"
+
+#include <string>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include <curl/curl.h>
+#include "genc/cc/testing/http_test_server.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+namespace {
+
+using ::genc::testing::HttpTestServer;
+
+// Replies with what it was asked, and the size of the body it was sent.
+HttpTestServer::Response Echo(const HttpTestServer::Request& request) {
+  HttpTestServer::Response response;
+  response.body =
+      absl::StrCat(request.method, " ", request.target, " [",
+                   request.header("Expect"), "] ", request.body.size());
+  return response;
+}
+
+// POSTs `body` to `url` with a handle of the default pool.
+std::string Post(const std::string& url, const std::string& body) {
+  PooledCurlHandle curl = AcquireCurlHandle().value();
+  curl_easy_setopt(curl.get(), CURLOPT_URL, url.c_str());
+  curl_slist* headers = SetPostBody(curl.get(), body, nullptr);
+  curl_easy_setopt(curl.get(), CURLOPT_HTTPHEADER, headers);
+  std::string response;
+  curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, AppendToString);
+  curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
+  EXPECT_EQ(curl_easy_perform(curl.get()), CURLE_OK);
+  curl.reset();
+  curl_slist_free_all(headers);
+  return response;
+}
+
+TEST(CurlHandlePoolTest, ReusesReleasedHandles) {
+  CURL* curl = CurlHandlePool::Default().Acquire();
+  ASSERT_NE(curl, nullptr);
+  CurlHandlePool::Default().Release(curl);
+  EXPECT_EQ(CurlHandlePool::Default().Acquire(), curl);
+  CurlHandlePool::Default().Release(curl);
+}
+
+TEST(CurlHandlePoolTest, PostsWithoutWaitingForContinue) {
+  auto server = HttpTestServer::Start(Echo).value();
+  // Large enough that CURL would otherwise send "Expect: 100-continue".
+  const std::string body(2 << 20, 'x');
+  EXPECT_EQ(Post(server->Url("/large"), body), "POST /large [] 2097152");
+}
+
+TEST(CurlHandlePoolTest, HandlesShareConnections) {
+  auto server = HttpTestServer::Start(Echo).value();
+  // Two handles in use at once, so that the second can't be the first one
+  // back from the pool.
+  PooledCurlHandle other = AcquireCurlHandle().value();
+  EXPECT_EQ(Post(server->Url("/1"), "a"), "POST /1 [] 1");
+  curl_easy_setopt(other.get(), CURLOPT_URL, server->Url("/2").c_str());
+  std::string response;
+  curl_easy_setopt(other.get(), CURLOPT_WRITEFUNCTION, AppendToString);
+  curl_easy_setopt(other.get(), CURLOPT_WRITEDATA, &response);
+  EXPECT_EQ(curl_easy_perform(other.get()), CURLE_OK);
+  EXPECT_EQ(response, "GET /2 [] 0");
+  EXPECT_EQ(server->num_connections(), 1);
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,357 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/curl_multi_http_client.h"
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include <curl/curl.h>
+#include "genc/cc/interop/networking/curl_handle_pool.h"
+#include "genc/cc/runtime/concurrency.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+namespace {
+
+// Longest the event loop sleeps without activity. Submit() wakes it up
+// earlier, and CURL's own timeouts shorten it too.
+constexpr int kPollTimeoutMs = 1000;
+
+// Completed by the event-loop thread.
+class ResponseFuture : public FutureInterface<std::string> {
+ public:
+  absl::StatusOr<std::string> Get() override {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(&done_));
+    return result_;
+  }
+
+  void Set(absl::StatusOr<std::string> result) {
+    absl::MutexLock lock(&mutex_);
+    result_ = std::move(result);
+    done_ = true;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  bool done_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::StatusOr<std::string> result_ ABSL_GUARDED_BY(mutex_);
+};
+
+struct Transfer {
+  CurlMultiHttpClient::Request request;
+  CurlMultiHttpClient::Callback on_done;
+  std::shared_ptr<ResponseFuture> future;
+  curl_slist* headers = nullptr;
+  std::string response;
+};
+
+}  // namespace
+
+class CurlMultiHttpClient::EventLoop {
+ public:
+  static absl::StatusOr<std::unique_ptr<EventLoop>> Create(
+      Options options,
+      std::shared_ptr<ConcurrencyInterface> concurrency_interface) {
+    absl::Status init = InitCurl();
+    if (!init.ok()) {
+      return init;
+    }
+    CURLM* multi = curl_multi_init();
+    if (multi == nullptr) {
+      return absl::InternalError("Unable to init CURL multi.");
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                      options.max_connections);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                      options.max_connections_per_host);
+    return absl::WrapUnique(
+        new EventLoop(options, std::move(concurrency_interface), multi));
+  }
+
+  ~EventLoop() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    curl_multi_wakeup(multi_);
+    thread_.join();
+    curl_multi_cleanup(multi_);
+  }
+
+  void Submit(std::unique_ptr<Transfer> transfer) {
+    {
+      absl::MutexLock lock(&mutex_);
+      if (!stopping_) {
+        submitted_.push_back(std::move(transfer));
+      }
+    }
+    if (transfer != nullptr) {
+      Deliver(std::move(transfer),
+              absl::CancelledError("The HTTP client is shutting down."));
+      return;
+    }
+    curl_multi_wakeup(multi_);
+  }
+
+ private:
+  EventLoop(Options options,
+            std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+            CURLM* multi)
+      : options_(options),
+        concurrency_interface_(std::move(concurrency_interface)),
+        multi_(multi),
+        thread_([this]() { Run(); }) {}
+
+  void Run() {
+    while (true) {
+      std::vector<std::unique_ptr<Transfer>> submitted;
+      bool stopping;
+      {
+        absl::MutexLock lock(&mutex_);
+        submitted.swap(submitted_);
+        stopping = stopping_;
+      }
+      if (stopping) {
+        Cancel(std::move(submitted));
+        return;
+      }
+      for (std::unique_ptr<Transfer>& transfer : submitted) {
+        Start(std::move(transfer));
+      }
+
+      int running = 0;
+      curl_multi_perform(multi_, &running);
+      int queued = 0;
+      while (CURLMsg* message = curl_multi_info_read(multi_, &queued)) {
+        if (message->msg == CURLMSG_DONE) {
+          Complete(message->easy_handle, message->data.result);
+        }
+      }
+      curl_multi_poll(multi_, nullptr, 0, kPollTimeoutMs, nullptr);
+    }
+  }
+
+  void Start(std::unique_ptr<Transfer> transfer) {
+    CURL* curl = CurlHandlePool::Default().Acquire();
+    if (curl == nullptr) {
+      Deliver(std::move(transfer), absl::InternalError("Unable to init CURL."));
+      return;
+    }
+    const Request& request = transfer->request;
+    curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+    if (!request.socket_path.empty()) {
+      curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH,
+                       request.socket_path.c_str());
+    }
+    for (const std::string& header : request.headers) {
+      transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+    }
+    if (request.method == Request::Method::kPost) {
+      transfer->headers = SetPostBody(curl, request.body, transfer->headers);
+    } else {
+      curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->response);
+    // HTTP/2 over TLS where the server offers it, HTTP/1.1 otherwise. A
+    // request waits for a multiplexed connection to come up rather than
+    // opening one more.
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                     static_cast<long>(absl::ToInt64Milliseconds(
+                         options_.timeout)));
+    if (options_.debug) {
+      curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+    }
+
+    CURLMcode code = curl_multi_add_handle(multi_, curl);
+    if (code != CURLM_OK) {
+      curl_slist_free_all(transfer->headers);
+      CurlHandlePool::Default().Release(curl);
+      Deliver(std::move(transfer),
+              absl::InternalError(curl_multi_strerror(code)));
+      return;
+    }
+    in_flight_[curl] = std::move(transfer);
+  }
+
+  void Complete(CURL* curl, CURLcode code) {
+    auto it = in_flight_.find(curl);
+    if (it == in_flight_.end()) return;
+    std::unique_ptr<Transfer> transfer = std::move(it->second);
+    in_flight_.erase(it);
+    curl_multi_remove_handle(multi_, curl);
+    curl_slist_free_all(transfer->headers);
+    CurlHandlePool::Default().Release(curl);
+
+    if (code != CURLE_OK) {
+      const std::string url = transfer->request.url;
+      Deliver(std::move(transfer),
+              absl::InternalError(absl::StrCat(
+                  "Received an error from \"", url, "\": \"",
+                  curl_easy_strerror(code), "\".")));
+      return;
+    }
+    std::string response = std::move(transfer->response);
+    Deliver(std::move(transfer), std::move(response));
+  }
+
+  // Fails `submitted` and the requests in flight.
+  void Cancel(std::vector<std::unique_ptr<Transfer>> submitted) {
+    for (auto& [curl, transfer] : in_flight_) {
+      curl_multi_remove_handle(multi_, curl);
+      curl_slist_free_all(transfer->headers);
+      CurlHandlePool::Default().Release(curl);
+      submitted.push_back(std::move(transfer));
+    }
+    in_flight_.clear();
+    for (std::unique_ptr<Transfer>& transfer : submitted) {
+      Deliver(std::move(transfer),
+              absl::CancelledError("The HTTP client is shutting down."));
+    }
+  }
+
+  void Deliver(std::unique_ptr<Transfer> transfer,
+               absl::StatusOr<std::string> result) {
+    if (transfer->on_done == nullptr) {
+      transfer->future->Set(std::move(result));
+      return;
+    }
+    auto done = [on_done = std::move(transfer->on_done),
+                 future = std::move(transfer->future),
+                 result = std::move(result)]() {
+      on_done(result);
+      future->Set(result);
+      return absl::OkStatus();
+    };
+    if (concurrency_interface_ != nullptr) {
+      concurrency_interface_->RunAsync(std::move(done));
+    } else {
+      done().IgnoreError();
+    }
+  }
+
+  const Options options_;
+  const std::shared_ptr<ConcurrencyInterface> concurrency_interface_;
+  CURLM* const multi_;
+
+  absl::Mutex mutex_;
+  std::vector<std::unique_ptr<Transfer>> submitted_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // Only used by the event-loop thread.
+  absl::flat_hash_map<CURL*, std::unique_ptr<Transfer>> in_flight_;
+
+  // Last, so that it starts after the rest is initialized.
+  std::thread thread_;
+};
+
+absl::StatusOr<std::unique_ptr<CurlMultiHttpClient>>
+CurlMultiHttpClient::Create(
+    Options options,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface) {
+  absl::StatusOr<std::unique_ptr<EventLoop>> event_loop =
+      EventLoop::Create(options, std::move(concurrency_interface));
+  if (!event_loop.ok()) {
+    return event_loop.status();
+  }
+  return absl::WrapUnique(
+      new CurlMultiHttpClient(std::move(event_loop).value()));
+}
+
+CurlMultiHttpClient::CurlMultiHttpClient(std::unique_ptr<EventLoop> event_loop)
+    : event_loop_(std::move(event_loop)) {}
+
+CurlMultiHttpClient::~CurlMultiHttpClient() = default;
+
+std::shared_ptr<FutureInterface<std::string>> CurlMultiHttpClient::SendAsync(
+    Request request, Callback on_done) {
+  auto transfer = std::make_unique<Transfer>();
+  transfer->request = std::move(request);
+  transfer->on_done = std::move(on_done);
+  transfer->future = std::make_shared<ResponseFuture>();
+  std::shared_ptr<FutureInterface<std::string>> future = transfer->future;
+  event_loop_->Submit(std::move(transfer));
+  return future;
+}
+
+std::shared_ptr<FutureInterface<std::string>>
+CurlMultiHttpClient::GetFromUrlAsync(const std::string& url) {
+  Request request;
+  request.url = url;
+  return SendAsync(std::move(request));
+}
+
+std::shared_ptr<FutureInterface<std::string>>
+CurlMultiHttpClient::PostJsonToUrlAsync(const std::string& url,
+                                        const std::string& json_request) {
+  Request request;
+  request.method = Request::Method::kPost;
+  request.url = url;
+  request.headers.push_back("Content-Type: application/json");
+  request.body = json_request;
+  return SendAsync(std::move(request));
+}
+
+absl::StatusOr<std::string> CurlMultiHttpClient::GetFromUrl(
+    const std::string& url) {
+  return GetFromUrlAsync(url)->Get();
+}
+
+absl::StatusOr<std::string> CurlMultiHttpClient::PostJsonToUrl(
+    const std::string& url, const std::string& json_request) {
+  return PostJsonToUrlAsync(url, json_request)->Get();
+}
+
+absl::StatusOr<std::string> CurlMultiHttpClient::GetFromUrlAndSocket(
+    const std::string& url, const std::string& socket_path) {
+  Request request;
+  request.url = url;
+  request.socket_path = socket_path;
+  return SendAsync(std::move(request))->Get();
+}
+
+absl::StatusOr<std::string> CurlMultiHttpClient::PostJsonToUrlAndSocket(
+    const std::string& url, const std::string& socket_path,
+    const std::string& json_request) {
+  Request request;
+  request.method = Request::Method::kPost;
+  request.url = url;
+  request.socket_path = socket_path;
+  request.headers.push_back("Content-Type: application/json");
+  request.body = json_request;
+  return SendAsync(std::move(request))->Get();
+}
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
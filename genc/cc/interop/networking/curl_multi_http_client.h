@@ -0,0 +1,119 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_NETWORKING_CURL_MULTI_HTTP_CLIENT_H_
+#define GENC_CC_INTEROP_NETWORKING_CURL_MULTI_HTTP_CLIENT_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "genc/cc/interop/networking/http_client_interface.h"
+#include "genc/cc/runtime/concurrency.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+// An HttpClientInterface that doesn't hold a thread per request. A single
+// event-loop thread drives every request in flight through curl_multi, and
+// completes a future for each. Requests to the same host share connections,
+// and over HTTPS they are multiplexed on one HTTP/2 connection where the
+// server supports it, so thousands of requests can be in flight at once.
+//
+// The blocking methods of HttpClientInterface wait for the future of the
+// corresponding *Async() method. All methods are thread-safe.
+//
+// For benchmarks and load tests of the transport only. Unlike
+// CurlBasedHttpClient, it doesn't go through EndpointLimiter, so its calls
+// are neither paced nor retried when throttled, and it doesn't compress
+// requests. Its target is testonly to keep it out of production binaries.
+class CurlMultiHttpClient : public HttpClientInterface {
+ public:
+  struct Options {
+    // Limits on the connections open at once, in total and to each host.
+    // Requests beyond them wait for a connection. Zero means no limit.
+    long max_connections = 0;
+    long max_connections_per_host = 16;
+    // Timeout of each request, including connecting; zero means none.
+    absl::Duration timeout = absl::ZeroDuration();
+    bool debug = false;
+  };
+
+  struct Request {
+    enum class Method { kGet, kPost };
+    Method method = Method::kGet;
+    std::string url;
+    // Connects to this Unix domain socket instead of the URL's host.
+    std::string socket_path;
+    // "Name: value" lines.
+    std::vector<std::string> headers;
+    // Posted as is.
+    std::string body;
+  };
+
+  using Callback = std::function<void(absl::StatusOr<std::string> response)>;
+
+  // Completion callbacks run on `concurrency_interface` if given, one task
+  // per completion, so that they can take their time without holding up
+  // other requests. Otherwise they run on the event-loop thread, and must be
+  // quick.
+  static absl::StatusOr<std::unique_ptr<CurlMultiHttpClient>> Create(
+      Options options,
+      std::shared_ptr<ConcurrencyInterface> concurrency_interface = nullptr);
+
+  // Fails requests still in flight with a CancelledError, and stops the
+  // event-loop thread.
+  ~CurlMultiHttpClient() override;
+
+  CurlMultiHttpClient(const CurlMultiHttpClient&) = delete;
+  CurlMultiHttpClient& operator=(const CurlMultiHttpClient&) = delete;
+
+  // Starts `request`, and returns a future of the response body. If given,
+  // `on_done` is called with the response once it is complete, before the
+  // future is.
+  std::shared_ptr<FutureInterface<std::string>> SendAsync(
+      Request request, Callback on_done = nullptr);
+
+  std::shared_ptr<FutureInterface<std::string>> GetFromUrlAsync(
+      const std::string& url);
+  std::shared_ptr<FutureInterface<std::string>> PostJsonToUrlAsync(
+      const std::string& url, const std::string& json_request);
+
+  absl::StatusOr<std::string> GetFromUrl(const std::string& url) override;
+  absl::StatusOr<std::string> PostJsonToUrl(
+      const std::string& url, const std::string& json_request) override;
+  absl::StatusOr<std::string> GetFromUrlAndSocket(
+      const std::string& url, const std::string& socket_path) override;
+  absl::StatusOr<std::string> PostJsonToUrlAndSocket(
+      const std::string& url, const std::string& socket_path,
+      const std::string& json_request) override;
+
+ private:
+  class EventLoop;
+
+  explicit CurlMultiHttpClient(std::unique_ptr<EventLoop> event_loop);
+
+  const std::unique_ptr<EventLoop> event_loop_;
+};
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_NETWORKING_CURL_MULTI_HTTP_CLIENT_H_
@@ -0,0 +1,146 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/curl_multi_http_client.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/runtime/concurrency.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/cc/testing/http_test_server.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+namespace {
+
+using ::genc::testing::HttpTestServer;
+
+// Replies to "<METHOD> <target>" with "<METHOD> <target> <body>", after a
+// pause of N milliseconds for targets "/delay/N".
+std::unique_ptr<HttpTestServer> StartServer() {
+  return HttpTestServer::Start([](const HttpTestServer::Request& request) {
+           HttpTestServer::Response response;
+           response.body = absl::StrCat(request.method, " ", request.target,
+                                        " ", request.body);
+           absl::string_view target = request.target;
+           int delay_ms;
+           if (absl::ConsumePrefix(&target, "/delay/") &&
+               absl::SimpleAtoi(target, &delay_ms)) {
+             response.delay = absl::Milliseconds(delay_ms);
+           }
+           return response;
+         })
+      .value();
+}
+
+TEST(CurlMultiHttpClientTest, GetsAndPosts) {
+  auto server = StartServer();
+  auto client = CurlMultiHttpClient::Create({}).value();
+  EXPECT_EQ(client->GetFromUrl(server->Url("/hello")).value(), "GET /hello ");
+  EXPECT_EQ(client->PostJsonToUrl(server->Url("/echo"), "{\"a\": 1}").value(),
+            "POST /echo {\"a\": 1}");
+}
+
+TEST(CurlMultiHttpClientTest, MultiplexesRequestsOnOneThread) {
+  auto server = StartServer();
+  CurlMultiHttpClient::Options options;
+  options.max_connections_per_host = 8;
+  auto client = CurlMultiHttpClient::Create(options).value();
+
+  constexpr int kNumRequests = 200;
+  const absl::Time start = absl::Now();
+  std::vector<std::shared_ptr<FutureInterface<std::string>>> futures;
+  for (int i = 0; i < kNumRequests; ++i) {
+    futures.push_back(
+        client->PostJsonToUrlAsync(server->Url("/delay/20"), absl::StrCat(i)));
+  }
+  for (int i = 0; i < kNumRequests; ++i) {
+    EXPECT_EQ(futures[i]->Get().value(), absl::StrCat("POST /delay/20 ", i));
+  }
+  // One at a time, they would take 4 seconds.
+  EXPECT_LT(absl::Now() - start, absl::Seconds(2));
+  EXPECT_LE(server->num_connections(), 8);
+}
+
+TEST(CurlMultiHttpClientTest, RunsCallbacksOnConcurrencyInterface) {
+  auto server = StartServer();
+  auto client = CurlMultiHttpClient::Create(
+                    {}, CreateThreadBasedConcurrencyManager())
+                    .value();
+  std::atomic<int> num_called = 0;
+  std::vector<std::shared_ptr<FutureInterface<std::string>>> futures;
+  for (int i = 0; i < 10; ++i) {
+    CurlMultiHttpClient::Request request;
+    request.url = server->Url(absl::StrCat("/", i));
+    futures.push_back(client->SendAsync(
+        request, [&num_called, i](absl::StatusOr<std::string> response) {
+          EXPECT_EQ(response.value(), absl::StrCat("GET /", i, " "));
+          ++num_called;
+        }));
+  }
+  for (auto& future : futures) {
+    EXPECT_TRUE(future->Get().ok());
+  }
+  EXPECT_EQ(num_called.load(), 10);
+}
+
+TEST(CurlMultiHttpClientTest, FailsOnConnectionErrors) {
+  std::string url;
+  {
+    auto server = StartServer();
+    url = server->Url("/gone");
+  }
+  auto client = CurlMultiHttpClient::Create({}).value();
+  EXPECT_EQ(client->GetFromUrl(url).status().code(),
+            absl::StatusCode::kInternal);
+}
+
+TEST(CurlMultiHttpClientTest, TimesOut) {
+  auto server = StartServer();
+  CurlMultiHttpClient::Options options;
+  options.timeout = absl::Milliseconds(50);
+  auto client = CurlMultiHttpClient::Create(options).value();
+  EXPECT_EQ(client->GetFromUrl(server->Url("/delay/2000")).status().code(),
+            absl::StatusCode::kInternal);
+}
+
+TEST(CurlMultiHttpClientTest, CancelsRequestsInFlightWhenDestroyed) {
+  auto server = StartServer();
+  auto client = CurlMultiHttpClient::Create({}).value();
+  std::shared_ptr<FutureInterface<std::string>> future =
+      client->GetFromUrlAsync(server->Url("/delay/5000"));
+  absl::SleepFor(absl::Milliseconds(50));
+  client.reset();
+  EXPECT_EQ(future->Get().status().code(), absl::StatusCode::kCancelled);
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,275 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/endpoint_limiter.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/random/distributions.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+struct EndpointLimiter::Endpoint {
+  explicit Endpoint(const Options& options)
+      : options(options),
+        limit(options.initial_concurrency),
+        tokens(options.burst),
+        refilled(absl::Now()) {}
+
+  Options options;
+  // Fractional, so that it can grow by 1/limit per call.
+  double limit;
+  double tokens;
+  absl::Time refilled;
+  // No call starts before then, as asked by a Retry-After header.
+  absl::Time paused_until = absl::InfinitePast();
+  // Attempts started before then were in flight when the limit was last cut,
+  // and are not allowed to cut it again.
+  absl::Time decreased = absl::InfinitePast();
+  // Signalled when an attempt is done.
+  absl::CondVar done;
+  Metrics metrics;
+};
+
+EndpointLimiter::EndpointLimiter() : EndpointLimiter(Options()) {}
+
+EndpointLimiter::EndpointLimiter(Options default_options)
+    : default_options_(default_options) {}
+
+EndpointLimiter::~EndpointLimiter() = default;
+
+EndpointLimiter& EndpointLimiter::Default() {
+  // Never destroyed, as calls may be in flight at exit.
+  static EndpointLimiter* const limiter = new EndpointLimiter();
+  return *limiter;
+}
+
+std::string EndpointLimiter::EndpointOf(absl::string_view url) {
+  size_t start = url.find("://");
+  start = start == absl::string_view::npos ? 0 : start + 3;
+  absl::string_view authority = url.substr(start);
+  authority = authority.substr(0, authority.find_first_of("/?#"));
+  const size_t at = authority.rfind('@');
+  if (at != absl::string_view::npos) {
+    authority.remove_prefix(at + 1);
+  }
+  std::string endpoint = absl::StrCat(url.substr(0, start), authority);
+  absl::AsciiStrToLower(&endpoint);
+  return endpoint;
+}
+
+absl::Status EndpointLimiter::SetOptions(absl::string_view endpoint,
+                                         Options options) {
+  if (options.requests_per_second < 0 || options.burst < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected requests_per_second >= 0 and burst >= 1, got ",
+        options.requests_per_second, " and ", options.burst, "."));
+  }
+  if (options.min_concurrency < 1 ||
+      options.max_concurrency < options.min_concurrency ||
+      options.initial_concurrency < options.min_concurrency ||
+      options.initial_concurrency > options.max_concurrency) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected 1 <= min_concurrency <= initial_concurrency <= "
+        "max_concurrency, got ",
+        options.min_concurrency, ", ", options.initial_concurrency, " and ",
+        options.max_concurrency, "."));
+  }
+  if (!(options.decrease_factor > 0 && options.decrease_factor <= 1) ||
+      options.max_attempts < 1) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected 0 < decrease_factor <= 1 and max_attempts >= 1, got ",
+        options.decrease_factor, " and ", options.max_attempts, "."));
+  }
+  const std::string key = EndpointOf(endpoint);
+  absl::MutexLock lock(&mutex_);
+  auto it = endpoints_.find(key);
+  if (it == endpoints_.end()) {
+    endpoints_.emplace(key, std::make_unique<Endpoint>(options));
+    return absl::OkStatus();
+  }
+  Endpoint& state = *it->second;
+  state.options = options;
+  state.limit = std::clamp<double>(state.limit, options.min_concurrency,
+                                   options.max_concurrency);
+  state.tokens = std::min<double>(state.tokens, options.burst);
+  state.done.SignalAll();
+  return absl::OkStatus();
+}
+
+EndpointLimiter::Endpoint& EndpointLimiter::GetEndpoint(
+    absl::string_view endpoint) {
+  std::unique_ptr<Endpoint>& state = endpoints_[EndpointOf(endpoint)];
+  if (state == nullptr) {
+    state = std::make_unique<Endpoint>(default_options_);
+  }
+  return *state;
+}
+
+void EndpointLimiter::Acquire(Endpoint& endpoint) {
+  const absl::Time start = absl::Now();
+  ++endpoint.metrics.queued;
+  while (true) {
+    const Options& options = endpoint.options;
+    const absl::Time now = absl::Now();
+    if (now < endpoint.paused_until) {
+      endpoint.done.WaitWithDeadline(&mutex_, endpoint.paused_until);
+      continue;
+    }
+    if (endpoint.metrics.in_flight >= static_cast<int>(endpoint.limit)) {
+      endpoint.done.Wait(&mutex_);
+      continue;
+    }
+    if (options.requests_per_second > 0) {
+      endpoint.tokens = std::min<double>(
+          options.burst,
+          endpoint.tokens + absl::ToDoubleSeconds(now - endpoint.refilled) *
+                                options.requests_per_second);
+      endpoint.refilled = now;
+      if (endpoint.tokens < 1) {
+        endpoint.done.WaitWithTimeout(
+            &mutex_, absl::Seconds((1 - endpoint.tokens) /
+                                   options.requests_per_second));
+        continue;
+      }
+      endpoint.tokens -= 1;
+    }
+    break;
+  }
+  --endpoint.metrics.queued;
+  ++endpoint.metrics.in_flight;
+  ++endpoint.metrics.attempts;
+  const absl::Duration wait = absl::Now() - start;
+  endpoint.metrics.queue_wait += wait;
+  endpoint.metrics.max_queue_wait =
+      std::max(endpoint.metrics.max_queue_wait, wait);
+}
+
+void EndpointLimiter::Release(Endpoint& endpoint, absl::Time start,
+                              const Attempt& attempt) {
+  const Options& options = endpoint.options;
+  const int in_flight = endpoint.metrics.in_flight--;
+  if (IsThrottled(attempt.http_status)) {
+    ++endpoint.metrics.throttled;
+    // Cuts the limit once per round of calls, not once per call that was
+    // already in flight when the endpoint started throttling.
+    if (start >= endpoint.decreased) {
+      endpoint.limit = std::max<double>(
+          options.min_concurrency, endpoint.limit * options.decrease_factor);
+      endpoint.decreased = absl::Now();
+    }
+    if (attempt.retry_after > absl::ZeroDuration() &&
+        attempt.retry_after <= options.max_retry_after) {
+      endpoint.paused_until = std::max(endpoint.paused_until,
+                                       absl::Now() + attempt.retry_after);
+    }
+  } else if (attempt.response.ok() && 2 * in_flight >= endpoint.limit) {
+    // Only grows a limit that calls use, or it would grow without bound
+    // while the endpoint is lightly loaded.
+    endpoint.limit = std::min<double>(options.max_concurrency,
+                                      endpoint.limit + 1 / endpoint.limit);
+  }
+  endpoint.done.SignalAll();
+}
+
+absl::Duration EndpointLimiter::Backoff(const Options& options, int retry) {
+  absl::Duration ceiling = options.initial_backoff;
+  for (int i = 1; i < retry && ceiling < options.max_backoff; ++i) {
+    ceiling *= 2;
+  }
+  ceiling = std::min(ceiling, options.max_backoff);
+  return absl::Microseconds(absl::Uniform<double>(
+      bitgen_, 0, absl::ToDoubleMicroseconds(ceiling)));
+}
+
+absl::StatusOr<std::string> EndpointLimiter::Call(absl::string_view endpoint,
+                                                  const AttemptFn& attempt) {
+  mutex_.Lock();
+  Endpoint& state = GetEndpoint(endpoint);
+  ++state.metrics.calls;
+  for (int retry = 0;; ++retry) {
+    Acquire(state);
+    mutex_.Unlock();
+    const absl::Time start = absl::Now();
+    Attempt result = attempt();
+    mutex_.Lock();
+    Release(state, start, result);
+    if (!IsThrottled(result.http_status)) {
+      mutex_.Unlock();
+      return std::move(result.response);
+    }
+    if (retry + 1 >= state.options.max_attempts ||
+        result.retry_after > state.options.max_retry_after) {
+      ++state.metrics.failed;
+      mutex_.Unlock();
+      std::string message = absl::StrCat(
+          "Received HTTP status ", result.http_status, " from ", endpoint,
+          " after ", retry + 1, " attempts.");
+      return result.http_status == 429
+                 ? absl::ResourceExhaustedError(message)
+                 : absl::UnavailableError(message);
+    }
+    // Spreads out the retries of calls throttled together, after any pause
+    // the endpoint asked for.
+    const absl::Duration backoff =
+        result.retry_after + Backoff(state.options, retry + 1);
+    mutex_.Unlock();
+    absl::SleepFor(backoff);
+    mutex_.Lock();
+  }
+}
+
+absl::flat_hash_map<std::string, EndpointLimiter::Metrics>
+EndpointLimiter::metrics() const {
+  absl::MutexLock lock(&mutex_);
+  absl::flat_hash_map<std::string, Metrics> result;
+  for (const auto& [endpoint, state] : endpoints_) {
+    result[endpoint] = MetricsOf(*state);
+  }
+  return result;
+}
+
+EndpointLimiter::Metrics EndpointLimiter::metrics(
+    absl::string_view endpoint) const {
+  absl::MutexLock lock(&mutex_);
+  auto it = endpoints_.find(EndpointOf(endpoint));
+  return it == endpoints_.end() ? Metrics() : MetricsOf(*it->second);
+}
+
+EndpointLimiter::Metrics EndpointLimiter::MetricsOf(const Endpoint& state) {
+  Metrics metrics = state.metrics;
+  metrics.requests_per_second = state.options.requests_per_second;
+  metrics.concurrency_limit = static_cast<int>(state.limit);
+  return metrics;
+}
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,184 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_NETWORKING_ENDPOINT_LIMITER_H_
+#define GENC_CC_INTEROP_NETWORKING_ENDPOINT_LIMITER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+// Bounds and paces the calls made to each endpoint, so that bursts of calls
+// don't overwhelm it, and retries the calls it throttles.
+//
+// Calls to an endpoint wait in line until:
+//  - a token bucket refilled at `requests_per_second` has a token, and
+//  - fewer than the endpoint's concurrency limit are in flight.
+// The concurrency limit adapts like TCP's congestion window (AIMD): it grows
+// by about one per round of calls that use it fully, and is cut by
+// `decrease_factor` when the endpoint throttles a call, i.e. answers with
+// HTTP 429 or 503. A throttled call is retried after a jittered exponential
+// backoff, and no sooner than the endpoint asked in a Retry-After header,
+// which also holds back every other call to the endpoint.
+//
+// Safe to call from many threads.
+class EndpointLimiter {
+ public:
+  struct Options {
+    // Most calls started per second, on average. 0 for no limit.
+    double requests_per_second = 0;
+    // Most calls started at once after a quiet period, i.e. the size of the
+    // token bucket.
+    int burst = 1;
+    // Bounds of the adaptive concurrency limit, and where it starts.
+    int initial_concurrency = 32;
+    int min_concurrency = 1;
+    int max_concurrency = 1024;
+    // Factor the concurrency limit is multiplied by when a call is throttled.
+    double decrease_factor = 0.5;
+    // Most attempts at a call that keeps being throttled.
+    int max_attempts = 4;
+    // The backoff before the n-th retry is drawn from
+    // [0, min(max_backoff, initial_backoff * 2^(n-1))].
+    absl::Duration initial_backoff = absl::Milliseconds(100);
+    absl::Duration max_backoff = absl::Seconds(10);
+    // A call asked to retry any later than this fails instead of waiting.
+    absl::Duration max_retry_after = absl::Seconds(60);
+  };
+
+  // The outcome of one attempt at a call.
+  struct Attempt {
+    // The response body, or the error that prevented getting one.
+    absl::StatusOr<std::string> response;
+    // 0 if no response was received.
+    int http_status = 0;
+    // How long the endpoint asked to wait before retrying, if it did.
+    absl::Duration retry_after = absl::ZeroDuration();
+  };
+  using AttemptFn = std::function<Attempt()>;
+
+  struct Metrics {
+    double requests_per_second = 0;
+    int concurrency_limit = 0;
+    int in_flight = 0;
+    // Calls waiting for their turn.
+    int queued = 0;
+    int64_t calls = 0;
+    int64_t attempts = 0;
+    // Attempts answered with HTTP 429 or 503.
+    int64_t throttled = 0;
+    // Calls that were still throttled after their last attempt.
+    int64_t failed = 0;
+    // Time calls spent waiting for their turn, retries included, but not the
+    // backoffs between them.
+    absl::Duration queue_wait;
+    absl::Duration max_queue_wait;
+  };
+
+  // Returns the limiter shared by the HTTP clients of the process.
+  static EndpointLimiter& Default();
+
+  EndpointLimiter();
+  // `default_options` must be valid, as SetOptions() checks.
+  explicit EndpointLimiter(Options default_options);
+  ~EndpointLimiter();
+
+  EndpointLimiter(const EndpointLimiter&) = delete;
+  EndpointLimiter& operator=(const EndpointLimiter&) = delete;
+
+  // Returns whether a response with `http_status` means the endpoint throttled
+  // the call.
+  static bool IsThrottled(int http_status) {
+    return http_status == 429 || http_status == 503;
+  }
+
+  // Returns the endpoint `url` is a call to, i.e. its lowercased scheme, host
+  // and port, as a server limits its calls as a whole rather than by path.
+  // Leaves out the user info, path and query, which may hold credentials.
+  static std::string EndpointOf(absl::string_view url);
+
+  // Sets the options of calls to `endpoint`, any URL on the server, instead
+  // of the default ones, including those already waiting for their turn.
+  // Fails if `options` are not valid, e.g. with a min_concurrency below 1,
+  // which would let the limit drop to 0 and stop all calls.
+  absl::Status SetOptions(absl::string_view endpoint, Options options);
+
+  // Makes a call to `endpoint`, any URL on the server, by calling `attempt`
+  // when it's the call's turn, and again after a backoff for as long as the
+  // endpoint throttles it.
+  // Returns the response of the first attempt that isn't throttled. Fails
+  // with a ResourceExhaustedError (429) or UnavailableError (503) if all
+  // attempts are.
+  absl::StatusOr<std::string> Call(absl::string_view endpoint,
+                                   const AttemptFn& attempt);
+
+  // Returns the metrics of each endpoint called so far, keyed by EndpointOf().
+  absl::flat_hash_map<std::string, Metrics> metrics() const;
+
+  // Returns the metrics of the endpoint of `endpoint`, any URL on the server,
+  // which are all zero if it wasn't called.
+  Metrics metrics(absl::string_view endpoint) const;
+
+ private:
+  struct Endpoint;
+
+  // Returns the state of the endpoint of `endpoint`, any URL on the server.
+  Endpoint& GetEndpoint(absl::string_view endpoint)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  static Metrics MetricsOf(const Endpoint& state);
+
+  // Waits for the turn of an attempt at a call to `endpoint`, and marks it in
+  // flight.
+  void Acquire(Endpoint& endpoint) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Marks an attempt started at `start` done, and adapts the concurrency
+  // limit to its outcome.
+  void Release(Endpoint& endpoint, absl::Time start, const Attempt& attempt)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the backoff before retry number `retry`.
+  absl::Duration Backoff(const Options& options, int retry)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const Options default_options_;
+
+  mutable absl::Mutex mutex_;
+  // One per server called, as EndpointOf() keys them, so there are few. Never
+  // removed, so references stay valid.
+  absl::flat_hash_map<std::string, std::unique_ptr<Endpoint>> endpoints_
+      ABSL_GUARDED_BY(mutex_);
+  absl::BitGen bitgen_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_NETWORKING_ENDPOINT_LIMITER_H_
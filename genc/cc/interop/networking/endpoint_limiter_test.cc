@@ -0,0 +1,269 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/endpoint_limiter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+namespace {
+
+using Attempt = EndpointLimiter::Attempt;
+
+constexpr char kEndpoint[] = "https://example.com/v1/generate";
+
+Attempt Ok(absl::Duration latency = absl::ZeroDuration()) {
+  absl::SleepFor(latency);
+  return {"ok", 200};
+}
+
+EndpointLimiter::Options FastRetries() {
+  EndpointLimiter::Options options;
+  options.initial_backoff = absl::Milliseconds(1);
+  return options;
+}
+
+TEST(EndpointLimiterTest, EndpointOfIsTheServer) {
+  EXPECT_EQ(EndpointLimiter::EndpointOf(
+                "https://example.com/v1/m:generateContent?key=secret"),
+            "https://example.com");
+  EXPECT_EQ(EndpointLimiter::EndpointOf("http://localhost:80/a#b"),
+            "http://localhost:80");
+  EXPECT_EQ(EndpointLimiter::EndpointOf("HTTP://user:pw@Example.com:8080"),
+            "http://example.com:8080");
+  EXPECT_EQ(EndpointLimiter::EndpointOf("http://[::1]:80?q=/"),
+            "http://[::1]:80");
+  EXPECT_EQ(EndpointLimiter::EndpointOf("localhost:80/a"), "localhost:80");
+}
+
+TEST(EndpointLimiterTest, SetOptionsRejectsBadOptions) {
+  EndpointLimiter limiter;
+  EXPECT_TRUE(limiter.SetOptions(kEndpoint, EndpointLimiter::Options()).ok());
+  const auto bad = [&](auto set) {
+    EndpointLimiter::Options options;
+    set(options);
+    return limiter.SetOptions(kEndpoint, options).code() ==
+           absl::StatusCode::kInvalidArgument;
+  };
+  using Options = EndpointLimiter::Options;
+  EXPECT_TRUE(bad([](Options& options) { options.min_concurrency = 0; }));
+  EXPECT_TRUE(bad([](Options& options) { options.max_concurrency = 16; }));
+  EXPECT_TRUE(bad([](Options& options) { options.initial_concurrency = 0; }));
+  EXPECT_TRUE(bad([](Options& options) { options.burst = 0; }));
+  EXPECT_TRUE(bad([](Options& options) { options.requests_per_second = -1; }));
+  EXPECT_TRUE(bad([](Options& options) { options.decrease_factor = 0; }));
+  EXPECT_TRUE(bad([](Options& options) { options.max_attempts = 0; }));
+}
+
+TEST(EndpointLimiterTest, SetsOptionsOfTheServer) {
+  EndpointLimiter limiter;
+  EndpointLimiter::Options options;
+  options.initial_concurrency = 2;
+  options.requests_per_second = 5;
+  ASSERT_TRUE(
+      limiter.SetOptions("HTTPS://Example.com/v1/embed?key=secret", options)
+          .ok());
+  ASSERT_TRUE(limiter.Call(kEndpoint, [] { return Ok(); }).ok());
+
+  const auto metrics = limiter.metrics();
+  ASSERT_EQ(metrics.size(), 1);
+  EXPECT_EQ(metrics.begin()->first, "https://example.com");
+  EXPECT_EQ(limiter.metrics("https://example.com/other").concurrency_limit, 2);
+  EXPECT_EQ(limiter.metrics(kEndpoint).requests_per_second, 5);
+  EXPECT_EQ(limiter.metrics(kEndpoint).calls, 1);
+  EXPECT_EQ(limiter.metrics("https://example.org").calls, 0);
+}
+
+TEST(EndpointLimiterTest, RetriesThrottledCalls) {
+  EndpointLimiter limiter(FastRetries());
+  int attempts = 0;
+  absl::StatusOr<std::string> response =
+      limiter.Call(kEndpoint, [&]() -> Attempt {
+        if (++attempts < 3) return {"slow down", 429};
+        return Ok();
+      });
+  EXPECT_EQ(response.value(), "ok");
+
+  EndpointLimiter::Metrics metrics = limiter.metrics(kEndpoint);
+  EXPECT_EQ(metrics.calls, 1);
+  EXPECT_EQ(metrics.attempts, 3);
+  EXPECT_EQ(metrics.throttled, 2);
+  EXPECT_EQ(metrics.failed, 0);
+  EXPECT_EQ(metrics.in_flight, 0);
+}
+
+TEST(EndpointLimiterTest, FailsAfterTheLastAttempt) {
+  EndpointLimiter::Options options = FastRetries();
+  options.max_attempts = 2;
+  EndpointLimiter limiter(options);
+  EXPECT_EQ(limiter.Call(kEndpoint, []() -> Attempt { return {"", 503}; })
+                .status()
+                .code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(limiter.Call(kEndpoint, []() -> Attempt { return {"", 429}; })
+                .status()
+                .code(),
+            absl::StatusCode::kResourceExhausted);
+  EXPECT_EQ(limiter.metrics(kEndpoint).attempts, 4);
+  EXPECT_EQ(limiter.metrics(kEndpoint).failed, 2);
+
+  // Errors other than throttling are not retried.
+  int attempts = 0;
+  EXPECT_EQ(limiter
+                .Call(kEndpoint,
+                      [&]() -> Attempt {
+                        ++attempts;
+                        return {absl::InternalError("reset"), 0};
+                      })
+                .status()
+                .code(),
+            absl::StatusCode::kInternal);
+  EXPECT_EQ(attempts, 1);
+}
+
+TEST(EndpointLimiterTest, HonoursRetryAfter) {
+  EndpointLimiter limiter(FastRetries());
+  const absl::Duration retry_after = absl::Milliseconds(100);
+  int attempts = 0;
+  const absl::Time start = absl::Now();
+  ASSERT_TRUE(limiter
+                  .Call(kEndpoint,
+                        [&]() -> Attempt {
+                          if (++attempts == 1) return {"", 429, retry_after};
+                          return Ok();
+                        })
+                  .ok());
+  EXPECT_GE(absl::Now() - start, retry_after);
+
+  // Fails right away when asked to wait too long.
+  EndpointLimiter::Options options = FastRetries();
+  options.max_retry_after = absl::Seconds(1);
+  ASSERT_TRUE(limiter.SetOptions(kEndpoint, options).ok());
+  attempts = 0;
+  EXPECT_EQ(limiter
+                .Call(kEndpoint,
+                      [&]() -> Attempt {
+                        ++attempts;
+                        return {"", 503, absl::Hours(1)};
+                      })
+                .status()
+                .code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(attempts, 1);
+}
+
+TEST(EndpointLimiterTest, PacesCalls) {
+  EndpointLimiter::Options options;
+  options.requests_per_second = 100;
+  options.burst = 5;
+  EndpointLimiter limiter(options);
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < 25; ++i) {
+    ASSERT_TRUE(limiter.Call(kEndpoint, [] { return Ok(); }).ok());
+  }
+  // The first 5 calls use up the burst, and the other 20 are 10ms apart.
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(190));
+  EXPECT_GT(limiter.metrics(kEndpoint).queue_wait,
+            absl::Milliseconds(150));
+}
+
+// Runs `num_calls` calls on each of `num_threads` threads, and returns the
+// most calls seen in flight at once.
+int MaxInFlight(EndpointLimiter& limiter, int num_threads, int num_calls,
+                const EndpointLimiter::AttemptFn& attempt) {
+  std::atomic<int> in_flight{0};
+  std::atomic<int> max_in_flight{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < num_calls; ++i) {
+        limiter
+            .Call(kEndpoint,
+                  [&]() {
+                    const int now = ++in_flight;
+                    int max = max_in_flight.load();
+                    while (now > max &&
+                           !max_in_flight.compare_exchange_weak(max, now)) {
+                    }
+                    Attempt result = attempt();
+                    --in_flight;
+                    return result;
+                  })
+            .IgnoreError();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return max_in_flight;
+}
+
+TEST(EndpointLimiterTest, BoundsConcurrency) {
+  EndpointLimiter::Options options;
+  options.initial_concurrency = 4;
+  options.max_concurrency = 4;
+  EndpointLimiter limiter(options);
+  EXPECT_LE(MaxInFlight(limiter, 16, 5,
+                        [] { return Ok(absl::Milliseconds(2)); }),
+            4);
+  EndpointLimiter::Metrics metrics = limiter.metrics(kEndpoint);
+  EXPECT_EQ(metrics.calls, 80);
+  EXPECT_EQ(metrics.concurrency_limit, 4);
+  EXPECT_GT(metrics.max_queue_wait, absl::ZeroDuration());
+}
+
+TEST(EndpointLimiterTest, AdaptsConcurrencyToThrottling) {
+  EndpointLimiter::Options options = FastRetries();
+  options.initial_concurrency = 16;
+  options.max_attempts = 1;
+  EndpointLimiter limiter(options);
+
+  // The endpoint throttles beyond 4 calls at once.
+  std::atomic<int> in_flight{0};
+  const EndpointLimiter::AttemptFn overloaded = [&]() -> Attempt {
+    const bool throttled = ++in_flight > 4;
+    absl::SleepFor(absl::Milliseconds(2));
+    --in_flight;
+    if (throttled) return {"", 429};
+    return Ok();
+  };
+  MaxInFlight(limiter, 16, 20, overloaded);
+  const int limit = limiter.metrics(kEndpoint).concurrency_limit;
+  EXPECT_LT(limit, 16);
+  EXPECT_GE(limit, 1);
+
+  // Then grows back while calls succeed.
+  MaxInFlight(limiter, 16, 20, [] { return Ok(absl::Milliseconds(1)); });
+  EXPECT_GT(limiter.metrics(kEndpoint).concurrency_limit, limit);
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
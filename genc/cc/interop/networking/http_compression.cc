@@ -0,0 +1,164 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/http_compression.h"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include <curl/curl.h>
+#include <zlib.h>
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+namespace {
+
+// Tells zlib to read and write the gzip format, rather than the zlib one.
+constexpr int kGzipWindowBits = 15 + 16;
+
+// Output is produced in pieces of at most this many bytes.
+constexpr size_t kChunkBytes = 64 * 1024;
+
+absl::Status ZlibError(absl::string_view what, const z_stream& stream,
+                       int code) {
+  return absl::InternalError(absl::StrCat(
+      what, " failed: ", stream.msg != nullptr ? stream.msg : "", " (", code,
+      ")"));
+}
+
+}  // namespace
+
+CompressionStats& CompressionStats::Default() {
+  static CompressionStats* const stats = new CompressionStats();
+  return *stats;
+}
+
+void CompressionStats::RecordSent(size_t bytes, size_t compressed_bytes) {
+  absl::MutexLock lock(&mutex_);
+  ++sent_.bodies;
+  sent_.bytes += bytes;
+  sent_.compressed_bytes += compressed_bytes;
+}
+
+void CompressionStats::RecordReceived(size_t bytes, size_t compressed_bytes) {
+  absl::MutexLock lock(&mutex_);
+  ++received_.bodies;
+  received_.bytes += bytes;
+  received_.compressed_bytes += compressed_bytes;
+}
+
+CompressionStats::Totals CompressionStats::sent() const {
+  absl::MutexLock lock(&mutex_);
+  return sent_;
+}
+
+CompressionStats::Totals CompressionStats::received() const {
+  absl::MutexLock lock(&mutex_);
+  return received_;
+}
+
+absl::StatusOr<std::string> GzipCompress(absl::string_view data, int level) {
+  z_stream stream = {};
+  int code = deflateInit2(&stream, level, Z_DEFLATED, kGzipWindowBits,
+                          /*memLevel=*/8, Z_DEFAULT_STRATEGY);
+  if (code != Z_OK) return ZlibError("deflateInit2", stream, code);
+  std::string compressed;
+  compressed.resize(deflateBound(&stream, data.size()));
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+  stream.avail_out = compressed.size();
+  // The output fits, as it is as large as deflateBound() says it can be.
+  code = deflate(&stream, Z_FINISH);
+  const size_t size = stream.total_out;
+  deflateEnd(&stream);
+  if (code != Z_STREAM_END) return ZlibError("deflate", stream, code);
+  compressed.resize(size);
+  return compressed;
+}
+
+absl::StatusOr<std::string> GzipDecompress(absl::string_view compressed) {
+  z_stream stream = {};
+  int code = inflateInit2(&stream, kGzipWindowBits);
+  if (code != Z_OK) return ZlibError("inflateInit2", stream, code);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = compressed.size();
+  std::string data;
+  do {
+    const size_t size = data.size();
+    data.resize(size + kChunkBytes);
+    stream.next_out = reinterpret_cast<Bytef*>(data.data() + size);
+    stream.avail_out = kChunkBytes;
+    code = inflate(&stream, Z_NO_FLUSH);
+    data.resize(size + kChunkBytes - stream.avail_out);
+  } while (code == Z_OK);
+  inflateEnd(&stream);
+  if (code != Z_STREAM_END) {
+    // Z_BUF_ERROR if `compressed` is cut short.
+    return ZlibError("inflate", stream, code);
+  }
+  return data;
+}
+
+bool MaybeCompressRequest(const HttpCompressionOptions& options,
+                          const std::string& body, std::string* compressed,
+                          CompressionStats& stats) {
+  if (!options.compress_requests || body.size() < options.min_request_bytes) {
+    return false;
+  }
+  absl::StatusOr<std::string> gzipped = GzipCompress(body, options.level);
+  // Falls back on the body as is, which the server takes all the same.
+  if (!gzipped.ok() || gzipped->size() >= body.size()) return false;
+  stats.RecordSent(body.size(), gzipped->size());
+  *compressed = *std::move(gzipped);
+  return true;
+}
+
+void AcceptCompressedResponses(const HttpCompressionOptions& options,
+                               CURL* curl) {
+  if (options.accept_compressed_responses) {
+    // Empty for every encoding CURL was built to decode.
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  }
+}
+
+void RecordResponseCompression(CURL* curl, size_t bytes,
+                               CompressionStats& stats) {
+  curl_header* encoding = nullptr;
+  if (curl_easy_header(curl, "Content-Encoding", 0, CURLH_HEADER, -1,
+                       &encoding) != CURLHE_OK ||
+      absl::EqualsIgnoreCase(encoding->value, "identity")) {
+    return;
+  }
+  // The size of the body as received, before it was decoded.
+  curl_off_t compressed_bytes = 0;
+  curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &compressed_bytes);
+  stats.RecordReceived(bytes, compressed_bytes);
+}
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
@@ -0,0 +1,105 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTEROP_NETWORKING_HTTP_COMPRESSION_H_
+#define GENC_CC_INTEROP_NETWORKING_HTTP_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include <curl/curl.h>
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+// Opt-in compression of the bodies of HTTP calls. Off by default, as not
+// every server accepts compressed requests.
+struct HttpCompressionOptions {
+  // Asks for compressed responses, in any encoding CURL can decode, e.g.
+  // gzip, and decodes them.
+  bool accept_compressed_responses = false;
+  // Sends request bodies of at least `min_request_bytes` gzip-compressed,
+  // unless that doesn't make them smaller. The server must accept requests
+  // with a "Content-Encoding: gzip" header.
+  bool compress_requests = false;
+  size_t min_request_bytes = 16 * 1024;
+  // From 1 (fastest) to 9 (smallest).
+  int level = 6;
+};
+
+// Counts the bytes that compression saved, in both directions.
+// Safe to update from many threads.
+class CompressionStats {
+ public:
+  struct Totals {
+    // Compressed bodies, and their sizes before and after compression.
+    int64_t bodies = 0;
+    int64_t bytes = 0;
+    int64_t compressed_bytes = 0;
+
+    int64_t bytes_saved() const { return bytes - compressed_bytes; }
+  };
+
+  // Returns the stats of the HTTP clients of the process.
+  static CompressionStats& Default();
+
+  // Records a request body of `bytes` sent as `compressed_bytes`.
+  void RecordSent(size_t bytes, size_t compressed_bytes);
+  // Records a response body received as `compressed_bytes`, which decoded to
+  // `bytes`.
+  void RecordReceived(size_t bytes, size_t compressed_bytes);
+
+  Totals sent() const;
+  Totals received() const;
+
+ private:
+  mutable absl::Mutex mutex_;
+  Totals sent_ ABSL_GUARDED_BY(mutex_);
+  Totals received_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Returns `data` compressed in the gzip format, at `level` 1 to 9.
+absl::StatusOr<std::string> GzipCompress(absl::string_view data,
+                                         int level = 6);
+
+// Returns the data compressed in gzip format in `compressed`.
+absl::StatusOr<std::string> GzipDecompress(absl::string_view compressed);
+
+// Compresses `body` into `compressed` if `options` call for it, and records
+// the bytes saved in `stats`. Returns whether it did.
+bool MaybeCompressRequest(const HttpCompressionOptions& options,
+                          const std::string& body, std::string* compressed,
+                          CompressionStats& stats);
+
+// Sets up `curl` to ask for compressed responses if `options` call for it.
+void AcceptCompressedResponses(const HttpCompressionOptions& options,
+                               CURL* curl);
+
+// Records the bytes saved by the compression of the response `curl`
+// received, which decoded to `bytes`, in `stats`, if it was compressed.
+void RecordResponseCompression(CURL* curl, size_t bytes,
+                               CompressionStats& stats);
+
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
+
+#endif  // GENC_CC_INTEROP_NETWORKING_HTTP_COMPRESSION_H_
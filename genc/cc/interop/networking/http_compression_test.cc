@@ -0,0 +1,93 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/interop/networking/http_compression.h"
+
+#include <cstdint>
+#include <string>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+namespace genc {
+namespace interop {
+namespace networking {
+
+namespace {
+
+std::string Prompt(int num_chunks) {
+  std::string prompt;
+  for (int i = 0; i < num_chunks; ++i) {
+    absl::StrAppend(&prompt, "{\"chunk\": ", i,
+                    ", \"text\": \"The quick brown fox jumps over the lazy "
+                    "dog.\"}\n");
+  }
+  return prompt;
+}
+
+TEST(HttpCompressionTest, RoundTrips) {
+  for (const std::string& data : {std::string(), Prompt(1), Prompt(10000)}) {
+    std::string compressed = GzipCompress(data).value();
+    EXPECT_EQ(GzipDecompress(compressed).value(), data);
+  }
+  EXPECT_LT(GzipCompress(Prompt(10000)).value().size(),
+            Prompt(10000).size() / 5);
+}
+
+TEST(HttpCompressionTest, FailsOnCorruptData) {
+  std::string compressed = GzipCompress(Prompt(100)).value();
+  EXPECT_EQ(GzipDecompress("not gzip").status().code(),
+            absl::StatusCode::kInternal);
+  EXPECT_EQ(GzipDecompress(compressed.substr(0, compressed.size() / 2))
+                .status()
+                .code(),
+            absl::StatusCode::kInternal);
+}
+
+TEST(HttpCompressionTest, CompressesLargeRequests) {
+  HttpCompressionOptions options;
+  options.compress_requests = true;
+  options.min_request_bytes = 1024;
+  CompressionStats stats;
+  std::string compressed;
+
+  const std::string small = Prompt(1);
+  EXPECT_FALSE(MaybeCompressRequest(options, small, &compressed, stats));
+  // Random bytes don't get any smaller.
+  std::string noise;
+  uint32_t x = 1;
+  for (int i = 0; i < 4096; ++i) {
+    x = x * 1103515245 + 12345;
+    noise.push_back(static_cast<char>(x >> 16));
+  }
+  EXPECT_FALSE(MaybeCompressRequest(options, noise, &compressed, stats));
+
+  const std::string large = Prompt(1000);
+  ASSERT_TRUE(MaybeCompressRequest(options, large, &compressed, stats));
+  EXPECT_EQ(GzipDecompress(compressed).value(), large);
+  EXPECT_EQ(stats.sent().bodies, 1);
+  EXPECT_EQ(stats.sent().bytes, large.size());
+  EXPECT_EQ(stats.sent().bytes_saved(), large.size() - compressed.size());
+
+  options.compress_requests = false;
+  EXPECT_FALSE(MaybeCompressRequest(options, large, &compressed, stats));
+}
+
+}  // namespace
+}  // namespace networking
+}  // namespace interop
+}  // namespace genc
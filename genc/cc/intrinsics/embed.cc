@@ -0,0 +1,106 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/intrinsics/embed.h"
+
+#include <cmath>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace intrinsics {
+namespace {
+
+// Dimension of the embeddings of the test model.
+constexpr int kTestModelDimension = 8;
+
+// Returns a deterministic embedding of `text` for tests: a normalized bag of
+// bytes hashed into `kTestModelDimension` buckets, so that texts sharing more
+// characters are more similar.
+v0::Value TestModelEmbedding(const std::string& text) {
+  float embedding[kTestModelDimension] = {};
+  float norm = 0.0f;
+  for (unsigned char c : text) {
+    embedding[c % kTestModelDimension] += 1.0f;
+  }
+  for (float x : embedding) {
+    norm += x * x;
+  }
+  if (norm > 0.0f) {
+    for (float& x : embedding) {
+      x /= std::sqrt(norm);
+    }
+  }
+  return CreateFloatTensor(embedding);
+}
+
+}  // namespace
+
+absl::Status Embed::CheckWellFormed(const v0::Intrinsic& intrinsic_pb) const {
+  if (!intrinsic_pb.static_parameter().has_struct_() ||
+      intrinsic_pb.static_parameter().struct_().element_size() == 0) {
+    return absl::InvalidArgumentError("Expected struct_ to be set, got none.");
+  }
+  if (!intrinsic_pb.static_parameter().struct_().element(0).has_str()) {
+    return absl::InvalidArgumentError(
+        "Expected model_uri to be set, got none.");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Embed::ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                                const v0::Value& arg, v0::Value* result,
+                                Context* context) const {
+  if (arg.has_struct_()) {
+    for (const v0::Value& element : arg.struct_().element()) {
+      if (!element.has_str()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Expected a struct of strings, got: ", arg.DebugString()));
+      }
+    }
+  } else if (!arg.has_str()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected a string or a struct of strings, got: ", arg.DebugString()));
+  }
+
+  const std::string& model_uri =
+      intrinsic_pb.static_parameter().struct_().element(0).str();
+  if (model_uri == "test_model") {
+    if (arg.has_str()) {
+      *result = TestModelEmbedding(arg.str());
+    } else {
+      v0::Struct* embeddings = result->mutable_struct_();
+      for (const v0::Value& element : arg.struct_().element()) {
+        *embeddings->add_element() = TestModelEmbedding(element.str());
+      }
+    }
+    return absl::OkStatus();
+  }
+  auto it = embedding_map_.find(model_uri);
+  if (it == embedding_map_.end()) {
+    return absl::UnimplementedError(
+        absl::StrCat("Unsupported embedding model: ", model_uri));
+  }
+  *result = GENC_TRY(it->second(intrinsic_pb, arg));
+  return absl::OkStatus();
+}
+
+}  // namespace intrinsics
+}  // namespace genc
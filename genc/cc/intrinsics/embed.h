@@ -0,0 +1,62 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTRINSICS_EMBED_H_
+#define GENC_CC_INTRINSICS_EMBED_H_
+
+#include <functional>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "genc/cc/intrinsics/intrinsic_uris.h"
+#include "genc/cc/runtime/intrinsic_handler.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace intrinsics {
+
+// Computes embeddings of text with the model named by the static parameter.
+class Embed : public InlineIntrinsicHandlerBase {
+ public:
+  // Takes the intrinsic (for access to the model config) and either a string
+  // or a struct of strings, and returns a float tensor for each, in the same
+  // shape. Backends are expected to embed a struct of strings in as few model
+  // calls as they can.
+  typedef std::function<absl::StatusOr<v0::Value>(
+      v0::Intrinsic intrinsic_pb, const v0::Value)>
+      EmbeddingFn;
+  typedef absl::flat_hash_map<std::string, EmbeddingFn> EmbeddingMap;
+
+  Embed(const EmbeddingMap& embedding_map)
+      : InlineIntrinsicHandlerBase(kEmbed), embedding_map_(embedding_map) {}
+
+  virtual ~Embed() {}
+
+  absl::Status CheckWellFormed(const v0::Intrinsic& intrinsic_pb) const final;
+
+  absl::Status ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                           const v0::Value& arg, v0::Value* result,
+                           Context* context) const final;
+
+ private:
+  const EmbeddingMap embedding_map_;
+};
+
+}  // namespace intrinsics
+}  // namespace genc
+
+#endif  // GENC_CC_INTRINSICS_EMBED_H_
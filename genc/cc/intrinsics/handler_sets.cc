@@ -23,6 +23,7 @@ limitations under the License
 #include "genc/cc/intrinsics/confidential_computation.h"
 #include "genc/cc/intrinsics/custom_function.h"
 #include "genc/cc/intrinsics/delegate.h"
+#include "genc/cc/intrinsics/embed.h"
 #include "genc/cc/intrinsics/fallback.h"
 #include "genc/cc/intrinsics/inja_template.h"
 #include "genc/cc/intrinsics/logger.h"
@@ -32,10 +33,13 @@ limitations under the License
 #include "genc/cc/intrinsics/parallel_map.h"
 #include "genc/cc/intrinsics/prompt_template.h"
 #include "genc/cc/intrinsics/regex_partial_match.h"
+#include "genc/cc/intrinsics/regex_router.h"
 #include "genc/cc/intrinsics/repeat.h"
 #include "genc/cc/intrinsics/repeated_conditional_chain.h"
 #include "genc/cc/intrinsics/rest_call.h"
 #include "genc/cc/intrinsics/serial_chain.h"
+#include "genc/cc/intrinsics/similarity.h"
+#include "genc/cc/intrinsics/top_k.h"
 #include "genc/cc/intrinsics/while.h"
 #include "genc/cc/runtime/intrinsic_handler.h"
 
@@ -52,6 +56,7 @@ std::shared_ptr<IntrinsicHandlerSet> CreateCompleteHandlerSet(
   handlers->AddHandler(new intrinsics::ConfidentialComputation(
       config.http_client_interface));
   handlers->AddHandler(new intrinsics::Delegate(config.delegate_map));
+  handlers->AddHandler(new intrinsics::Embed(config.embedding_map));
   handlers->AddHandler(new intrinsics::Fallback());
   handlers->AddHandler(new intrinsics::Logger);
   handlers->AddHandler(new intrinsics::InjaTemplate());
@@ -67,8 +72,11 @@ std::shared_ptr<IntrinsicHandlerSet> CreateCompleteHandlerSet(
   handlers->AddHandler(new intrinsics::PromptTemplate());
   handlers->AddHandler(new intrinsics::PromptTemplateWithParameters());
   handlers->AddHandler(new intrinsics::RegexPartialMatch());
+  handlers->AddHandler(new intrinsics::RegexRouter());
   handlers->AddHandler(new intrinsics::Repeat());
   handlers->AddHandler(new intrinsics::RestCall());
+  handlers->AddHandler(new intrinsics::Similarity());
+  handlers->AddHandler(new intrinsics::TopK());
   handlers->AddHandler(new intrinsics::While());
   handlers->AddHandler(new intrinsics::RepeatedConditionalChain());
 
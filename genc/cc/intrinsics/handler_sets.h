@@ -22,6 +22,7 @@ limitations under the License
 #include "genc/cc/interop/networking/http_client_interface.h"
 #include "genc/cc/intrinsics/custom_function.h"
 #include "genc/cc/intrinsics/delegate.h"
+#include "genc/cc/intrinsics/embed.h"
 #include "genc/cc/intrinsics/model_inference.h"
 #include "genc/cc/intrinsics/model_inference_with_config.h"
 #include "genc/cc/runtime/intrinsic_handler.h"
@@ -35,6 +36,7 @@ struct HandlerSetConfig {
   // model_inference_with_config_map into one map.
   ModelInference::InferenceMap model_inference_map;
   ModelInferenceWithConfig::InferenceMap model_inference_with_config_map;
+  Embed::EmbeddingMap embedding_map;
   CustomFunction::FunctionMap custom_function_map;
   std::vector<const IntrinsicHandler*> custom_intrinsics_list;
 
@@ -54,6 +54,7 @@ PYBIND11_MODULE(intrinsic_bindings, m) {
   intrinsics.attr("CONDITIONAL") = py::str(intrinsics::kConditional);
   intrinsics.attr("CUSTOM_FUNCTION") = py::str(intrinsics::kCustomFunction);
   intrinsics.attr("DELEGATE") = py::str(intrinsics::kDelegate);
+  intrinsics.attr("EMBED") = py::str(intrinsics::kEmbed);
   intrinsics.attr("FALLBACK") = py::str(intrinsics::kFallback);
   intrinsics.attr("LOGGER") = py::str(intrinsics::kLogger);
   intrinsics.attr("LOGICAL_NOT") = py::str(intrinsics::kLogicalNot);
@@ -66,10 +67,13 @@ PYBIND11_MODULE(intrinsic_bindings, m) {
   intrinsics.attr("PARALLEL_MAP") = py::str(intrinsics::kParallelMap);
   intrinsics.attr("REGEX_PARTIAL_MATCH") =
       py::str(intrinsics::kRegexPartialMatch);
+  intrinsics.attr("REGEX_ROUTER") = py::str(intrinsics::kRegexRouter);
   intrinsics.attr("REPEAT") = py::str(intrinsics::kRepeat);
   intrinsics.attr("REPEATED_CONDITIONAL_CHAIN") =
       py::str(intrinsics::kRepeatedConditionalChain);
   intrinsics.attr("SERIAL_CHAIN") = py::str(intrinsics::kSerialChain);
+  intrinsics.attr("SIMILARITY") = py::str(intrinsics::kSimilarity);
+  intrinsics.attr("TOP_K") = py::str(intrinsics::kTopK);
   intrinsics.attr("WHILE") = py::str(intrinsics::kWhile);
   intrinsics.attr("CONFIDENTIAL_COMPUTATION") =
       py::str(intrinsics::kConfidentialComputation);
@@ -71,6 +71,28 @@ inline constexpr absl::string_view kModelInference = "model_inference";
 inline constexpr absl::string_view kModelInferenceWithConfig =
         "model_inference_with_config";
 
+// Computes embeddings of text with a model.
+// Takes one static struct_ parameter containing 'model_uri' of a string type
+// and optionally 'model_config' of a string or struct_ type.
+// Takes one dynamic parameter, either a string or a struct of strings, and
+// returns a rank-1 float tensor per string, in the same shape.
+inline constexpr absl::string_view kEmbed = "embed";
+
+// Scores the similarity of two float tensors.
+// Takes one static string parameter naming the metric: "cosine", "dot" (the
+// dot product) or "l2" (the negated squared Euclidean distance).
+// Takes one dynamic struct parameter of two rank-1 float tensors of the same
+// size, and returns a float_32 score, which is higher for more similar tensors.
+inline constexpr absl::string_view kSimilarity = "similarity";
+
+// Finds the float tensors most similar to a query.
+// Takes one static struct_ parameter containing 'k' of an int_32 type and
+// 'metric' of a string type, as in `kSimilarity`.
+// Takes one dynamic struct parameter of a query tensor and a struct of
+// candidate tensors of the same size. Returns a struct of (at most) k structs
+// of the candidate's 'index' and its 'score', most similar first.
+inline constexpr absl::string_view kTopK = "top_k";
+
 // Calls a user defined custom function.
 // Takes one static parameter "fn_uri" of a string type.
 // Takes one dynamic value parameter, which serves as the input to the function.
@@ -100,6 +122,18 @@ inline constexpr absl::string_view kPromptTemplateWithParameters =
 // a match, False otherwise.
 inline constexpr absl::string_view kRegexPartialMatch = "regex_partial_match";
 
+// Routes a string input to the first of several branches whose regex pattern
+// finds a partial match in it. All patterns are compiled together into a single
+// RE2::Set when the intrinsic is first prepared, so routing scans the input
+// once regardless of the number of branches.
+// Takes a struct static parameter, in which each element labeled "route" is
+// a two-element struct of a pattern string and the branch function, and an
+// optional element labeled "default" holds the function to invoke when none
+// of the patterns match.
+// Takes one dynamic string parameter, which is matched against the patterns
+// and then passed on as the argument to the selected branch.
+inline constexpr absl::string_view kRegexRouter = "regex_router";
+
 // Represents a loop that repeats its logic n times sequentially .
 // Takes one static parameter contains body_fn and num_steps.
 // Takes one dynamic Value parameter, which serves as the input to the loop.
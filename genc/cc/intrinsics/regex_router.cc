@@ -0,0 +1,201 @@
+/* Copyright 2023, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/intrinsics/regex_router.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "genc/cc/runtime/intrinsic_handler.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+#include "re2/re2.h"
+#include "re2/set.h"
+
+namespace genc {
+namespace intrinsics {
+namespace {
+
+constexpr char kRouteLabel[] = "route";
+constexpr char kDefaultLabel[] = "default";
+
+bool IsRoute(const v0::Value& element) {
+  return element.label() == kRouteLabel;
+}
+
+// Joins the patterns of all routes into a single key for the compiled cache.
+// Each pattern is prefixed with its length, so that no two lists of patterns
+// share a key, whatever characters they contain.
+std::string PatternsKey(const v0::Intrinsic& intrinsic_pb) {
+  std::string key;
+  for (const v0::Value& element :
+       intrinsic_pb.static_parameter().struct_().element()) {
+    if (IsRoute(element)) {
+      const std::string& pattern = element.struct_().element(0).str();
+      absl::StrAppend(&key, pattern.size(), ":", pattern);
+    }
+  }
+  return key;
+}
+
+}  // namespace
+
+absl::Status RegexRouter::CheckWellFormed(
+    const v0::Intrinsic& intrinsic_pb) const {
+  if (!intrinsic_pb.static_parameter().has_struct_()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Static parameter is not a struct: ",
+                     intrinsic_pb.static_parameter().DebugString()));
+  }
+  int num_routes = 0;
+  int num_defaults = 0;
+  for (const v0::Value& element :
+       intrinsic_pb.static_parameter().struct_().element()) {
+    if (IsRoute(element)) {
+      if (!element.has_struct_() || element.struct_().element_size() != 2 ||
+          !element.struct_().element(0).has_str()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Each route must be a pair of a pattern string and a branch: ",
+            element.DebugString()));
+      }
+      ++num_routes;
+    } else if (element.label() == kDefaultLabel) {
+      ++num_defaults;
+    } else {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unexpected static parameter: ", element.label()));
+    }
+  }
+  if (num_routes == 0) {
+    return absl::InvalidArgumentError("Missing routes.");
+  }
+  if (num_defaults > 1) {
+    return absl::InvalidArgumentError("More than one default branch.");
+  }
+  return GetOrCompilePatterns(intrinsic_pb).status();
+}
+
+absl::StatusOr<std::shared_ptr<const RE2::Set>>
+RegexRouter::GetOrCompilePatterns(const v0::Intrinsic& intrinsic_pb) const {
+  std::string key = PatternsKey(intrinsic_pb);
+  {
+    absl::ReaderMutexLock lock(&patterns_mutex_);
+    auto it = compiled_patterns_.find(key);
+    if (it != compiled_patterns_.end()) {
+      it->second.last_used = ++clock_;
+      return it->second.set;
+    }
+  }
+
+  // Compile outside of the lock; if another thread races us to it, the first
+  // set inserted wins and this one is discarded.
+  auto patterns =
+      std::make_shared<RE2::Set>(RE2::DefaultOptions, RE2::UNANCHORED);
+  for (const v0::Value& element :
+       intrinsic_pb.static_parameter().struct_().element()) {
+    if (!IsRoute(element)) {
+      continue;
+    }
+    const std::string& pattern = element.struct_().element(0).str();
+    std::string error;
+    if (patterns->Add(pattern, &error) < 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid pattern \"", pattern, "\": ", error));
+    }
+  }
+  if (!patterns->Compile()) {
+    return absl::ResourceExhaustedError(
+        "Failed to compile the patterns, likely out of memory.");
+  }
+
+  absl::MutexLock lock(&patterns_mutex_);
+  auto [it, inserted] = compiled_patterns_.try_emplace(key);
+  if (inserted) {
+    it->second.set = std::move(patterns);
+    // Routers built from patterns that vary per request would otherwise grow
+    // the cache without bound.
+    if (compiled_patterns_.size() > kMaxCompiledPatterns) {
+      auto lru = compiled_patterns_.end();
+      for (auto entry = compiled_patterns_.begin();
+           entry != compiled_patterns_.end(); ++entry) {
+        if (entry != it && (lru == compiled_patterns_.end() ||
+                            entry->second.last_used <
+                                lru->second.last_used)) {
+          lru = entry;
+        }
+      }
+      compiled_patterns_.erase(lru);
+    }
+  }
+  it->second.last_used = ++clock_;
+  return it->second.set;
+}
+
+absl::StatusOr<ControlFlowIntrinsicHandlerInterface::ValueRef>
+RegexRouter::ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                         std::optional<ValueRef> arg, Context* context) const {
+  if (!arg.has_value()) {
+    return absl::InvalidArgumentError("Missing input to route.");
+  }
+  v0::Value input_pb;
+  GENC_TRY(context->Materialize(arg.value(), &input_pb));
+  if (!input_pb.has_str()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Argument is not a string: ", input_pb.DebugString()));
+  }
+
+  std::shared_ptr<const RE2::Set> patterns =
+      GENC_TRY(GetOrCompilePatterns(intrinsic_pb));
+  std::vector<int> matches;
+  const v0::Value* branch_pb = nullptr;
+  if (patterns->Match(input_pb.str(), &matches)) {
+    // RE2::Set reports matches in no particular order; the routes are tried in
+    // the order listed, so the lowest index wins.
+    int route = *std::min_element(matches.begin(), matches.end());
+    for (const v0::Value& element :
+         intrinsic_pb.static_parameter().struct_().element()) {
+      if (IsRoute(element) && route-- == 0) {
+        branch_pb = &element.struct_().element(1);
+        break;
+      }
+    }
+  } else {
+    for (const v0::Value& element :
+         intrinsic_pb.static_parameter().struct_().element()) {
+      if (element.label() == kDefaultLabel) {
+        branch_pb = &element;
+        break;
+      }
+    }
+  }
+  if (branch_pb == nullptr) {
+    return absl::NotFoundError(absl::StrCat(
+        "No route matches the input, and no default branch was given: ",
+        input_pb.str()));
+  }
+
+  ValueRef branch = GENC_TRY(context->CreateValue(*branch_pb));
+  return context->CreateCall(branch, arg);
+}
+
+}  // namespace intrinsics
+}  // namespace genc
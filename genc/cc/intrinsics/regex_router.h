@@ -0,0 +1,77 @@
+/* Copyright 2023, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_INTRINSICS_REGEX_ROUTER_H_
+#define GENC_CC_INTRINSICS_REGEX_ROUTER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "genc/cc/intrinsics/intrinsic_uris.h"
+#include "genc/cc/runtime/intrinsic_handler.h"
+#include "genc/proto/v0/computation.pb.h"
+#include "re2/set.h"
+
+namespace genc {
+namespace intrinsics {
+
+class RegexRouter : public ControlFlowIntrinsicHandlerBase {
+ public:
+  RegexRouter() : ControlFlowIntrinsicHandlerBase(kRegexRouter) {}
+
+  virtual ~RegexRouter() {}
+
+  // Validates the routes and compiles their patterns into an RE2::Set that is
+  // cached for subsequent calls with the same list of patterns. The sets of
+  // the least recently used lists are dropped once more than
+  // `kMaxCompiledPatterns` are cached, and compiled again when next used.
+  absl::Status CheckWellFormed(const v0::Intrinsic& intrinsic_pb) const final;
+
+  absl::StatusOr<ValueRef> ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                                       std::optional<ValueRef> arg,
+                                       Context* context) const final;
+
+  static constexpr int kMaxCompiledPatterns = 64;
+
+ private:
+  struct CompiledPatterns {
+    std::shared_ptr<const RE2::Set> set;
+    // When it was last used, in ticks of `clock_`.
+    mutable std::atomic<int64_t> last_used{0};
+  };
+
+  // Returns the compiled set for the routes in `intrinsic_pb`, compiling and
+  // caching it if this is the first time these patterns are seen.
+  absl::StatusOr<std::shared_ptr<const RE2::Set>> GetOrCompilePatterns(
+      const v0::Intrinsic& intrinsic_pb) const;
+
+  mutable absl::Mutex patterns_mutex_;
+  mutable absl::node_hash_map<std::string, CompiledPatterns>
+      compiled_patterns_ ABSL_GUARDED_BY(patterns_mutex_);
+  mutable std::atomic<int64_t> clock_{0};
+};
+
+}  // namespace intrinsics
+}  // namespace genc
+
+#endif  // GENC_CC_INTRINSICS_REGEX_ROUTER_H_
@@ -0,0 +1,62 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/intrinsics/similarity.h"
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace intrinsics {
+
+absl::Status Similarity::CheckWellFormed(
+    const v0::Intrinsic& intrinsic_pb) const {
+  if (!intrinsic_pb.static_parameter().has_str()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Static parameter is not a string:",
+                     intrinsic_pb.static_parameter().DebugString()));
+  }
+  return ParseVectorMetric(intrinsic_pb.static_parameter().str()).status();
+}
+
+absl::Status Similarity::ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                                     const v0::Value& arg, v0::Value* result,
+                                     Context* context) const {
+  if (!arg.has_struct_() || arg.struct_().element_size() != 2) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected a struct of two tensors, got: ", arg.DebugString()));
+  }
+  const VectorMetric metric =
+      GENC_TRY(ParseVectorMetric(intrinsic_pb.static_parameter().str()));
+  const std::vector<float> a =
+      GENC_TRY(GetFloatTensor(arg.struct_().element(0)));
+  const std::vector<float> b =
+      GENC_TRY(GetFloatTensor(arg.struct_().element(1)));
+  if (a.size() != b.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Tensors differ in size: ", a.size(), " vs ", b.size()));
+  }
+  result->set_float_32(Score(metric, a, b));
+  return absl::OkStatus();
+}
+
+}  // namespace intrinsics
+}  // namespace genc
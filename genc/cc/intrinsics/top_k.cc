@@ -0,0 +1,90 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/intrinsics/top_k.h"
+
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace intrinsics {
+
+absl::Status TopK::CheckWellFormed(const v0::Intrinsic& intrinsic_pb) const {
+  const v0::Value& params = intrinsic_pb.static_parameter();
+  if (!params.has_struct_() || params.struct_().element_size() != 2 ||
+      !params.struct_().element(0).has_int_32() ||
+      !params.struct_().element(1).has_str()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected a struct of k and metric, got: ", params.DebugString()));
+  }
+  if (params.struct_().element(0).int_32() <= 0) {
+    return absl::InvalidArgumentError("Expected k to be positive.");
+  }
+  return ParseVectorMetric(params.struct_().element(1).str()).status();
+}
+
+absl::Status TopK::ExecuteCall(const v0::Intrinsic& intrinsic_pb,
+                               const v0::Value& arg, v0::Value* result,
+                               Context* context) const {
+  if (!arg.has_struct_() || arg.struct_().element_size() != 2 ||
+      !arg.struct_().element(1).has_struct_()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Expected a struct of a query tensor and a struct of candidate "
+        "tensors, got: ",
+        arg.DebugString()));
+  }
+  const v0::Struct& params = intrinsic_pb.static_parameter().struct_();
+  const VectorMetric metric =
+      GENC_TRY(ParseVectorMetric(params.element(1).str()));
+  const std::vector<float> query =
+      GENC_TRY(GetFloatTensor(arg.struct_().element(0)));
+
+  // Decode all candidates into one row-major matrix, so that they are scored
+  // in a single pass over contiguous memory.
+  const v0::Struct& candidates = arg.struct_().element(1).struct_();
+  std::vector<float> matrix;
+  matrix.reserve(query.size() * candidates.element_size());
+  for (const v0::Value& candidate : candidates.element()) {
+    const size_t offset = matrix.size();
+    GENC_TRY(AppendFloatTensor(candidate, &matrix));
+    if (matrix.size() - offset != query.size()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Candidate has ", matrix.size() - offset,
+                       " elements, but the query has ", query.size()));
+    }
+  }
+
+  v0::Struct* top = result->mutable_struct_();
+  for (const ScoredIndex& scored :
+       genc::TopK(metric, query, matrix, params.element(0).int_32())) {
+    v0::Struct* entry = top->add_element()->mutable_struct_();
+    v0::Value* index = entry->add_element();
+    index->set_label("index");
+    index->set_int_32(scored.index);
+    v0::Value* score = entry->add_element();
+    score->set_label("score");
+    score->set_float_32(scored.score);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace intrinsics
+}  // namespace genc
@@ -0,0 +1,107 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/parsers/sse_parser.h"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+
+namespace genc {
+
+bool SseParser::Feed(absl::string_view bytes, const EventFn& on_event) {
+  // Nothing to parse, and a LF may still follow a CR fed before.
+  if (bytes.empty()) return true;
+  // A CR at the end of the last bytes already ended its line.
+  if (after_cr_ && bytes.front() == '\n') {
+    bytes.remove_prefix(1);
+  }
+  after_cr_ = false;
+  while (!bytes.empty()) {
+    const size_t end = bytes.find_first_of("\r\n");
+    if (end == absl::string_view::npos) {
+      line_.append(bytes.data(), bytes.size());
+      return true;
+    }
+    bool keep_going;
+    if (line_.empty()) {
+      keep_going = ProcessLine(bytes.substr(0, end), on_event);
+    } else {
+      line_.append(bytes.data(), end);
+      keep_going = ProcessLine(line_, on_event);
+      line_.clear();
+    }
+    const bool cr = bytes[end] == '\r';
+    bytes.remove_prefix(end + 1);
+    if (cr) {
+      if (bytes.empty()) {
+        after_cr_ = true;
+      } else if (bytes.front() == '\n') {
+        bytes.remove_prefix(1);
+      }
+    }
+    if (!keep_going) return false;
+  }
+  return true;
+}
+
+bool SseParser::ProcessLine(absl::string_view line, const EventFn& on_event) {
+  if (line.empty()) {
+    // Dispatches the event, if it has data.
+    if (data_.empty()) {
+      type_.clear();
+      return true;
+    }
+    Event event;
+    event.type = type_.empty() ? "message" : std::move(type_);
+    // Drops the newline after the last data line.
+    data_.pop_back();
+    event.data = std::move(data_);
+    event.id = id_;
+    type_.clear();
+    data_.clear();
+    return on_event(event);
+  }
+  if (line.front() == ':') {
+    // A comment, e.g. a keep-alive.
+    return true;
+  }
+  absl::string_view field = line;
+  absl::string_view value;
+  const size_t colon = line.find(':');
+  if (colon != absl::string_view::npos) {
+    field = line.substr(0, colon);
+    value = line.substr(colon + 1);
+    if (!value.empty() && value.front() == ' ') {
+      value.remove_prefix(1);
+    }
+  }
+  if (field == "data") {
+    absl::StrAppend(&data_, value, "\n");
+  } else if (field == "event") {
+    type_ = std::string(value);
+  } else if (field == "id") {
+    if (value.find('\0') == absl::string_view::npos) {
+      id_ = std::string(value);
+    }
+  }
+  // Other fields, such as "retry", are ignored.
+  return true;
+}
+
+}  // namespace genc
@@ -0,0 +1,63 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_PARSERS_SSE_PARSER_H_
+#define GENC_CC_MODULES_PARSERS_SSE_PARSER_H_
+
+#include <functional>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace genc {
+
+// Incremental parser of server-sent events, i.e. a text/event-stream body as
+// specified by https://html.spec.whatwg.org/multipage/server-sent-events.html.
+// It is fed bytes as they arrive, split anywhere, and emits each event as
+// soon as the blank line that ends it arrives.
+class SseParser {
+ public:
+  struct Event {
+    // "message" unless the event names its type.
+    std::string type;
+    // The event's data lines, joined by "\n".
+    std::string data;
+    // The last event id seen so far in the stream.
+    std::string id;
+  };
+
+  // Returns false to stop parsing.
+  using EventFn = std::function<bool(const Event& event)>;
+
+  // Parses `bytes`, and calls `on_event` for each event they complete.
+  // Returns false if `on_event` did.
+  bool Feed(absl::string_view bytes, const EventFn& on_event);
+
+ private:
+  // Returns false if `on_event` did.
+  bool ProcessLine(absl::string_view line, const EventFn& on_event);
+
+  // The start of a line whose end hasn't arrived yet.
+  std::string line_;
+  // Whether the last byte fed was a CR, which a LF may follow.
+  bool after_cr_ = false;
+  std::string type_;
+  std::string data_;
+  std::string id_;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_PARSERS_SSE_PARSER_H_
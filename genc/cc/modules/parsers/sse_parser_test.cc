@@ -0,0 +1,113 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/parsers/sse_parser.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+
+namespace genc {
+
+namespace {
+
+using ::testing::ElementsAre;
+
+// Formats events as "type/id: data".
+std::vector<std::string> Parse(SseParser& parser, absl::string_view bytes) {
+  std::vector<std::string> events;
+  parser.Feed(bytes, [&](const SseParser::Event& event) {
+    events.push_back(absl::StrCat(event.type, "/", event.id, ": ", event.data));
+    return true;
+  });
+  return events;
+}
+
+constexpr absl::string_view kStream =
+    ": keep-alive\r\n"
+    "data: {\"a\": 1}\r\n"
+    "\r\n"
+    "event: update\n"
+    "id: 7\n"
+    "data:two\n"
+    "data:  lines\n"
+    "retry: 100\n"
+    "\n"
+    "event: ignored without data\r"
+    "\r"
+    "data\r"
+    "\r"
+    "data: unfinished";
+
+TEST(SseParserTest, ParsesEvents) {
+  SseParser parser;
+  EXPECT_THAT(Parse(parser, kStream),
+              ElementsAre("message/: {\"a\": 1}", "update/7: two\n lines",
+                          "message/7: "));
+  // The last event is dispatched by the blank line that ends it.
+  EXPECT_THAT(Parse(parser, "\n"), ElementsAre());
+  EXPECT_THAT(Parse(parser, "\n"), ElementsAre("message/7: unfinished"));
+}
+
+TEST(SseParserTest, ParsesBytesSplitAnywhere) {
+  std::vector<std::string> expected;
+  {
+    SseParser parser;
+    expected = Parse(parser, kStream);
+  }
+  for (size_t split = 0; split <= kStream.size(); ++split) {
+    SseParser parser;
+    std::vector<std::string> events = Parse(parser, kStream.substr(0, split));
+    for (std::string& event : Parse(parser, kStream.substr(split))) {
+      events.push_back(event);
+    }
+    EXPECT_EQ(events, expected) << "split at " << split;
+  }
+  SseParser parser;
+  std::vector<std::string> events;
+  for (char c : kStream) {
+    for (std::string& event : Parse(parser, absl::string_view(&c, 1))) {
+      events.push_back(event);
+    }
+  }
+  EXPECT_EQ(events, expected);
+}
+
+TEST(SseParserTest, IgnoresEmptyBytesBetweenCrAndLf) {
+  SseParser parser;
+  EXPECT_THAT(Parse(parser, "data: a\r"), ElementsAre());
+  EXPECT_THAT(Parse(parser, ""), ElementsAre());
+  EXPECT_THAT(Parse(parser, "\ndata: b\r\n\r\n"),
+              ElementsAre("message/: a\nb"));
+}
+
+TEST(SseParserTest, StopsWhenAsked) {
+  SseParser parser;
+  int num_events = 0;
+  EXPECT_FALSE(parser.Feed("data: 1\n\ndata: 2\n\n",
+                           [&](const SseParser::Event&) {
+                             ++num_events;
+                             return false;
+                           }));
+  EXPECT_EQ(num_events, 1);
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,576 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/bm25_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/proto/v0/computation.pb.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// SSE2 is part of x86-64, so it needs neither flags nor runtime detection.
+#define GENC_BM25_HAVE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define GENC_BM25_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace genc {
+namespace {
+
+bool IsTermByte(char c) {
+  return absl::ascii_isalnum(c) || static_cast<unsigned char>(c) >= 0x80;
+}
+
+void PutVarint(uint32_t value, std::vector<uint8_t>& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* GetVarint(const uint8_t* p, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *p++;
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  *value = result;
+  return p;
+}
+
+// Whether `a` ranks before `b` in search results.
+bool RanksBefore(const ScoredIndex& a, const ScoredIndex& b) {
+  return a.score > b.score || (a.score == b.score && a.index < b.index);
+}
+
+std::vector<ScoredIndex> Best(std::vector<ScoredIndex> scored, int k) {
+  if (k < 0) {
+    k = 0;
+  }
+  if (scored.size() > static_cast<size_t>(k)) {
+    std::nth_element(scored.begin(), scored.begin() + k, scored.end(),
+                     RanksBefore);
+    scored.resize(k);
+  }
+  std::sort(scored.begin(), scored.end(), RanksBefore);
+  return scored;
+}
+
+#if GENC_BM25_HAVE_SSE2
+
+// Compares four ids of each sequence at a time, all against all, by rotating
+// the ids of `b` through the lanes. Whichever block of four ends first is
+// done, since its ids are below all ids of the other one yet to come.
+size_t Sse2Intersect(const uint32_t* a, size_t a_size, const uint32_t* b,
+                     size_t b_size, uint32_t* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t count = 0;
+  while (i + 4 <= a_size && j + 4 <= b_size) {
+    const __m128i va =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    const __m128i vb =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+    const __m128i b1 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+    const __m128i b2 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+    const __m128i b3 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3));
+    const __m128i eq =
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                                  _mm_cmpeq_epi32(va, b1)),
+                     _mm_or_si128(_mm_cmpeq_epi32(va, b2),
+                                  _mm_cmpeq_epi32(va, b3)));
+    for (int mask = _mm_movemask_ps(_mm_castsi128_ps(eq)); mask != 0;
+         mask &= mask - 1) {
+      out[count++] = a[i + __builtin_ctz(mask)];
+    }
+    const uint32_t a_last = a[i + 3];
+    const uint32_t b_last = b[j + 3];
+    if (a_last <= b_last) {
+      i += 4;
+    }
+    if (b_last <= a_last) {
+      j += 4;
+    }
+  }
+  return count + scalar::IntersectSorted(
+                     absl::MakeConstSpan(a + i, a_size - i),
+                     absl::MakeConstSpan(b + j, b_size - j), out + count);
+}
+
+#elif GENC_BM25_HAVE_NEON
+
+// Same as the SSE2 kernel.
+size_t NeonIntersect(const uint32_t* a, size_t a_size, const uint32_t* b,
+                     size_t b_size, uint32_t* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t count = 0;
+  while (i + 4 <= a_size && j + 4 <= b_size) {
+    const uint32x4_t va = vld1q_u32(a + i);
+    const uint32x4_t vb = vld1q_u32(b + j);
+    const uint32x4_t eq =
+        vorrq_u32(vorrq_u32(vceqq_u32(va, vb),
+                            vceqq_u32(va, vextq_u32(vb, vb, 1))),
+                  vorrq_u32(vceqq_u32(va, vextq_u32(vb, vb, 2)),
+                            vceqq_u32(va, vextq_u32(vb, vb, 3))));
+    if (vmaxvq_u32(eq) != 0) {
+      uint32_t lanes[4];
+      vst1q_u32(lanes, eq);
+      for (int lane = 0; lane < 4; ++lane) {
+        if (lanes[lane] != 0) {
+          out[count++] = a[i + lane];
+        }
+      }
+    }
+    const uint32_t a_last = a[i + 3];
+    const uint32_t b_last = b[j + 3];
+    if (a_last <= b_last) {
+      i += 4;
+    }
+    if (b_last <= a_last) {
+      j += 4;
+    }
+  }
+  return count + scalar::IntersectSorted(
+                     absl::MakeConstSpan(a + i, a_size - i),
+                     absl::MakeConstSpan(b + j, b_size - j), out + count);
+}
+
+#endif
+
+}  // namespace
+
+namespace scalar {
+
+size_t IntersectSorted(absl::Span<const uint32_t> a,
+                       absl::Span<const uint32_t> b, uint32_t* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t count = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i] < b[j]) {
+      ++i;
+    } else if (b[j] < a[i]) {
+      ++j;
+    } else {
+      out[count++] = a[i];
+      ++i;
+      ++j;
+    }
+  }
+  return count;
+}
+
+}  // namespace scalar
+
+size_t IntersectSorted(absl::Span<const uint32_t> a,
+                       absl::Span<const uint32_t> b, uint32_t* out) {
+#if GENC_BM25_HAVE_SSE2
+  return Sse2Intersect(a.data(), a.size(), b.data(), b.size(), out);
+#elif GENC_BM25_HAVE_NEON
+  return NeonIntersect(a.data(), a.size(), b.data(), b.size(), out);
+#else
+  return scalar::IntersectSorted(a, b, out);
+#endif
+}
+
+absl::string_view IntersectKernelIsa() {
+#if GENC_BM25_HAVE_SSE2
+  return "sse2";
+#elif GENC_BM25_HAVE_NEON
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+std::vector<std::string> Bm25Terms(absl::string_view text) {
+  std::vector<std::string> terms;
+  size_t i = 0;
+  while (i < text.size()) {
+    if (!IsTermByte(text[i])) {
+      ++i;
+      continue;
+    }
+    std::string term;
+    for (; i < text.size() && IsTermByte(text[i]); ++i) {
+      term.push_back(absl::ascii_tolower(text[i]));
+    }
+    terms.push_back(std::move(term));
+  }
+  return terms;
+}
+
+// Reads the blocks of a posting list in order, decoding each at most once.
+class Bm25Index::Cursor {
+ public:
+  explicit Cursor(const PostingList& list) : list_(list) {}
+
+  // Moves to the first block whose last id is at least `doc`, skipping the
+  // ones before it undecoded. Returns false past the last block.
+  bool SeekBlock(uint32_t doc) {
+    while (block_ < list_.num_blocks() && list_.LastDoc(block_) < doc) {
+      ++block_;
+    }
+    if (block_ >= list_.num_blocks()) {
+      return false;
+    }
+    if (decoded_ != block_) {
+      size_ = Decode(list_, block_, docs_, freqs_);
+      position_ = 0;
+      decoded_ = block_;
+    }
+    return true;
+  }
+
+  // Returns the frequency of `doc`, or 0 if the list doesn't have it. Must be
+  // called with increasing ids.
+  uint32_t Frequency(uint32_t doc) {
+    if (!SeekBlock(doc)) {
+      return 0;
+    }
+    while (position_ < size_ && docs_[position_] < doc) {
+      ++position_;
+    }
+    return position_ < size_ && docs_[position_] == doc ? freqs_[position_]
+                                                        : 0;
+  }
+
+  // The decoded ids of the current block.
+  absl::Span<const uint32_t> docs() const {
+    return absl::MakeConstSpan(docs_, size_);
+  }
+  uint32_t last_doc() const { return list_.LastDoc(block_); }
+  void NextBlock() { ++block_; }
+
+ private:
+  const PostingList& list_;
+  int block_ = 0;
+  int decoded_ = -1;
+  int size_ = 0;
+  int position_ = 0;
+  uint32_t docs_[kBlockSize];
+  uint32_t freqs_[kBlockSize];
+};
+
+Bm25Index::Bm25Index(const Options& options) : options_(options) {}
+
+void Bm25Index::Append(PostingList& list, uint32_t doc, uint32_t freq) {
+  list.tail_docs.push_back(doc);
+  list.tail_freqs.push_back(freq);
+  ++list.doc_count;
+  if (list.tail_docs.size() < kBlockSize) {
+    return;
+  }
+  Block block;
+  block.offset = list.data.size();
+  block.last_doc = list.tail_docs.back();
+  uint32_t previous = list.blocks.empty() ? 0 : list.blocks.back().last_doc;
+  for (uint32_t tail_doc : list.tail_docs) {
+    PutVarint(tail_doc - previous, list.data);
+    previous = tail_doc;
+  }
+  for (uint32_t tail_freq : list.tail_freqs) {
+    PutVarint(tail_freq - 1, list.data);
+  }
+  list.blocks.push_back(block);
+  list.tail_docs.clear();
+  list.tail_freqs.clear();
+}
+
+int Bm25Index::Decode(const PostingList& list, int block, uint32_t* docs,
+                      uint32_t* freqs) {
+  if (block == static_cast<int>(list.blocks.size())) {
+    std::copy(list.tail_docs.begin(), list.tail_docs.end(), docs);
+    std::copy(list.tail_freqs.begin(), list.tail_freqs.end(), freqs);
+    return list.tail_docs.size();
+  }
+  const uint8_t* p = list.data.data() + list.blocks[block].offset;
+  uint32_t doc = block == 0 ? 0 : list.blocks[block - 1].last_doc;
+  for (int i = 0; i < kBlockSize; ++i) {
+    uint32_t delta;
+    p = GetVarint(p, &delta);
+    doc += delta;
+    docs[i] = doc;
+  }
+  for (int i = 0; i < kBlockSize; ++i) {
+    p = GetVarint(p, &freqs[i]);
+    ++freqs[i];
+  }
+  return kBlockSize;
+}
+
+int Bm25Index::Add(absl::string_view text) {
+  absl::flat_hash_map<std::string, uint32_t> frequencies;
+  const std::vector<std::string> terms = Bm25Terms(text);
+  for (const std::string& term : terms) {
+    ++frequencies[term];
+  }
+  absl::MutexLock lock(&mutex_);
+  const uint32_t id = doc_lengths_.size();
+  for (auto& [term, frequency] : frequencies) {
+    Append(terms_[term], id, frequency);
+  }
+  doc_lengths_.push_back(terms.size());
+  total_length_ += terms.size();
+  return id;
+}
+
+std::vector<const Bm25Index::PostingList*> Bm25Index::Lists(
+    absl::string_view query, bool match_all_terms) const {
+  std::vector<const PostingList*> lists;
+  absl::flat_hash_set<std::string> seen;
+  for (std::string& term : Bm25Terms(query)) {
+    auto it = terms_.find(term);
+    if (it == terms_.end()) {
+      if (match_all_terms) {
+        return {};
+      }
+      continue;
+    }
+    if (seen.insert(std::move(term)).second) {
+      lists.push_back(&it->second);
+    }
+  }
+  return lists;
+}
+
+std::vector<uint32_t> Bm25Index::Intersect(
+    std::vector<const PostingList*> lists) const {
+  // Starts from the shortest list, so that the candidates only shrink, and
+  // long lists are mostly skipped block by block.
+  std::sort(lists.begin(), lists.end(),
+            [](const PostingList* a, const PostingList* b) {
+              return a->doc_count < b->doc_count;
+            });
+  std::vector<uint32_t> candidates;
+  candidates.reserve(lists[0]->doc_count);
+  Cursor first(*lists[0]);
+  for (uint32_t doc = 0; first.SeekBlock(doc); doc = first.last_doc() + 1) {
+    candidates.insert(candidates.end(), first.docs().begin(),
+                      first.docs().end());
+  }
+  std::vector<uint32_t> matches(candidates.size());
+  for (size_t l = 1; l < lists.size() && !candidates.empty(); ++l) {
+    Cursor cursor(*lists[l]);
+    size_t num_matches = 0;
+    size_t begin = 0;
+    while (begin < candidates.size() && cursor.SeekBlock(candidates[begin])) {
+      const size_t end =
+          std::upper_bound(candidates.begin() + begin, candidates.end(),
+                           cursor.last_doc()) -
+          candidates.begin();
+      num_matches += IntersectSorted(
+          absl::MakeConstSpan(candidates).subspan(begin, end - begin),
+          cursor.docs(), matches.data() + num_matches);
+      begin = end;
+      cursor.NextBlock();
+    }
+    matches.resize(num_matches);
+    candidates.swap(matches);
+    matches.resize(candidates.size());
+  }
+  return candidates;
+}
+
+float Bm25Index::Idf(const PostingList& list) const {
+  const double n = doc_lengths_.size();
+  const double df = list.doc_count;
+  return std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+}
+
+float Bm25Index::TermWeight(uint32_t freq, uint32_t doc,
+                            float average_length) const {
+  const float length_norm =
+      average_length > 0.0f
+          ? 1.0f - options_.b + options_.b * doc_lengths_[doc] / average_length
+          : 1.0f;
+  return freq * (options_.k1 + 1.0f) / (freq + options_.k1 * length_norm);
+}
+
+std::vector<ScoredIndex> Bm25Index::Search(
+    absl::string_view query, const SearchOptions& options) const {
+  absl::ReaderMutexLock lock(&mutex_);
+  const std::vector<const PostingList*> lists =
+      Lists(query, options.match_all_terms);
+  if (lists.empty()) {
+    return {};
+  }
+  const float average_length =
+      static_cast<double>(total_length_) / doc_lengths_.size();
+  std::vector<ScoredIndex> scored;
+
+  if (options.match_all_terms) {
+    const std::vector<uint32_t> docs = Intersect(lists);
+    scored.reserve(docs.size());
+    for (uint32_t doc : docs) {
+      scored.push_back({static_cast<int>(doc), 0.0f});
+    }
+    for (const PostingList* list : lists) {
+      const float idf = Idf(*list);
+      Cursor cursor(*list);
+      for (ScoredIndex& result : scored) {
+        result.score +=
+            idf * TermWeight(cursor.Frequency(result.index), result.index,
+                             average_length);
+      }
+    }
+    return Best(std::move(scored), options.k);
+  }
+
+  // Accumulates scores term by term, over every document that has any of
+  // the terms.
+  std::vector<float> scores(doc_lengths_.size(), 0.0f);
+  std::vector<uint32_t> touched;
+  uint32_t docs[kBlockSize];
+  uint32_t freqs[kBlockSize];
+  for (const PostingList* list : lists) {
+    const float idf = Idf(*list);
+    for (int block = 0; block < list->num_blocks(); ++block) {
+      const int size = Decode(*list, block, docs, freqs);
+      for (int i = 0; i < size; ++i) {
+        if (scores[docs[i]] == 0.0f) {
+          touched.push_back(docs[i]);
+        }
+        scores[docs[i]] += idf * TermWeight(freqs[i], docs[i], average_length);
+      }
+    }
+  }
+  scored.reserve(touched.size());
+  for (uint32_t doc : touched) {
+    scored.push_back({static_cast<int>(doc), scores[doc]});
+  }
+  return Best(std::move(scored), options.k);
+}
+
+int Bm25Index::size() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return doc_lengths_.size();
+}
+
+int Bm25Index::num_terms() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  return terms_.size();
+}
+
+size_t Bm25Index::posting_bytes() const {
+  absl::ReaderMutexLock lock(&mutex_);
+  size_t bytes = 0;
+  for (const auto& [term, list] : terms_) {
+    bytes += list.data.size() + list.blocks.size() * sizeof(Block) +
+             list.tail_docs.size() * 2 * sizeof(uint32_t);
+  }
+  return bytes;
+}
+
+absl::Status SetCustomFunctionsForBm25Index(
+    intrinsics::CustomFunction::FunctionMap& fn_map, Bm25Index& index,
+    int default_k) {
+  fn_map[kBm25IndexUri] =
+      [&index](const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    v0::Value result;
+    if (arg.has_str()) {
+      result.set_int_32(index.Add(arg.str()));
+      return result;
+    }
+    if (!arg.has_struct_()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Expected a string or a struct of strings, got: ",
+          arg.DebugString()));
+    }
+    // Checks every document before adding any, so that a failed call adds
+    // none whose ids it couldn't return.
+    for (const v0::Value& document : arg.struct_().element()) {
+      if (!document.has_str()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Expected a string, got: ", document.DebugString()));
+      }
+    }
+    v0::Struct* ids = result.mutable_struct_();
+    for (const v0::Value& document : arg.struct_().element()) {
+      ids->add_element()->set_int_32(index.Add(document.str()));
+    }
+    return result;
+  };
+
+  fn_map[kBm25SearchUri] =
+      [&index, default_k](const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    const v0::Value* query = &arg;
+    Bm25Index::SearchOptions options;
+    options.k = default_k;
+    if (arg.has_struct_()) {
+      if (arg.struct_().element_size() == 0) {
+        return absl::InvalidArgumentError("Expected a query string.");
+      }
+      query = &arg.struct_().element(0);
+      for (int i = 1; i < arg.struct_().element_size(); ++i) {
+        const v0::Value& option = arg.struct_().element(i);
+        if (option.has_int_32()) {
+          options.k = option.int_32();
+        } else if (option.has_boolean() &&
+                   option.label() == "match_all_terms") {
+          options.match_all_terms = option.boolean();
+        } else {
+          return absl::InvalidArgumentError(absl::StrCat(
+              "Expected an int_32 k or a boolean match_all_terms, got: ",
+              option.DebugString()));
+        }
+      }
+    }
+    if (!query->has_str()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Expected a query string, got: ", query->DebugString()));
+    }
+    v0::Value result;
+    v0::Struct* top = result.mutable_struct_();
+    for (const ScoredIndex& scored : index.Search(query->str(), options)) {
+      v0::Struct* entry = top->add_element()->mutable_struct_();
+      v0::Value* id = entry->add_element();
+      id->set_label("index");
+      id->set_int_32(scored.index);
+      v0::Value* score = entry->add_element();
+      score->set_label("score");
+      score->set_float_32(scored.score);
+    }
+    return result;
+  };
+
+  return absl::OkStatus();
+}
+
+}  // namespace genc
@@ -0,0 +1,190 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_BM25_INDEX_H_
+#define GENC_CC_MODULES_RETRIEVAL_BM25_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/modules/vector/vector_math.h"
+
+namespace genc {
+
+constexpr char kBm25IndexUri[] = "/bm25/index";
+constexpr char kBm25SearchUri[] = "/bm25/search";
+
+// Splits `text` into lowercase terms: runs of ASCII letters and digits, and
+// of non-ASCII bytes, so that UTF-8 words stay whole.
+std::vector<std::string> Bm25Terms(absl::string_view text);
+
+// An in-process inverted index that ranks documents by Okapi BM25, for
+// lexical retrieval without an external search service.
+//
+// Each term's posting list holds the ids of the documents that contain it,
+// in increasing order, with the term's frequency in each. Postings are sealed
+// in blocks of kBlockSize, delta- and varint-coded, with the last id of each
+// block kept aside, so that searches that need all query terms can skip the
+// blocks that cannot match without decoding them. Decoded blocks are
+// intersected with SIMD compares where the CPU has them.
+//
+// Add() and Search() may be called from many threads at once; adds are
+// serialized, and searches share a reader lock.
+class Bm25Index {
+ public:
+  struct Options {
+    // Saturates the contribution of a term's frequency in a document.
+    float k1 = 1.2f;
+    // How much scores are normalized by document length, in [0, 1].
+    float b = 0.75f;
+  };
+
+  struct SearchOptions {
+    // Number of results.
+    int k = 10;
+    // Only returns documents containing every query term, rather than any.
+    bool match_all_terms = false;
+  };
+
+  // Number of postings per sealed block.
+  static constexpr int kBlockSize = 128;
+
+  Bm25Index() : Bm25Index(Options()) {}
+  explicit Bm25Index(const Options& options);
+
+  Bm25Index(const Bm25Index&) = delete;
+  Bm25Index& operator=(const Bm25Index&) = delete;
+
+  // Indexes `text` and returns its id. Ids are dense, starting at zero.
+  int Add(absl::string_view text);
+
+  // Returns the (at most) `k` documents that score highest against `query`,
+  // highest first, with their BM25 scores. Ties are broken in favor of the
+  // lower id. Documents that share no term with the query are not returned.
+  std::vector<ScoredIndex> Search(absl::string_view query,
+                                  const SearchOptions& options) const;
+  std::vector<ScoredIndex> Search(absl::string_view query, int k) const {
+    return Search(query, SearchOptions{k});
+  }
+
+  // Returns the number of documents.
+  int size() const;
+
+  // Returns the number of distinct terms.
+  int num_terms() const;
+
+  // Returns the bytes taken by posting lists, compressed or not yet sealed.
+  size_t posting_bytes() const;
+
+ private:
+  struct Block {
+    uint32_t last_doc;
+    // Offset of the block in PostingList::data.
+    uint32_t offset;
+  };
+
+  struct PostingList {
+    std::vector<Block> blocks;
+    std::vector<uint8_t> data;
+    // Postings not yet sealed into a block; fewer than kBlockSize.
+    std::vector<uint32_t> tail_docs;
+    std::vector<uint32_t> tail_freqs;
+    // Number of documents containing the term.
+    uint32_t doc_count = 0;
+
+    int num_blocks() const {
+      return static_cast<int>(blocks.size()) + (tail_docs.empty() ? 0 : 1);
+    }
+    uint32_t LastDoc(int block) const {
+      return block < static_cast<int>(blocks.size()) ? blocks[block].last_doc
+                                                     : tail_docs.back();
+    }
+  };
+
+  // Reads one block of a posting list at a time.
+  class Cursor;
+
+  static void Append(PostingList& list, uint32_t doc, uint32_t freq);
+
+  // Decodes `block` of `list` into `docs` and `freqs`, which hold
+  // kBlockSize, and returns its number of postings.
+  static int Decode(const PostingList& list, int block, uint32_t* docs,
+                    uint32_t* freqs);
+
+  // Returns the posting lists of the distinct terms of `query`; missing
+  // terms are left out, or, if `match_all_terms`, make the result empty.
+  std::vector<const PostingList*> Lists(absl::string_view query,
+                                        bool match_all_terms) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Returns the ids of the documents in all of `lists`, in increasing order.
+  std::vector<uint32_t> Intersect(
+      std::vector<const PostingList*> lists) const;
+
+  float Idf(const PostingList& list) const ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Returns the part of a term's score that depends on the document.
+  float TermWeight(uint32_t freq, uint32_t doc, float average_length) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  const Options options_;
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, PostingList> terms_ ABSL_GUARDED_BY(mutex_);
+  // Number of terms of each document.
+  std::vector<uint32_t> doc_lengths_ ABSL_GUARDED_BY(mutex_);
+  uint64_t total_length_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+// Writes the ids that occur in both of the increasing sequences `a` and `b`
+// to `out`, which must hold min(a.size(), b.size()) ids, and returns their
+// number.
+size_t IntersectSorted(absl::Span<const uint32_t> a,
+                       absl::Span<const uint32_t> b, uint32_t* out);
+
+// Returns the instruction set IntersectSorted dispatches to: "sse2", "neon"
+// or "scalar".
+absl::string_view IntersectKernelIsa();
+
+namespace scalar {
+
+size_t IntersectSorted(absl::Span<const uint32_t> a,
+                       absl::Span<const uint32_t> b, uint32_t* out);
+
+}  // namespace scalar
+
+// Make CustomFunctions aware of a BM25 index.
+// The index function takes a string, or a struct of strings, and returns the
+// int_32 id of each, in the same shape. The search function takes a query
+// string, or a struct of a query string and an int_32 k, and returns a struct
+// of (index, score) structs as the top_k intrinsic does. A struct may also
+// carry a boolean labeled "match_all_terms".
+// Doesn't own it, index must stay alive during the life time of the Runtime.
+absl::Status SetCustomFunctionsForBm25Index(
+    intrinsics::CustomFunction::FunctionMap& fn_map, Bm25Index& index,
+    int default_k = 10);
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_BM25_INDEX_H_
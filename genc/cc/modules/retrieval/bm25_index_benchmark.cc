@@ -0,0 +1,204 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Indexes a synthetic corpus whose term frequencies follow Zipf's law, then
+// measures ingest throughput, the size of the posting lists, and the latency
+// of any-term and all-terms searches, along with the throughput of the SIMD
+// and scalar posting list intersections.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/modules/retrieval/bm25_index.h"
+#include "genc/cc/modules/vector/vector_math.h"
+
+ABSL_FLAG(int, num_docs, 200000, "Number of documents to index.");
+ABSL_FLAG(int, doc_length, 100, "Number of terms per document.");
+ABSL_FLAG(int, vocabulary_size, 50000, "Number of distinct terms.");
+ABSL_FLAG(int, num_queries, 1000, "Number of queries to measure.");
+ABSL_FLAG(int, query_length, 3, "Number of terms per query.");
+ABSL_FLAG(int, k, 10, "Number of results per query.");
+
+namespace genc {
+namespace {
+
+// Draws term ranks with probability proportional to 1 / rank.
+class ZipfTerms {
+ public:
+  ZipfTerms(int vocabulary_size, int seed) : rng_(seed) {
+    cumulative_.reserve(vocabulary_size);
+    double sum = 0.0;
+    for (int rank = 1; rank <= vocabulary_size; ++rank) {
+      sum += 1.0 / rank;
+      cumulative_.push_back(sum);
+    }
+  }
+
+  int Next() {
+    const double x = uniform_(rng_) * cumulative_.back();
+    return std::lower_bound(cumulative_.begin(), cumulative_.end(), x) -
+           cumulative_.begin();
+  }
+
+  std::string Text(int length) {
+    std::string text;
+    for (int i = 0; i < length; ++i) {
+      absl::StrAppend(&text, i == 0 ? "" : " ", "w", Next());
+    }
+    return text;
+  }
+
+ private:
+  std::mt19937 rng_;
+  std::uniform_real_distribution<double> uniform_;
+  std::vector<double> cumulative_;
+};
+
+struct Latency {
+  double mean_us;
+  double p50_us;
+  double p99_us;
+};
+
+Latency Summarize(std::vector<double> micros) {
+  std::sort(micros.begin(), micros.end());
+  double sum = 0.0;
+  for (double us : micros) {
+    sum += us;
+  }
+  return {sum / micros.size(), micros[micros.size() / 2],
+          micros[micros.size() * 99 / 100]};
+}
+
+Latency MeasureSearches(const Bm25Index& index,
+                        const std::vector<std::string>& queries,
+                        const Bm25Index::SearchOptions& options,
+                        double* mean_results) {
+  std::vector<double> micros;
+  size_t results = 0;
+  for (const std::string& query : queries) {
+    const absl::Time start = absl::Now();
+    results += index.Search(query, options).size();
+    micros.push_back(absl::ToDoubleMicroseconds(absl::Now() - start));
+  }
+  *mean_results = static_cast<double>(results) / queries.size();
+  return Summarize(std::move(micros));
+}
+
+// Returns ids per second intersected by `intersect`.
+template <typename Intersect>
+double MeasureIntersect(Intersect intersect) {
+  std::mt19937 rng(3);
+  std::vector<uint32_t> a;
+  std::vector<uint32_t> b;
+  for (uint32_t doc = 0; a.size() < (1 << 16); doc += 1 + rng() % 4) {
+    a.push_back(doc);
+  }
+  for (uint32_t doc = 0; b.size() < (1 << 16); doc += 1 + rng() % 4) {
+    b.push_back(doc);
+  }
+  std::vector<uint32_t> out(a.size());
+  constexpr int kRounds = 200;
+  size_t found = 0;
+  const absl::Time start = absl::Now();
+  for (int round = 0; round < kRounds; ++round) {
+    found += intersect(a, b, out.data());
+  }
+  const double seconds = absl::ToDoubleSeconds(absl::Now() - start);
+  if (found == 0) {
+    std::cerr << "No ids in common.\n";
+  }
+  return 2.0 * a.size() * kRounds / seconds;
+}
+
+void Run() {
+  const int num_docs = absl::GetFlag(FLAGS_num_docs);
+  const int doc_length = absl::GetFlag(FLAGS_doc_length);
+  ZipfTerms terms(absl::GetFlag(FLAGS_vocabulary_size), 1);
+
+  std::vector<std::string> docs;
+  docs.reserve(num_docs);
+  size_t text_bytes = 0;
+  for (int i = 0; i < num_docs; ++i) {
+    docs.push_back(terms.Text(doc_length));
+    text_bytes += docs.back().size();
+  }
+
+  Bm25Index index;
+  absl::Time start = absl::Now();
+  for (const std::string& doc : docs) {
+    index.Add(doc);
+  }
+  const double ingest_seconds = absl::ToDoubleSeconds(absl::Now() - start);
+  std::cout << "isa=" << IntersectKernelIsa() << " num_docs=" << num_docs
+            << " doc_length=" << doc_length
+            << " num_terms=" << index.num_terms() << "\n"
+            << "ingest: " << num_docs / ingest_seconds << " docs/s, "
+            << text_bytes / ingest_seconds / (1 << 20) << " MiB/s\n"
+            << "postings: " << index.posting_bytes() / double{1 << 20}
+            << " MiB\n";
+
+  // Queries mix common and rare terms, as drawn from the same law.
+  std::vector<std::string> queries;
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_queries); ++i) {
+    queries.push_back(terms.Text(absl::GetFlag(FLAGS_query_length)));
+  }
+  for (bool match_all_terms : {false, true}) {
+    Bm25Index::SearchOptions options;
+    options.k = absl::GetFlag(FLAGS_k);
+    options.match_all_terms = match_all_terms;
+    double mean_results;
+    const Latency latency =
+        MeasureSearches(index, queries, options, &mean_results);
+    std::cout << (match_all_terms ? "all terms" : "any term")
+              << ": mean " << latency.mean_us << " us, p50 "
+              << latency.p50_us << " us, p99 " << latency.p99_us
+              << " us, " << mean_results << " results\n";
+  }
+
+  std::cout << "intersect: "
+            << MeasureIntersect([](const std::vector<uint32_t>& a,
+                                   const std::vector<uint32_t>& b,
+                                   uint32_t* out) {
+                 return IntersectSorted(a, b, out);
+               }) / 1e6
+            << " M ids/s, scalar "
+            << MeasureIntersect([](const std::vector<uint32_t>& a,
+                                   const std::vector<uint32_t>& b,
+                                   uint32_t* out) {
+                 return scalar::IntersectSorted(a, b, out);
+               }) / 1e6
+            << " M ids/s\n";
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
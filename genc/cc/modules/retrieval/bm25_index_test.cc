@@ -0,0 +1,251 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/bm25_index.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "genc/cc/authoring/constructor.h"
+#include "genc/cc/intrinsics/handler_sets.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/executor.h"
+#include "genc/cc/runtime/inline_executor.h"
+#include "genc/cc/runtime/runner.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+using ::testing::ElementsAre;
+
+std::vector<int> Ids(const std::vector<ScoredIndex>& results) {
+  std::vector<int> ids;
+  for (const ScoredIndex& result : results) {
+    ids.push_back(result.index);
+  }
+  return ids;
+}
+
+TEST(Bm25TermsTest, SplitsAndLowercases) {
+  EXPECT_THAT(Bm25Terms("Hello, World! It's 2024 -- café."),
+              ElementsAre("hello", "world", "it", "s", "2024", "café"));
+  EXPECT_THAT(Bm25Terms("  ,. "), ElementsAre());
+}
+
+TEST(IntersectSortedTest, MatchesScalar) {
+  std::mt19937 rng(1);
+  for (int round = 0; round < 200; ++round) {
+    std::uniform_int_distribution<size_t> size(0, 300);
+    std::uniform_int_distribution<int> density(1, 8);
+    std::vector<uint32_t> a;
+    std::vector<uint32_t> b;
+    const int a_step = density(rng);
+    const int b_step = density(rng);
+    for (uint32_t doc = 0; a.size() < size(rng); doc += 1 + rng() % a_step) {
+      a.push_back(doc);
+    }
+    for (uint32_t doc = rng() % 4; b.size() < size(rng);
+         doc += 1 + rng() % b_step) {
+      b.push_back(doc);
+    }
+    std::vector<uint32_t> expected(std::min(a.size(), b.size()));
+    expected.resize(scalar::IntersectSorted(a, b, expected.data()));
+    std::vector<uint32_t> actual(std::min(a.size(), b.size()));
+    actual.resize(IntersectSorted(a, b, actual.data()));
+    ASSERT_EQ(actual, expected) << IntersectKernelIsa();
+  }
+}
+
+TEST(Bm25IndexTest, RanksByBm25) {
+  Bm25Index index;
+  EXPECT_EQ(index.Add("the quick brown fox"), 0);
+  EXPECT_EQ(index.Add("the lazy dog"), 1);
+  EXPECT_EQ(index.Add("the quick dog jumps over the quick fox"), 2);
+  EXPECT_EQ(index.size(), 3);
+
+  std::vector<ScoredIndex> results = index.Search("quick fox", 10);
+  // The shorter document wins, although the longer one has "quick" twice.
+  EXPECT_THAT(Ids(results), ElementsAre(0, 2));
+  // Both terms occur in 2 of 3 documents.
+  const float idf = std::log(1.0f + (3 - 2 + 0.5f) / (2 + 0.5f));
+  const float average_length = 15.0f / 3;
+  auto weight = [&](float freq, float length) {
+    return freq * 2.2f / (freq + 1.2f * (0.25f + 0.75f * length /
+                                                     average_length));
+  };
+  EXPECT_NEAR(results[0].score, idf * (weight(1, 4) + weight(1, 4)), 1e-5);
+  EXPECT_NEAR(results[1].score, idf * (weight(2, 8) + weight(1, 8)), 1e-5);
+
+  EXPECT_THAT(Ids(index.Search("dog", 1)), ElementsAre(1));
+  EXPECT_THAT(index.Search("cat", 10), ElementsAre());
+  EXPECT_THAT(index.Search("", 10), ElementsAre());
+}
+
+TEST(Bm25IndexTest, MatchAllTermsNeedsEveryTerm) {
+  Bm25Index index;
+  index.Add("quick fox");
+  index.Add("quick dog");
+  index.Add("lazy fox and quick dog");
+  Bm25Index::SearchOptions options;
+  options.match_all_terms = true;
+  EXPECT_THAT(Ids(index.Search("quick dog", options)), ElementsAre(1, 2));
+  EXPECT_THAT(Ids(index.Search("fox dog", options)), ElementsAre(2));
+  EXPECT_THAT(index.Search("fox cat", options), ElementsAre());
+  // Any-term search ranks the same documents the same way.
+  std::vector<ScoredIndex> any = index.Search("fox dog", 10);
+  std::vector<ScoredIndex> all = index.Search("fox dog", options);
+  ASSERT_EQ(all.size(), 1);
+  EXPECT_EQ(any[0].index, all[0].index);
+  EXPECT_FLOAT_EQ(any[0].score, all[0].score);
+}
+
+// Many documents, so that posting lists span sealed blocks, checked against
+// brute force.
+TEST(Bm25IndexTest, AgreesWithBruteForceAcrossBlocks) {
+  Bm25Index index;
+  std::vector<std::vector<std::string>> docs;
+  std::mt19937 rng(7);
+  for (int d = 0; d < 2000; ++d) {
+    std::string text;
+    std::vector<std::string> terms;
+    const int length = 3 + rng() % 10;
+    for (int t = 0; t < length; ++t) {
+      // Terms are log-uniform, so that low ones are common.
+      const int term = static_cast<int>(std::pow(50.0, rng() % 1000 / 1000.0));
+      terms.push_back(absl::StrCat("t", term));
+      absl::StrAppend(&text, " t", term);
+    }
+    docs.push_back(terms);
+    ASSERT_EQ(index.Add(text), d);
+  }
+
+  for (const char* query : {"t1 t2", "t0 t7 t30", "t3 t4 t5", "t40"}) {
+    const std::vector<std::string> query_terms = Bm25Terms(query);
+    for (bool match_all_terms : {false, true}) {
+      size_t expected = 0;
+      for (const std::vector<std::string>& terms : docs) {
+        bool any = false;
+        bool all = true;
+        for (const std::string& query_term : query_terms) {
+          bool found = false;
+          for (const std::string& term : terms) {
+            found |= term == query_term;
+          }
+          any |= found;
+          all &= found;
+        }
+        expected += match_all_terms ? all : any;
+      }
+      Bm25Index::SearchOptions options;
+      options.k = docs.size();
+      options.match_all_terms = match_all_terms;
+      std::vector<ScoredIndex> results = index.Search(query, options);
+      EXPECT_EQ(results.size(), expected) << query;
+      for (size_t i = 1; i < results.size(); ++i) {
+        EXPECT_GE(results[i - 1].score, results[i].score);
+      }
+    }
+  }
+  EXPECT_LT(index.posting_bytes(), 2000 * 12 * 2 * sizeof(uint32_t));
+}
+
+TEST(Bm25IndexTest, ConcurrentAddsAndSearches) {
+  Bm25Index index;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&index, t]() {
+      for (int i = 0; i < 500; ++i) {
+        index.Add(absl::StrCat("common thread", t, " doc", i));
+        EXPECT_FALSE(index.Search("common", 5).empty());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(index.size(), 2000);
+  Bm25Index::SearchOptions options;
+  options.k = 10000;
+  options.match_all_terms = true;
+  EXPECT_EQ(index.Search("common thread2", options).size(), 500);
+}
+
+TEST(SetCustomFunctionsForBm25Index, IndexAndSearchWorkWithExecutor) {
+  intrinsics::HandlerSetConfig config;
+  Bm25Index index;
+  EXPECT_EQ(SetCustomFunctionsForBm25Index(config.custom_function_map, index),
+            absl::OkStatus());
+  std::shared_ptr<Executor> executor =
+      CreateInlineExecutor(intrinsics::CreateCompleteHandlerSet(config),
+                           CreateThreadBasedConcurrencyManager())
+          .value();
+
+  v0::Value index_pb = CreateCustomFunction(kBm25IndexUri).value();
+  v0::Value search_pb = CreateCustomFunction(kBm25SearchUri).value();
+
+  Runner runner = Runner::Create(executor).value();
+
+  v0::Value documents;
+  documents.mutable_struct_()->add_element()->set_str("red apples");
+  documents.mutable_struct_()->add_element()->set_str("green pears");
+  v0::Value result = runner.Run(index_pb, documents).value();
+  ASSERT_EQ(result.struct_().element_size(), 2);
+  EXPECT_EQ(result.struct_().element(1).int_32(), 1);
+
+  v0::Value query;
+  query.set_str("pears");
+  result = runner.Run(search_pb, query).value();
+  ASSERT_EQ(result.struct_().element_size(), 1);
+  EXPECT_EQ(result.struct_().element(0).struct_().element(0).int_32(), 1);
+
+  query.Clear();
+  query.mutable_struct_()->add_element()->set_str("red pears");
+  query.mutable_struct_()->add_element()->set_int_32(5);
+  v0::Value* match_all_terms = query.mutable_struct_()->add_element();
+  match_all_terms->set_label("match_all_terms");
+  match_all_terms->set_boolean(true);
+  result = runner.Run(search_pb, query).value();
+  EXPECT_EQ(result.struct_().element_size(), 0);
+}
+
+TEST(SetCustomFunctionsForBm25Index, IndexAddsNoneOfAMixedStruct) {
+  intrinsics::CustomFunction::FunctionMap fn_map;
+  Bm25Index index;
+  ASSERT_EQ(SetCustomFunctionsForBm25Index(fn_map, index), absl::OkStatus());
+
+  v0::Value documents;
+  documents.mutable_struct_()->add_element()->set_str("red apples");
+  documents.mutable_struct_()->add_element()->set_int_32(7);
+  documents.mutable_struct_()->add_element()->set_str("green pears");
+  EXPECT_EQ(fn_map[kBm25IndexUri](documents).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(index.size(), 0);
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,292 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_CONCURRENT_BI_MAP_H_
+#define GENC_CC_MODULES_RETRIEVAL_CONCURRENT_BI_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
+
+namespace genc {
+
+// Thread-safe bidirectional map for read-heavy use from many threads, with
+// the same interface and semantics as BiMap.
+//
+// Each pair is stored once, in a slab whose elements never move, and is found
+// through two index tables of pointers into it, one hashed by key and one by
+// value. The slab and the tables are split into independently locked shards:
+// a pair lives in the shard of its key, and is indexed by value in the shard
+// of its value. Lookups take one shard's reader lock, so readers of different
+// shards never touch the same cache line; writers lock the shards of the key
+// and the value they change, in index order.
+//
+// A pair is only modified with the locks of both its key shard and its value
+// shard held, so a reader holding either one sees it whole.
+template <typename K, typename V>
+class ConcurrentBiMap {
+ public:
+  explicit ConcurrentBiMap(size_t num_shards = 64)
+      : num_shards_(std::max<size_t>(num_shards, 1)),
+        shards_(new Shard[num_shards_]) {}
+
+  // Returns true if the insertion is successful.
+  bool Insert(const K& key, const V& value) {
+    const size_t key_shard = KeyShard(key);
+    const size_t value_shard = ValueShard(value);
+    ShardLocks locks(this, {key_shard, value_shard});
+    if (shards_[key_shard].by_key.contains(key) ||
+        shards_[value_shard].by_value.contains(value)) {
+      return false;
+    }
+    Add(key_shard, value_shard, key, value);
+    return true;
+  }
+
+  bool Upsert(const K& key, const V& value) {
+    const size_t key_shard = KeyShard(key);
+    const size_t value_shard = ValueShard(value);
+    Shards needed = {key_shard, value_shard};
+    while (true) {
+      ShardLocks locks(this, needed);
+      Pair* const by_key = Find(shards_[key_shard].by_key, key);
+      Pair* const by_value = Find(shards_[value_shard].by_value, value);
+      if (by_key != nullptr && by_value != nullptr) {
+        return false;
+      }
+      // Unlinking the pair of the key or of the value also needs the shard of
+      // its other half. If that was not locked, start over with it.
+      const size_t other_shard = by_key != nullptr ? ValueShard(by_key->value)
+                                 : by_value != nullptr ? KeyShard(by_value->key)
+                                                       : key_shard;
+      if (!locks.Holds(other_shard)) {
+        needed.push_back(other_shard);
+        continue;
+      }
+
+      if (by_key != nullptr) {
+        shards_[other_shard].by_value.erase(by_key);
+        by_key->value = value;
+        shards_[value_shard].by_value.insert(by_key);
+      } else {
+        if (by_value != nullptr) {
+          Remove(other_shard, value_shard, by_value);
+        }
+        Add(key_shard, value_shard, key, value);
+      }
+      return true;
+    }
+  }
+
+  // Removes a pair by Key.
+  bool RemoveByKey(const K& key) {
+    const size_t key_shard = KeyShard(key);
+    Shards needed = {key_shard};
+    while (true) {
+      ShardLocks locks(this, needed);
+      Pair* const pair = Find(shards_[key_shard].by_key, key);
+      if (pair == nullptr) {
+        return false;
+      }
+      const size_t value_shard = ValueShard(pair->value);
+      if (!locks.Holds(value_shard)) {
+        needed.push_back(value_shard);
+        continue;
+      }
+      Remove(key_shard, value_shard, pair);
+      return true;
+    }
+  }
+
+  // Removes a pair by Value.
+  bool RemoveByValue(const V& value) {
+    const size_t value_shard = ValueShard(value);
+    Shards needed = {value_shard};
+    while (true) {
+      ShardLocks locks(this, needed);
+      Pair* const pair = Find(shards_[value_shard].by_value, value);
+      if (pair == nullptr) {
+        return false;
+      }
+      const size_t key_shard = KeyShard(pair->key);
+      if (!locks.Holds(key_shard)) {
+        needed.push_back(key_shard);
+        continue;
+      }
+      Remove(key_shard, value_shard, pair);
+      return true;
+    }
+  }
+
+  // Finds the Value by Key.
+  std::optional<V> FindByKey(const K& key) const {
+    const Shard& shard = shards_[KeyShard(key)];
+    absl::ReaderMutexLock lock(&shard.mutex);
+    const Pair* pair = Find(shard.by_key, key);
+    return pair != nullptr ? std::optional(pair->value) : std::nullopt;
+  }
+
+  // Finds Key by Value.
+  std::optional<K> FindByValue(const V& value) const {
+    const Shard& shard = shards_[ValueShard(value)];
+    absl::ReaderMutexLock lock(&shard.mutex);
+    const Pair* pair = Find(shard.by_value, value);
+    return pair != nullptr ? std::optional(pair->key) : std::nullopt;
+  }
+
+  // Returns the size of the map. Locks one shard at a time, so concurrent
+  // writes may or may not be counted.
+  size_t size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < num_shards_; ++i) {
+      absl::ReaderMutexLock lock(&shards_[i].mutex);
+      size += shards_[i].by_key.size();
+    }
+    return size;
+  }
+
+ private:
+  struct Pair {
+    Pair(const K& key, const V& value) : key(key), value(value) {}
+    K key;
+    V value;
+  };
+
+  // Hashes and compares pairs by one of their halves, so that the index
+  // tables can be searched with a bare key or value.
+  template <typename T, T Pair::*kField>
+  struct ByField {
+    using is_transparent = void;
+
+    static const T& Get(const T& t) { return t; }
+    static const T& Get(const Pair* pair) { return pair->*kField; }
+
+    template <typename A>
+    size_t operator()(const A& a) const {
+      return absl::Hash<T>{}(Get(a));
+    }
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+      return Get(a) == Get(b);
+    }
+  };
+  using ByKey = ByField<K, &Pair::key>;
+  using ByValue = ByField<V, &Pair::value>;
+
+  struct alignas(64) Shard {
+    mutable absl::Mutex mutex;
+    // Pairs whose key hashes to this shard. A deque never moves its elements.
+    std::deque<Pair> slab;
+    // Elements of `slab` that are not in use.
+    std::vector<Pair*> free;
+    // Pairs whose key hashes to this shard.
+    absl::flat_hash_set<Pair*, ByKey, ByKey> by_key;
+    // Pairs whose value hashes to this shard.
+    absl::flat_hash_set<Pair*, ByValue, ByValue> by_value;
+  };
+
+  using Shards = absl::InlinedVector<size_t, 3>;
+
+  // Exclusively locks a set of shards, in index order.
+  class ShardLocks {
+   public:
+    ShardLocks(const ConcurrentBiMap* map, Shards shards)
+        : map_(map), shards_(std::move(shards)) {
+      std::sort(shards_.begin(), shards_.end());
+      shards_.erase(std::unique(shards_.begin(), shards_.end()),
+                    shards_.end());
+      for (size_t shard : shards_) {
+        map_->shards_[shard].mutex.Lock();
+      }
+    }
+    ~ShardLocks() {
+      for (auto it = shards_.rbegin(); it != shards_.rend(); ++it) {
+        map_->shards_[*it].mutex.Unlock();
+      }
+    }
+    ShardLocks(const ShardLocks&) = delete;
+    ShardLocks& operator=(const ShardLocks&) = delete;
+
+    bool Holds(size_t shard) const {
+      return std::binary_search(shards_.begin(), shards_.end(), shard);
+    }
+
+   private:
+    const ConcurrentBiMap* map_;
+    Shards shards_;
+  };
+
+  // Picks shards from a remix of the hash, since the index tables use the
+  // low bits of the hash itself, and these would be the same in one shard.
+  size_t ShardOf(size_t hash) const {
+    return (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull >> 32) %
+           num_shards_;
+  }
+  size_t KeyShard(const K& key) const { return ShardOf(ByKey()(key)); }
+  size_t ValueShard(const V& value) const {
+    return ShardOf(ByValue()(value));
+  }
+
+  template <typename Index, typename T>
+  static Pair* Find(const Index& index, const T& t) {
+    auto it = index.find(t);
+    return it != index.end() ? *it : nullptr;
+  }
+
+  // Stores a new pair. Requires both shards to be locked.
+  void Add(size_t key_shard, size_t value_shard, const K& key,
+           const V& value) {
+    Shard& shard = shards_[key_shard];
+    Pair* pair;
+    if (shard.free.empty()) {
+      pair = &shard.slab.emplace_back(key, value);
+    } else {
+      pair = shard.free.back();
+      shard.free.pop_back();
+      pair->key = key;
+      pair->value = value;
+    }
+    shard.by_key.insert(pair);
+    shards_[value_shard].by_value.insert(pair);
+  }
+
+  // Unlinks a pair and frees its slot. Requires both shards to be locked.
+  void Remove(size_t key_shard, size_t value_shard, Pair* pair) {
+    Shard& shard = shards_[key_shard];
+    shard.by_key.erase(pair);
+    shards_[value_shard].by_value.erase(pair);
+    // Releases whatever the halves own until the slot is reused.
+    pair->key = K();
+    pair->value = V();
+    shard.free.push_back(pair);
+  }
+
+  const size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_CONCURRENT_BI_MAP_H_
@@ -0,0 +1,133 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Measures the throughput of BiMap and ConcurrentBiMap under a read-heavy mix
+// of lookups in both directions and upserts, at several thread counts.
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/modules/retrieval/bi_map.h"
+#include "genc/cc/modules/retrieval/concurrent_bi_map.h"
+
+ABSL_FLAG(int, num_pairs, 100000, "Number of pairs in the map.");
+ABSL_FLAG(int, ops_per_thread, 1000000, "Number of operations per thread.");
+ABSL_FLAG(int, write_per_mille, 10,
+          "Operations per thousand that are upserts rather than lookups.");
+ABSL_FLAG(std::string, num_threads, "1,2,4,8,16,32",
+          "Comma-separated thread counts to measure at.");
+ABSL_FLAG(int, num_shards, 64, "Number of shards of ConcurrentBiMap.");
+
+namespace genc {
+namespace {
+
+std::string Key(int i) { return absl::StrCat("name_", i); }
+std::string Value(int i) { return absl::StrCat("ir_value_", i); }
+
+// Returns operations per second over `num_threads` threads.
+template <typename Map>
+double Measure(Map& map, int num_threads) {
+  const int num_pairs = absl::GetFlag(FLAGS_num_pairs);
+  const int ops_per_thread = absl::GetFlag(FLAGS_ops_per_thread);
+  const int write_per_mille = absl::GetFlag(FLAGS_write_per_mille);
+  std::vector<std::thread> threads;
+  const absl::Time start = absl::Now();
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::mt19937 rng(t);
+      std::uniform_int_distribution<int> pair(0, num_pairs - 1);
+      std::uniform_int_distribution<int> per_mille(0, 999);
+      // Keys and values are built ahead of the loop, so that only the map is
+      // measured.
+      std::vector<std::string> keys;
+      std::vector<std::string> values;
+      for (int i = 0; i < 1024; ++i) {
+        const int p = pair(rng);
+        keys.push_back(Key(p));
+        values.push_back(Value(p));
+      }
+      size_t found = 0;
+      for (int i = 0; i < ops_per_thread; ++i) {
+        const int j = i % 1024;
+        if (per_mille(rng) < write_per_mille) {
+          map.Upsert(keys[j], values[j]);
+        } else if (i % 2 == 0) {
+          found += map.FindByKey(keys[j]).has_value();
+        } else {
+          found += map.FindByValue(values[j]).has_value();
+        }
+      }
+      if (found == 0) {
+        std::cerr << "No lookups succeeded.\n";
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return static_cast<double>(num_threads) * ops_per_thread /
+         absl::ToDoubleSeconds(absl::Now() - start);
+}
+
+template <typename Map>
+void Fill(Map& map) {
+  for (int i = 0; i < absl::GetFlag(FLAGS_num_pairs); ++i) {
+    map.Insert(Key(i), Value(i));
+  }
+}
+
+void Run() {
+  std::cout << "num_pairs=" << absl::GetFlag(FLAGS_num_pairs)
+            << " write_per_mille=" << absl::GetFlag(FLAGS_write_per_mille)
+            << " hardware_threads=" << std::thread::hardware_concurrency()
+            << "\n";
+  BiMap<std::string, std::string> bi_map;
+  ConcurrentBiMap<std::string, std::string> concurrent_bi_map(
+      absl::GetFlag(FLAGS_num_shards));
+  Fill(bi_map);
+  Fill(concurrent_bi_map);
+  for (absl::string_view flag :
+       absl::StrSplit(absl::GetFlag(FLAGS_num_threads), ',')) {
+    int num_threads;
+    if (!absl::SimpleAtoi(flag, &num_threads) || num_threads < 1) {
+      std::cerr << "Bad --num_threads value: " << flag << "\n";
+      return;
+    }
+    std::cout << "threads=" << num_threads
+              << ": BiMap " << Measure(bi_map, num_threads) / 1e6
+              << " Mops/s, ConcurrentBiMap "
+              << Measure(concurrent_bi_map, num_threads) / 1e6 << " Mops/s\n";
+  }
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
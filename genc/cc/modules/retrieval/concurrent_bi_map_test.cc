@@ -0,0 +1,154 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/concurrent_bi_map.h"
+
+#include <optional>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace genc {
+
+namespace {
+
+TEST(ConcurrentBiMapTest, InsertSuccessfully) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  EXPECT_TRUE(int_str_map.Insert(1, "one"));
+  EXPECT_EQ(int_str_map.FindByKey(1).value(), "one");
+  EXPECT_EQ(int_str_map.FindByValue("one").value(), 1);
+}
+
+TEST(ConcurrentBiMapTest, InsertFailureOnDuplicateKeyOrValue) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  int_str_map.Insert(1, "one");
+  EXPECT_FALSE(int_str_map.Insert(1, "duplicate"));
+  EXPECT_FALSE(int_str_map.Insert(2, "one"));
+  EXPECT_EQ(int_str_map.size(), 1);
+}
+
+TEST(ConcurrentBiMapTest, UpsertUpdatesExistingValue) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  int_str_map.Insert(1, "one");
+  EXPECT_TRUE(int_str_map.Upsert(1, "updated_one"));
+  EXPECT_EQ(int_str_map.FindByKey(1).value(), "updated_one");
+  EXPECT_EQ(int_str_map.FindByValue("updated_one").value(), 1);
+  EXPECT_EQ(int_str_map.FindByValue("one"), std::nullopt);
+  EXPECT_EQ(int_str_map.size(), 1);
+}
+
+TEST(ConcurrentBiMapTest, UpsertMovesExistingValueToNewKey) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  int_str_map.Insert(1, "one");
+  EXPECT_TRUE(int_str_map.Upsert(2, "one"));
+  EXPECT_EQ(int_str_map.FindByKey(1), std::nullopt);
+  EXPECT_EQ(int_str_map.FindByKey(2).value(), "one");
+  EXPECT_EQ(int_str_map.FindByValue("one").value(), 2);
+  EXPECT_EQ(int_str_map.size(), 1);
+}
+
+TEST(ConcurrentBiMapTest, UpsertFailsWhenKeyAndValueExist) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  int_str_map.Insert(1, "one");
+  int_str_map.Insert(2, "two");
+  EXPECT_FALSE(int_str_map.Upsert(1, "two"));
+  EXPECT_FALSE(int_str_map.Upsert(1, "one"));
+  EXPECT_EQ(int_str_map.FindByKey(1).value(), "one");
+}
+
+TEST(ConcurrentBiMapTest, RemovesPairs) {
+  ConcurrentBiMap<int, std::string> int_str_map;
+  int_str_map.Insert(1, "one");
+  int_str_map.Insert(2, "two");
+  EXPECT_TRUE(int_str_map.RemoveByKey(1));
+  EXPECT_FALSE(int_str_map.RemoveByKey(1));
+  EXPECT_EQ(int_str_map.FindByValue("one"), std::nullopt);
+  EXPECT_TRUE(int_str_map.RemoveByValue("two"));
+  EXPECT_FALSE(int_str_map.RemoveByValue("two"));
+  EXPECT_EQ(int_str_map.FindByKey(2), std::nullopt);
+  EXPECT_EQ(int_str_map.size(), 0);
+
+  // Freed slots are reused.
+  EXPECT_TRUE(int_str_map.Insert(3, "three"));
+  EXPECT_EQ(int_str_map.FindByValue("three").value(), 3);
+}
+
+TEST(ConcurrentBiMapTest, KeepsBothDirectionsConsistentAcrossShards) {
+  ConcurrentBiMap<int, std::string> int_str_map(4);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(int_str_map.Insert(i, std::to_string(i)));
+  }
+  // Rotates every value to the next key, moving pairs between shards.
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(int_str_map.Upsert(i + 1000, std::to_string(i)));
+  }
+  EXPECT_EQ(int_str_map.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(int_str_map.FindByKey(i), std::nullopt);
+    EXPECT_EQ(int_str_map.FindByKey(i + 1000).value(), std::to_string(i));
+    EXPECT_EQ(int_str_map.FindByValue(std::to_string(i)).value(), i + 1000);
+  }
+}
+
+TEST(ConcurrentBiMapTest, ConcurrentReadersAndWritersAgree) {
+  ConcurrentBiMap<int, std::string> int_str_map(8);
+  for (int i = 0; i < 100; ++i) {
+    int_str_map.Insert(i, std::to_string(i));
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    // Writers move the pairs of their own keys back and forth.
+    threads.emplace_back([&int_str_map, t]() {
+      for (int round = 0; round < 200; ++round) {
+        for (int i = t; i < 100; i += 4) {
+          const std::string value = std::to_string(i);
+          if (round % 2 == 0) {
+            EXPECT_TRUE(int_str_map.Upsert(i + 1000, value));
+          } else {
+            EXPECT_TRUE(int_str_map.RemoveByValue(value));
+            EXPECT_TRUE(int_str_map.Insert(i, value));
+          }
+        }
+      }
+    });
+    // Readers only ever see one of the two keys of a value.
+    threads.emplace_back([&int_str_map]() {
+      for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 100; ++i) {
+          std::optional<int> key = int_str_map.FindByValue(std::to_string(i));
+          if (key.has_value()) {
+            EXPECT_TRUE(*key == i || *key == i + 1000);
+          }
+          std::optional<std::string> value = int_str_map.FindByKey(i);
+          if (value.has_value()) {
+            EXPECT_EQ(*value, std::to_string(i));
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(int_str_map.size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(int_str_map.FindByValue(std::to_string(i)).value(), i);
+  }
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,608 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/modules/retrieval/index_file.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+// Caps the layer of a node, which is drawn from a geometric distribution.
+constexpr int kMaxLevel = 16;
+
+// Marks the nodes a search has visited. Each thread keeps one, and starts a
+// new search by bumping the epoch instead of clearing the marks.
+struct VisitedSet {
+  std::vector<uint32_t> marks;
+  uint32_t epoch = 0;
+
+  void Reset(int size) {
+    if (marks.size() < static_cast<size_t>(size)) {
+      marks.resize(size, 0);
+    }
+    if (++epoch == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      epoch = 1;
+    }
+  }
+
+  // Returns true if `id` was not visited before.
+  bool Visit(int id) {
+    if (marks[id] == epoch) {
+      return false;
+    }
+    marks[id] = epoch;
+    return true;
+  }
+};
+
+VisitedSet& ThreadVisitedSet() {
+  thread_local VisitedSet visited;
+  return visited;
+}
+
+// Mixes the bits of `x` (SplitMix64), for drawing reproducible levels without
+// sharing a random number generator between threads.
+uint64_t Mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+int64_t PackEntry(int id, int level) {
+  return (static_cast<int64_t>(level) << 32) | static_cast<uint32_t>(id);
+}
+
+int EntryId(int64_t entry) { return static_cast<int>(entry & 0xffffffff); }
+
+int EntryLevel(int64_t entry) { return static_cast<int>(entry >> 32); }
+
+// Neighbor lists are written and mapped as plain int32 arrays.
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t) &&
+              std::atomic<int32_t>::is_always_lock_free);
+
+std::atomic<int32_t>* AsAtomic(int32_t* data) {
+  return reinterpret_cast<std::atomic<int32_t>*>(data);
+}
+
+// The sections of an index file.
+enum HnswSection : uint32_t {
+  // One HnswFileParams.
+  kParams = 1,
+  // float32 vectors, row-major.
+  kVectors = 2,
+  // int32 top level of each node.
+  kLevels = 3,
+  // int32 bottom-layer neighbor lists, `1 + 2 * m` elements per node.
+  kLevel0 = 4,
+  // uint64 offsets into kUpper of the upper-layer lists of each node, and of
+  // the end.
+  kUpperOffsets = 5,
+  // int32 upper-layer neighbor lists, `1 + m` elements per list.
+  kUpper = 6,
+};
+
+struct HnswFileParams {
+  int32_t dim;
+  int32_t num_elements;
+  int32_t metric;
+  int32_t m;
+  int32_t ef_construction;
+  int32_t ef_search;
+  uint64_t seed;
+  int64_t entry;
+};
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<HnswIndex>> HnswIndex::Create(
+    const Options& options) {
+  if (options.dim <= 0 || options.max_elements <= 0) {
+    return absl::InvalidArgumentError(
+        "Expected dim and max_elements to be positive.");
+  }
+  if (options.m < 2 || options.ef_construction <= 0 ||
+      options.ef_search <= 0) {
+    return absl::InvalidArgumentError(
+        "Expected m to be at least 2, and ef_construction and ef_search to "
+        "be positive.");
+  }
+  std::unique_ptr<HnswIndex> index(new HnswIndex(options));
+  const size_t n = options.max_elements;
+  index->vector_storage_.reset(new float[n * options.dim]);
+  index->level0_storage_.reset(
+      new std::atomic<int32_t>[n * index->level0_stride_]);
+  index->level_storage_.reset(new int32_t[n]);
+  index->upper_neighbors_.reset(new std::atomic<int32_t>*[n]);
+  index->upper_storage_.reset(new std::unique_ptr<std::atomic<int32_t>[]>[n]);
+  index->link_mutexes_.reset(new absl::Mutex[n]);
+  index->vectors_ = index->vector_storage_.get();
+  index->level0_neighbors_ = index->level0_storage_.get();
+  index->levels_ = index->level_storage_.get();
+  return index;
+}
+
+HnswIndex::HnswIndex(const Options& options)
+    : options_(options),
+      level0_stride_(1 + 2 * options.m),
+      level_multiplier_(1.0 / std::log(static_cast<double>(options.m))),
+      ef_search_(options.ef_search) {}
+
+absl::StatusOr<std::unique_ptr<HnswIndex>> HnswIndex::Load(
+    const std::string& path) {
+  std::unique_ptr<MappedIndexFile> file =
+      GENC_TRY(MappedIndexFile::Open(path, IndexFileKind::kHnswIndex));
+  const HnswFileParams params =
+      GENC_TRY(file->Array<HnswFileParams>(kParams, 1))[0];
+  Options options;
+  options.dim = params.dim;
+  options.max_elements = params.num_elements;
+  options.metric = static_cast<VectorMetric>(params.metric);
+  options.m = params.m;
+  options.ef_construction = params.ef_construction;
+  options.ef_search = params.ef_search;
+  options.seed = params.seed;
+  if (options.dim <= 0 || options.max_elements <= 0 || options.m < 2 ||
+      options.ef_search <= 0 || params.metric < 0 ||
+      params.metric > static_cast<int32_t>(VectorMetric::kL2) ||
+      params.entry < 0 || EntryId(params.entry) >= params.num_elements ||
+      EntryLevel(params.entry) > kMaxLevel) {
+    return absl::DataLossError(
+        absl::StrCat("Invalid parameters in index file: ", path));
+  }
+  std::unique_ptr<HnswIndex> index(new HnswIndex(options));
+  const size_t n = options.max_elements;
+
+  const absl::Span<const float> vectors =
+      GENC_TRY(file->Array<float>(kVectors, n * options.dim));
+  const absl::Span<const int32_t> levels =
+      GENC_TRY(file->Array<int32_t>(kLevels, n));
+  const absl::Span<const int32_t> level0 =
+      GENC_TRY(file->Array<int32_t>(kLevel0, n * index->level0_stride_));
+  const absl::Span<const uint64_t> upper_offsets =
+      GENC_TRY(file->Array<uint64_t>(kUpperOffsets, n + 1));
+  const absl::Span<const int32_t> upper =
+      GENC_TRY(file->Array<int32_t>(kUpper));
+
+  // Only the per-node pointers to the upper lists are built; everything else
+  // is used in place.
+  index->upper_neighbors_.reset(new std::atomic<int32_t>*[n]);
+  for (size_t id = 0; id < n; ++id) {
+    const uint64_t begin = upper_offsets[id];
+    if (levels[id] < 0 || levels[id] > kMaxLevel || begin > upper.size() ||
+        upper_offsets[id + 1] - begin !=
+            static_cast<uint64_t>(levels[id]) * (1 + options.m)) {
+      return absl::DataLossError(
+          absl::StrCat("Invalid neighbor lists in index file: ", path));
+    }
+    index->upper_neighbors_[id] =
+        AsAtomic(const_cast<int32_t*>(upper.data()) + begin);
+  }
+  if (upper_offsets[n] != upper.size()) {
+    return absl::DataLossError(
+        absl::StrCat("Invalid neighbor lists in index file: ", path));
+  }
+  // Searches descend from the entry point and follow the lists of layer `l`
+  // into their neighbors' lists of the same layer, which only exist if the
+  // neighbors reach up to it.
+  if (levels[EntryId(params.entry)] < EntryLevel(params.entry)) {
+    return absl::DataLossError(
+        absl::StrCat("Invalid parameters in index file: ", path));
+  }
+  for (size_t id = 0; id < n; ++id) {
+    for (int l = 1; l <= levels[id]; ++l) {
+      const int32_t* list =
+          upper.data() + upper_offsets[id] + (l - 1) * (1 + options.m);
+      const int count = std::min(list[0], options.m);
+      for (int i = 1; i <= count; ++i) {
+        if (list[i] >= 0 && static_cast<size_t>(list[i]) < n &&
+            levels[list[i]] < l) {
+          return absl::DataLossError(
+              absl::StrCat("Invalid neighbor lists in index file: ", path));
+        }
+      }
+    }
+  }
+  index->vectors_ = const_cast<float*>(vectors.data());
+  index->levels_ = const_cast<int32_t*>(levels.data());
+  index->level0_neighbors_ = AsAtomic(const_cast<int32_t*>(level0.data()));
+  index->next_id_.store(n);
+  index->size_.store(n);
+  index->entry_.store(params.entry);
+  index->file_ = std::move(file);
+  return index;
+}
+
+absl::Status HnswIndex::WriteTo(const std::string& path) const {
+  IndexFileWriter writer(IndexFileKind::kHnswIndex);
+  {
+    absl::WriterMutexLock lock(&snapshot_mutex_);
+    const size_t n = next_id_.load();
+    if (n == 0) {
+      return absl::FailedPreconditionError("Cannot write an empty index.");
+    }
+    HnswFileParams params;
+    params.dim = options_.dim;
+    params.num_elements = n;
+    params.metric = static_cast<int32_t>(options_.metric);
+    params.m = options_.m;
+    params.ef_construction = options_.ef_construction;
+    params.ef_search = ef_search_.load();
+    params.seed = options_.seed;
+    params.entry = entry_.load();
+    writer.AddSection<HnswFileParams>(kParams, absl::MakeConstSpan(&params, 1));
+    writer.AddSection<float>(kVectors,
+                             absl::MakeConstSpan(vectors_, n * options_.dim));
+    writer.AddSection<int32_t>(kLevels, absl::MakeConstSpan(levels_, n));
+    std::vector<int32_t> level0(n * level0_stride_);
+    std::vector<uint64_t> upper_offsets = {0};
+    std::vector<int32_t> upper;
+    for (size_t id = 0; id < n; ++id) {
+      for (size_t i = 0; i < level0_stride_; ++i) {
+        level0[id * level0_stride_ + i] =
+            level0_neighbors_[id * level0_stride_ + i].load(
+                std::memory_order_relaxed);
+      }
+      for (int i = 0; i < levels_[id] * (1 + options_.m); ++i) {
+        upper.push_back(
+            upper_neighbors_[id][i].load(std::memory_order_relaxed));
+      }
+      upper_offsets.push_back(upper.size());
+    }
+    writer.AddSection<int32_t>(kLevel0, level0);
+    writer.AddSection<uint64_t>(kUpperOffsets, upper_offsets);
+    writer.AddSection<int32_t>(kUpper, upper);
+  }
+  return writer.Write(path);
+}
+
+float HnswIndex::Distance(const float* query, int id) const {
+  absl::Span<const float> a = absl::MakeConstSpan(query, options_.dim);
+  if (options_.metric == VectorMetric::kL2) {
+    return SquaredL2Distance(a, vector(id));
+  }
+  // Cosine vectors are normalized on the way in.
+  return -DotProduct(a, vector(id));
+}
+
+int HnswIndex::RandomLevel(int id) const {
+  const double uniform =
+      (Mix(options_.seed ^ static_cast<uint64_t>(id)) >> 11) * 0x1.0p-53;
+  const double level = -std::log(1.0 - uniform) * level_multiplier_;
+  return std::min(static_cast<int>(level), kMaxLevel);
+}
+
+std::atomic<int32_t>* HnswIndex::Neighbors(int id, int level) const {
+  if (level == 0) {
+    return level0_neighbors_ + id * level0_stride_;
+  }
+  return upper_neighbors_[id] + (level - 1) * (1 + options_.m);
+}
+
+int HnswIndex::GreedyClosest(const float* query, int entry, int level) const {
+  int closest = entry;
+  float closest_distance = Distance(query, closest);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const std::atomic<int32_t>* list = Neighbors(closest, level);
+    const int count = std::min<int>(list[0].load(std::memory_order_acquire),
+                                    MaxNeighbors(level));
+    for (int i = 1; i <= count; ++i) {
+      const int neighbor = list[i].load(std::memory_order_acquire);
+      if (!IsValidId(neighbor)) {
+        continue;
+      }
+      const float distance = Distance(query, neighbor);
+      if (distance < closest_distance) {
+        closest = neighbor;
+        closest_distance = distance;
+        changed = true;
+      }
+    }
+  }
+  return closest;
+}
+
+std::vector<HnswIndex::Candidate> HnswIndex::SearchLayer(const float* query,
+                                                         int entry, int ef,
+                                                         int level) const {
+  VisitedSet& visited = ThreadVisitedSet();
+  visited.Reset(options_.max_elements);
+
+  // Nodes to expand, closest on top.
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate>>
+      frontier;
+  // The `ef` closest nodes found so far, farthest on top.
+  std::priority_queue<Candidate> nearest;
+
+  const Candidate start = {Distance(query, entry), entry};
+  visited.Visit(entry);
+  frontier.push(start);
+  nearest.push(start);
+  while (!frontier.empty()) {
+    const Candidate current = frontier.top();
+    if (current.first > nearest.top().first) {
+      break;
+    }
+    frontier.pop();
+    const std::atomic<int32_t>* list = Neighbors(current.second, level);
+    const int count = std::min<int>(list[0].load(std::memory_order_acquire),
+                                    MaxNeighbors(level));
+    for (int i = 1; i <= count; ++i) {
+      const int neighbor = list[i].load(std::memory_order_acquire);
+      if (!IsValidId(neighbor) || !visited.Visit(neighbor)) {
+        continue;
+      }
+      const float distance = Distance(query, neighbor);
+      if (static_cast<int>(nearest.size()) < ef ||
+          distance < nearest.top().first) {
+        frontier.push({distance, neighbor});
+        nearest.push({distance, neighbor});
+        if (static_cast<int>(nearest.size()) > ef) {
+          nearest.pop();
+        }
+      }
+    }
+  }
+
+  std::vector<Candidate> result(nearest.size());
+  for (int i = nearest.size() - 1; i >= 0; --i) {
+    result[i] = nearest.top();
+    nearest.pop();
+  }
+  return result;
+}
+
+std::vector<int> HnswIndex::SelectNeighbors(
+    const std::vector<Candidate>& candidates, int max_neighbors) const {
+  std::vector<int> selected;
+  selected.reserve(max_neighbors);
+  for (const Candidate& candidate : candidates) {
+    if (static_cast<int>(selected.size()) >= max_neighbors) {
+      break;
+    }
+    const float* const candidate_vector =
+        vectors_ + Offset(candidate.second);
+    bool keep = true;
+    for (int other : selected) {
+      if (Distance(candidate_vector, other) < candidate.first) {
+        keep = false;
+        break;
+      }
+    }
+    if (keep) {
+      selected.push_back(candidate.second);
+    }
+  }
+  return selected;
+}
+
+void HnswIndex::StoreNeighbors(std::atomic<int32_t>* list,
+                               const std::vector<int>& neighbors) {
+  // Publish the ids before the count, so that readers never see an unset id.
+  // Readers holding an older, larger count may still see stale ids past the
+  // new end, which are valid nodes too.
+  for (size_t i = 0; i < neighbors.size(); ++i) {
+    list[i + 1].store(neighbors[i], std::memory_order_release);
+  }
+  list[0].store(neighbors.size(), std::memory_order_release);
+}
+
+void HnswIndex::Link(int id, int new_id, int level) {
+  absl::MutexLock lock(&link_mutexes_[id]);
+  std::atomic<int32_t>* list = Neighbors(id, level);
+  const int count = list[0].load(std::memory_order_acquire);
+  if (count < MaxNeighbors(level)) {
+    list[count + 1].store(new_id, std::memory_order_release);
+    list[0].store(count + 1, std::memory_order_release);
+    return;
+  }
+  const float* const base = vectors_ + Offset(id);
+  std::vector<Candidate> candidates;
+  candidates.reserve(count + 1);
+  candidates.push_back({Distance(base, new_id), new_id});
+  for (int i = 1; i <= count; ++i) {
+    const int neighbor = list[i].load(std::memory_order_acquire);
+    candidates.push_back({Distance(base, neighbor), neighbor});
+  }
+  std::sort(candidates.begin(), candidates.end());
+  StoreNeighbors(list, SelectNeighbors(candidates, MaxNeighbors(level)));
+}
+
+absl::StatusOr<int> HnswIndex::Add(absl::Span<const float> vector) {
+  if (vector.size() != static_cast<size_t>(options_.dim)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected a vector of ", options_.dim, " elements, got ",
+                     vector.size()));
+  }
+  if (file_ != nullptr) {
+    return absl::FailedPreconditionError(
+        "The index was loaded from a file and is read-only.");
+  }
+  absl::ReaderMutexLock snapshot_lock(&snapshot_mutex_);
+  int id = next_id_.load(std::memory_order_relaxed);
+  do {
+    if (id >= options_.max_elements) {
+      return absl::ResourceExhaustedError(absl::StrCat(
+          "The index is full at ", options_.max_elements, " vectors."));
+    }
+  } while (!next_id_.compare_exchange_weak(id, id + 1));
+
+  float* const stored = vectors_ + Offset(id);
+  std::memcpy(stored, vector.data(), vector.size() * sizeof(float));
+  if (options_.metric == VectorMetric::kCosine) {
+    Normalize(absl::MakeSpan(stored, options_.dim));
+  }
+  const int level = RandomLevel(id);
+  levels_[id] = level;
+  Neighbors(id, 0)[0].store(0, std::memory_order_relaxed);
+  upper_neighbors_[id] = nullptr;
+  if (level > 0) {
+    const size_t length = static_cast<size_t>(level) * (1 + options_.m);
+    upper_storage_[id].reset(new std::atomic<int32_t>[length]);
+    for (size_t i = 0; i < length; ++i) {
+      upper_storage_[id][i].store(0, std::memory_order_relaxed);
+    }
+    upper_neighbors_[id] = upper_storage_[id].get();
+  }
+
+  // Inserts that may raise the top level are serialized, so that the entry
+  // point only ever moves up.
+  std::optional<absl::MutexLock> entry_lock;
+  int64_t entry = entry_.load(std::memory_order_acquire);
+  if (entry < 0 || level > EntryLevel(entry)) {
+    entry_lock.emplace(&entry_mutex_);
+    entry = entry_.load(std::memory_order_acquire);
+  }
+  if (entry < 0) {
+    entry_.store(PackEntry(id, level), std::memory_order_release);
+    size_.fetch_add(1, std::memory_order_release);
+    return id;
+  }
+
+  int closest = EntryId(entry);
+  const int top_level = EntryLevel(entry);
+  for (int l = top_level; l > level; --l) {
+    closest = GreedyClosest(stored, closest, l);
+  }
+  for (int l = std::min(level, top_level); l >= 0; --l) {
+    const std::vector<Candidate> candidates =
+        SearchLayer(stored, closest, options_.ef_construction, l);
+    const std::vector<int> neighbors =
+        SelectNeighbors(candidates, options_.m);
+    {
+      absl::MutexLock lock(&link_mutexes_[id]);
+      StoreNeighbors(Neighbors(id, l), neighbors);
+    }
+    for (int neighbor : neighbors) {
+      Link(neighbor, id, l);
+    }
+    closest = candidates.front().second;
+  }
+  if (level > top_level) {
+    entry_.store(PackEntry(id, level), std::memory_order_release);
+  }
+  size_.fetch_add(1, std::memory_order_release);
+  return id;
+}
+
+absl::StatusOr<std::vector<ScoredIndex>> HnswIndex::Search(
+    absl::Span<const float> query, int k, std::optional<int> ef) const {
+  if (query.size() != static_cast<size_t>(options_.dim)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected a query of ", options_.dim, " elements, got ",
+                     query.size()));
+  }
+  const int64_t entry = entry_.load(std::memory_order_acquire);
+  if (entry < 0 || k <= 0) {
+    return std::vector<ScoredIndex>();
+  }
+  std::vector<float> normalized;
+  const float* q = query.data();
+  if (options_.metric == VectorMetric::kCosine) {
+    normalized.assign(query.begin(), query.end());
+    Normalize(absl::MakeSpan(normalized));
+    q = normalized.data();
+  }
+
+  int closest = EntryId(entry);
+  for (int l = EntryLevel(entry); l > 0; --l) {
+    closest = GreedyClosest(q, closest, l);
+  }
+  const std::vector<Candidate> candidates = SearchLayer(
+      q, closest, std::max(k, ef.value_or(ef_search_.load())), 0);
+
+  std::vector<ScoredIndex> result;
+  result.reserve(std::min<size_t>(k, candidates.size()));
+  for (const Candidate& candidate : candidates) {
+    if (static_cast<int>(result.size()) >= k) {
+      break;
+    }
+    result.push_back({candidate.second, -candidate.first});
+  }
+  return result;
+}
+
+absl::Status SetCustomFunctionsForVectorIndex(
+    intrinsics::CustomFunction::FunctionMap& fn_map, HnswIndex& index,
+    int default_k) {
+  fn_map[kVectorIndexAddUri] =
+      [&index](const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    const std::vector<float> vector = GENC_TRY(GetFloatTensor(arg));
+    v0::Value result;
+    result.set_int_32(GENC_TRY(index.Add(vector)));
+    return result;
+  };
+
+  fn_map[kVectorIndexSearchUri] =
+      [&index, default_k](const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    const v0::Value* query = &arg;
+    int k = default_k;
+    if (arg.has_struct_()) {
+      if (arg.struct_().element_size() != 2 ||
+          !arg.struct_().element(1).has_int_32()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Expected a struct of a query tensor and k, got: ",
+            arg.DebugString()));
+      }
+      query = &arg.struct_().element(0);
+      k = arg.struct_().element(1).int_32();
+    }
+    const std::vector<float> vector = GENC_TRY(GetFloatTensor(*query));
+    v0::Value result;
+    v0::Struct* top = result.mutable_struct_();
+    for (const ScoredIndex& scored : GENC_TRY(index.Search(vector, k))) {
+      v0::Struct* entry = top->add_element()->mutable_struct_();
+      v0::Value* id = entry->add_element();
+      id->set_label("index");
+      id->set_int_32(scored.index);
+      v0::Value* score = entry->add_element();
+      score->set_label("score");
+      score->set_float_32(scored.score);
+    }
+    return result;
+  };
+
+  return absl::OkStatus();
+}
+
+}  // namespace genc
@@ -0,0 +1,211 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_HNSW_INDEX_H_
+#define GENC_CC_MODULES_RETRIEVAL_HNSW_INDEX_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/modules/retrieval/index_file.h"
+#include "genc/cc/modules/vector/vector_math.h"
+
+namespace genc {
+
+constexpr char kVectorIndexAddUri[] = "/vector_index/add";
+constexpr char kVectorIndexSearchUri[] = "/vector_index/search";
+
+// An in-process approximate nearest-neighbor index over float vectors, using
+// a Hierarchical Navigable Small World (HNSW) graph.
+//
+// All storage is allocated up front for `max_elements` vectors: the vectors
+// live in one contiguous row-major array, and the bottom-layer neighbor lists
+// in another, so that a search touches few cache lines per visited node.
+//
+// Add() may be called from many threads at once; inserts only lock the nodes
+// whose neighbor lists they rewrite. Search() takes no locks at all: neighbor
+// lists are arrays of atomics, so a search that races with an insert sees
+// either the old or the new neighbors of a node, both of which are valid.
+//
+// WriteTo() snapshots the index to an index file, and Load() serves searches
+// straight from a read-only mapping of one, without rebuilding the graph.
+class HnswIndex {
+ public:
+  struct Options {
+    // Number of elements per vector.
+    int dim = 0;
+    // Number of vectors the index can hold.
+    int max_elements = 0;
+    VectorMetric metric = VectorMetric::kCosine;
+    // Number of neighbors per node on the upper layers. The bottom layer
+    // keeps twice as many. Larger values raise recall and memory use.
+    int m = 16;
+    // Size of the candidate list while inserting. Larger values build a
+    // better graph, more slowly.
+    int ef_construction = 200;
+    // Default size of the candidate list while searching. Larger values
+    // raise recall and lower QPS.
+    int ef_search = 64;
+    // Seeds the choice of each node's layer.
+    uint64_t seed = 100;
+  };
+
+  static absl::StatusOr<std::unique_ptr<HnswIndex>> Create(
+      const Options& options);
+
+  // Maps an index written by WriteTo(). The loaded index is read-only: its
+  // capacity is the number of vectors it holds, and Add() fails.
+  static absl::StatusOr<std::unique_ptr<HnswIndex>> Load(
+      const std::string& path);
+
+  HnswIndex(const HnswIndex&) = delete;
+  HnswIndex& operator=(const HnswIndex&) = delete;
+
+  // Inserts a copy of `vector` and returns its id. Ids are dense, starting at
+  // zero, in the order that inserts begin.
+  absl::StatusOr<int> Add(absl::Span<const float> vector);
+
+  // Returns the (at most) `k` ids whose vectors are approximately the most
+  // similar to `query`, most similar first, with their scores under the
+  // index's metric. Uses `ef` candidates, or the default `ef_search` if
+  // unset.
+  absl::StatusOr<std::vector<ScoredIndex>> Search(
+      absl::Span<const float> query, int k,
+      std::optional<int> ef = std::nullopt) const;
+
+  // Writes the vectors and graph to `path`. Waits for inserts in flight, and
+  // holds off new ones until the snapshot is taken; searches go on.
+  absl::Status WriteTo(const std::string& path) const;
+
+  // Changes the default `ef_search`, e.g. to trade recall for QPS.
+  void set_ef_search(int ef) { ef_search_.store(ef); }
+
+  // Returns the number of vectors inserted so far.
+  int size() const { return size_.load(std::memory_order_acquire); }
+
+  int dim() const { return options_.dim; }
+
+  // Returns the stored vector for `id`, which is normalized for the cosine
+  // metric.
+  absl::Span<const float> vector(int id) const {
+    return absl::MakeConstSpan(vectors_ + Offset(id), options_.dim);
+  }
+
+ private:
+  // A candidate node and its distance to the query; lower is closer.
+  using Candidate = std::pair<float, int>;
+
+  explicit HnswIndex(const Options& options);
+
+  size_t Offset(int id) const {
+    return static_cast<size_t>(id) * options_.dim;
+  }
+
+  float Distance(const float* query, int id) const;
+
+  // Guards searches against corrupt neighbor lists in loaded files.
+  bool IsValidId(int id) const {
+    return static_cast<unsigned>(id) <
+           static_cast<unsigned>(options_.max_elements);
+  }
+
+  int RandomLevel(int id) const;
+
+  // Returns the neighbor list of `id` on `level`: a count followed by up to
+  // `MaxNeighbors(level)` ids.
+  std::atomic<int32_t>* Neighbors(int id, int level) const;
+
+  int MaxNeighbors(int level) const {
+    return level == 0 ? 2 * options_.m : options_.m;
+  }
+
+  // Moves greedily from `entry` to the closest node to `query` on `level`.
+  int GreedyClosest(const float* query, int entry, int level) const;
+
+  // Returns the (at most) `ef` closest nodes to `query` on `level` found from
+  // `entry`, closest first.
+  std::vector<Candidate> SearchLayer(const float* query, int entry, int ef,
+                                     int level) const;
+
+  // Picks up to `max_neighbors` of the closest-first `candidates`, skipping
+  // those that are closer to an already picked one than to the base node,
+  // which keeps the graph navigable across clusters.
+  std::vector<int> SelectNeighbors(const std::vector<Candidate>& candidates,
+                                   int max_neighbors) const;
+
+  // Replaces the neighbor list of `id` on `level` with `neighbors`.
+  static void StoreNeighbors(std::atomic<int32_t>* list,
+                             const std::vector<int>& neighbors);
+
+  // Adds `new_id` to the neighbors of `id` on `level`, pruning the list if it
+  // is full.
+  void Link(int id, int new_id, int level);
+
+  const Options options_;
+  const size_t level0_stride_;
+  const double level_multiplier_;
+  std::atomic<int> ef_search_;
+
+  // The arrays of the index, which either the storage below owns, or `file_`
+  // maps. Mapped arrays are never written, since Add() fails on them.
+  float* vectors_ = nullptr;
+  std::atomic<int32_t>* level0_neighbors_ = nullptr;
+  int32_t* levels_ = nullptr;
+  // The upper-layer neighbor lists of each node, `levels_[id]` lists of
+  // `1 + m` elements each.
+  std::unique_ptr<std::atomic<int32_t>*[]> upper_neighbors_;
+
+  std::unique_ptr<float[]> vector_storage_;
+  std::unique_ptr<std::atomic<int32_t>[]> level0_storage_;
+  std::unique_ptr<int32_t[]> level_storage_;
+  std::unique_ptr<std::unique_ptr<std::atomic<int32_t>[]>[]> upper_storage_;
+  std::unique_ptr<absl::Mutex[]> link_mutexes_;
+  std::unique_ptr<MappedIndexFile> file_;
+
+  // Number of ids handed out to inserts.
+  std::atomic<int> next_id_{0};
+  // Number of completed inserts.
+  std::atomic<int> size_{0};
+  // The entry point packed as (top level << 32 | id), or -1 when empty.
+  std::atomic<int64_t> entry_{-1};
+  // Held by inserts that may raise the top level.
+  absl::Mutex entry_mutex_;
+  // Shared by inserts, and held exclusively by WriteTo().
+  mutable absl::Mutex snapshot_mutex_;
+};
+
+// Make CustomFunctions aware of a vector index.
+// The add function takes a float tensor and returns its int_32 id. The search
+// function takes a float tensor, or a struct of a float tensor and an int_32
+// k, and returns a struct of (index, score) structs as the top_k intrinsic
+// does.
+// Doesn't own it, index must stay alive during the life time of the Runtime.
+absl::Status SetCustomFunctionsForVectorIndex(
+    intrinsics::CustomFunction::FunctionMap& fn_map, HnswIndex& index,
+    int default_k = 10);
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_HNSW_INDEX_H_
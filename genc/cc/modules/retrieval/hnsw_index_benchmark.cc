@@ -0,0 +1,159 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Builds an HNSW index over random vectors with several threads, then
+// measures the recall@k and single-threaded QPS of searches at several values
+// of ef, against an exact brute-force top-k.
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/modules/vector/vector_math.h"
+
+ABSL_FLAG(int, dim, 128, "Number of elements per vector.");
+ABSL_FLAG(int, num_vectors, 100000, "Number of vectors to index.");
+ABSL_FLAG(int, num_queries, 1000, "Number of queries to measure.");
+ABSL_FLAG(int, k, 10, "Number of results per query.");
+ABSL_FLAG(int, m, 16, "Number of neighbors per node.");
+ABSL_FLAG(int, ef_construction, 200, "Candidate list size while inserting.");
+ABSL_FLAG(std::string, ef_search, "16,32,64,128,256",
+          "Comma-separated candidate list sizes to measure searches at.");
+ABSL_FLAG(int, num_threads, 8, "Number of threads that build the index.");
+
+namespace genc {
+namespace {
+
+std::vector<float> RandomVectors(int n, int dim, int seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> distribution;
+  std::vector<float> vectors(static_cast<size_t>(n) * dim);
+  for (float& x : vectors) {
+    x = distribution(rng);
+  }
+  return vectors;
+}
+
+void Run() {
+  const int dim = absl::GetFlag(FLAGS_dim);
+  const int num_vectors = absl::GetFlag(FLAGS_num_vectors);
+  const int num_queries = absl::GetFlag(FLAGS_num_queries);
+  const int k = absl::GetFlag(FLAGS_k);
+  const int num_threads = absl::GetFlag(FLAGS_num_threads);
+
+  HnswIndex::Options options;
+  options.dim = dim;
+  options.max_elements = num_vectors;
+  options.m = absl::GetFlag(FLAGS_m);
+  options.ef_construction = absl::GetFlag(FLAGS_ef_construction);
+  std::unique_ptr<HnswIndex> index = HnswIndex::Create(options).value();
+
+  const std::vector<float> data = RandomVectors(num_vectors, dim, 1);
+  const std::vector<float> queries = RandomVectors(num_queries, dim, 2);
+  auto row = [dim](const std::vector<float>& matrix, int i) {
+    return absl::MakeConstSpan(matrix).subspan(static_cast<size_t>(i) * dim,
+                                               dim);
+  };
+
+  absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = t; i < num_vectors; i += num_threads) {
+        index->Add(row(data, i)).value();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const absl::Duration build_time = absl::Now() - start;
+  std::cout << "isa=" << VectorKernelIsa() << " dim=" << dim
+            << " num_vectors=" << num_vectors << " m=" << options.m
+            << " ef_construction=" << options.ef_construction << "\n"
+            << "build: " << absl::ToDoubleSeconds(build_time) << " s with "
+            << num_threads << " threads ("
+            << num_vectors / absl::ToDoubleSeconds(build_time)
+            << " inserts/s)\n";
+
+  // Ids follow the order in which inserts began, so the exact answers are
+  // computed over the stored vectors.
+  std::vector<float> stored;
+  stored.reserve(data.size());
+  for (int i = 0; i < num_vectors; ++i) {
+    absl::Span<const float> v = index->vector(i);
+    stored.insert(stored.end(), v.begin(), v.end());
+  }
+  start = absl::Now();
+  std::vector<std::vector<ScoredIndex>> exact;
+  for (int q = 0; q < num_queries; ++q) {
+    exact.push_back(TopK(options.metric, row(queries, q), stored, k));
+  }
+  std::cout << "brute force: "
+            << num_queries / absl::ToDoubleSeconds(absl::Now() - start)
+            << " QPS\n";
+
+  for (absl::string_view ef_flag :
+       absl::StrSplit(absl::GetFlag(FLAGS_ef_search), ',')) {
+    int ef;
+    if (!absl::SimpleAtoi(ef_flag, &ef)) {
+      std::cerr << "Bad --ef_search value: " << ef_flag << "\n";
+      return;
+    }
+    std::vector<std::vector<ScoredIndex>> results;
+    results.reserve(num_queries);
+    start = absl::Now();
+    for (int q = 0; q < num_queries; ++q) {
+      results.push_back(index->Search(row(queries, q), k, ef).value());
+    }
+    const double qps =
+        num_queries / absl::ToDoubleSeconds(absl::Now() - start);
+    int found = 0;
+    for (int q = 0; q < num_queries; ++q) {
+      for (const ScoredIndex& expected : exact[q]) {
+        for (const ScoredIndex& result : results[q]) {
+          if (result.index == expected.index) {
+            ++found;
+            break;
+          }
+        }
+      }
+    }
+    std::cout << "ef=" << ef << ": recall@" << k << " "
+              << static_cast<double>(found) / (num_queries * k) << ", " << qps
+              << " QPS\n";
+  }
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
@@ -0,0 +1,294 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "genc/cc/authoring/constructor.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/intrinsics/handler_sets.h"
+#include "genc/cc/modules/retrieval/index_file.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/executor.h"
+#include "genc/cc/runtime/inline_executor.h"
+#include "genc/cc/runtime/runner.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+constexpr int kDim = 32;
+
+std::vector<float> RandomVectors(int n, int dim, int seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> distribution;
+  std::vector<float> vectors(static_cast<size_t>(n) * dim);
+  for (float& x : vectors) {
+    x = distribution(rng);
+  }
+  return vectors;
+}
+
+absl::Span<const float> Row(const std::vector<float>& matrix, int i) {
+  return absl::MakeConstSpan(matrix).subspan(i * kDim, kDim);
+}
+
+// Returns the fraction of the exact top 10 of each query that the index finds.
+double Recall(const HnswIndex& index, const std::vector<float>& data,
+              const std::vector<float>& queries, VectorMetric metric) {
+  int found = 0;
+  int total = 0;
+  for (int q = 0; q < static_cast<int>(queries.size()) / kDim; ++q) {
+    std::vector<ScoredIndex> actual = index.Search(Row(queries, q), 10).value();
+    for (const ScoredIndex& expected :
+         TopK(metric, Row(queries, q), data, 10)) {
+      ++total;
+      for (const ScoredIndex& result : actual) {
+        if (result.index == expected.index) {
+          ++found;
+          break;
+        }
+      }
+    }
+  }
+  return static_cast<double>(found) / total;
+}
+
+HnswIndex::Options TestOptions(int max_elements, VectorMetric metric) {
+  HnswIndex::Options options;
+  options.dim = kDim;
+  options.max_elements = max_elements;
+  options.metric = metric;
+  options.m = 8;
+  options.ef_construction = 100;
+  options.ef_search = 50;
+  return options;
+}
+
+TEST(HnswIndexTest, FindsExactMatch) {
+  std::unique_ptr<HnswIndex> index =
+      HnswIndex::Create(TestOptions(100, VectorMetric::kL2)).value();
+  const std::vector<float> data = RandomVectors(100, kDim, 1);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(index->Add(Row(data, i)).value(), i);
+  }
+  EXPECT_EQ(index->size(), 100);
+  for (int i = 0; i < 100; ++i) {
+    std::vector<ScoredIndex> result = index->Search(Row(data, i), 1).value();
+    ASSERT_EQ(result.size(), 1);
+    EXPECT_EQ(result[0].index, i);
+    EXPECT_EQ(result[0].score, 0.0f);
+  }
+}
+
+TEST(HnswIndexTest, HasHighRecall) {
+  for (VectorMetric metric : {VectorMetric::kCosine, VectorMetric::kL2}) {
+    std::unique_ptr<HnswIndex> index =
+        HnswIndex::Create(TestOptions(2000, metric)).value();
+    const std::vector<float> data = RandomVectors(2000, kDim, 2);
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_TRUE(index->Add(Row(data, i)).ok());
+    }
+    EXPECT_GT(Recall(*index, data, RandomVectors(50, kDim, 3), metric), 0.9);
+  }
+}
+
+TEST(HnswIndexTest, ConcurrentAddsAndSearchesKeepRecall) {
+  std::unique_ptr<HnswIndex> index =
+      HnswIndex::Create(TestOptions(2000, VectorMetric::kCosine)).value();
+  const std::vector<float> data = RandomVectors(2000, kDim, 4);
+  const std::vector<float> queries = RandomVectors(50, kDim, 5);
+  std::vector<std::thread> threads;
+  std::vector<std::vector<int>> ids(4);
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = t; i < 2000; i += 4) {
+        ids[t].push_back(index->Add(Row(data, i)).value());
+        // Searches interleave with the inserts of the other threads.
+        ASSERT_TRUE(index->Search(Row(queries, i % 50), 10).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(index->size(), 2000);
+
+  // Ids follow the order in which inserts began, not the order of `data`, so
+  // compare the index against the stored vectors.
+  std::vector<float> stored;
+  for (int i = 0; i < 2000; ++i) {
+    absl::Span<const float> v = index->vector(i);
+    stored.insert(stored.end(), v.begin(), v.end());
+  }
+  EXPECT_GT(Recall(*index, stored, queries, VectorMetric::kCosine), 0.9);
+}
+
+TEST(HnswIndexTest, RejectsBadInput) {
+  EXPECT_FALSE(HnswIndex::Create(TestOptions(0, VectorMetric::kL2)).ok());
+  std::unique_ptr<HnswIndex> index =
+      HnswIndex::Create(TestOptions(1, VectorMetric::kL2)).value();
+  EXPECT_TRUE(index->Search(std::vector<float>(kDim), 1).value().empty());
+  EXPECT_EQ(index->Add(std::vector<float>(kDim - 1)).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(index->Add(std::vector<float>(kDim)).ok());
+  EXPECT_EQ(index->Add(std::vector<float>(kDim)).status().code(),
+            absl::StatusCode::kResourceExhausted);
+  EXPECT_FALSE(index->Search(std::vector<float>(kDim + 1), 1).ok());
+}
+
+TEST(HnswIndexTest, LoadedIndexServesSameResults) {
+  std::unique_ptr<HnswIndex> index =
+      HnswIndex::Create(TestOptions(500, VectorMetric::kCosine)).value();
+  const std::vector<float> data = RandomVectors(500, kDim, 6);
+  for (int i = 0; i < 500; ++i) {
+    ASSERT_TRUE(index->Add(Row(data, i)).ok());
+  }
+  const std::string path = ::testing::TempDir() + "/hnsw_index";
+  ASSERT_EQ(index->WriteTo(path), absl::OkStatus());
+
+  std::unique_ptr<HnswIndex> loaded = HnswIndex::Load(path).value();
+  EXPECT_EQ(loaded->size(), 500);
+  const std::vector<float> queries = RandomVectors(20, kDim, 7);
+  for (int q = 0; q < 20; ++q) {
+    std::vector<ScoredIndex> expected =
+        index->Search(Row(queries, q), 5).value();
+    std::vector<ScoredIndex> actual =
+        loaded->Search(Row(queries, q), 5).value();
+    ASSERT_EQ(actual.size(), expected.size());
+    for (int i = 0; i < static_cast<int>(actual.size()); ++i) {
+      EXPECT_EQ(actual[i].index, expected[i].index);
+      EXPECT_EQ(actual[i].score, expected[i].score);
+    }
+  }
+  EXPECT_EQ(loaded->Add(Row(data, 0)).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(HnswIndexTest, LoadRejectsOtherFiles) {
+  const std::string path = ::testing::TempDir() + "/not_an_index";
+  std::ofstream(path) << "This is not an index file, but it is long enough.";
+  EXPECT_EQ(HnswIndex::Load(path).status().code(),
+            absl::StatusCode::kDataLoss);
+  EXPECT_EQ(HnswIndex::Load(path + ".missing").status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+// Writes a two-node index file by hand, in the layout of HnswIndex::WriteTo,
+// where node 0 reaches layer `level0` and node 1 layer `level1`, and each is
+// the other's neighbor on every layer they share according to node 0.
+void WriteTwoNodeIndex(const std::string& path, int level0, int level1) {
+  struct Params {
+    int32_t dim;
+    int32_t num_elements;
+    int32_t metric;
+    int32_t m;
+    int32_t ef_construction;
+    int32_t ef_search;
+    uint64_t seed;
+    int64_t entry;
+  };
+  const int m = 2;
+  const Params params = {/*dim=*/2,
+                         /*num_elements=*/2,
+                         static_cast<int32_t>(VectorMetric::kL2),
+                         m,
+                         /*ef_construction=*/10,
+                         /*ef_search=*/10,
+                         /*seed=*/0,
+                         /*entry=*/static_cast<int64_t>(level0) << 32};
+  const std::vector<float> vectors = {0, 0, 1, 1};
+  const std::vector<int32_t> levels = {level0, level1};
+  const std::vector<int32_t> level0_lists = {1, 1, 0, 0, 0, 1, 0, 0, 0, 0};
+  std::vector<int32_t> upper;
+  for (int l = 1; l <= level0; ++l) {
+    upper.insert(upper.end(), {1, 1, 0});
+  }
+  for (int l = 1; l <= level1; ++l) {
+    upper.insert(upper.end(), {1, 0, 0});
+  }
+  const std::vector<uint64_t> upper_offsets = {
+      0, static_cast<uint64_t>(level0) * (1 + m), upper.size()};
+  IndexFileWriter writer(IndexFileKind::kHnswIndex);
+  writer.AddSection(
+      1, absl::string_view(reinterpret_cast<const char*>(&params),
+                           sizeof(params)));
+  writer.AddSection<float>(2, vectors);
+  writer.AddSection<int32_t>(3, levels);
+  writer.AddSection<int32_t>(4, level0_lists);
+  writer.AddSection<uint64_t>(5, upper_offsets);
+  writer.AddSection<int32_t>(6, upper);
+  ASSERT_EQ(writer.Write(path), absl::OkStatus());
+}
+
+TEST(HnswIndexTest, LoadRejectsNeighborsBelowTheirLayer) {
+  const std::string path = ::testing::TempDir() + "/two_node_index";
+  WriteTwoNodeIndex(path, /*level0=*/1, /*level1=*/1);
+  std::unique_ptr<HnswIndex> index = HnswIndex::Load(path).value();
+  EXPECT_EQ(index->Search({1, 1}, 1).value()[0].index, 1);
+
+  // Node 0 lists node 1 on layer 1, which node 1 does not reach.
+  WriteTwoNodeIndex(path, /*level0=*/1, /*level1=*/0);
+  EXPECT_EQ(HnswIndex::Load(path).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(SetCustomFunctionsForVectorIndex, AddAndSearchWorkWithExecutor) {
+  intrinsics::HandlerSetConfig config;
+  HnswIndex::Options options;
+  options.dim = 2;
+  options.max_elements = 10;
+  std::unique_ptr<HnswIndex> index = HnswIndex::Create(options).value();
+  EXPECT_EQ(SetCustomFunctionsForVectorIndex(config.custom_function_map,
+                                             *index),
+            absl::OkStatus());
+  std::shared_ptr<Executor> executor =
+      CreateInlineExecutor(intrinsics::CreateCompleteHandlerSet(config),
+                           CreateThreadBasedConcurrencyManager())
+          .value();
+
+  v0::Value add_pb = CreateCustomFunction(kVectorIndexAddUri).value();
+  v0::Value search_pb = CreateCustomFunction(kVectorIndexSearchUri).value();
+
+  Runner runner = Runner::Create(executor).value();
+
+  v0::Value result =
+      runner.Run(add_pb, CreateFloatTensor({1.0f, 0.0f})).value();
+  EXPECT_EQ(result.int_32(), 0);
+  result = runner.Run(add_pb, CreateFloatTensor({0.0f, 1.0f})).value();
+  EXPECT_EQ(result.int_32(), 1);
+  v0::Value query;
+  *query.mutable_struct_()->add_element() = CreateFloatTensor({0.1f, 1.0f});
+  query.mutable_struct_()->add_element()->set_int_32(1);
+  result = runner.Run(search_pb, query).value();
+  ASSERT_EQ(result.struct_().element_size(), 1);
+  EXPECT_EQ(result.struct_().element(0).struct_().element(0).int_32(), 1);
+}
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,391 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/index_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+constexpr char kMagic[8] = {'G', 'E', 'N', 'C', 'R', 'I', 'D', 'X'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr size_t kAlignment = 64;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order_mark;
+  uint32_t kind;
+  uint32_t num_sections;
+};
+
+struct SectionEntry {
+  uint32_t tag;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+
+size_t Align(size_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// The sections of a value cache snapshot.
+enum ValueCacheSection : uint32_t {
+  // uint64 offsets into kKeys of each key, in sorted order, and of the end.
+  kKeyOffsets = 1,
+  // The keys, back to back.
+  kKeys = 2,
+  // uint64 index of the first message of each key, and of the end.
+  kFirstMessages = 3,
+  // uint64 offsets into kMessages of each serialized message, and of the end.
+  kMessageOffsets = 4,
+  // The serialized v0::Value messages, back to back.
+  kMessages = 5,
+  // A single uint64: the last log record folded into the snapshot. Optional.
+  kSequence = 6,
+};
+
+// Flushes the file or directory at `path` to disk.
+absl::Status Sync(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open ", path, ": ", std::strerror(errno)));
+  }
+  const int result = fsync(fd);
+  close(fd);
+  if (result != 0) {
+    return absl::InternalError(
+        absl::StrCat("Failed to sync ", path, ": ", std::strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+std::string DirectoryOf(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Checks that a table of `num + 1` offsets ends at `size`.
+bool EndsAt(absl::Span<const uint64_t> offsets, size_t size) {
+  return !offsets.empty() && offsets.front() == 0 && offsets.back() == size;
+}
+
+}  // namespace
+
+void IndexFileWriter::AddSection(uint32_t tag, absl::string_view data) {
+  sections_.emplace_back(tag, std::string(data));
+}
+
+absl::Status IndexFileWriter::Write(const std::string& path) const {
+  FileHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order_mark = kByteOrderMark;
+  header.kind = static_cast<uint32_t>(kind_);
+  header.num_sections = sections_.size();
+
+  std::vector<SectionEntry> table;
+  size_t offset =
+      Align(sizeof(FileHeader) + sections_.size() * sizeof(SectionEntry));
+  for (const auto& [tag, data] : sections_) {
+    table.push_back({tag, 0, offset, data.size()});
+    offset = Align(offset + data.size());
+  }
+
+  const std::string temp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return absl::InternalError(
+          absl::StrCat("Failed to open for writing: ", temp_path));
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()),
+              table.size() * sizeof(SectionEntry));
+    size_t written = sizeof(header) + table.size() * sizeof(SectionEntry);
+    const std::string padding(kAlignment, '\0');
+    for (size_t i = 0; i < sections_.size(); ++i) {
+      out.write(padding.data(), table[i].offset - written);
+      out.write(sections_[i].second.data(), sections_[i].second.size());
+      written = table[i].offset + sections_[i].second.size();
+    }
+    out.flush();
+    if (!out) {
+      return absl::InternalError(absl::StrCat("Failed to write: ", temp_path));
+    }
+  }
+  // The contents must be on disk before the rename is, or a crash could leave
+  // a renamed but empty file in place of the old one.
+  GENC_TRY(Sync(temp_path));
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    return absl::InternalError(absl::StrCat("Failed to rename ", temp_path,
+                                            " to ", path, ": ",
+                                            std::strerror(errno)));
+  }
+  return Sync(DirectoryOf(path));
+}
+
+absl::StatusOr<std::unique_ptr<MappedIndexFile>> MappedIndexFile::Open(
+    const std::string& path, IndexFileKind kind) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open ", path, ": ", std::strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    close(fd);
+    return absl::DataLossError(absl::StrCat("Truncated index file: ", path));
+  }
+  void* const data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("Failed to map ", path, ": ", std::strerror(errno)));
+  }
+  std::unique_ptr<MappedIndexFile> file(
+      new MappedIndexFile(static_cast<const char*>(data), st.st_size));
+
+  FileHeader header;
+  std::memcpy(&header, file->data_, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    return absl::DataLossError(absl::StrCat("Not an index file: ", path));
+  }
+  if (header.version != kVersion || header.byte_order_mark != kByteOrderMark) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Unsupported version ", header.version,
+                     " or byte order of index file: ", path));
+  }
+  if (header.kind != static_cast<uint32_t>(kind)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Index file ", path, " holds kind ", header.kind,
+                     ", expected ", static_cast<uint32_t>(kind)));
+  }
+  if (header.num_sections >
+      (file->size_ - sizeof(header)) / sizeof(SectionEntry)) {
+    return absl::DataLossError(absl::StrCat("Truncated index file: ", path));
+  }
+  for (uint32_t i = 0; i < header.num_sections; ++i) {
+    SectionEntry entry;
+    std::memcpy(&entry, file->data_ + sizeof(header) + i * sizeof(entry),
+                sizeof(entry));
+    if (entry.offset > file->size_ || entry.size > file->size_ - entry.offset) {
+      return absl::DataLossError(
+          absl::StrCat("Section ", entry.tag, " is out of bounds: ", path));
+    }
+    file->sections_[entry.tag] =
+        absl::string_view(file->data_ + entry.offset, entry.size);
+  }
+  return file;
+}
+
+MappedIndexFile::~MappedIndexFile() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+absl::StatusOr<absl::string_view> MappedIndexFile::Section(
+    uint32_t tag) const {
+  auto it = sections_.find(tag);
+  if (it == sections_.end()) {
+    return absl::DataLossError(absl::StrCat("Missing section ", tag));
+  }
+  return it->second;
+}
+
+absl::Status MappedIndexFile::SizeError(uint32_t tag, size_t size) {
+  return absl::DataLossError(
+      absl::StrCat("Section ", tag, " has an unexpected size of ", size));
+}
+
+absl::Status MappedIndexFile::AlignmentError(uint32_t tag, size_t offset) {
+  return absl::DataLossError(
+      absl::StrCat("Section ", tag, " has a misaligned offset of ", offset));
+}
+
+absl::Status WriteLocalValueCache(const LocalValueCache& cache,
+                                  const std::string& path, uint64_t sequence) {
+  std::vector<std::pair<std::string, std::vector<v0::Value>>> entries;
+  cache.ForEach(
+      [&entries](const std::string& key, const std::vector<v0::Value>& values) {
+        entries.emplace_back(key, values);
+      });
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  std::vector<uint64_t> key_offsets = {0};
+  std::string keys;
+  std::vector<uint64_t> first_messages = {0};
+  std::vector<uint64_t> message_offsets = {0};
+  std::string messages;
+  for (const auto& [key, values] : entries) {
+    keys.append(key);
+    key_offsets.push_back(keys.size());
+    for (const v0::Value& value : values) {
+      if (!value.AppendToString(&messages)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Failed to serialize a message of key ", key));
+      }
+      message_offsets.push_back(messages.size());
+    }
+    first_messages.push_back(message_offsets.size() - 1);
+  }
+
+  IndexFileWriter writer(IndexFileKind::kValueCache);
+  writer.AddSection<uint64_t>(kKeyOffsets, key_offsets);
+  writer.AddSection(kKeys, keys);
+  writer.AddSection<uint64_t>(kFirstMessages, first_messages);
+  writer.AddSection<uint64_t>(kMessageOffsets, message_offsets);
+  writer.AddSection(kMessages, messages);
+  writer.AddSection<uint64_t>(kSequence, absl::MakeConstSpan(&sequence, 1));
+  return writer.Write(path);
+}
+
+absl::StatusOr<std::unique_ptr<MappedValueCache>> MappedValueCache::Open(
+    const std::string& path) {
+  std::unique_ptr<MappedValueCache> cache(new MappedValueCache());
+  cache->file_ =
+      GENC_TRY(MappedIndexFile::Open(path, IndexFileKind::kValueCache));
+  const MappedIndexFile& file = *cache->file_;
+  const absl::Span<const uint64_t> key_offsets =
+      GENC_TRY(file.Array<uint64_t>(kKeyOffsets));
+  const absl::string_view keys = GENC_TRY(file.Section(kKeys));
+  const absl::Span<const uint64_t> first_messages =
+      GENC_TRY(file.Array<uint64_t>(kFirstMessages, key_offsets.size()));
+  const absl::Span<const uint64_t> message_offsets =
+      GENC_TRY(file.Array<uint64_t>(kMessageOffsets));
+  const absl::string_view messages = GENC_TRY(file.Section(kMessages));
+  if (!EndsAt(key_offsets, keys.size()) ||
+      !EndsAt(message_offsets, messages.size()) ||
+      !EndsAt(first_messages, message_offsets.size() - 1)) {
+    return absl::DataLossError(
+        absl::StrCat("Inconsistent offsets in value cache file: ", path));
+  }
+  cache->key_offsets_ = key_offsets;
+  cache->keys_ = keys;
+  cache->first_messages_ = first_messages;
+  cache->message_offsets_ = message_offsets;
+  cache->messages_ = messages;
+  if (file.Section(kSequence).ok()) {
+    cache->sequence_ = GENC_TRY(file.Array<uint64_t>(kSequence, 1))[0];
+  }
+  return cache;
+}
+
+// Offsets are only checked at their ends when opening, so that opening does
+// not touch every page; each lookup checks the ones it uses.
+absl::string_view MappedValueCache::Key(int i) const {
+  const uint64_t begin = key_offsets_[i];
+  const uint64_t end = key_offsets_[i + 1];
+  if (begin > end || end > keys_.size()) {
+    return absl::string_view();
+  }
+  return keys_.substr(begin, end - begin);
+}
+
+absl::string_view MappedValueCache::Message(uint64_t i) const {
+  const uint64_t begin = message_offsets_[i];
+  const uint64_t end = message_offsets_[i + 1];
+  if (begin > end || end > messages_.size()) {
+    return absl::string_view();
+  }
+  return messages_.substr(begin, end - begin);
+}
+
+int MappedValueCache::Find(absl::string_view key) const {
+  int low = 0;
+  int high = size();
+  while (low < high) {
+    const int mid = low + (high - low) / 2;
+    if (Key(mid) < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < static_cast<int>(size()) && Key(low) == key ? low : -1;
+}
+
+absl::StatusOr<std::vector<v0::Value>> MappedValueCache::Get(
+    absl::string_view key, std::optional<int> n) const {
+  const int i = Find(key);
+  if (i < 0) {
+    return std::vector<v0::Value>();
+  }
+  uint64_t begin = first_messages_[i];
+  const uint64_t end = first_messages_[i + 1];
+  if (begin > end || end >= message_offsets_.size()) {
+    return absl::DataLossError(
+        absl::StrCat("Inconsistent messages of key ", key));
+  }
+  if (n) {
+    const uint64_t count = std::max(*n, 0);
+    if (count < end - begin) {
+      begin = end - count;
+    }
+  }
+  std::vector<v0::Value> values(end - begin);
+  for (uint64_t j = begin; j < end; ++j) {
+    const absl::string_view bytes = Message(j);
+    if (!values[j - begin].ParseFromArray(bytes.data(), bytes.size())) {
+      return absl::DataLossError(
+          absl::StrCat("Failed to parse a message of key ", key));
+    }
+  }
+  return values;
+}
+
+absl::Status MappedValueCache::LoadInto(LocalValueCache& cache) const {
+  for (size_t i = 0; i < size(); ++i) {
+    const std::string key(Key(i));
+    for (const v0::Value& value : GENC_TRY(Get(key))) {
+      cache.Put(key, value);
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace genc
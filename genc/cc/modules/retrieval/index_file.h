@@ -0,0 +1,183 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_INDEX_FILE_H_
+#define GENC_CC_MODULES_RETRIEVAL_INDEX_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+// An on-disk format for retrieval data that is served straight from a
+// read-only memory mapping, so that opening a file costs a few page faults
+// rather than a rebuild.
+//
+// A file is a fixed header, a table of sections, and the sections themselves.
+// Each section is a flat array of fixed-size little-endian values, aligned to
+// 64 bytes so that it can be read in place by the SIMD kernels:
+//
+//   header:   magic "GENCRIDX", format version, byte-order mark, file kind,
+//             number of sections
+//   table:    per section, its tag, offset and size in bytes
+//   sections: the arrays, in any order
+//
+// Readers reject files with an unknown version, kind or byte order, and files
+// whose sections point outside of the file. Writers replace the file
+// atomically by renaming a complete, synced temporary file over it.
+
+namespace genc {
+
+// What a file holds.
+enum class IndexFileKind : uint32_t {
+  kHnswIndex = 1,
+  kValueCache = 2,
+};
+
+// Builds a file in memory, section by section, and then writes it out.
+class IndexFileWriter {
+ public:
+  explicit IndexFileWriter(IndexFileKind kind) : kind_(kind) {}
+
+  // Adds a section holding a copy of `data`.
+  void AddSection(uint32_t tag, absl::string_view data);
+
+  template <typename T>
+  void AddSection(uint32_t tag, absl::Span<const T> data) {
+    AddSection(tag,
+               absl::string_view(reinterpret_cast<const char*>(data.data()),
+                                 data.size() * sizeof(T)));
+  }
+
+  // Writes the file to a temporary path next to `path`, then renames it to
+  // `path`.
+  absl::Status Write(const std::string& path) const;
+
+ private:
+  IndexFileKind kind_;
+  std::vector<std::pair<uint32_t, std::string>> sections_;
+};
+
+// A read-only memory mapping of a file written by IndexFileWriter.
+class MappedIndexFile {
+ public:
+  static absl::StatusOr<std::unique_ptr<MappedIndexFile>> Open(
+      const std::string& path, IndexFileKind kind);
+
+  ~MappedIndexFile();
+  MappedIndexFile(const MappedIndexFile&) = delete;
+  MappedIndexFile& operator=(const MappedIndexFile&) = delete;
+
+  // Returns the bytes of the section with `tag`, or an error if there is no
+  // such section.
+  absl::StatusOr<absl::string_view> Section(uint32_t tag) const;
+
+  // Returns the section with `tag` as an array of `T`, or an error if it is
+  // not aligned for `T`, if its size is not a multiple of `sizeof(T)`, or is
+  // not `expected_size` elements when given.
+  template <typename T>
+  absl::StatusOr<absl::Span<const T>> Array(
+      uint32_t tag, std::optional<size_t> expected_size = std::nullopt) const {
+    const absl::string_view section = GENC_TRY(Section(tag));
+    // The mapping is page-aligned, so the offset decides the alignment.
+    const size_t offset = section.data() - data_;
+    if (offset % alignof(T) != 0) {
+      return AlignmentError(tag, offset);
+    }
+    if (section.size() % sizeof(T) != 0 ||
+        (expected_size && section.size() / sizeof(T) != *expected_size)) {
+      return SizeError(tag, section.size());
+    }
+    return absl::MakeConstSpan(reinterpret_cast<const T*>(section.data()),
+                               section.size() / sizeof(T));
+  }
+
+ private:
+  MappedIndexFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  static absl::Status SizeError(uint32_t tag, size_t size);
+  static absl::Status AlignmentError(uint32_t tag, size_t offset);
+
+  const char* data_;
+  size_t size_;
+  absl::flat_hash_map<uint32_t, absl::string_view> sections_;
+};
+
+// Writes a snapshot of every key and its messages in `cache`. `sequence`
+// records how far a write-ahead log had been folded into the snapshot, see
+// ValueCacheLog.
+absl::Status WriteLocalValueCache(const LocalValueCache& cache,
+                                  const std::string& path,
+                                  uint64_t sequence = 0);
+
+// Serves the messages of a snapshot written by WriteLocalValueCache, straight
+// from the file. Keys are looked up by binary search over a sorted table, and
+// only the returned messages are parsed.
+class MappedValueCache {
+ public:
+  static absl::StatusOr<std::unique_ptr<MappedValueCache>> Open(
+      const std::string& path);
+
+  // Retrieves the last n messages associated with a key, as LocalCache does.
+  // If n is not present, returns everything, and if it is negative, nothing.
+  absl::StatusOr<std::vector<v0::Value>> Get(
+      absl::string_view key, std::optional<int> n = std::nullopt) const;
+
+  // Returns true if there are any messages associated with a key.
+  bool Exists(absl::string_view key) const { return Find(key) >= 0; }
+
+  // Returns the number of keys.
+  size_t size() const { return key_offsets_.size() - 1; }
+
+  // Returns the sequence the snapshot was written with.
+  uint64_t sequence() const { return sequence_; }
+
+  // Puts every message of every key into `cache`, e.g. to resume writing to
+  // a restored cache.
+  absl::Status LoadInto(LocalValueCache& cache) const;
+
+ private:
+  MappedValueCache() = default;
+
+  absl::string_view Key(int i) const;
+  absl::string_view Message(uint64_t i) const;
+
+  // Returns the position of `key` in the key table, or -1.
+  int Find(absl::string_view key) const;
+
+  std::unique_ptr<MappedIndexFile> file_;
+  absl::Span<const uint64_t> key_offsets_;
+  absl::string_view keys_;
+  absl::Span<const uint64_t> first_messages_;
+  absl::Span<const uint64_t> message_offsets_;
+  absl::string_view messages_;
+  uint64_t sequence_ = 0;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_INDEX_FILE_H_
@@ -0,0 +1,136 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Compares the cold-start time of retrieval data served from index files
+// against rebuilding it: an HNSW index over random vectors, and a value cache
+// of many conversations.
+//
+// The files are freshly written, so they are in the page cache; to measure
+// reads from disk as well, drop the page cache between --write and a later
+// run with --nowrite.
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/modules/retrieval/index_file.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/proto/v0/computation.pb.h"
+
+ABSL_FLAG(std::string, dir, "/tmp", "Directory to write the files to.");
+ABSL_FLAG(bool, write, true, "Whether to build and write the files first.");
+ABSL_FLAG(int, dim, 128, "Number of elements per vector.");
+ABSL_FLAG(int, num_vectors, 100000, "Number of vectors to index.");
+ABSL_FLAG(int, num_keys, 10000, "Number of keys in the value cache.");
+ABSL_FLAG(int, messages_per_key, 50, "Number of messages per key.");
+
+namespace genc {
+namespace {
+
+double Seconds(absl::Time start) {
+  return absl::ToDoubleSeconds(absl::Now() - start);
+}
+
+void RunHnswIndex(const std::string& path) {
+  const int dim = absl::GetFlag(FLAGS_dim);
+  const int num_vectors = absl::GetFlag(FLAGS_num_vectors);
+  std::mt19937 rng(1);
+  std::normal_distribution<float> distribution;
+  std::vector<float> query(dim);
+  for (float& x : query) {
+    x = distribution(rng);
+  }
+
+  if (absl::GetFlag(FLAGS_write)) {
+    std::vector<float> data(static_cast<size_t>(num_vectors) * dim);
+    for (float& x : data) {
+      x = distribution(rng);
+    }
+    absl::Time start = absl::Now();
+    HnswIndex::Options options;
+    options.dim = dim;
+    options.max_elements = num_vectors;
+    std::unique_ptr<HnswIndex> index = HnswIndex::Create(options).value();
+    for (int i = 0; i < num_vectors; ++i) {
+      index->Add(absl::MakeConstSpan(data).subspan(
+                     static_cast<size_t>(i) * dim, dim))
+          .value();
+    }
+    std::cout << "hnsw rebuild: " << Seconds(start) << " s\n";
+    start = absl::Now();
+    index->WriteTo(path).IgnoreError();
+    std::cout << "hnsw write: " << Seconds(start) << " s\n";
+  }
+
+  const absl::Time start = absl::Now();
+  std::unique_ptr<HnswIndex> loaded = HnswIndex::Load(path).value();
+  std::cout << "hnsw load: " << Seconds(start) << " s\n";
+  loaded->Search(query, 10).value();
+  std::cout << "hnsw load and first search: " << Seconds(start) << " s\n";
+}
+
+void RunValueCache(const std::string& path) {
+  const int num_keys = absl::GetFlag(FLAGS_num_keys);
+  const int messages_per_key = absl::GetFlag(FLAGS_messages_per_key);
+
+  if (absl::GetFlag(FLAGS_write)) {
+    absl::Time start = absl::Now();
+    LocalValueCache cache(messages_per_key);
+    for (int m = 0; m < messages_per_key; ++m) {
+      for (int k = 0; k < num_keys; ++k) {
+        v0::Value message;
+        message.set_str(absl::StrCat("Message ", m, " of conversation ", k,
+                                     ", padded to a typical chat turn."));
+        cache.Put(absl::StrCat("key_", k), message);
+      }
+    }
+    std::cout << "value cache rebuild: " << Seconds(start) << " s\n";
+    start = absl::Now();
+    WriteLocalValueCache(cache, path).IgnoreError();
+    std::cout << "value cache write: " << Seconds(start) << " s\n";
+  }
+
+  absl::Time start = absl::Now();
+  std::unique_ptr<MappedValueCache> mapped =
+      MappedValueCache::Open(path).value();
+  mapped->Get("key_0").value();
+  std::cout << "value cache open and first read: " << Seconds(start)
+            << " s\n";
+  start = absl::Now();
+  LocalValueCache restored(messages_per_key);
+  mapped->LoadInto(restored).IgnoreError();
+  std::cout << "value cache load into LocalValueCache: " << Seconds(start)
+            << " s\n";
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  const std::string dir = absl::GetFlag(FLAGS_dir);
+  genc::RunHnswIndex(dir + "/hnsw_index_benchmark.idx");
+  genc::RunValueCache(dir + "/value_cache_benchmark.idx");
+  return 0;
+}
@@ -0,0 +1,158 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/index_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+v0::Value StrValue(absl::string_view str) {
+  v0::Value value;
+  value.set_str(std::string(str));
+  return value;
+}
+
+TEST(IndexFileTest, SectionsRoundTripAligned) {
+  const std::string path = ::testing::TempDir() + "/sections";
+  IndexFileWriter writer(IndexFileKind::kHnswIndex);
+  writer.AddSection(7, "abc");
+  const std::vector<float> floats = {1.0f, 2.0f, 3.0f};
+  writer.AddSection<float>(8, floats);
+  ASSERT_EQ(writer.Write(path), absl::OkStatus());
+
+  std::unique_ptr<MappedIndexFile> file =
+      MappedIndexFile::Open(path, IndexFileKind::kHnswIndex).value();
+  EXPECT_EQ(file->Section(7).value(), "abc");
+  absl::Span<const float> mapped = file->Array<float>(8, 3).value();
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(mapped.data()) % 64, 0);
+  EXPECT_THAT(mapped, testing::ElementsAre(1.0f, 2.0f, 3.0f));
+  EXPECT_EQ(file->Array<float>(8, 4).status().code(),
+            absl::StatusCode::kDataLoss);
+  EXPECT_EQ(file->Section(9).status().code(), absl::StatusCode::kDataLoss);
+  EXPECT_EQ(MappedIndexFile::Open(path, IndexFileKind::kValueCache)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(IndexFileTest, RejectsTruncatedFile) {
+  const std::string path = ::testing::TempDir() + "/truncated";
+  IndexFileWriter writer(IndexFileKind::kValueCache);
+  writer.AddSection(1, std::string(1000, 'x'));
+  ASSERT_EQ(writer.Write(path), absl::OkStatus());
+  std::string contents;
+  {
+    std::ifstream in(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      << contents.substr(0, 500);
+  EXPECT_EQ(MappedIndexFile::Open(path, IndexFileKind::kValueCache)
+                .status()
+                .code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST(IndexFileTest, RejectsMisalignedArray) {
+  const std::string path = ::testing::TempDir() + "/misaligned";
+  IndexFileWriter writer(IndexFileKind::kHnswIndex);
+  const std::vector<uint64_t> values = {1, 2};
+  writer.AddSection<uint64_t>(8, values);
+  ASSERT_EQ(writer.Write(path), absl::OkStatus());
+  std::string contents;
+  {
+    std::ifstream in(path, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  // Moves the only section 4 bytes in, and shortens it to 8 bytes. Its table
+  // entry follows the 24-byte header, with the offset and size after the tag.
+  uint64_t offset;
+  uint64_t size;
+  std::memcpy(&offset, &contents[32], sizeof(offset));
+  std::memcpy(&size, &contents[40], sizeof(size));
+  offset += 4;
+  size -= 8;
+  std::memcpy(&contents[32], &offset, sizeof(offset));
+  std::memcpy(&contents[40], &size, sizeof(size));
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+
+  std::unique_ptr<MappedIndexFile> file =
+      MappedIndexFile::Open(path, IndexFileKind::kHnswIndex).value();
+  EXPECT_EQ(file->Section(8).value().size(), 8);
+  EXPECT_EQ(file->Array<uint64_t>(8).status().code(),
+            absl::StatusCode::kDataLoss);
+  EXPECT_EQ(file->Array<uint32_t>(8).value().size(), 2);
+}
+
+TEST(MappedValueCacheTest, ServesSnapshotOfLocalValueCache) {
+  LocalValueCache cache(10);
+  cache.Put("user_b", StrValue("b1"));
+  cache.Put("user_a", StrValue("a1"));
+  cache.Put("user_a", StrValue("a2"));
+  cache.Put("user_a", StrValue("a3"));
+  const std::string path = ::testing::TempDir() + "/value_cache";
+  ASSERT_EQ(WriteLocalValueCache(cache, path), absl::OkStatus());
+
+  std::unique_ptr<MappedValueCache> mapped =
+      MappedValueCache::Open(path).value();
+  EXPECT_EQ(mapped->size(), 2);
+  EXPECT_TRUE(mapped->Exists("user_a"));
+  EXPECT_FALSE(mapped->Exists("user_c"));
+  std::vector<v0::Value> values = mapped->Get("user_a").value();
+  ASSERT_EQ(values.size(), 3);
+  EXPECT_EQ(values[0].str(), "a1");
+  EXPECT_EQ(values[2].str(), "a3");
+  values = mapped->Get("user_a", 1).value();
+  ASSERT_EQ(values.size(), 1);
+  EXPECT_EQ(values[0].str(), "a3");
+  EXPECT_TRUE(mapped->Get("user_c").value().empty());
+  EXPECT_TRUE(mapped->Get("user_a", 0).value().empty());
+  EXPECT_TRUE(mapped->Get("user_a", -1).value().empty());
+
+  LocalValueCache restored(10);
+  ASSERT_EQ(mapped->LoadInto(restored), absl::OkStatus());
+  ASSERT_EQ(restored.Get("user_b").size(), 1);
+  EXPECT_EQ(restored.Get("user_b")[0].str(), "b1");
+  EXPECT_EQ(restored.Get("user_a").size(), 3);
+}
+
+TEST(MappedValueCacheTest, ServesEmptySnapshot) {
+  LocalValueCache cache(10);
+  const std::string path = ::testing::TempDir() + "/empty_value_cache";
+  ASSERT_EQ(WriteLocalValueCache(cache, path), absl::OkStatus());
+  std::unique_ptr<MappedValueCache> mapped =
+      MappedValueCache::Open(path).value();
+  EXPECT_EQ(mapped->size(), 0);
+  EXPECT_TRUE(mapped->Get("key").value().empty());
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,470 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/ingestion_pipeline.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/modules/retrieval/bm25_index.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/runtime/concurrency.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+struct WordRange {
+  size_t begin;
+  size_t end;
+};
+
+// Returns the byte ranges of the words of `text`.
+std::vector<WordRange> Words(absl::string_view text) {
+  std::vector<WordRange> words;
+  size_t i = 0;
+  while (i < text.size()) {
+    if (absl::ascii_isspace(text[i])) {
+      ++i;
+      continue;
+    }
+    const size_t begin = i;
+    while (i < text.size() && !absl::ascii_isspace(text[i])) {
+      ++i;
+    }
+    words.push_back({begin, i});
+  }
+  return words;
+}
+
+bool EndsSentence(absl::string_view word) {
+  // Skips closing quotes and brackets, as in `"Stop."` or `(see above.)`.
+  while (!word.empty() && absl::StrContains("\"')]", word.back())) {
+    word.remove_suffix(1);
+  }
+  return !word.empty() && absl::StrContains(".!?", word.back());
+}
+
+absl::Status CheckChunkingOptions(const ChunkingOptions& options) {
+  if (options.max_tokens < 1 || options.overlap_tokens < 0 ||
+      options.overlap_tokens >= options.max_tokens) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Expected 0 <= overlap_tokens < max_tokens, got ",
+                     options.overlap_tokens, " and ", options.max_tokens));
+  }
+  return absl::OkStatus();
+}
+
+// Appends the windows of `words[begin, end)` to `chunks`, for checked
+// `options`.
+void AppendWindows(absl::string_view text, const std::vector<WordRange>& words,
+                   size_t begin, size_t end, const ChunkingOptions& options,
+                   std::vector<absl::string_view>& chunks) {
+  const size_t size = options.max_tokens;
+  const size_t step = size - options.overlap_tokens;
+  for (size_t first = begin; first < end; first += step) {
+    const size_t last = std::min(first + size, end) - 1;
+    chunks.push_back(text.substr(words[first].begin,
+                                 words[last].end - words[first].begin));
+    if (last + 1 == end) {
+      break;
+    }
+  }
+}
+
+int64_t ChunkBytes(const IngestionPipeline::Chunk& chunk) {
+  return chunk.text.size() + chunk.embedding.size() * sizeof(float);
+}
+
+size_t PeakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  // Linux reports kilobytes.
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<absl::string_view>> ChunkDocument(
+    absl::string_view text, const ChunkingOptions& options) {
+  GENC_TRY(CheckChunkingOptions(options));
+  const std::vector<WordRange> words = Words(text);
+  std::vector<absl::string_view> chunks;
+  if (options.mode == ChunkingOptions::Mode::kTokenWindows) {
+    AppendWindows(text, words, 0, words.size(), options, chunks);
+    return chunks;
+  }
+  const size_t max_tokens = options.max_tokens;
+  // The words of the chunk being packed, and of the current sentence.
+  size_t chunk_begin = 0;
+  size_t sentence_begin = 0;
+  auto flush = [&](size_t end) {
+    if (chunk_begin < end) {
+      chunks.push_back(text.substr(words[chunk_begin].begin,
+                                   words[end - 1].end -
+                                       words[chunk_begin].begin));
+    }
+    chunk_begin = end;
+  };
+  for (size_t i = 0; i < words.size(); ++i) {
+    const bool last = i + 1 == words.size();
+    if (!last && !EndsSentence(text.substr(words[i].begin,
+                                           words[i].end - words[i].begin))) {
+      continue;
+    }
+    const size_t sentence_end = i + 1;
+    if (sentence_end - sentence_begin > max_tokens) {
+      flush(sentence_begin);
+      AppendWindows(text, words, sentence_begin, sentence_end, options,
+                    chunks);
+      chunk_begin = sentence_end;
+    } else if (sentence_end - chunk_begin > max_tokens) {
+      flush(sentence_begin);
+    }
+    sentence_begin = sentence_end;
+  }
+  flush(words.size());
+  return chunks;
+}
+
+double IngestionPipeline::Stats::documents_per_second() const {
+  const double seconds = absl::ToDoubleSeconds(elapsed);
+  return seconds > 0.0 ? documents / seconds : 0.0;
+}
+
+absl::StatusOr<std::unique_ptr<IngestionPipeline>> IngestionPipeline::Start(
+    Options options,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+    IndexFn index_fn) {
+  if (!options.embedding_fn || !index_fn || concurrency_interface == nullptr) {
+    return absl::InvalidArgumentError(
+        "An embedding_fn, an index_fn and a concurrency interface are "
+        "required.");
+  }
+  GENC_TRY(CheckChunkingOptions(options.chunking));
+  if (options.embedding_batch_size < 1 || options.num_chunkers < 1 ||
+      options.num_embedders < 1 || options.num_indexers < 1 ||
+      options.queue_capacity < 1) {
+    return absl::InvalidArgumentError(
+        "Batch size, task counts and queue capacity must be positive.");
+  }
+  std::unique_ptr<IngestionPipeline> pipeline(
+      new IngestionPipeline(std::move(options), std::move(index_fn)));
+  IngestionPipeline* p = pipeline.get();
+  const Options& o = p->options_;
+  for (int i = 0; i < o.num_chunkers; ++i) {
+    p->chunkers_.push_back(
+        concurrency_interface->RunAsync([p]() { return p->Chunker(); }));
+  }
+  for (int i = 0; i < o.num_embedders; ++i) {
+    p->embedders_.push_back(
+        concurrency_interface->RunAsync([p]() { return p->Embedder(); }));
+  }
+  for (int i = 0; i < o.num_indexers; ++i) {
+    p->indexers_.push_back(
+        concurrency_interface->RunAsync([p]() { return p->Indexer(); }));
+  }
+  return pipeline;
+}
+
+IngestionPipeline::IngestionPipeline(Options options, IndexFn index_fn)
+    : options_(std::move(options)),
+      index_fn_(std::move(index_fn)),
+      start_(absl::Now()),
+      documents_(options_.queue_capacity),
+      chunks_(options_.queue_capacity),
+      embedded_(options_.queue_capacity) {}
+
+IngestionPipeline::~IngestionPipeline() {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (finished_) {
+      return;
+    }
+  }
+  Finish().IgnoreError();
+}
+
+absl::Status IngestionPipeline::Add(std::string document) {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!status_.ok()) {
+      return status_;
+    }
+    if (finished_) {
+      return absl::FailedPreconditionError("The pipeline is finished.");
+    }
+  }
+  const int64_t bytes = document.size();
+  Track(bytes);
+  if (!documents_.Push(
+          Document{next_document_.fetch_add(1), std::move(document)})) {
+    Track(-bytes);
+    absl::MutexLock lock(&mutex_);
+    return status_.ok()
+               ? absl::FailedPreconditionError("The pipeline is finished.")
+               : status_;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<IngestionPipeline::Stats> IngestionPipeline::Finish() {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (finished_) {
+      return absl::FailedPreconditionError("The pipeline is finished.");
+    }
+    finished_ = true;
+  }
+  // Each stage finishes once the one before it has, and has closed their
+  // queue.
+  documents_.Close();
+  Wait(chunkers_).IgnoreError();
+  chunks_.Close();
+  Wait(embedders_).IgnoreError();
+  embedded_.Close();
+  Wait(indexers_).IgnoreError();
+  {
+    absl::MutexLock lock(&mutex_);
+    if (!status_.ok()) {
+      return status_;
+    }
+  }
+  Stats stats;
+  stats.documents = num_documents_.load();
+  stats.chunks = num_chunks_.load();
+  stats.elapsed = absl::Now() - start_;
+  stats.peak_bytes_in_flight = peak_bytes_in_flight_.load();
+  stats.peak_rss_bytes = PeakRssBytes();
+  return stats;
+}
+
+absl::Status IngestionPipeline::Chunker() {
+  while (std::optional<Document> document = documents_.Pop()) {
+    if (!failed()) {
+      // The options were checked by Start().
+      const std::vector<absl::string_view> pieces =
+          GENC_TRY(ChunkDocument(document->text, options_.chunking));
+      for (int i = 0; i < static_cast<int>(pieces.size()); ++i) {
+        Chunk chunk{document->number, i, std::string(pieces[i]), {}};
+        const int64_t bytes = ChunkBytes(chunk);
+        Track(bytes);
+        if (!chunks_.Push(std::move(chunk))) {
+          Track(-bytes);
+          break;
+        }
+      }
+      num_documents_.fetch_add(1);
+    }
+    Track(-static_cast<int64_t>(document->text.size()));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IngestionPipeline::Embedder() {
+  std::vector<Chunk> batch;
+  while (std::optional<Chunk> chunk = chunks_.Pop()) {
+    // Batches take whatever is queued, rather than wait for a full batch.
+    batch.push_back(std::move(*chunk));
+    while (batch.size() < static_cast<size_t>(options_.embedding_batch_size)) {
+      std::optional<Chunk> more = chunks_.TryPop();
+      if (!more.has_value()) {
+        break;
+      }
+      batch.push_back(std::move(*more));
+    }
+    int64_t bytes = 0;
+    for (const Chunk& unembedded : batch) {
+      bytes += ChunkBytes(unembedded);
+    }
+    // Embed() counts the chunks again as it passes them on, embedded.
+    absl::Status status = failed() ? absl::OkStatus() : Embed(batch);
+    Track(-bytes);
+    batch.clear();
+    if (!status.ok()) {
+      return Fail(std::move(status));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IngestionPipeline::Embed(std::vector<Chunk>& batch) {
+  v0::Value texts;
+  for (const Chunk& chunk : batch) {
+    texts.mutable_struct_()->add_element()->set_str(chunk.text);
+  }
+  const v0::Value embeddings =
+      GENC_TRY(options_.embedding_fn(options_.embedding_intrinsic, texts));
+  if (!embeddings.has_struct_() ||
+      embeddings.struct_().element_size() != static_cast<int>(batch.size())) {
+    return absl::InternalError(absl::StrCat(
+        "Expected a struct of ", batch.size(), " embeddings, got: ",
+        embeddings.ShortDebugString().substr(0, 200)));
+  }
+  for (int i = 0; i < static_cast<int>(batch.size()); ++i) {
+    batch[i].embedding =
+        GENC_TRY(GetFloatTensor(embeddings.struct_().element(i)));
+  }
+  for (Chunk& chunk : batch) {
+    const int64_t bytes = ChunkBytes(chunk);
+    Track(bytes);
+    if (!embedded_.Push(std::move(chunk))) {
+      Track(-bytes);
+      break;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IngestionPipeline::Indexer() {
+  while (std::optional<Chunk> chunk = embedded_.Pop()) {
+    const int64_t bytes = ChunkBytes(*chunk);
+    absl::Status status =
+        failed() ? absl::OkStatus() : index_fn_(std::move(*chunk));
+    Track(-bytes);
+    if (!status.ok()) {
+      return Fail(std::move(status));
+    }
+    num_chunks_.fetch_add(1);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IngestionPipeline::Fail(absl::Status status) {
+  {
+    absl::MutexLock lock(&mutex_);
+    if (status_.ok()) {
+      status_ = status;
+    }
+  }
+  failed_.store(true);
+  documents_.Close();
+  chunks_.Close();
+  embedded_.Close();
+  return status;
+}
+
+absl::Status IngestionPipeline::Wait(Tasks& tasks) {
+  absl::Status first;
+  for (std::shared_ptr<FutureInterface<absl::Status>>& task : tasks) {
+    absl::StatusOr<absl::Status> status = task->Get();
+    first.Update(status.ok() ? *status : status.status());
+  }
+  return first;
+}
+
+void IngestionPipeline::Track(int64_t bytes) {
+  const int64_t now = bytes_in_flight_.fetch_add(bytes) + bytes;
+  int64_t peak = peak_bytes_in_flight_.load(std::memory_order_relaxed);
+  while (now > peak && !peak_bytes_in_flight_.compare_exchange_weak(
+                           peak, now, std::memory_order_relaxed)) {
+  }
+}
+
+IngestionPipeline::IndexFn IndexInto(HnswIndex& vector_index,
+                                     Bm25Index* keyword_index,
+                                     std::vector<std::string>* texts) {
+  auto mutex = std::make_shared<absl::Mutex>();
+  return [&vector_index, keyword_index, texts,
+          mutex](IngestionPipeline::Chunk chunk) -> absl::Status {
+    absl::MutexLock lock(mutex.get());
+    const int id = GENC_TRY(vector_index.Add(chunk.embedding));
+    if (keyword_index != nullptr && keyword_index->Add(chunk.text) != id) {
+      return absl::FailedPreconditionError(
+          "The keyword index and the vector index assign different ids.");
+    }
+    if (texts != nullptr) {
+      if (texts->size() <= static_cast<size_t>(id)) {
+        texts->resize(id + 1);
+      }
+      (*texts)[id] = std::move(chunk.text);
+    }
+    return absl::OkStatus();
+  };
+}
+
+absl::Status SetCustomFunctionsForIngestion(
+    intrinsics::CustomFunction::FunctionMap& fn_map,
+    IngestionPipeline::Options options,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+    IngestionPipeline::IndexFn index_fn) {
+  fn_map[kIngestUri] =
+      [options = std::move(options),
+       concurrency_interface = std::move(concurrency_interface),
+       index_fn = std::move(index_fn)](
+          const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    if (!arg.has_str() && !arg.has_struct_()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Expected a string or a struct of strings, got: ",
+          arg.DebugString()));
+    }
+    // Checks every document first, so that none is indexed on an error.
+    for (const v0::Value& document : arg.struct_().element()) {
+      if (!document.has_str()) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Expected a string, got: ", document.DebugString()));
+      }
+    }
+    std::unique_ptr<IngestionPipeline> pipeline = GENC_TRY(
+        IngestionPipeline::Start(options, concurrency_interface, index_fn));
+    if (arg.has_str()) {
+      GENC_TRY(pipeline->Add(arg.str()));
+    }
+    for (const v0::Value& document : arg.struct_().element()) {
+      GENC_TRY(pipeline->Add(document.str()));
+    }
+    const IngestionPipeline::Stats stats = GENC_TRY(pipeline->Finish());
+    v0::Value result;
+    v0::Struct* fields = result.mutable_struct_();
+    v0::Value* documents = fields->add_element();
+    documents->set_label("documents");
+    documents->set_int_32(stats.documents);
+    v0::Value* chunks = fields->add_element();
+    chunks->set_label("chunks");
+    chunks->set_int_32(stats.chunks);
+    v0::Value* rate = fields->add_element();
+    rate->set_label("documents_per_second");
+    rate->set_float_32(stats.documents_per_second());
+    v0::Value* peak = fields->add_element();
+    peak->set_label("peak_bytes_in_flight");
+    peak->set_float_32(stats.peak_bytes_in_flight);
+    return result;
+  };
+  return absl::OkStatus();
+}
+
+}  // namespace genc
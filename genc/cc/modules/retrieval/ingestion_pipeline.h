@@ -0,0 +1,205 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_INGESTION_PIPELINE_H_
+#define GENC_CC_MODULES_RETRIEVAL_INGESTION_PIPELINE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/intrinsics/embed.h"
+#include "genc/cc/modules/retrieval/bm25_index.h"
+#include "genc/cc/modules/retrieval/bounded_queue.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/runtime/concurrency.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+constexpr char kIngestUri[] = "/retrieval/ingest";
+
+// How documents are cut into chunks. Tokens are words, i.e. runs of
+// non-whitespace; chunks are slices of the original text.
+struct ChunkingOptions {
+  enum class Mode {
+    // Whole sentences, packed into chunks of at most `max_tokens`. Longer
+    // sentences are cut as token windows.
+    kSentences,
+    // Windows of `max_tokens`, each overlapping the previous one by
+    // `overlap_tokens`.
+    kTokenWindows,
+  };
+  Mode mode = Mode::kSentences;
+  int max_tokens = 256;
+  int overlap_tokens = 32;
+};
+
+// Returns the chunks of `text`, or InvalidArgument unless
+// 0 <= overlap_tokens < max_tokens.
+absl::StatusOr<std::vector<absl::string_view>> ChunkDocument(
+    absl::string_view text, const ChunkingOptions& options);
+
+// Loads documents into retrieval indexes. Documents stream through three
+// stages, each run by its own tasks on a ConcurrencyInterface: chunking,
+// embedding in batches, and indexing. The stages are connected by bounded
+// queues, so a slow stage holds back the ones before it, down to Add(), and
+// the memory in flight stays bounded however many documents are added.
+class IngestionPipeline {
+ public:
+  struct Chunk {
+    // Number of the document, in the order of Add().
+    int64_t document;
+    // Number of the chunk within its document.
+    int position;
+    std::string text;
+    std::vector<float> embedding;
+  };
+
+  // Stores an embedded chunk. Called from `num_indexers` tasks at once.
+  using IndexFn = std::function<absl::Status(Chunk chunk)>;
+
+  struct Options {
+    ChunkingOptions chunking;
+    // Computes embeddings; called with `embedding_intrinsic` and a struct of
+    // up to `embedding_batch_size` chunk texts.
+    intrinsics::Embed::EmbeddingFn embedding_fn;
+    v0::Intrinsic embedding_intrinsic;
+    int embedding_batch_size = 32;
+    int num_chunkers = 1;
+    int num_embedders = 4;
+    int num_indexers = 1;
+    // Capacity of each queue between stages, in documents or chunks.
+    int queue_capacity = 256;
+  };
+
+  struct Stats {
+    int64_t documents = 0;
+    int64_t chunks = 0;
+    absl::Duration elapsed;
+    // Most bytes of document text, chunk text and embeddings that were held
+    // by the pipeline at once.
+    size_t peak_bytes_in_flight = 0;
+    // Peak resident memory of the process so far.
+    size_t peak_rss_bytes = 0;
+
+    double documents_per_second() const;
+  };
+
+  // Starts the stages' tasks on `concurrency_interface`.
+  static absl::StatusOr<std::unique_ptr<IngestionPipeline>> Start(
+      Options options,
+      std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+      IndexFn index_fn);
+
+  // Finishes the pipeline if Finish() wasn't called.
+  ~IngestionPipeline();
+
+  IngestionPipeline(const IngestionPipeline&) = delete;
+  IngestionPipeline& operator=(const IngestionPipeline&) = delete;
+
+  // Queues a document, blocking while the pipeline is full. Fails once a
+  // stage has failed, or after Finish().
+  absl::Status Add(std::string document);
+
+  // Waits for every added document to be indexed, and stops the stages.
+  // Returns the first error of any stage.
+  absl::StatusOr<Stats> Finish();
+
+ private:
+  using Tasks = std::vector<std::shared_ptr<FutureInterface<absl::Status>>>;
+
+  struct Document {
+    int64_t number;
+    std::string text;
+  };
+
+  IngestionPipeline(Options options, IndexFn index_fn);
+
+  absl::Status Chunker();
+  absl::Status Embedder();
+  absl::Status Indexer();
+
+  // Embeds `batch`, and queues it for indexing.
+  absl::Status Embed(std::vector<Chunk>& batch);
+
+  // Records the first error, and closes the queues so that every stage
+  // winds down.
+  absl::Status Fail(absl::Status status);
+  bool failed() const { return failed_.load(std::memory_order_relaxed); }
+
+  // Waits for `tasks`; returns the first error.
+  static absl::Status Wait(Tasks& tasks);
+
+  void Track(int64_t bytes);
+
+  const Options options_;
+  const IndexFn index_fn_;
+  const absl::Time start_;
+
+  BoundedQueue<Document> documents_;
+  BoundedQueue<Chunk> chunks_;
+  BoundedQueue<Chunk> embedded_;
+  Tasks chunkers_;
+  Tasks embedders_;
+  Tasks indexers_;
+
+  std::atomic<int64_t> next_document_{0};
+  std::atomic<int64_t> num_documents_{0};
+  std::atomic<int64_t> num_chunks_{0};
+  std::atomic<int64_t> bytes_in_flight_{0};
+  std::atomic<int64_t> peak_bytes_in_flight_{0};
+  std::atomic<bool> failed_{false};
+
+  absl::Mutex mutex_;
+  absl::Status status_ ABSL_GUARDED_BY(mutex_);
+  bool finished_ ABSL_GUARDED_BY(mutex_) = false;
+};
+
+// Returns an IndexFn that adds each chunk's embedding to `vector_index`,
+// and, if given, its text to `keyword_index` and `texts`, all under the id
+// the vector index assigns. Chunks are added one at a time, so that the ids
+// agree.
+IngestionPipeline::IndexFn IndexInto(HnswIndex& vector_index,
+                                     Bm25Index* keyword_index = nullptr,
+                                     std::vector<std::string>* texts = nullptr);
+
+// Make CustomFunctions aware of an ingestion pipeline.
+// The ingest function takes a document string, or a struct of them, runs a
+// pipeline over them with `options`, and returns a struct of the labeled
+// "documents", "chunks", "documents_per_second" and "peak_bytes_in_flight"
+// stats.
+// Doesn't own `index_fn`'s targets, which must stay alive during the life
+// time of the Runtime.
+absl::Status SetCustomFunctionsForIngestion(
+    intrinsics::CustomFunction::FunctionMap& fn_map,
+    IngestionPipeline::Options options,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+    IngestionPipeline::IndexFn index_fn);
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_INGESTION_PIPELINE_H_
@@ -0,0 +1,142 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Streams synthetic documents through an IngestionPipeline into an HNSW and a
+// BM25 index, with an embedding model simulated by a fixed cost per call and
+// per chunk, and reports documents per second and peak memory for several
+// numbers of embedding tasks.
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/modules/retrieval/bm25_index.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/modules/retrieval/ingestion_pipeline.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/proto/v0/computation.pb.h"
+
+ABSL_FLAG(int, num_docs, 2000, "Number of documents to ingest.");
+ABSL_FLAG(int, doc_words, 600, "Number of words per document.");
+ABSL_FLAG(int, max_tokens, 128, "Maximum number of words per chunk.");
+ABSL_FLAG(int, dim, 128, "Number of elements per embedding.");
+ABSL_FLAG(int, batch_size, 32, "Number of chunks per embedding call.");
+ABSL_FLAG(int, call_micros, 2000, "Simulated latency of an embedding call.");
+ABSL_FLAG(int, chunk_micros, 100, "Simulated latency per embedded chunk.");
+ABSL_FLAG(std::string, num_embedders, "1,2,4,8",
+          "Comma-separated numbers of embedding tasks to measure with.");
+
+namespace genc {
+namespace {
+
+std::string Document(std::mt19937& rng, int num_words) {
+  std::string text;
+  for (int i = 0; i < num_words; ++i) {
+    absl::StrAppend(&text, i == 0 ? "" : " ", "w", rng() % 20000,
+                    i % 15 == 14 ? "." : "");
+  }
+  return text;
+}
+
+// Stands in for a remote or local embedding model, which is mostly waiting.
+absl::StatusOr<v0::Value> SimulatedEmbedding(v0::Intrinsic,
+                                             const v0::Value texts) {
+  const int size = texts.struct_().element_size();
+  absl::SleepFor(absl::Microseconds(absl::GetFlag(FLAGS_call_micros) +
+                                    absl::GetFlag(FLAGS_chunk_micros) * size));
+  v0::Value result;
+  std::vector<float> embedding(absl::GetFlag(FLAGS_dim));
+  for (int i = 0; i < size; ++i) {
+    for (size_t j = 0; j < embedding.size(); ++j) {
+      embedding[j] = static_cast<float>((i * 31 + j * 17) % 101);
+    }
+    *result.mutable_struct_()->add_element() = CreateFloatTensor(embedding);
+  }
+  return result;
+}
+
+void Run() {
+  const int num_docs = absl::GetFlag(FLAGS_num_docs);
+  std::mt19937 rng(1);
+  std::vector<std::string> documents;
+  for (int i = 0; i < num_docs; ++i) {
+    documents.push_back(Document(rng, absl::GetFlag(FLAGS_doc_words)));
+  }
+  std::cout << "num_docs=" << num_docs
+            << " doc_words=" << absl::GetFlag(FLAGS_doc_words)
+            << " max_tokens=" << absl::GetFlag(FLAGS_max_tokens)
+            << " batch_size=" << absl::GetFlag(FLAGS_batch_size) << "\n";
+
+  for (absl::string_view flag :
+       absl::StrSplit(absl::GetFlag(FLAGS_num_embedders), ',')) {
+    int num_embedders;
+    if (!absl::SimpleAtoi(flag, &num_embedders) || num_embedders < 1) {
+      std::cerr << "Bad --num_embedders value: " << flag << "\n";
+      return;
+    }
+    HnswIndex::Options index_options;
+    index_options.dim = absl::GetFlag(FLAGS_dim);
+    index_options.max_elements =
+        num_docs * (absl::GetFlag(FLAGS_doc_words) /
+                        absl::GetFlag(FLAGS_max_tokens) +
+                    2);
+    std::unique_ptr<HnswIndex> vector_index =
+        HnswIndex::Create(index_options).value();
+    Bm25Index keyword_index;
+
+    IngestionPipeline::Options options;
+    options.chunking.max_tokens = absl::GetFlag(FLAGS_max_tokens);
+    options.embedding_fn = SimulatedEmbedding;
+    options.embedding_batch_size = absl::GetFlag(FLAGS_batch_size);
+    options.num_embedders = num_embedders;
+    std::unique_ptr<IngestionPipeline> pipeline =
+        IngestionPipeline::Start(options,
+                                 CreateThreadBasedConcurrencyManager(),
+                                 IndexInto(*vector_index, &keyword_index))
+            .value();
+    for (const std::string& document : documents) {
+      pipeline->Add(document).IgnoreError();
+    }
+    const IngestionPipeline::Stats stats = pipeline->Finish().value();
+    std::cout << "embedders=" << num_embedders << ": "
+              << stats.documents_per_second() << " docs/s, "
+              << stats.chunks / absl::ToDoubleSeconds(stats.elapsed)
+              << " chunks/s, peak in flight "
+              << stats.peak_bytes_in_flight / double{1 << 20}
+              << " MiB, peak RSS " << stats.peak_rss_bytes / double{1 << 20}
+              << " MiB\n";
+  }
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
@@ -0,0 +1,302 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/ingestion_pipeline.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/authoring/constructor.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/intrinsics/custom_function.h"
+#include "genc/cc/intrinsics/handler_sets.h"
+#include "genc/cc/modules/retrieval/bm25_index.h"
+#include "genc/cc/modules/retrieval/bounded_queue.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/runtime/executor.h"
+#include "genc/cc/runtime/inline_executor.h"
+#include "genc/cc/runtime/runner.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAreArray;
+
+constexpr int kDim = 26;
+
+// Embeds each text of a struct as its letter counts.
+absl::StatusOr<v0::Value> EmbedLetters(v0::Intrinsic, const v0::Value arg) {
+  v0::Value result;
+  for (const v0::Value& text : arg.struct_().element()) {
+    std::vector<float> counts(kDim, 0.0f);
+    for (char c : text.str()) {
+      if (c >= 'a' && c <= 'z') {
+        counts[c - 'a'] += 1.0f;
+      }
+    }
+    counts[0] += 0.5f;
+    *result.mutable_struct_()->add_element() = CreateFloatTensor(counts);
+  }
+  return result;
+}
+
+IngestionPipeline::Options TestOptions() {
+  IngestionPipeline::Options options;
+  options.embedding_fn = EmbedLetters;
+  options.chunking.max_tokens = 4;
+  options.chunking.overlap_tokens = 1;
+  options.embedding_batch_size = 3;
+  options.num_embedders = 2;
+  options.queue_capacity = 2;
+  return options;
+}
+
+TEST(ChunkDocumentTest, PacksSentences) {
+  ChunkingOptions options;
+  options.max_tokens = 5;
+  options.overlap_tokens = 1;
+  EXPECT_THAT(ChunkDocument("One two. Three  four five. Six!\nSeven eight "
+                            "nine ten eleven twelve. End",
+                            options)
+                  .value(),
+              ElementsAre("One two. Three  four five.", "Six!",
+                          "Seven eight nine ten eleven", "eleven twelve.",
+                          "End"));
+  EXPECT_THAT(ChunkDocument(" \n ", options).value(), ElementsAre());
+}
+
+TEST(ChunkDocumentTest, CutsOverlappingWindows) {
+  ChunkingOptions options;
+  options.mode = ChunkingOptions::Mode::kTokenWindows;
+  options.max_tokens = 3;
+  options.overlap_tokens = 1;
+  EXPECT_THAT(ChunkDocument("a b. c d e f", options).value(),
+              ElementsAre("a b. c", "c d e", "e f"));
+  EXPECT_THAT(ChunkDocument("a b c", options).value(), ElementsAre("a b c"));
+}
+
+TEST(ChunkDocumentTest, RejectsBadOptions) {
+  ChunkingOptions options;
+  options.mode = ChunkingOptions::Mode::kTokenWindows;
+  options.max_tokens = 0;
+  options.overlap_tokens = 0;
+  EXPECT_EQ(ChunkDocument("a b c", options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  options.max_tokens = 2;
+  options.overlap_tokens = 2;
+  EXPECT_EQ(ChunkDocument("a b c", options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(BoundedQueueTest, BlocksProducersWhileFull) {
+  BoundedQueue<int> queue(2);
+  std::atomic<int> pushed = 0;
+  std::thread producer([&]() {
+    for (int i = 0; i < 5; ++i) {
+      ASSERT_TRUE(queue.Push(i));
+      ++pushed;
+    }
+    queue.Close();
+  });
+  absl::SleepFor(absl::Milliseconds(20));
+  EXPECT_EQ(pushed.load(), 2);
+  std::vector<int> popped;
+  while (std::optional<int> item = queue.Pop()) {
+    EXPECT_LE(queue.size(), 2);
+    popped.push_back(*item);
+  }
+  producer.join();
+  EXPECT_THAT(popped, ElementsAre(0, 1, 2, 3, 4));
+  EXPECT_FALSE(queue.Push(5));
+  EXPECT_EQ(queue.TryPop(), std::nullopt);
+}
+
+TEST(IngestionPipelineTest, IndexesEveryChunk) {
+  absl::Mutex mutex;
+  std::vector<std::string> indexed;
+  auto pipeline =
+      IngestionPipeline::Start(
+          TestOptions(), CreateThreadBasedConcurrencyManager(),
+          [&](IngestionPipeline::Chunk chunk) -> absl::Status {
+            EXPECT_EQ(chunk.embedding.size(), kDim);
+            absl::MutexLock lock(&mutex);
+            indexed.push_back(
+                absl::StrCat(chunk.document, ":", chunk.position, " ",
+                             chunk.text));
+            return absl::OkStatus();
+          })
+          .value();
+  std::vector<std::string> expected;
+  for (int d = 0; d < 50; ++d) {
+    ASSERT_TRUE(pipeline->Add(absl::StrCat("doc ", d, " is short. It has "
+                                                     "two sentences."))
+                    .ok());
+    expected.push_back(absl::StrCat(d, ":0 doc ", d, " is short."));
+    expected.push_back(absl::StrCat(d, ":1 It has two sentences."));
+  }
+  IngestionPipeline::Stats stats = pipeline->Finish().value();
+  EXPECT_EQ(stats.documents, 50);
+  EXPECT_EQ(stats.chunks, 100);
+  EXPECT_GT(stats.documents_per_second(), 0.0);
+  EXPECT_GT(stats.peak_bytes_in_flight, 0);
+  EXPECT_GT(stats.peak_rss_bytes, 0);
+  EXPECT_THAT(indexed, UnorderedElementsAreArray(expected));
+  EXPECT_EQ(pipeline->Add("late").code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST(IngestionPipelineTest, BoundsMemoryInFlight) {
+  // Indexing is slow, so the queues fill up, and Add() has to wait.
+  IngestionPipeline::Options options = TestOptions();
+  auto pipeline =
+      IngestionPipeline::Start(
+          options, CreateThreadBasedConcurrencyManager(),
+          [](IngestionPipeline::Chunk) -> absl::Status {
+            absl::SleepFor(absl::Microseconds(200));
+            return absl::OkStatus();
+          })
+          .value();
+  const std::string document(400, 'x');
+  for (int d = 0; d < 200; ++d) {
+    ASSERT_TRUE(pipeline->Add(document).ok());
+  }
+  IngestionPipeline::Stats stats = pipeline->Finish().value();
+  EXPECT_EQ(stats.chunks, 200);
+  // Each queue holds 2 items, and each task a few more, far fewer than the
+  // 200 documents.
+  EXPECT_LT(stats.peak_bytes_in_flight, 30 * (document.size() + kDim * 4));
+}
+
+TEST(IngestionPipelineTest, StopsOnFirstError) {
+  IngestionPipeline::Options options = TestOptions();
+  options.embedding_fn = [](v0::Intrinsic,
+                            const v0::Value) -> absl::StatusOr<v0::Value> {
+    return absl::UnavailableError("no embedding model");
+  };
+  auto pipeline =
+      IngestionPipeline::Start(
+          options, CreateThreadBasedConcurrencyManager(),
+          [](IngestionPipeline::Chunk) { return absl::OkStatus(); })
+          .value();
+  absl::Status status;
+  for (int d = 0; d < 1000 && status.ok(); ++d) {
+    status = pipeline->Add("some text");
+  }
+  EXPECT_EQ(status.code(), absl::StatusCode::kUnavailable);
+  EXPECT_EQ(pipeline->Finish().status().code(),
+            absl::StatusCode::kUnavailable);
+}
+
+TEST(IngestionPipelineTest, RejectsBadOptions) {
+  IngestionPipeline::Options options = TestOptions();
+  options.chunking.overlap_tokens = options.chunking.max_tokens;
+  EXPECT_EQ(IngestionPipeline::Start(
+                options, CreateThreadBasedConcurrencyManager(),
+                [](IngestionPipeline::Chunk) { return absl::OkStatus(); })
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(IndexIntoTest, AddsToBothIndexesUnderOneId) {
+  HnswIndex::Options index_options;
+  index_options.dim = kDim;
+  index_options.max_elements = 100;
+  std::unique_ptr<HnswIndex> vector_index =
+      HnswIndex::Create(index_options).value();
+  Bm25Index keyword_index;
+  std::vector<std::string> texts;
+  auto pipeline = IngestionPipeline::Start(
+                      TestOptions(), CreateThreadBasedConcurrencyManager(),
+                      IndexInto(*vector_index, &keyword_index, &texts))
+                      .value();
+  ASSERT_TRUE(pipeline->Add("Cats purr. Dogs bark loudly.").ok());
+  ASSERT_TRUE(pipeline->Add("Birds sing.").ok());
+  EXPECT_EQ(pipeline->Finish().value().chunks, 3);
+  EXPECT_EQ(vector_index->size(), 3);
+  EXPECT_EQ(keyword_index.size(), 3);
+  std::vector<ScoredIndex> found = keyword_index.Search("bark", 1);
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(texts[found[0].index], "Dogs bark loudly.");
+}
+
+TEST(SetCustomFunctionsForIngestion, IngestsFromRunner) {
+  HnswIndex::Options index_options;
+  index_options.dim = kDim;
+  index_options.max_elements = 100;
+  std::unique_ptr<HnswIndex> vector_index =
+      HnswIndex::Create(index_options).value();
+  intrinsics::HandlerSetConfig config;
+  std::shared_ptr<ConcurrencyInterface> concurrency =
+      CreateThreadBasedConcurrencyManager();
+  EXPECT_EQ(SetCustomFunctionsForIngestion(config.custom_function_map,
+                                           TestOptions(), concurrency,
+                                           IndexInto(*vector_index)),
+            absl::OkStatus());
+  std::shared_ptr<Executor> executor =
+      CreateInlineExecutor(intrinsics::CreateCompleteHandlerSet(config),
+                           concurrency)
+          .value();
+  Runner runner = Runner::Create(executor).value();
+
+  v0::Value documents;
+  documents.mutable_struct_()->add_element()->set_str("One. Two.");
+  documents.mutable_struct_()->add_element()->set_str("Three.");
+  v0::Value result =
+      runner.Run(CreateCustomFunction(kIngestUri).value(), documents).value();
+  ASSERT_EQ(result.struct_().element_size(), 4);
+  EXPECT_EQ(result.struct_().element(0).label(), "documents");
+  EXPECT_EQ(result.struct_().element(0).int_32(), 2);
+  EXPECT_EQ(result.struct_().element(1).int_32(), 2);
+  EXPECT_EQ(vector_index->size(), 2);
+}
+
+TEST(SetCustomFunctionsForIngestion, IndexesNothingFromBadStructs) {
+  HnswIndex::Options index_options;
+  index_options.dim = kDim;
+  index_options.max_elements = 100;
+  std::unique_ptr<HnswIndex> vector_index =
+      HnswIndex::Create(index_options).value();
+  intrinsics::CustomFunction::FunctionMap fn_map;
+  EXPECT_EQ(SetCustomFunctionsForIngestion(
+                fn_map, TestOptions(), CreateThreadBasedConcurrencyManager(),
+                IndexInto(*vector_index)),
+            absl::OkStatus());
+
+  v0::Value documents;
+  documents.mutable_struct_()->add_element()->set_str("One. Two.");
+  documents.mutable_struct_()->add_element()->set_int_32(3);
+  EXPECT_EQ(fn_map[kIngestUri](documents).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(vector_index->size(), 0);
+}
+
+}  // namespace
+}  // namespace genc
@@ -15,27 +15,81 @@ limitations under the License
 
 #include "genc/cc/modules/retrieval/local_cache.h"
 
+#include <algorithm>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "genc/cc/intrinsics/custom_function.h"
 #include "genc/proto/v0/computation.pb.h"
 
 namespace genc {
+namespace {
+
+// Returns the element labeled `label` of a struct `arg`, or nullptr.
+const v0::Value* FindLabeled(const v0::Value& arg, absl::string_view label) {
+  if (!arg.has_struct_()) {
+    return nullptr;
+  }
+  for (const v0::Value& element : arg.struct_().element()) {
+    if (element.label() == label) {
+      return &element;
+    }
+  }
+  return nullptr;
+}
+
+std::string KeyOf(const v0::Value& arg, const std::string& default_key) {
+  const v0::Value* key = FindLabeled(arg, "key");
+  return key != nullptr ? key->str() : default_key;
+}
+
+// Returns the budget given by `arg`, or else `default_budget`.
+ReadBudget BudgetOf(const v0::Value& arg, const ReadBudget& default_budget) {
+  const v0::Value* max_tokens = FindLabeled(arg, "max_tokens");
+  const v0::Value* max_bytes = FindLabeled(arg, "max_bytes");
+  if (max_tokens == nullptr && max_bytes == nullptr) {
+    return default_budget;
+  }
+  ReadBudget budget;
+  if (max_tokens != nullptr) {
+    budget.max_tokens = std::max(max_tokens->int_32(), 0);
+  }
+  if (max_bytes != nullptr) {
+    budget.max_bytes = std::max(max_bytes->int_32(), 0);
+  }
+  return budget;
+}
+
+}  // namespace
+
 absl::Status SetCustomFunctionsForLocalValueCache(
     intrinsics::CustomFunction::FunctionMap& fn_map, LocalValueCache& cache,
-    std::string default_delimiter, std::string default_key) {
+    std::string default_delimiter, std::string default_key,
+    ReadBudget default_budget) {
   // TODO(b/304905545): default behavior is read all, improve flexibility.
-  fn_map[kLocalCacheReadUri] = [&cache, default_delimiter,
-                                default_key](const v0::Value& arg) {
-    std::string key = default_key;
+  fn_map[kLocalCacheReadUri] = [&cache, default_delimiter, default_key,
+                                default_budget](const v0::Value& arg) {
     std::string delimiter = default_delimiter;
+    const std::string key = KeyOf(arg, default_key);
+    ReadBudget budget = BudgetOf(arg, default_budget);
+
+    std::vector<std::shared_ptr<const v0::Value>> messages;
+    if (budget.max_tokens || budget.max_bytes) {
+      budget.per_message = MeasureMessage(delimiter);
+      messages = cache.SnapshotWithin(key, budget);
+    } else {
+      messages = cache.Snapshot(key);
+    }
 
     std::ostringstream str_stream;
-    for (const v0::Value& v : cache.Get(key)) {
-      str_stream << v.str() << delimiter;
+    for (const auto& v : messages) {
+      str_stream << v->str() << delimiter;
     }
 
     v0::Value result;
@@ -43,17 +97,26 @@ absl::Status SetCustomFunctionsForLocalValueCache(
     return result;
   };
 
-  fn_map[kLocalCacheWriteUri] = [&cache, default_key](const v0::Value& arg) {
-    // TODO(b/304905545): write to default key. improve flexibility.
-    std::string key = default_key;
-    cache.Put(key, arg);
-    return arg;
+  fn_map[kLocalCacheWriteUri] =
+      [&cache, default_key](
+          const v0::Value& arg) -> absl::StatusOr<v0::Value> {
+    const v0::Value* value = FindLabeled(arg, "value");
+    if (FindLabeled(arg, "key") == nullptr) {
+      cache.Put(default_key, arg);
+      return arg;
+    }
+    // Reads and removes would take the key of such an argument, so storing
+    // it under the default key would lose it.
+    if (value == nullptr) {
+      return absl::InvalidArgumentError(
+          "Expected an element labeled \"value\" along with the \"key\".");
+    }
+    cache.Put(KeyOf(arg, default_key), *value);
+    return *value;
   };
 
   fn_map[kLocalCacheRemoveUri] = [&cache, default_key](const v0::Value& arg) {
-    // TODO(b/304905545): write to default key. improve flexibility.
-    std::string key = default_key;
-    cache.Remove(key);
+    cache.Remove(KeyOf(arg, default_key));
     return arg;
   };
 
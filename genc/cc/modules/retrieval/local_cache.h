@@ -16,14 +16,23 @@ limitations under the License
 #ifndef GENC_CC_MODULES_RETRIEVAL_LOCAL_CACHE_H_
 #define GENC_CC_MODULES_RETRIEVAL_LOCAL_CACHE_H_
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "genc/cc/intrinsics/custom_function.h"
 #include "genc/proto/v0/computation.pb.h"
 
@@ -33,64 +42,331 @@ constexpr char kLocalCacheReadUri[] = "/local_cache/read";
 constexpr char kLocalCacheWriteUri[] = "/local_cache/write";
 constexpr char kLocalCacheRemoveUri[] = "/local_cache/remove";
 
-// A thread-safe Local cache that stores vectors of elements per key.
+// The size of a message, measured once when it is stored.
+struct MessageSize {
+  size_t bytes = 0;
+  size_t tokens = 0;
+};
+
+// Estimates the number of tokens in `text` without a tokenizer: common BPE
+// tokenizers average about four bytes per token on English text.
+inline size_t EstimateTokenCount(absl::string_view text) {
+  return (text.size() + 3) / 4;
+}
+
+inline MessageSize MeasureMessage(absl::string_view text) {
+  return {text.size(), EstimateTokenCount(text)};
+}
+inline MessageSize MeasureMessage(const std::string& text) {
+  return MeasureMessage(absl::string_view(text));
+}
+inline MessageSize MeasureMessage(const v0::Value& value) {
+  return MeasureMessage(absl::string_view(value.str()));
+}
+// Messages of other types count as empty.
+template <typename V>
+MessageSize MeasureMessage(const V&) {
+  return {};
+}
+
+// Limits on the total size of the messages a read returns. A limit that is
+// not present does not apply.
+struct ReadBudget {
+  std::optional<size_t> max_bytes;
+  std::optional<size_t> max_tokens;
+  // Added to the size of every message, e.g. for a delimiter between them.
+  MessageSize per_message;
+};
+
+// A thread-safe Local cache that stores the most recent elements per key.
 // Convenient for testing and local development, for deployment, please choose a
 // more robust distributed cache.
+//
+// Keys are spread over independently locked shards, so that sessions on
+// different keys rarely contend. Each key keeps its messages in a ring buffer
+// of fixed capacity, so that a Put() on a full key is O(1). Messages are
+// immutable once stored and shared by pointer, so Snapshot() reads copy no
+// message bodies, and stay valid after later writes.
 template <typename K, typename V>
 class LocalCache {
  public:
+  struct Options {
+    // Number of messages kept per key; older ones are dropped.
+    size_t max_messages_per_key = 100;
+    // Number of independently locked shards.
+    size_t num_shards = 16;
+    // Keys expire this long after their last Put(), and are then dropped,
+    // either by EvictExpired() or by later writes to their shard.
+    absl::Duration ttl = absl::InfiniteDuration();
+    // Source of the current time, for testing expiry.
+    std::function<absl::Time()> clock = absl::Now;
+    // Measures messages for reads within a ReadBudget, e.g. with the
+    // tokenizer of the model that the messages are sent to.
+    std::function<MessageSize(const V&)> measure = [](const V& message) {
+      return MeasureMessage(message);
+    };
+  };
+
+  // Sees every change to the cache: `message` is the stored message after a
+  // Put(), and null after the key was removed or dropped on expiry.
+  using WriteObserver = std::function<void(const K& key, const V* message)>;
+
   explicit LocalCache(size_t max_messages_per_key)
-      : max_messages_per_key_(max_messages_per_key) {}
+      : LocalCache(Options{max_messages_per_key}) {}
+
+  explicit LocalCache(Options options)
+      : options_(std::move(options)),
+        shards_(new Shard[std::max<size_t>(options_.num_shards, 1)]) {
+    options_.num_shards = std::max<size_t>(options_.num_shards, 1);
+    options_.max_messages_per_key =
+        std::max<size_t>(options_.max_messages_per_key, 1);
+  }
 
   // Inserts a keyed message.
   void Put(const K& key, const V& message) {
-    absl::WriterMutexLock lock(&mutex_);
-    std::vector<V>& messages = cache_[key];
+    Stored stored = {std::make_shared<const V>(message),
+                     options_.measure ? options_.measure(message)
+                                      : MessageSize()};
+    const absl::Time now = options_.clock();
+    Shard& shard = ShardOf(key);
+    absl::MutexLock lock(&shard.mutex);
+    // Sweeps the shard once it took as many writes as it held keys at the
+    // last sweep, so that expired keys do not pile up between calls to
+    // EvictExpired(), at an amortized constant cost per write.
+    if (options_.ttl != absl::InfiniteDuration()) {
+      if (shard.writes_until_sweep == 0) {
+        EvictExpired(shard, now);
+      } else {
+        --shard.writes_until_sweep;
+      }
+    }
+    Entry& entry = shard.entries[key];
+    if (entry.Expired(now)) {
+      entry = Entry();
+      Notify(key, nullptr);
+    }
+    Notify(key, stored.message.get());
+    entry.Push(std::move(stored), options_.max_messages_per_key);
+    entry.expiry = now + options_.ttl;
+  }
 
-    if (messages.size() >= max_messages_per_key_) {
-      messages.erase(messages.begin());
+  // Returns the last n messages associated with a key, oldest first, without
+  // copying them. If n is not present, returns everything.
+  std::vector<std::shared_ptr<const V>> Snapshot(
+      const K& key, std::optional<int> n = std::nullopt) const {
+    const absl::Time now = options_.clock();
+    const Shard& shard = ShardOf(key);
+    absl::ReaderMutexLock lock(&shard.mutex);
+    const auto it = shard.entries.find(key);
+    if (it == shard.entries.end() || it->second.Expired(now)) {
+      return {};
     }
+    return it->second.Last(n);
+  }
 
-    messages.push_back(message);
+  // Returns the most recent messages associated with a key that fit in
+  // `budget` together, oldest first, without copying them. Stops at the
+  // first message that does not fit, so the result has no gaps. Takes time
+  // in the number of messages returned, since their sizes are measured when
+  // they are stored.
+  std::vector<std::shared_ptr<const V>> SnapshotWithin(
+      const K& key, const ReadBudget& budget) const {
+    const absl::Time now = options_.clock();
+    const Shard& shard = ShardOf(key);
+    absl::ReaderMutexLock lock(&shard.mutex);
+    const auto it = shard.entries.find(key);
+    if (it == shard.entries.end() || it->second.Expired(now)) {
+      return {};
+    }
+    const Entry& entry = it->second;
+    size_t bytes = 0;
+    size_t tokens = 0;
+    int count = 0;
+    for (int i = static_cast<int>(entry.messages.size()) - 1; i >= 0; --i) {
+      const MessageSize& size = entry.At(i).size;
+      bytes += size.bytes + budget.per_message.bytes;
+      tokens += size.tokens + budget.per_message.tokens;
+      if ((budget.max_bytes && bytes > *budget.max_bytes) ||
+          (budget.max_tokens && tokens > *budget.max_tokens)) {
+        break;
+      }
+      ++count;
+    }
+    return entry.Last(count);
   }
 
   // Retrieves the last n messages associated with a key. Read only.
   // If n is not present, returns everything.
   std::vector<V> Get(const K& key, std::optional<int> n = std::nullopt) const {
-    absl::ReaderMutexLock lock(&mutex_);
-    const auto& messages = cache_.find(key);
-
-    if (messages == cache_.end()) {
-      return {};
-    }
-
-    if (n && *n < static_cast<int>(messages->second.size())) {
-      return std::vector<V>(messages->second.end() - *n,
-                            messages->second.end());
-    } else {
-      return messages->second;
+    std::vector<V> messages;
+    for (const std::shared_ptr<const V>& message : Snapshot(key, n)) {
+      messages.push_back(*message);
     }
+    return messages;
   }
 
   // Returns true if there are any messages associated with a key in the cache.
   bool Exists(const K& key) const {
-    absl::ReaderMutexLock lock(&mutex_);
-    return cache_.find(key) != cache_.end();
+    const absl::Time now = options_.clock();
+    const Shard& shard = ShardOf(key);
+    absl::ReaderMutexLock lock(&shard.mutex);
+    const auto it = shard.entries.find(key);
+    return it != shard.entries.end() && !it->second.Expired(now);
+  }
+
+  // Returns the number of keys in the cache, including expired keys that
+  // EvictExpired() has not dropped yet.
+  size_t size() const {
+    size_t size = 0;
+    for (size_t i = 0; i < options_.num_shards; ++i) {
+      absl::ReaderMutexLock lock(&shards_[i].mutex);
+      size += shards_[i].entries.size();
+    }
+    return size;
   }
 
-  // Returns the number of keys in the cache.
-  size_t size() const { return cache_.size(); }
+  // Calls `fn(key, messages)` for every unexpired key in the cache. Locks one
+  // shard at a time, so `fn` must not call back into the cache.
+  template <typename Fn>
+  void ForEach(Fn fn) const {
+    const absl::Time now = options_.clock();
+    for (size_t i = 0; i < options_.num_shards; ++i) {
+      absl::ReaderMutexLock lock(&shards_[i].mutex);
+      for (const auto& [key, entry] : shards_[i].entries) {
+        if (entry.Expired(now)) {
+          continue;
+        }
+        std::vector<V> messages;
+        for (const std::shared_ptr<const V>& message : entry.Last()) {
+          messages.push_back(*message);
+        }
+        fn(key, messages);
+      }
+    }
+  }
 
   // Removes all messages associated with a key from the cache.
   void Remove(const K& key) {
-    absl::WriterMutexLock lock(&mutex_);
-    cache_.erase(key);
+    Shard& shard = ShardOf(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (shard.entries.erase(key) > 0) {
+      Notify(key, nullptr);
+    }
+  }
+
+  // Drops every expired key, and returns how many were dropped. Expired keys
+  // already read as empty; this frees their memory.
+  size_t EvictExpired() {
+    const absl::Time now = options_.clock();
+    size_t evicted = 0;
+    for (size_t i = 0; i < options_.num_shards; ++i) {
+      absl::MutexLock lock(&shards_[i].mutex);
+      evicted += EvictExpired(shards_[i], now);
+    }
+    return evicted;
   }
 
+  // Installs `observer`, or removes it if null. The observer is called under
+  // the lock of the changed key, so it sees the changes to each key in order,
+  // and must be quick and must not call back into the cache.
+  void SetWriteObserver(WriteObserver observer) {
+    // Holding every shard lock orders this against all writes.
+    for (size_t i = 0; i < options_.num_shards; ++i) {
+      shards_[i].mutex.Lock();
+    }
+    observer_ = std::move(observer);
+    for (size_t i = options_.num_shards; i > 0; --i) {
+      shards_[i - 1].mutex.Unlock();
+    }
+  }
+
+  size_t max_messages_per_key() const { return options_.max_messages_per_key; }
+  const Options& options() const { return options_; }
+
  private:
-  absl::flat_hash_map<K, std::vector<V>> cache_;
-  size_t max_messages_per_key_;
-  mutable absl::Mutex mutex_;
+  struct Stored {
+    std::shared_ptr<const V> message;
+    MessageSize size;
+  };
+
+  // The messages of one key: a ring buffer that grows up to its capacity,
+  // and then overwrites its oldest message.
+  struct Entry {
+    std::vector<Stored> messages;
+    // Index of the oldest message once the buffer is full.
+    size_t head = 0;
+    absl::Time expiry = absl::InfiniteFuture();
+
+    bool Expired(absl::Time now) const { return now >= expiry; }
+
+    // Returns the i-th oldest message.
+    const Stored& At(size_t i) const {
+      return messages[(head + i) % messages.size()];
+    }
+
+    void Push(Stored message, size_t capacity) {
+      if (messages.size() < capacity) {
+        messages.push_back(std::move(message));
+        return;
+      }
+      messages[head] = std::move(message);
+      head = (head + 1) % messages.size();
+    }
+
+    std::vector<std::shared_ptr<const V>> Last(
+        std::optional<int> n = std::nullopt) const {
+      size_t count = messages.size();
+      if (n && *n < static_cast<int>(count)) {
+        count = std::max(*n, 0);
+      }
+      std::vector<std::shared_ptr<const V>> last;
+      last.reserve(count);
+      for (size_t i = messages.size() - count; i < messages.size(); ++i) {
+        last.push_back(At(i).message);
+      }
+      return last;
+    }
+  };
+
+  struct Shard {
+    mutable absl::Mutex mutex;
+    absl::flat_hash_map<K, Entry> entries;
+    // Number of Put() calls left before the shard is swept again.
+    size_t writes_until_sweep = 0;
+  };
+
+  // Picks shards from a remix of the hash, since the maps of the shards use
+  // the low bits of the hash itself, and these would be the same in one
+  // shard.
+  Shard& ShardOf(const K& key) const {
+    const uint64_t hash = absl::Hash<K>{}(key);
+    return shards_[(hash * 0x9E3779B97F4A7C15ull >> 32) % options_.num_shards];
+  }
+
+  // Drops the expired keys of `shard`, whose lock is held.
+  size_t EvictExpired(Shard& shard, absl::Time now) {
+    size_t evicted = 0;
+    absl::erase_if(shard.entries, [this, now, &evicted](const auto& entry) {
+      if (!entry.second.Expired(now)) {
+        return false;
+      }
+      Notify(entry.first, nullptr);
+      ++evicted;
+      return true;
+    });
+    shard.writes_until_sweep = shard.entries.size();
+    return evicted;
+  }
+
+  void Notify(const K& key, const V* message) const {
+    if (observer_) {
+      observer_(key, message);
+    }
+  }
+
+  Options options_;
+  std::unique_ptr<Shard[]> shards_;
+  WriteObserver observer_;
 };
 
 // Typically used in applications (e.g. chatbot) where access to context is
@@ -100,11 +376,20 @@ using LocalStringCache = LocalCache<std::string, std::string>;
 using LocalValueCache = LocalCache<std::string, v0::Value>;
 
 // Make CustomFunctions aware of local cache.
+// Each function reads the key from an element labeled "key" when its argument
+// is a struct that has one, so that one cache can hold many sessions, and
+// uses `default_key` otherwise. The write function stores the element labeled
+// "value" of such a struct, which it requires, or else the whole argument.
+// The read function returns the most recent messages that fit in a budget of
+// int_32 elements labeled "max_tokens" and "max_bytes" of its argument, or
+// else of `default_budget`, counting the delimiter after each message. With
+// neither, it returns every message.
 // Doesn't own it, cache must stay alive during the life time of the Runtime.
 absl::Status SetCustomFunctionsForLocalValueCache(
     intrinsics::CustomFunction::FunctionMap& fn_map, LocalValueCache& cache,
     std::string default_delimiter = "\n",
-    std::string default_key = "default_key");
+    std::string default_key = "default_key",
+    ReadBudget default_budget = ReadBudget());
 }  // namespace genc
 
 #endif  // GENC_CC_MODULES_RETRIEVAL_LOCAL_CACHE_H_
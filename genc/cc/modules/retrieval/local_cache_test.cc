@@ -25,6 +25,9 @@ limitations under the License
 #include "googlemock/include/gmock/gmock.h"
 #include "googletest/include/gtest/gtest.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "genc/cc/authoring/constructor.h"
 #include "genc/cc/intrinsics/handler_sets.h"
 #include "genc/cc/runtime/executor.h"
@@ -63,6 +66,73 @@ TEST(PutTest, PrunesEarliestMessageWhenCapacityReached) {
   ASSERT_EQ(values[1], "v3");
 }
 
+TEST(PutTest, KeepsOrderAfterWrappingAround) {
+  LocalCache<std::string, int> cache(3);
+  for (int i = 1; i <= 8; ++i) {
+    cache.Put("key", i);
+  }
+  EXPECT_THAT(cache.Get("key"), testing::ElementsAre(6, 7, 8));
+  EXPECT_THAT(cache.Get("key", 2), testing::ElementsAre(7, 8));
+}
+
+TEST(SnapshotTest, StaysValidAfterLaterWrites) {
+  LocalStringCache cache(2);
+  cache.Put("key", "v1");
+  cache.Put("key", "v2");
+  auto snapshot = cache.Snapshot("key");
+  cache.Put("key", "v3");
+  cache.Remove("key");
+  ASSERT_EQ(snapshot.size(), 2);
+  EXPECT_EQ(*snapshot[0], "v1");
+  EXPECT_EQ(*snapshot[1], "v2");
+}
+
+TEST(TtlTest, ExpiresKeysAfterLastWrite) {
+  absl::Time now = absl::UnixEpoch();
+  LocalStringCache::Options options;
+  options.max_messages_per_key = 10;
+  options.ttl = absl::Minutes(5);
+  options.clock = [&now]() { return now; };
+  LocalStringCache cache(options);
+
+  cache.Put("old", "v1");
+  now += absl::Minutes(3);
+  cache.Put("new", "v1");
+  now += absl::Minutes(3);
+  EXPECT_FALSE(cache.Exists("old"));
+  EXPECT_TRUE(cache.Get("old").empty());
+  EXPECT_THAT(cache.Get("new"), testing::ElementsAre("v1"));
+
+  // Writing to an expired key starts it afresh.
+  cache.Put("old", "v2");
+  EXPECT_THAT(cache.Get("old"), testing::ElementsAre("v2"));
+
+  now += absl::Minutes(10);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.EvictExpired(), 2);
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(TtlTest, WritesDropExpiredKeysOfTheirShard) {
+  absl::Time now = absl::UnixEpoch();
+  LocalStringCache::Options options;
+  options.num_shards = 1;
+  options.ttl = absl::Minutes(5);
+  options.clock = [&now]() { return now; };
+  LocalStringCache cache(options);
+
+  for (int i = 0; i < 10; ++i) {
+    cache.Put(absl::StrCat("old", i), "v1");
+  }
+  now += absl::Minutes(10);
+  // The sweeps are spread over as many writes as there are keys.
+  for (int i = 0; i < 10; ++i) {
+    cache.Put("new", "v1");
+  }
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_TRUE(cache.Exists("new"));
+}
+
 TEST(RemoveTest, DeletesAllMessages) {
   LocalStringCache cache(2);
   cache.Put("key", "v1");
@@ -74,6 +144,87 @@ TEST(RemoveTest, DeletesAllMessages) {
   ASSERT_TRUE(values.empty());
 }
 
+TEST(SnapshotWithinTest, ReturnsMostRecentMessagesThatFit) {
+  LocalStringCache cache(10);
+  cache.Put("key", std::string(40, 'a'));
+  cache.Put("key", std::string(8, 'b'));
+  cache.Put("key", std::string(12, 'c'));
+  cache.Put("key", std::string(4, 'd'));
+
+  auto Joined = [&cache](const ReadBudget& budget) {
+    std::string joined;
+    for (const auto& message : cache.SnapshotWithin("key", budget)) {
+      joined += message->substr(0, 1);
+    }
+    return joined;
+  };
+  ReadBudget budget;
+  EXPECT_EQ(Joined(budget), "abcd");
+  budget.max_bytes = 24;
+  EXPECT_EQ(Joined(budget), "bcd");
+  // Stops at the first message that does not fit.
+  budget.max_bytes = 20;
+  EXPECT_EQ(Joined(budget), "cd");
+  budget.per_message.bytes = 1;
+  EXPECT_EQ(Joined(budget), "cd");
+  budget.per_message.bytes = 3;
+  EXPECT_EQ(Joined(budget), "d");
+  budget.max_bytes = std::nullopt;
+  budget.per_message = MessageSize();
+  // 1 + 3 + 2 tokens.
+  budget.max_tokens = 6;
+  EXPECT_EQ(Joined(budget), "bcd");
+  budget.max_tokens = 0;
+  EXPECT_EQ(Joined(budget), "");
+  EXPECT_TRUE(cache.SnapshotWithin("missing", budget).empty());
+}
+
+TEST(SnapshotWithinTest, UsesCustomMeasure) {
+  LocalStringCache::Options options;
+  options.measure = [](const std::string& message) {
+    return MessageSize{message.size(), 1};
+  };
+  LocalStringCache cache(options);
+  for (int i = 0; i < 5; ++i) {
+    cache.Put("key", "a long message of many words");
+  }
+  ReadBudget budget;
+  budget.max_tokens = 3;
+  EXPECT_EQ(cache.SnapshotWithin("key", budget).size(), 3);
+}
+
+TEST(WriteObserverTest, SeesEveryChange) {
+  absl::Time now = absl::UnixEpoch();
+  LocalStringCache::Options options;
+  options.ttl = absl::Minutes(5);
+  options.clock = [&now]() { return now; };
+  LocalStringCache cache(options);
+  std::vector<std::string> changes;
+  cache.SetWriteObserver(
+      [&changes](const std::string& key, const std::string* message) {
+        changes.push_back(key + "=" + (message ? *message : "removed"));
+      });
+
+  cache.Put("a", "v1");
+  cache.Put("b", "v1");
+  cache.Remove("a");
+  cache.Remove("missing");
+  now += absl::Minutes(10);
+  cache.Put("b", "v2");
+  cache.Put("c", "v1");
+  EXPECT_THAT(changes,
+              testing::ElementsAre("a=v1", "b=v1", "a=removed", "b=removed",
+                                   "b=v2", "c=v1"));
+
+  changes.clear();
+  now += absl::Minutes(10);
+  cache.EvictExpired();
+  cache.SetWriteObserver(nullptr);
+  cache.Put("d", "v1");
+  EXPECT_THAT(changes,
+              testing::UnorderedElementsAre("b=removed", "c=removed"));
+}
+
 TEST(ThreadSafetyTest, MultiTreadedReadWriteIsSafe) {
   LocalCache<std::string, int> cache(100);
 
@@ -126,5 +277,77 @@ TEST(SetCustomFunctionsForLocalValueCache, CacheReadWriteWorksWithExecutor) {
   v0::Value result = runner.Run(read_pb, read_all).value();
   EXPECT_EQ(result.str(), "test\ntest\n");
 }
+
+v0::Value Keyed(absl::string_view key, absl::string_view value = "") {
+  v0::Value arg;
+  v0::Value* key_pb = arg.mutable_struct_()->add_element();
+  key_pb->set_label("key");
+  key_pb->set_str(std::string(key));
+  if (!value.empty()) {
+    v0::Value* value_pb = arg.mutable_struct_()->add_element();
+    value_pb->set_label("value");
+    value_pb->set_str(std::string(value));
+  }
+  return arg;
+}
+
+TEST(SetCustomFunctionsForLocalValueCache, FunctionsTakeKeyFromArgument) {
+  intrinsics::CustomFunction::FunctionMap fn_map;
+  LocalValueCache cache(100);
+  ASSERT_EQ(SetCustomFunctionsForLocalValueCache(fn_map, cache),
+            absl::OkStatus());
+  auto& read = fn_map[kLocalCacheReadUri];
+  auto& write = fn_map[kLocalCacheWriteUri];
+  auto& remove = fn_map[kLocalCacheRemoveUri];
+
+  EXPECT_EQ(write(Keyed("session_a", "a1")).value().str(), "a1");
+  write(Keyed("session_b", "b1")).value();
+  write(Keyed("session_a", "a2")).value();
+  v0::Value unkeyed;
+  unkeyed.set_str("default");
+  write(unkeyed).value();
+
+  EXPECT_EQ(read(Keyed("session_a")).value().str(), "a1\na2\n");
+  EXPECT_EQ(read(Keyed("session_b")).value().str(), "b1\n");
+  EXPECT_EQ(read(v0::Value()).value().str(), "default\n");
+
+  EXPECT_EQ(write(Keyed("session_b")).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  EXPECT_EQ(read(Keyed("session_b")).value().str(), "b1\n");
+  EXPECT_EQ(read(v0::Value()).value().str(), "default\n");
+
+  remove(Keyed("session_a")).value();
+  EXPECT_EQ(read(Keyed("session_a")).value().str(), "");
+  EXPECT_EQ(read(Keyed("session_b")).value().str(), "b1\n");
+}
+
+TEST(SetCustomFunctionsForLocalValueCache, ReadStaysWithinBudget) {
+  intrinsics::CustomFunction::FunctionMap fn_map;
+  LocalValueCache cache(100);
+  ReadBudget default_budget;
+  default_budget.max_bytes = 12;
+  ASSERT_EQ(SetCustomFunctionsForLocalValueCache(fn_map, cache, "\n",
+                                                 "default_key", default_budget),
+            absl::OkStatus());
+  auto& read = fn_map[kLocalCacheReadUri];
+  auto& write = fn_map[kLocalCacheWriteUri];
+  for (absl::string_view message : {"first", "second", "third"}) {
+    write(Keyed("session", message)).value();
+  }
+
+  // "second\nthird\n" is 13 bytes.
+  EXPECT_EQ(read(Keyed("session")).value().str(), "third\n");
+  v0::Value arg = Keyed("session");
+  v0::Value* max_bytes = arg.mutable_struct_()->add_element();
+  max_bytes->set_label("max_bytes");
+  max_bytes->set_int_32(13);
+  EXPECT_EQ(read(arg).value().str(), "second\nthird\n");
+  // Each of these messages and its delimiter are estimated at 3 tokens.
+  arg = Keyed("session");
+  v0::Value* max_tokens = arg.mutable_struct_()->add_element();
+  max_tokens->set_label("max_tokens");
+  max_tokens->set_int_32(8);
+  EXPECT_EQ(read(arg).value().str(), "second\nthird\n");
+}
 }  // namespace
 }  // namespace genc
@@ -0,0 +1,206 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/semantic_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/cc/modules/vector/vector_math.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+absl::StatusOr<std::unique_ptr<SemanticCache>> SemanticCache::Create(
+    Options options) {
+  if (!options.embedding_fn) {
+    return absl::InvalidArgumentError("An embedding_fn is required.");
+  }
+  if (options.min_similarity < -1.0f || options.min_similarity > 1.0f) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "min_similarity must be in [-1, 1], got ", options.min_similarity));
+  }
+  std::unique_ptr<SemanticCache> cache(new SemanticCache(std::move(options)));
+  std::shared_ptr<Generation> generation = GENC_TRY(cache->NewGeneration());
+  absl::MutexLock lock(&cache->mutex_);
+  cache->generation_ = std::move(generation);
+  return cache;
+}
+
+SemanticCache::SemanticCache(Options options) : options_(std::move(options)) {}
+
+absl::StatusOr<std::shared_ptr<SemanticCache::Generation>>
+SemanticCache::NewGeneration() const {
+  HnswIndex::Options index_options;
+  index_options.dim = options_.dim;
+  index_options.max_elements = options_.max_entries;
+  index_options.metric = VectorMetric::kCosine;
+  auto generation = std::make_shared<Generation>();
+  generation->index = GENC_TRY(HnswIndex::Create(index_options));
+  generation->entries.resize(options_.max_entries);
+  return generation;
+}
+
+std::shared_ptr<SemanticCache::Generation> SemanticCache::generation() const {
+  absl::MutexLock lock(&mutex_);
+  return generation_;
+}
+
+int SemanticCache::size() const { return generation()->index->size(); }
+
+intrinsics::ModelInferenceWithConfig::InferenceFn SemanticCache::Wrap(
+    intrinsics::ModelInferenceWithConfig::InferenceFn inference) {
+  return [this, inference = std::move(inference)](
+             v0::Intrinsic intrinsic_pb,
+             const v0::Value arg) -> absl::StatusOr<v0::Value> {
+    if (!arg.has_str()) {
+      return inference(intrinsic_pb, arg);
+    }
+    return Infer(inference, intrinsic_pb, arg);
+  };
+}
+
+absl::Status SemanticCache::WrapModel(
+    absl::string_view model_uri,
+    intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map) {
+  auto it = inference_map.find(model_uri);
+  if (it == inference_map.end()) {
+    return absl::NotFoundError(
+        absl::StrCat("No model is registered as ", model_uri));
+  }
+  it->second = Wrap(std::move(it->second));
+  return absl::OkStatus();
+}
+
+absl::StatusOr<v0::Value> SemanticCache::Infer(
+    const intrinsics::ModelInferenceWithConfig::InferenceFn& inference,
+    const v0::Intrinsic& intrinsic_pb, const v0::Value& arg) {
+  const absl::Time start = absl::Now();
+  const uint64_t config =
+      absl::HashOf(intrinsic_pb.static_parameter().SerializeAsString());
+  std::shared_ptr<Generation> generation = this->generation();
+  v0::Value prompt;
+  prompt.set_str(arg.str());
+  absl::StatusOr<v0::Value> embedded =
+      options_.embedding_fn(options_.embedding_intrinsic, prompt);
+  absl::StatusOr<std::vector<float>> embedding =
+      embedded.ok() ? GetFloatTensor(*embedded) : embedded.status();
+  if (!embedding.ok()) {
+    LOG(WARNING) << "Semantic cache failed to embed a prompt: "
+                 << embedding.status();
+    absl::MutexLock lock(&mutex_);
+    ++stats_.errors;
+  }
+  std::shared_ptr<const Entry> hit =
+      embedding.ok() ? Find(*generation, *embedding, config) : nullptr;
+  const absl::Duration lookup_latency = absl::Now() - start;
+  {
+    absl::MutexLock lock(&mutex_);
+    ++stats_.lookups;
+    stats_.lookup_latency += lookup_latency;
+    if (hit != nullptr) {
+      ++stats_.hits;
+      stats_.saved_latency += hit->latency;
+    }
+  }
+  if (hit != nullptr) {
+    return hit->response;
+  }
+
+  const absl::Time inference_start = absl::Now();
+  v0::Value response = GENC_TRY(inference(intrinsic_pb, arg));
+  if (!embedding.ok()) {
+    return response;
+  }
+  auto entry = std::make_shared<const Entry>(
+      Entry{config, response, absl::Now() - inference_start});
+  const absl::Status status =
+      Store(std::move(generation), *embedding, std::move(entry));
+  if (!status.ok()) {
+    // The response is still good.
+    LOG(WARNING) << "Semantic cache failed to store a response: " << status;
+    absl::MutexLock lock(&mutex_);
+    ++stats_.errors;
+  }
+  return response;
+}
+
+absl::Status SemanticCache::Store(std::shared_ptr<Generation> generation,
+                                  absl::Span<const float> embedding,
+                                  std::shared_ptr<const Entry> entry) {
+  absl::StatusOr<int> id = generation->index->Add(embedding);
+  if (id.status().code() == absl::StatusCode::kResourceExhausted) {
+    {
+      absl::MutexLock lock(&mutex_);
+      // Unless another call already started over.
+      if (generation_ == generation) {
+        generation_ = GENC_TRY(NewGeneration());
+        ++stats_.resets;
+      }
+      generation = generation_;
+    }
+    id = generation->index->Add(embedding);
+  }
+  if (!id.ok()) {
+    return id.status();
+  }
+  absl::MutexLock lock(&mutex_);
+  generation->entries[*id] = std::move(entry);
+  return absl::OkStatus();
+}
+
+std::shared_ptr<const SemanticCache::Entry> SemanticCache::Find(
+    const Generation& generation, absl::Span<const float> embedding,
+    uint64_t config) const {
+  absl::StatusOr<std::vector<ScoredIndex>> nearest =
+      generation.index->Search(embedding, options_.num_candidates);
+  if (!nearest.ok()) {
+    return nullptr;
+  }
+  absl::MutexLock lock(&mutex_);
+  for (const ScoredIndex& candidate : *nearest) {
+    if (candidate.score < options_.min_similarity) {
+      break;
+    }
+    const std::shared_ptr<const Entry>& entry =
+        generation.entries[candidate.index];
+    if (entry != nullptr && entry->config == config) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+SemanticCache::Stats SemanticCache::stats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+}  // namespace genc
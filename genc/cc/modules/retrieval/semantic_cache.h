@@ -0,0 +1,157 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_SEMANTIC_CACHE_H_
+#define GENC_CC_MODULES_RETRIEVAL_SEMANTIC_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/intrinsics/embed.h"
+#include "genc/cc/intrinsics/model_inference_with_config.h"
+#include "genc/cc/modules/retrieval/hnsw_index.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+// Serves model responses for prompts that are similar, not just equal, to
+// earlier ones.
+//
+// Wrap() puts the cache in front of a model's InferenceFn. Each string prompt
+// is embedded, and looked up among the embeddings of earlier prompts in an
+// HNSW index. If one is at least `min_similarity` (cosine) close, and was sent
+// with the same model config, its response is returned without calling the
+// model. Otherwise the model is called, and its response is stored under the
+// prompt's embedding. Prompts that are not strings pass straight through.
+//
+// Works offline when the embedding backend is local, e.g. the llama.cpp one.
+// The cache holds at most `max_entries` responses. Once full, it drops them
+// all and starts over, as the index cannot delete single prompts. The cache
+// fails open: when embedding a prompt or indexing it fails, the error is
+// logged and the model's response is returned as if there were no cache.
+class SemanticCache {
+ public:
+  struct Options {
+    // Computes embeddings; called with `embedding_intrinsic`, which names the
+    // embedding model and its config, as built by CreateEmbed().
+    intrinsics::Embed::EmbeddingFn embedding_fn;
+    v0::Intrinsic embedding_intrinsic;
+    // Number of elements of the embeddings.
+    int dim = 0;
+    // Number of responses the cache can hold.
+    int max_entries = 10000;
+    // Cosine similarity from which a cached response is served.
+    float min_similarity = 0.95f;
+    // Number of nearest prompts checked for a matching model config.
+    int num_candidates = 4;
+  };
+
+  struct Stats {
+    int64_t lookups = 0;
+    int64_t hits = 0;
+    // Prompts that the cache failed to look up or store, and passed through.
+    int64_t errors = 0;
+    // Times the cache was full and started over.
+    int64_t resets = 0;
+    // Time the model took to produce the responses that were served from the
+    // cache, i.e. the time hits saved.
+    absl::Duration saved_latency;
+    // Time spent embedding prompts and searching the index, for hits and
+    // misses alike.
+    absl::Duration lookup_latency;
+
+    double hit_rate() const {
+      return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+    }
+  };
+
+  static absl::StatusOr<std::unique_ptr<SemanticCache>> Create(
+      Options options);
+
+  SemanticCache(const SemanticCache&) = delete;
+  SemanticCache& operator=(const SemanticCache&) = delete;
+
+  // Returns an InferenceFn that serves `inference` through the cache. The
+  // cache must outlive it.
+  intrinsics::ModelInferenceWithConfig::InferenceFn Wrap(
+      intrinsics::ModelInferenceWithConfig::InferenceFn inference);
+
+  // Puts the cache in front of the model registered as `model_uri` in
+  // `inference_map`.
+  absl::Status WrapModel(
+      absl::string_view model_uri,
+      intrinsics::ModelInferenceWithConfig::InferenceMap& inference_map);
+
+  Stats stats() const;
+
+  // Returns the number of cached responses.
+  int size() const;
+
+ private:
+  struct Entry {
+    // Hash of the model config the response was produced with.
+    uint64_t config;
+    v0::Value response;
+    absl::Duration latency;
+  };
+
+  // The index of the prompts, and their entries, which are replaced together
+  // when the cache starts over.
+  struct Generation {
+    std::unique_ptr<HnswIndex> index;
+    // Indexed by the id of the prompt's embedding in `index`, and guarded by
+    // the cache's mutex_. An id can be found in the index just before its
+    // entry is stored here.
+    std::vector<std::shared_ptr<const Entry>> entries;
+  };
+
+  explicit SemanticCache(Options options);
+
+  absl::StatusOr<std::shared_ptr<Generation>> NewGeneration() const;
+  std::shared_ptr<Generation> generation() const;
+
+  absl::StatusOr<v0::Value> Infer(
+      const intrinsics::ModelInferenceWithConfig::InferenceFn& inference,
+      const v0::Intrinsic& intrinsic_pb, const v0::Value& arg);
+
+  // Returns the cached entry for the closest prompt to `embedding` sent with
+  // `config` in `generation`, if it is similar enough.
+  std::shared_ptr<const Entry> Find(const Generation& generation,
+                                    absl::Span<const float> embedding,
+                                    uint64_t config) const;
+
+  // Stores `entry` under `embedding`, starting over if the cache is full.
+  absl::Status Store(std::shared_ptr<Generation> generation,
+                     absl::Span<const float> embedding,
+                     std::shared_ptr<const Entry> entry);
+
+  const Options options_;
+
+  mutable absl::Mutex mutex_;
+  std::shared_ptr<Generation> generation_ ABSL_GUARDED_BY(mutex_);
+  Stats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_SEMANTIC_CACHE_H_
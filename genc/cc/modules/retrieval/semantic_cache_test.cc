@@ -0,0 +1,203 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/semantic_cache.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/base/float_tensor.h"
+#include "genc/cc/intrinsics/model_inference_with_config.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+constexpr int kDim = 26;
+
+// Embeds text as its letter counts, so that anagrams are identical and texts
+// sharing most letters are close.
+absl::StatusOr<v0::Value> EmbedLetters(v0::Intrinsic, const v0::Value arg) {
+  std::vector<float> counts(kDim, 0.0f);
+  for (char c : arg.str()) {
+    if (c >= 'a' && c <= 'z') {
+      counts[c - 'a'] += 1.0f;
+    }
+  }
+  return CreateFloatTensor(counts);
+}
+
+v0::Intrinsic Config(const std::string& model) {
+  v0::Intrinsic intrinsic;
+  intrinsic.set_uri("model_inference_with_config");
+  intrinsic.mutable_static_parameter()->set_str(model);
+  return intrinsic;
+}
+
+v0::Value Str(const std::string& str) {
+  v0::Value value;
+  value.set_str(str);
+  return value;
+}
+
+class SemanticCacheTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<SemanticCache> MakeCache(int max_entries = 100) {
+    SemanticCache::Options options;
+    options.embedding_fn = EmbedLetters;
+    options.dim = kDim;
+    options.max_entries = max_entries;
+    options.min_similarity = 0.99f;
+    return SemanticCache::Create(options).value();
+  }
+
+  // Answers with the prompt and the number of calls so far.
+  intrinsics::ModelInferenceWithConfig::InferenceFn Model() {
+    return [this](v0::Intrinsic, const v0::Value arg)
+               -> absl::StatusOr<v0::Value> {
+      absl::SleepFor(absl::Milliseconds(2));
+      ++num_calls_;
+      return Str(absl::StrCat(arg.str(), " #", num_calls_));
+    };
+  }
+
+  int num_calls_ = 0;
+};
+
+TEST_F(SemanticCacheTest, ServesSimilarPromptsFromCache) {
+  std::unique_ptr<SemanticCache> cache = MakeCache();
+  auto model = cache->Wrap(Model());
+  EXPECT_EQ(model(Config("a"), Str("hello world")).value().str(),
+            "hello world #1");
+  // Same letters, so the cached response is served.
+  EXPECT_EQ(model(Config("a"), Str("world hello")).value().str(),
+            "hello world #1");
+  // Different letters call the model.
+  EXPECT_EQ(model(Config("a"), Str("good night")).value().str(),
+            "good night #2");
+  EXPECT_EQ(num_calls_, 2);
+  EXPECT_EQ(cache->size(), 2);
+
+  SemanticCache::Stats stats = cache->stats();
+  EXPECT_EQ(stats.lookups, 3);
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_DOUBLE_EQ(stats.hit_rate(), 1.0 / 3);
+  EXPECT_GE(stats.saved_latency, absl::Milliseconds(2));
+}
+
+TEST_F(SemanticCacheTest, KeepsResponsesOfDifferentConfigsApart) {
+  std::unique_ptr<SemanticCache> cache = MakeCache();
+  auto model = cache->Wrap(Model());
+  EXPECT_EQ(model(Config("a"), Str("hello")).value().str(), "hello #1");
+  EXPECT_EQ(model(Config("b"), Str("hello")).value().str(), "hello #2");
+  EXPECT_EQ(model(Config("a"), Str("hello")).value().str(), "hello #1");
+  EXPECT_EQ(model(Config("b"), Str("hello")).value().str(), "hello #2");
+  EXPECT_EQ(cache->stats().hits, 2);
+}
+
+TEST_F(SemanticCacheTest, PassesNonStringPromptsThrough) {
+  std::unique_ptr<SemanticCache> cache = MakeCache();
+  auto model = cache->Wrap(
+      [](v0::Intrinsic, const v0::Value arg) -> absl::StatusOr<v0::Value> {
+        return arg;
+      });
+  v0::Value prompt;
+  prompt.set_int_32(7);
+  EXPECT_EQ(model(Config("a"), prompt).value().int_32(), 7);
+  EXPECT_EQ(cache->stats().lookups, 0);
+  EXPECT_EQ(cache->size(), 0);
+}
+
+TEST_F(SemanticCacheTest, StartsOverWhenFull) {
+  std::unique_ptr<SemanticCache> cache = MakeCache(/*max_entries=*/2);
+  auto model = cache->Wrap(Model());
+  EXPECT_EQ(model(Config("a"), Str("abc")).value().str(), "abc #1");
+  EXPECT_EQ(model(Config("a"), Str("def")).value().str(), "def #2");
+  EXPECT_EQ(model(Config("a"), Str("xyz")).value().str(), "xyz #3");
+  EXPECT_EQ(cache->size(), 1);
+  EXPECT_EQ(model(Config("a"), Str("zyx")).value().str(), "xyz #3");
+  EXPECT_EQ(model(Config("a"), Str("cab")).value().str(), "cab #4");
+  EXPECT_EQ(cache->size(), 2);
+  EXPECT_EQ(cache->stats().resets, 1);
+}
+
+TEST_F(SemanticCacheTest, FailsOpenWhenEmbeddingFails) {
+  SemanticCache::Options options;
+  options.embedding_fn = [](v0::Intrinsic,
+                            const v0::Value) -> absl::StatusOr<v0::Value> {
+    return absl::UnavailableError("embedding backend is down");
+  };
+  options.dim = kDim;
+  std::unique_ptr<SemanticCache> cache = SemanticCache::Create(options).value();
+  auto model = cache->Wrap(Model());
+  EXPECT_EQ(model(Config("a"), Str("abc")).value().str(), "abc #1");
+  EXPECT_EQ(model(Config("a"), Str("abc")).value().str(), "abc #2");
+  EXPECT_EQ(cache->size(), 0);
+  EXPECT_EQ(cache->stats().errors, 2);
+}
+
+TEST_F(SemanticCacheTest, FailsOpenWhenIndexingFails) {
+  SemanticCache::Options options;
+  options.embedding_fn = EmbedLetters;
+  // Does not match the embeddings.
+  options.dim = kDim + 1;
+  std::unique_ptr<SemanticCache> cache = SemanticCache::Create(options).value();
+  auto model = cache->Wrap(Model());
+  EXPECT_EQ(model(Config("a"), Str("abc")).value().str(), "abc #1");
+  EXPECT_EQ(cache->size(), 0);
+  EXPECT_EQ(cache->stats().errors, 1);
+}
+
+TEST_F(SemanticCacheTest, PropagatesModelErrors) {
+  std::unique_ptr<SemanticCache> cache = MakeCache();
+  auto model = cache->Wrap(
+      [](v0::Intrinsic, const v0::Value) -> absl::StatusOr<v0::Value> {
+        return absl::UnavailableError("offline");
+      });
+  EXPECT_EQ(model(Config("a"), Str("hello")).status().code(),
+            absl::StatusCode::kUnavailable);
+  EXPECT_EQ(cache->size(), 0);
+}
+
+TEST_F(SemanticCacheTest, WrapsRegisteredModel) {
+  std::unique_ptr<SemanticCache> cache = MakeCache();
+  intrinsics::ModelInferenceWithConfig::InferenceMap inference_map;
+  inference_map["/device/test"] = Model();
+  ASSERT_TRUE(cache->WrapModel("/device/test", inference_map).ok());
+  EXPECT_EQ(cache->WrapModel("/device/other", inference_map).code(),
+            absl::StatusCode::kNotFound);
+  auto& model = inference_map["/device/test"];
+  EXPECT_EQ(model(Config("a"), Str("abc")).value().str(), "abc #1");
+  EXPECT_EQ(model(Config("a"), Str("bca")).value().str(), "abc #1");
+  EXPECT_EQ(num_calls_, 1);
+}
+
+TEST(SemanticCacheCreateTest, RequiresAnEmbeddingFn) {
+  SemanticCache::Options options;
+  options.dim = kDim;
+  EXPECT_EQ(SemanticCache::Create(options).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace genc
@@ -0,0 +1,412 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/value_cache_log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/crc/crc32c.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/modules/retrieval/index_file.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+namespace {
+
+// A log record is a header followed by a body:
+//
+//   header: uint32 size of the body, uint32 CRC32C of the body
+//   body:   uint64 sequence number, uint8 operation, uint32 size of the key,
+//           the key, and for kPut the serialized message
+struct RecordHeader {
+  uint32_t size;
+  uint32_t crc;
+};
+
+constexpr size_t kBodyPrefixSize =
+    sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+enum Operation : uint8_t {
+  kPut = 1,
+  kRemove = 2,
+};
+
+std::string SnapshotPath(const std::string& directory) {
+  return absl::StrCat(directory, "/snapshot");
+}
+
+std::string LogPath(const std::string& directory) {
+  return absl::StrCat(directory, "/log");
+}
+
+bool Exists(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+absl::Status ErrnoError(absl::string_view what, const std::string& path) {
+  return absl::InternalError(
+      absl::StrCat("Failed to ", what, " ", path, ": ", std::strerror(errno)));
+}
+
+// Where a replay of the directory ended.
+struct Restored {
+  // Sequence number of the last record in the snapshot or the log.
+  uint64_t sequence = 0;
+  // Size of the intact prefix of the log.
+  size_t log_bytes = 0;
+};
+
+// Applies the records of the log at `path` that come after
+// `restored.sequence` to `cache`, up to the first record that is cut short or
+// corrupt, and updates `restored` to where it stopped.
+absl::Status ReplayLog(const std::string& path, LocalValueCache& cache,
+                       Restored& restored) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return errno == ENOENT ? absl::OkStatus() : ErrnoError("open", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return ErrnoError("stat", path);
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return absl::OkStatus();
+  }
+  void* const mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return ErrnoError("map", path);
+  }
+  const absl::string_view log(static_cast<const char*>(mapped), st.st_size);
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+  absl::Status status;
+  size_t offset = 0;
+  while (log.size() - offset >= sizeof(RecordHeader)) {
+    RecordHeader header;
+    std::memcpy(&header, log.data() + offset, sizeof(header));
+    const absl::string_view body =
+        log.substr(offset + sizeof(header), header.size);
+    if (body.size() != header.size || body.size() < kBodyPrefixSize ||
+        static_cast<uint32_t>(absl::ComputeCrc32c(body)) != header.crc) {
+      break;
+    }
+    uint64_t sequence;
+    uint8_t operation;
+    uint32_t key_size;
+    std::memcpy(&sequence, body.data(), sizeof(sequence));
+    std::memcpy(&operation, body.data() + sizeof(sequence), sizeof(operation));
+    std::memcpy(&key_size, body.data() + sizeof(sequence) + sizeof(operation),
+                sizeof(key_size));
+    if (key_size > body.size() - kBodyPrefixSize) {
+      status = absl::DataLossError(
+          absl::StrCat("Bad record at offset ", offset, " of ", path));
+      break;
+    }
+    offset += sizeof(header) + body.size();
+    if (sequence <= restored.sequence) {
+      // Already in the snapshot.
+      continue;
+    }
+    restored.sequence = sequence;
+    const std::string key(body.substr(kBodyPrefixSize, key_size));
+    if (operation == kRemove) {
+      cache.Remove(key);
+      continue;
+    }
+    const absl::string_view message = body.substr(kBodyPrefixSize + key_size);
+    v0::Value value;
+    if (operation != kPut ||
+        !value.ParseFromArray(message.data(), message.size())) {
+      status = absl::DataLossError(
+          absl::StrCat("Bad record ", sequence, " of ", path));
+      break;
+    }
+    cache.Put(key, value);
+  }
+  restored.log_bytes = offset;
+  munmap(mapped, st.st_size);
+  return status;
+}
+
+// Loads the snapshot in `directory` into `cache`, then replays the log.
+absl::StatusOr<Restored> Restore(const std::string& directory,
+                                 LocalValueCache& cache) {
+  Restored restored;
+  const std::string snapshot_path = SnapshotPath(directory);
+  if (Exists(snapshot_path)) {
+    std::unique_ptr<MappedValueCache> snapshot =
+        GENC_TRY(MappedValueCache::Open(snapshot_path));
+    GENC_TRY(snapshot->LoadInto(cache));
+    restored.sequence = snapshot->sequence();
+  }
+  GENC_TRY(ReplayLog(LogPath(directory), cache, restored));
+  return restored;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<ValueCacheLog>> ValueCacheLog::Open(
+    Options options, LocalValueCache& cache) {
+  if (options.directory.empty()) {
+    return absl::InvalidArgumentError("A directory is required.");
+  }
+  if (mkdir(options.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    return ErrnoError("create", options.directory);
+  }
+  const Restored restored = GENC_TRY(Restore(options.directory, cache));
+
+  const std::string log_path = LogPath(options.directory);
+  const int fd =
+      open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return ErrnoError("open", log_path);
+  }
+  // Drops a record cut short by a crash, so that new records follow the last
+  // intact one.
+  if (ftruncate(fd, restored.log_bytes) != 0) {
+    close(fd);
+    return ErrnoError("truncate", log_path);
+  }
+
+  std::unique_ptr<ValueCacheLog> log(new ValueCacheLog(
+      std::move(options), cache, fd, restored.sequence, restored.log_bytes));
+  ValueCacheLog* const log_ptr = log.get();
+  cache.SetWriteObserver(
+      [log_ptr](const std::string& key, const v0::Value* message) {
+        log_ptr->Record(key, message);
+      });
+  return log;
+}
+
+ValueCacheLog::ValueCacheLog(Options options, LocalValueCache& cache, int fd,
+                             uint64_t sequence, size_t log_bytes)
+    : options_(std::move(options)),
+      cache_(cache),
+      fd_(fd),
+      log_bytes_(log_bytes),
+      next_sequence_(sequence + 1),
+      written_sequence_(sequence) {
+  thread_ = std::thread([this]() { Run(); });
+}
+
+ValueCacheLog::~ValueCacheLog() {
+  // No records can follow once the observer is gone, so the writer drains
+  // every one of them before it stops.
+  cache_.SetWriteObserver(nullptr);
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+    Wake();
+  }
+  thread_.join();
+  close(fd_);
+}
+
+void ValueCacheLog::Record(const std::string& key, const v0::Value* message) {
+  std::string body(kBodyPrefixSize, '\0');
+  body.append(key);
+  if (message != nullptr) {
+    message->AppendToString(&body);
+  }
+  const uint8_t operation = message != nullptr ? kPut : kRemove;
+  const uint32_t key_size = key.size();
+  std::memcpy(&body[sizeof(uint64_t)], &operation, sizeof(operation));
+  std::memcpy(&body[sizeof(uint64_t) + sizeof(operation)], &key_size,
+              sizeof(key_size));
+
+  // Only the sequence number, and so the checksum, depend on the order of the
+  // records.
+  absl::MutexLock lock(&mutex_);
+  const uint64_t sequence = next_sequence_++;
+  std::memcpy(&body[0], &sequence, sizeof(sequence));
+  const RecordHeader header = {
+      static_cast<uint32_t>(body.size()),
+      static_cast<uint32_t>(absl::ComputeCrc32c(body))};
+  pending_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  pending_.append(body);
+}
+
+void ValueCacheLog::Run() {
+  const bool expires = cache_.options().ttl != absl::InfiniteDuration();
+  absl::Time next_eviction = expires ? absl::Now() + options_.evict_interval
+                                     : absl::InfiniteFuture();
+  while (true) {
+    std::string batch;
+    uint64_t sequence;
+    uint64_t compactions;
+    bool compact;
+    bool stopping;
+    bool failed;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.AwaitWithDeadline(
+          absl::Condition(this, &ValueCacheLog::HasWork), next_eviction);
+    }
+    // The removals of the dropped keys are recorded, and join this batch.
+    if (absl::Now() >= next_eviction) {
+      cache_.EvictExpired();
+      next_eviction = absl::Now() + options_.evict_interval;
+    }
+    // Gathers more records, unless someone is waiting for them.
+    {
+      absl::MutexLock lock(&wake_mutex_);
+      wake_mutex_.AwaitWithTimeout(absl::Condition(&woken_),
+                                   options_.commit_interval);
+      woken_ = false;
+    }
+    {
+      absl::MutexLock lock(&mutex_);
+      batch.swap(pending_);
+      sequence = next_sequence_ - 1;
+      compactions = compactions_requested_;
+      compact = compactions_requested_ > compactions_done_;
+      stopping = stopping_;
+      failed = !status_.ok();
+    }
+
+    // After a failed write the log may end in a partial record, past which
+    // nothing can be recovered, so later records are dropped.
+    absl::Status status;
+    if (!failed) {
+      status = Append(batch);
+      if (status.ok() &&
+          (compact || log_bytes_ >= options_.compact_log_bytes)) {
+        status = CompactLog();
+      }
+    }
+    {
+      absl::MutexLock lock(&mutex_);
+      written_sequence_ = sequence;
+      compactions_done_ = compactions;
+      if (status_.ok()) {
+        status_ = status;
+      }
+    }
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+// Called with mutex_ held; the writer never takes mutex_ while holding
+// wake_mutex_.
+void ValueCacheLog::Wake() {
+  absl::MutexLock lock(&wake_mutex_);
+  woken_ = true;
+}
+
+absl::Status ValueCacheLog::Append(const std::string& batch) {
+  const std::string log_path = LogPath(options_.directory);
+  size_t written = 0;
+  while (written < batch.size()) {
+    const ssize_t result =
+        write(fd_, batch.data() + written, batch.size() - written);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ErrnoError("write", log_path);
+    }
+    written += result;
+  }
+  if (!batch.empty() && options_.sync && fdatasync(fd_) != 0) {
+    return ErrnoError("sync", log_path);
+  }
+  log_bytes_ += batch.size();
+  return absl::OkStatus();
+}
+
+absl::Status ValueCacheLog::CompactLog() {
+  // Rebuilds the state from disk rather than copying the live cache, which
+  // already holds changes that are not in the log yet.
+  LocalValueCache folded(cache_.options());
+  const Restored restored = GENC_TRY(Restore(options_.directory, folded));
+  // Leaves out the keys that expired, or were removed, in the live cache.
+  // Their removal is recorded once the cache drops them, or they are written
+  // again, and is then replayed harmlessly.
+  std::vector<std::string> dropped;
+  folded.ForEach(
+      [this, &dropped](const std::string& key, const std::vector<v0::Value>&) {
+        if (!cache_.Exists(key)) {
+          dropped.push_back(key);
+        }
+      });
+  for (const std::string& key : dropped) {
+    folded.Remove(key);
+  }
+  GENC_TRY(WriteLocalValueCache(folded, SnapshotPath(options_.directory),
+                                restored.sequence));
+  // A crash before the log is emptied is harmless: the snapshot's sequence
+  // number tells recovery to skip the records it already holds.
+  const std::string log_path = LogPath(options_.directory);
+  if (ftruncate(fd_, 0) != 0) {
+    return ErrnoError("truncate", log_path);
+  }
+  if (options_.sync && fsync(fd_) != 0) {
+    return ErrnoError("sync", log_path);
+  }
+  log_bytes_ = 0;
+  return absl::OkStatus();
+}
+
+absl::Status ValueCacheLog::Flush() {
+  absl::MutexLock lock(&mutex_);
+  const uint64_t sequence = next_sequence_ - 1;
+  ++flush_waiters_;
+  Wake();
+  auto written = [this, sequence]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return written_sequence_ >= sequence;
+  };
+  mutex_.Await(absl::Condition(&written));
+  --flush_waiters_;
+  return status_;
+}
+
+absl::Status ValueCacheLog::Compact() {
+  absl::MutexLock lock(&mutex_);
+  const uint64_t compaction = ++compactions_requested_;
+  Wake();
+  auto compacted = [this, compaction]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return compactions_done_ >= compaction;
+  };
+  mutex_.Await(absl::Condition(&compacted));
+  return status_;
+}
+
+}  // namespace genc
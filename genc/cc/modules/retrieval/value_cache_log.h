@@ -0,0 +1,144 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_RETRIEVAL_VALUE_CACHE_LOG_H_
+#define GENC_CC_MODULES_RETRIEVAL_VALUE_CACHE_LOG_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+// Persists a LocalValueCache to a directory, so that its contents survive a
+// restart of the process.
+//
+// The directory holds a snapshot, in the format of WriteLocalValueCache(),
+// and a write-ahead log of the changes made since. Changes are recorded as
+// they are made, but are written by a background thread, which gathers them
+// for up to `commit_interval` and then writes and syncs them together, so
+// that writes to the cache never wait for the disk. Once the log grows past
+// `compact_log_bytes`, the same thread folds it into a new snapshot and
+// empties it.
+//
+// Open() first restores the cache from the directory: it maps the snapshot
+// and the log, loads the snapshot, and replays the log records the snapshot
+// does not include. A record cut short by a crash ends the log, and is
+// dropped. Keys restored this way expire as if they had just been written.
+// Keys that expired before are not restored: the writer drops them from the
+// cache every `evict_interval`, which logs their removal, and compaction
+// leaves out the ones it has not dropped yet.
+//
+// Records that were not written yet when the process died are lost; Flush()
+// waits for every earlier change to be durable.
+class ValueCacheLog {
+ public:
+  struct Options {
+    // Directory that holds the snapshot and the log. Created if missing.
+    std::string directory;
+    // How long the writer gathers changes before writing them together.
+    absl::Duration commit_interval = absl::Milliseconds(5);
+    // Whether to wait for each write to reach the disk. Without it, a crash
+    // of the process loses nothing, but a crash of the machine may.
+    bool sync = true;
+    // Size of the log past which it is folded into the snapshot.
+    size_t compact_log_bytes = 64 << 20;
+    // How often the writer drops the expired keys of a cache with a TTL.
+    absl::Duration evict_interval = absl::Minutes(1);
+  };
+
+  // Restores `cache` from `options.directory`, then records every later
+  // change to it. `cache` should be empty, and must outlive the log.
+  static absl::StatusOr<std::unique_ptr<ValueCacheLog>> Open(
+      Options options, LocalValueCache& cache);
+
+  // Writes the remaining changes, and stops recording.
+  ~ValueCacheLog();
+  ValueCacheLog(const ValueCacheLog&) = delete;
+  ValueCacheLog& operator=(const ValueCacheLog&) = delete;
+
+  // Waits until every change made so far is written, and returns the first
+  // error the writer ran into, if any.
+  absl::Status Flush();
+
+  // Writes every change made so far, and folds the log into the snapshot.
+  absl::Status Compact();
+
+ private:
+  ValueCacheLog(Options options, LocalValueCache& cache, int fd,
+                uint64_t sequence, size_t log_bytes);
+
+  // Appends the record of a change; called by the cache under its lock.
+  void Record(const std::string& key, const v0::Value* message);
+
+  // The writer thread.
+  void Run();
+
+  // Ends the writer's wait for more records early.
+  void Wake();
+
+  // Writes a batch of records to the log.
+  absl::Status Append(const std::string& batch);
+
+  // Replaces the snapshot with one that also holds every record in the log,
+  // less the keys that expired since, and empties the log.
+  absl::Status CompactLog();
+
+  bool HasWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return stopping_ || flush_waiters_ > 0 ||
+           compactions_requested_ > compactions_done_ || !pending_.empty();
+  }
+
+  const Options options_;
+  LocalValueCache& cache_;
+  const int fd_;
+  // Only used by the writer thread, after Open().
+  size_t log_bytes_;
+
+  absl::Mutex mutex_;
+  // Records not yet handed to the writer.
+  std::string pending_ ABSL_GUARDED_BY(mutex_);
+  // Sequence number of the next record.
+  uint64_t next_sequence_ ABSL_GUARDED_BY(mutex_);
+  // Sequence number of the last record written.
+  uint64_t written_sequence_ ABSL_GUARDED_BY(mutex_);
+  int flush_waiters_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Number of compactions asked for by Compact(), and done by the writer.
+  uint64_t compactions_requested_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t compactions_done_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::Status status_ ABSL_GUARDED_BY(mutex_);
+
+  // The writer gathers records while waiting on its own mutex rather than on
+  // mutex_, so that Record() never has a waiter to wake.
+  absl::Mutex wake_mutex_;
+  bool woken_ ABSL_GUARDED_BY(wake_mutex_) = false;
+
+  std::thread thread_;
+};
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_RETRIEVAL_VALUE_CACHE_LOG_H_
@@ -0,0 +1,282 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/retrieval/value_cache_log.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/modules/retrieval/local_cache.h"
+#include "genc/proto/v0/computation.pb.h"
+
+namespace genc {
+
+namespace {
+
+v0::Value StrValue(const std::string& s) {
+  v0::Value value;
+  value.set_str(s);
+  return value;
+}
+
+std::vector<std::string> Strs(const std::vector<v0::Value>& values) {
+  std::vector<std::string> strs;
+  for (const v0::Value& value : values) {
+    strs.push_back(value.str());
+  }
+  return strs;
+}
+
+ValueCacheLog::Options TestOptions(const std::string& name) {
+  ValueCacheLog::Options options;
+  options.directory = ::testing::TempDir() + "/" + name;
+  options.commit_interval = absl::Milliseconds(1);
+  return options;
+}
+
+TEST(ValueCacheLogTest, RestoresWritesAfterRestart) {
+  const ValueCacheLog::Options options = TestOptions("restores_writes");
+  {
+    LocalValueCache cache(3);
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    for (int i = 0; i < 5; ++i) {
+      cache.Put("a", StrValue(absl::StrCat("a", i)));
+    }
+    cache.Put("b", StrValue("b0"));
+    cache.Put("c", StrValue("c0"));
+    cache.Remove("c");
+    // The destructor writes the remaining records.
+  }
+  LocalValueCache restored(3);
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_THAT(Strs(restored.Get("a")),
+              ::testing::ElementsAre("a2", "a3", "a4"));
+  EXPECT_THAT(Strs(restored.Get("b")), ::testing::ElementsAre("b0"));
+  EXPECT_FALSE(restored.Exists("c"));
+
+  // The restored cache keeps logging.
+  restored.Put("b", StrValue("b1"));
+  EXPECT_EQ(log->Flush(), absl::OkStatus());
+  log.reset();
+  LocalValueCache again(3);
+  std::unique_ptr<ValueCacheLog> again_log =
+      ValueCacheLog::Open(options, again).value();
+  EXPECT_THAT(Strs(again.Get("b")), ::testing::ElementsAre("b0", "b1"));
+}
+
+TEST(ValueCacheLogTest, CompactionKeepsContentsAndEmptiesLog) {
+  ValueCacheLog::Options options = TestOptions("compaction");
+  {
+    LocalValueCache cache(10);
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    cache.Put("a", StrValue("a0"));
+    cache.Put("b", StrValue("b0"));
+    EXPECT_EQ(log->Compact(), absl::OkStatus());
+    std::ifstream log_file(options.directory + "/log",
+                           std::ios::binary | std::ios::ate);
+    EXPECT_EQ(log_file.tellg(), 0);
+    // Changes after the compaction land in the log again.
+    cache.Put("a", StrValue("a1"));
+    cache.Remove("b");
+  }
+  LocalValueCache restored(10);
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_THAT(Strs(restored.Get("a")), ::testing::ElementsAre("a0", "a1"));
+  EXPECT_FALSE(restored.Exists("b"));
+}
+
+TEST(ValueCacheLogTest, CompactsOnceLogIsLarge) {
+  ValueCacheLog::Options options = TestOptions("compacts_when_large");
+  options.compact_log_bytes = 1000;
+  {
+    LocalValueCache cache(5);
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    for (int i = 0; i < 200; ++i) {
+      cache.Put(absl::StrCat("key", i % 10), StrValue(absl::StrCat(i)));
+      if (i % 20 == 0) {
+        EXPECT_EQ(log->Flush(), absl::OkStatus());
+      }
+    }
+    EXPECT_EQ(log->Flush(), absl::OkStatus());
+    std::ifstream log_file(options.directory + "/log",
+                           std::ios::binary | std::ios::ate);
+    EXPECT_LT(log_file.tellg(), 2000);
+  }
+  LocalValueCache restored(5);
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_EQ(restored.size(), 10);
+  EXPECT_THAT(Strs(restored.Get("key9")),
+              ::testing::ElementsAre("159", "169", "179", "189", "199"));
+}
+
+// A clock that the tests move forward, and that the writer thread reads.
+class FakeClock {
+ public:
+  absl::Time Now() const {
+    absl::MutexLock lock(&mutex_);
+    return now_;
+  }
+
+  void Advance(absl::Duration duration) {
+    absl::MutexLock lock(&mutex_);
+    now_ += duration;
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  absl::Time now_ = absl::UnixEpoch();
+};
+
+LocalValueCache::Options ExpiringCacheOptions(const FakeClock& clock) {
+  LocalValueCache::Options options;
+  options.ttl = absl::Minutes(5);
+  options.clock = [&clock]() { return clock.Now(); };
+  return options;
+}
+
+TEST(ValueCacheLogTest, LogsRemovalOfExpiredKeys) {
+  ValueCacheLog::Options options = TestOptions("expired_keys");
+  options.evict_interval = absl::Milliseconds(1);
+  FakeClock clock;
+  {
+    LocalValueCache cache(ExpiringCacheOptions(clock));
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    cache.Put("a", StrValue("a0"));
+    cache.Put("b", StrValue("b0"));
+    clock.Advance(absl::Minutes(3));
+    cache.Put("b", StrValue("b1"));
+    clock.Advance(absl::Minutes(3));
+    // Nothing but the writer drops "a".
+    while (cache.size() > 1) {
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+    EXPECT_EQ(log->Flush(), absl::OkStatus());
+  }
+  LocalValueCache restored(ExpiringCacheOptions(clock));
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_FALSE(restored.Exists("a"));
+  EXPECT_THAT(Strs(restored.Get("b")), ::testing::ElementsAre("b0", "b1"));
+}
+
+TEST(ValueCacheLogTest, CompactionLeavesOutExpiredKeys) {
+  ValueCacheLog::Options options = TestOptions("compaction_expired_keys");
+  options.evict_interval = absl::InfiniteDuration();
+  FakeClock clock;
+  {
+    LocalValueCache cache(ExpiringCacheOptions(clock));
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    cache.Put("a", StrValue("a0"));
+    clock.Advance(absl::Minutes(3));
+    cache.Put("b", StrValue("b0"));
+    clock.Advance(absl::Minutes(3));
+    EXPECT_EQ(log->Compact(), absl::OkStatus());
+  }
+  LocalValueCache restored(ExpiringCacheOptions(clock));
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_FALSE(restored.Exists("a"));
+  EXPECT_THAT(Strs(restored.Get("b")), ::testing::ElementsAre("b0"));
+}
+
+TEST(ValueCacheLogTest, DropsRecordCutShortByCrash) {
+  const ValueCacheLog::Options options = TestOptions("torn_record");
+  {
+    LocalValueCache cache(10);
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    cache.Put("a", StrValue("kept"));
+    EXPECT_EQ(log->Flush(), absl::OkStatus());
+    cache.Put("a", StrValue("torn"));
+  }
+  const std::string log_path = options.directory + "/log";
+  std::ifstream log_file(log_path, std::ios::binary | std::ios::ate);
+  const off_t log_size = log_file.tellg();
+  ASSERT_EQ(truncate(log_path.c_str(), log_size - 2), 0);
+
+  LocalValueCache restored(10);
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  EXPECT_THAT(Strs(restored.Get("a")), ::testing::ElementsAre("kept"));
+  // New records follow the last intact one.
+  restored.Put("a", StrValue("after"));
+  log.reset();
+  LocalValueCache again(10);
+  std::unique_ptr<ValueCacheLog> again_log =
+      ValueCacheLog::Open(options, again).value();
+  EXPECT_THAT(Strs(again.Get("a")), ::testing::ElementsAre("kept", "after"));
+}
+
+TEST(ValueCacheLogTest, ConcurrentWritersAreAllRestored) {
+  const ValueCacheLog::Options options = TestOptions("concurrent");
+  {
+    LocalValueCache cache(1000);
+    std::unique_ptr<ValueCacheLog> log =
+        ValueCacheLog::Open(options, cache).value();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&cache, t]() {
+        for (int i = 0; i < 250; ++i) {
+          cache.Put(absl::StrCat("key", t), StrValue(absl::StrCat(i)));
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(log->Flush(), absl::OkStatus());
+  }
+  LocalValueCache restored(1000);
+  std::unique_ptr<ValueCacheLog> log =
+      ValueCacheLog::Open(options, restored).value();
+  for (int t = 0; t < 4; ++t) {
+    std::vector<v0::Value> values = restored.Get(absl::StrCat("key", t));
+    ASSERT_EQ(values.size(), 250);
+    for (int i = 0; i < 250; ++i) {
+      EXPECT_EQ(values[i].str(), absl::StrCat(i));
+    }
+  }
+}
+
+TEST(ValueCacheLogTest, RejectsMissingDirectory) {
+  LocalValueCache cache(10);
+  EXPECT_EQ(ValueCacheLog::Open(ValueCacheLog::Options(), cache)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace genc
@@ -16,90 +16,250 @@ limitations under the License
 #include "genc/cc/modules/tools/curl_client.h"
 
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <utility>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include <curl/curl.h>
+#include "genc/cc/interop/networking/curl_handle_pool.h"
+#include "genc/cc/interop/networking/endpoint_limiter.h"
+#include "genc/cc/interop/networking/http_compression.h"
 #include "genc/proto/v0/computation.pb.h"
 
 namespace genc {
 
 namespace {
 
-// Callback fn to write the response.
-size_t WriteCallback(void* contents, size_t size, size_t nmemb,
-                     std::string* output) {
-  size_t totalSize = size * nmemb;
-  output->append(static_cast<char*>(contents), totalSize);
-  return totalSize;
-}
-}  // namespace
+using ::genc::interop::networking::AcceptCompressedResponses;
+using ::genc::interop::networking::AcquireCurlHandle;
+using ::genc::interop::networking::AppendToString;
+using ::genc::interop::networking::CompressionStats;
+using ::genc::interop::networking::EndpointLimiter;
+using ::genc::interop::networking::HttpCompressionOptions;
+using ::genc::interop::networking::MaybeCompressRequest;
+using ::genc::interop::networking::PooledCurlHandle;
+using ::genc::interop::networking::RecordResponseCompression;
+using ::genc::interop::networking::SetPostBody;
 
-absl::StatusOr<v0::Value> CurlClient::Post(const std::string& api_key,
-                                           const std::string& endpoint,
-                                           const std::string& json_request) {
-  CURL* curl = curl_easy_init();
+// The compression options set by CurlClient::SetCompression().
+class Compression final {
+ public:
+  static Compression& Instance() {
+    static Compression* const compression = new Compression();
+    return *compression;
+  }
+
+  HttpCompressionOptions options() const {
+    absl::MutexLock lock(&mutex_);
+    return options_;
+  }
+
+  void set_options(const HttpCompressionOptions& options) {
+    absl::MutexLock lock(&mutex_);
+    options_ = options;
+  }
 
-  if (curl == nullptr) return absl::InternalError("Unable to init CURL");
+ private:
+  mutable absl::Mutex mutex_;
+  HttpCompressionOptions options_ ABSL_GUARDED_BY(mutex_);
+};
 
+struct HeadersDeleter {
+  void operator()(curl_slist* headers) const { curl_slist_free_all(headers); }
+};
+using Headers = std::unique_ptr<curl_slist, HeadersDeleter>;
+
+// Sets up `curl` to POST `json_request`, which is gzip-compressed if
+// `compressed`. The returned headers must outlive the request.
+Headers SetUpPost(CURL* curl, const std::string& api_key,
+                  const std::string& endpoint, const std::string& json_request,
+                  bool compressed) {
   curl_easy_setopt(curl, CURLOPT_URL, endpoint.c_str());
 
-  struct curl_slist* headers = nullptr;
+  curl_slist* headers = nullptr;
   // API key can be embedded into the URL. Hence empty.
   if (!api_key.empty()) {
     headers = curl_slist_append(headers,
                                 ("Authorization: Bearer " + api_key).c_str());
   }
-
   headers = curl_slist_append(headers, "Content-Type: application/json");
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  if (compressed) {
+    headers = curl_slist_append(headers, "Content-Encoding: gzip");
+  }
+  Headers header_list(SetPostBody(curl, json_request, headers));
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list.get());
+  return header_list;
+}
+
+int HttpStatus(CURL* curl) {
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  return static_cast<int>(http_code);
+}
 
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_request.c_str());
+// Returns how long the server asked to wait before retrying, if it did.
+absl::Duration RetryAfter(CURL* curl) {
+  curl_off_t seconds = 0;
+  curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &seconds);
+  return absl::Seconds(seconds);
+}
+
+struct StreamState {
+  CURL* curl;
+  const CurlClient::DataFn* on_data;
+  bool cancelled = false;
+  // Decoded bytes handed over.
+  size_t bytes = 0;
+};
 
+// Callback fn to hand the response over as it arrives.
+size_t StreamCallback(void* contents, size_t size, size_t nmemb,
+                      StreamState* state) {
+  size_t totalSize = size * nmemb;
+  // Drops the response to a throttled call, which is retried.
+  if (EndpointLimiter::IsThrottled(HttpStatus(state->curl))) {
+    return totalSize;
+  }
+  if (!(*state->on_data)(
+          absl::string_view(static_cast<char*>(contents), totalSize))) {
+    state->cancelled = true;
+    // Anything but totalSize aborts the transfer.
+    return 0;
+  }
+  state->bytes += totalSize;
+  return totalSize;
+}
+
+// Sends the request set up on `curl`, and returns the response body.
+EndpointLimiter::Attempt Perform(CURL* curl,
+                                 const HttpCompressionOptions& compression) {
+  AcceptCompressedResponses(compression, curl);
   // Set the callback function to put the curl response into a buffer.
-  v0::Value response;
-  std::string* response_json = response.mutable_str();
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, response_json);
+  std::string response;
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendToString);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
 
   // Send the request
   CURLcode curl_code = curl_easy_perform(curl);
 
   // Error out if call fails
   if (curl_code != CURLE_OK) {
-    return absl::InternalError(curl_easy_strerror(curl_code));
+    return {absl::InternalError(curl_easy_strerror(curl_code))};
   }
+  RecordResponseCompression(curl, response.size(),
+                            CompressionStats::Default());
+  return {std::move(response), HttpStatus(curl), RetryAfter(curl)};
+}
 
-  // Cleanup, free resource and return.
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
-  return response;
+// Makes a call to `endpoint` through the shared limiter of its calls.
+absl::StatusOr<v0::Value> LimitedCall(
+    const std::string& endpoint, const EndpointLimiter::AttemptFn& attempt) {
+  absl::StatusOr<std::string> response = EndpointLimiter::Default().Call(
+      EndpointLimiter::EndpointOf(endpoint), attempt);
+  if (!response.ok()) return response.status();
+  v0::Value result;
+  *result.mutable_str() = *std::move(response);
+  return result;
 }
+}  // namespace
 
-// GET request, API key is embedded in the URL.
-absl::StatusOr<v0::Value> CurlClient::Get(const std::string& endpoint) {
-  CURL* curl = curl_easy_init();
+absl::StatusOr<v0::Value> CurlClient::Post(const std::string& api_key,
+                                           const std::string& endpoint,
+                                           const std::string& json_request) {
+  const HttpCompressionOptions compression = Compression::Instance().options();
+  // Compressed once for every attempt.
+  std::string compressed_request;
+  const bool compressed =
+      MaybeCompressRequest(compression, json_request, &compressed_request,
+                           CompressionStats::Default());
+  return LimitedCall(endpoint, [&]() -> EndpointLimiter::Attempt {
+    absl::StatusOr<PooledCurlHandle> curl = AcquireCurlHandle();
+    if (!curl.ok()) return {curl.status()};
+    Headers header_list =
+        SetUpPost(curl->get(), api_key, endpoint,
+                  compressed ? compressed_request : json_request, compressed);
+    return Perform(curl->get(), compression);
+  });
+}
 
-  if (curl == nullptr) return absl::InternalError("Unable to init CURL");
-  curl_easy_setopt(curl, CURLOPT_URL, endpoint.c_str());
+absl::Status CurlClient::PostAndStream(const std::string& api_key,
+                                       const std::string& endpoint,
+                                       const std::string& json_request,
+                                       const DataFn& on_data) {
+  const HttpCompressionOptions compression = Compression::Instance().options();
+  std::string compressed_request;
+  const bool compressed =
+      MaybeCompressRequest(compression, json_request, &compressed_request,
+                           CompressionStats::Default());
+  const auto attempt = [&]() -> EndpointLimiter::Attempt {
+    absl::StatusOr<PooledCurlHandle> curl = AcquireCurlHandle();
+    if (!curl.ok()) return {curl.status()};
+    Headers header_list =
+        SetUpPost(curl->get(), api_key, endpoint,
+                  compressed ? compressed_request : json_request, compressed);
+    AcceptCompressedResponses(compression, curl->get());
 
-  v0::Value response;
-  std::string* response_json = response.mutable_str();
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, response_json);
-  curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    StreamState state{curl->get(), &on_data};
+    curl_easy_setopt(curl->get(), CURLOPT_WRITEFUNCTION, StreamCallback);
+    curl_easy_setopt(curl->get(), CURLOPT_WRITEDATA, &state);
+    // Hands over bytes as they arrive, however few.
+    curl_easy_setopt(curl->get(), CURLOPT_TCP_NODELAY, 1L);
 
-  // Send the request
-  CURLcode curl_code = curl_easy_perform(curl);
+    CURLcode curl_code = curl_easy_perform(curl->get());
+    if (state.cancelled) {
+      return {absl::CancelledError("Streaming cancelled by the receiver.")};
+    }
+    if (curl_code != CURLE_OK) {
+      return {absl::InternalError(curl_easy_strerror(curl_code))};
+    }
+    const int http_status = HttpStatus(curl->get());
+    if (!EndpointLimiter::IsThrottled(http_status)) {
+      RecordResponseCompression(curl->get(), state.bytes,
+                                CompressionStats::Default());
+    }
+    if (http_status >= 400 && !EndpointLimiter::IsThrottled(http_status)) {
+      // Not naming the endpoint, which may hold an API key.
+      return {absl::InternalError(
+                  absl::StrCat("Received HTTP status ", http_status)),
+              http_status};
+    }
+    return {"", http_status, RetryAfter(curl->get())};
+  };
+  return LimitedCall(endpoint, attempt).status();
+}
 
-  // Error out if call fails
-  if (curl_code != CURLE_OK) {
-    return absl::InternalError(curl_easy_strerror(curl_code));
-  }
+// GET request, API key is embedded in the URL.
+absl::StatusOr<v0::Value> CurlClient::Get(const std::string& endpoint) {
+  const HttpCompressionOptions compression = Compression::Instance().options();
+  return LimitedCall(endpoint, [&]() -> EndpointLimiter::Attempt {
+    absl::StatusOr<PooledCurlHandle> curl = AcquireCurlHandle();
+    if (!curl.ok()) return {curl.status()};
+
+    curl_easy_setopt(curl->get(), CURLOPT_URL, endpoint.c_str());
+    curl_easy_setopt(curl->get(), CURLOPT_HTTPGET, 1L);
+    return Perform(curl->get(), compression);
+  });
+}
+
+void CurlClient::SetCompression(const HttpCompressionOptions& options) {
+  Compression::Instance().set_options(options);
+}
 
-  // Cleanup, free resource and return
-  curl_easy_cleanup(curl);
-  return response;
+std::string CurlClient::Escape(absl::string_view text) {
+  // Since CURL 7.82 the handle is ignored, but older versions require one.
+  absl::StatusOr<PooledCurlHandle> curl = AcquireCurlHandle();
+  char* escaped = curl_easy_escape(curl.ok() ? curl->get() : nullptr,
+                                   text.data(), static_cast<int>(text.size()));
+  if (escaped == nullptr) return "";
+  std::string result(escaped);
+  curl_free(escaped);
+  return result;
 }
 }  // namespace genc
@@ -15,13 +15,26 @@ limitations under the License
 #ifndef GENC_CC_MODULES_TOOLS_CURL_CLIENT_H_
 #define GENC_CC_MODULES_TOOLS_CURL_CLIENT_H_
 
+#include <functional>
 #include <string>
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "genc/cc/interop/networking/http_compression.h"
 #include "genc/proto/v0/computation.pb.h"
 
 namespace genc {
 
 // Makes REST calls via CURL.
+// Calls borrow easy handles from a process-wide pool instead of creating one
+// per call. The pooled handles share a DNS cache, TLS sessions and a cache of
+// kept-alive connections, so only the first call to a host pays for the DNS
+// lookup and the TCP and TLS handshakes. Safe to call from many threads.
+//
+// Calls to each endpoint go through the process-wide
+// interop::networking::EndpointLimiter, which bounds and paces them, and
+// retries those the endpoint throttles with HTTP 429 or 503. A call throttled
+// on every attempt fails with a ResourceExhaustedError or UnavailableError.
 class CurlClient final {
  public:
   ~CurlClient() = default;
@@ -32,11 +45,33 @@ class CurlClient final {
                                         const std::string& endpoint,
                                         const std::string& json_request);
 
+  // Receives the bytes of a response as they arrive. Returns false to cancel
+  // the request.
+  using DataFn = std::function<bool(absl::string_view data)>;
+
+  // POST request like Post(), whose response is handed over to `on_data` as
+  // it arrives, instead of all at once, e.g. for server-sent events. Fails
+  // with a CancelledError if `on_data` cancels, and on an HTTP error status,
+  // after handing over the error response. The responses of throttled
+  // attempts are not handed over.
+  static absl::Status PostAndStream(const std::string& api_key,
+                                    const std::string& endpoint,
+                                    const std::string& json_request,
+                                    const DataFn& on_data);
+
   // GET request, API key is embedded in the URL.
   static absl::StatusOr<v0::Value> Get(const std::string& endpoint);
 
-      // Not copyable or movable.
-      CurlClient(const CurlClient&) = delete;
+  // Compresses the bodies of the calls that follow as `options` say, and
+  // records the bytes saved in CompressionStats::Default(). Off by default.
+  static void SetCompression(
+      const interop::networking::HttpCompressionOptions& options);
+
+  // Returns `text` URL-encoded, e.g. for a query parameter.
+  static std::string Escape(absl::string_view text);
+
+  // Not copyable or movable.
+  CurlClient(const CurlClient&) = delete;
   CurlClient& operator=(const CurlClient&) = delete;
 
  private:
@@ -0,0 +1,147 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/tools/curl_client.h"
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "genc/cc/testing/http_test_server.h"
+
+namespace genc {
+namespace {
+
+using ::genc::testing::HttpTestServer;
+using ::testing::ElementsAre;
+
+// Replies with what it was asked, and the credentials it was given.
+HttpTestServer::Response Echo(const HttpTestServer::Request& request) {
+  HttpTestServer::Response response;
+  response.body = absl::StrCat(request.method, " ", request.target, " [",
+                               request.header("Authorization"), "] ",
+                               request.body);
+  return response;
+}
+
+TEST(CurlClientTest, PostsAndGets) {
+  auto server = HttpTestServer::Start(Echo).value();
+  EXPECT_EQ(CurlClient::Post("k", server->Url("/post"), "{}").value().str(),
+            "POST /post [Bearer k] {}");
+  // The key may be in the URL instead.
+  EXPECT_EQ(
+      CurlClient::Post("", server->Url("/post?key=k"), "[1]").value().str(),
+      "POST /post?key=k [] [1]");
+  EXPECT_EQ(CurlClient::Get(server->Url("/get?q=1")).value().str(),
+            "GET /get?q=1 [] ");
+}
+
+TEST(CurlClientTest, ReusesHandlesAndConnectionsAcrossThreads) {
+  auto server = HttpTestServer::Start(Echo).value();
+  constexpr int kNumThreads = 8;
+  constexpr int kNumCalls = 50;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kNumCalls; ++i) {
+        const std::string target = absl::StrCat("/", t, "/", i);
+        if (i % 2 == 0) {
+          EXPECT_EQ(CurlClient::Get(server->Url(target)).value().str(),
+                    absl::StrCat("GET ", target, " [] "));
+        } else {
+          const std::string body = absl::StrCat("{\"call\": ", i, "}");
+          EXPECT_EQ(
+              CurlClient::Post("k", server->Url(target), body).value().str(),
+              absl::StrCat("POST ", target, " [Bearer k] ", body));
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(server->num_requests(), kNumThreads * kNumCalls);
+  // Pooled handles keep their connections, so there are far fewer
+  // connections than calls.
+  EXPECT_LE(server->num_connections(), kNumThreads);
+}
+
+TEST(CurlClientTest, ReturnsErrorResponses) {
+  auto server =
+      HttpTestServer::Start([](const HttpTestServer::Request&) {
+        HttpTestServer::Response response;
+        response.status = 400;
+        response.body = "Bad request";
+        return response;
+      }).value();
+  EXPECT_EQ(CurlClient::Get(server->Url("/")).value().str(), "Bad request");
+}
+
+TEST(CurlClientTest, StreamsResponses) {
+  auto server =
+      HttpTestServer::Start([](const HttpTestServer::Request&) {
+        HttpTestServer::Response response;
+        response.body = "a";
+        response.stream = {"b", "c"};
+        response.stream_interval = absl::Milliseconds(10);
+        return response;
+      }).value();
+  std::vector<std::string> data;
+  EXPECT_EQ(CurlClient::PostAndStream("k", server->Url("/"), "{}",
+                                      [&](absl::string_view bytes) {
+                                        data.emplace_back(bytes);
+                                        return true;
+                                      }),
+            absl::OkStatus());
+  EXPECT_EQ(absl::StrJoin(data, ""), "abc");
+
+  data.clear();
+  EXPECT_EQ(CurlClient::PostAndStream("k", server->Url("/"), "{}",
+                                      [&](absl::string_view bytes) {
+                                        data.emplace_back(bytes);
+                                        return false;
+                                      })
+                .code(),
+            absl::StatusCode::kCancelled);
+  EXPECT_THAT(data, ElementsAre("a"));
+}
+
+TEST(CurlClientTest, Escapes) {
+  EXPECT_EQ(CurlClient::Escape("a b&c=d/\xc3\xa9"), "a%20b%26c%3Dd%2F%C3%A9");
+  EXPECT_EQ(CurlClient::Escape(""), "");
+  // Escaping borrows a pooled handle, like the calls.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([t]() {
+      for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(CurlClient::Escape(absl::StrCat(t, " ", i)),
+                  absl::StrCat(t, "%20", i));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace
+}  // namespace genc
@@ -15,55 +15,26 @@ limitations under the License
 
 #include "genc/cc/modules/tools/wolfram_alpha.h"
 
-#include <cstddef>
 #include <string>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
-#include <curl/curl.h>
+#include "genc/cc/modules/tools/curl_client.h"
 #include "genc/cc/runtime/status_macros.h"
 #include "genc/proto/v0/computation.pb.h"
 
 namespace genc {
 
 namespace {
-// Callback fn to write the response.
-size_t WriteCallback(void* contents, size_t size, size_t nmemb,
-                     std::string* output) {
-  size_t totalSize = size * nmemb;
-  output->append(static_cast<char*>(contents), totalSize);
-  return totalSize;
-}
-
-// TODO(b/315872721): migrate all curl stuff to HttpClients.
 // Calls Wolfram Alpha API to get a string response.
 absl::StatusOr<std::string> CallShortAnswersAPI(const std::string& app_id,
                                                 const std::string& query) {
-  CURL* curl;
-  CURLcode curl_code;
-  std::string readBuffer;
-
-  curl = curl_easy_init();
-  if (curl == nullptr) return absl::InternalError("Unable to init CURL");
-
-  char* escaped_query = curl_easy_escape(curl, query.c_str(), 0);
-
   std::string url =
       "http://api.wolframalpha.com/v2/query?appid=" + app_id +
-      "&output=json&includepodid=Result&input=" + std::string(escaped_query);
-
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-
-  curl_code = curl_easy_perform(curl);
-
-  // Error out if call fails
-  if (curl_code != CURLE_OK) {
-    return absl::InternalError(curl_easy_strerror(curl_code));
-  }
-  curl_easy_cleanup(curl);
-  return readBuffer;
+      "&output=json&includepodid=Result&input=" + CurlClient::Escape(query);
+  v0::Value response = GENC_TRY(CurlClient::Get(url));
+  return std::move(*response.mutable_str());
 }
 
 }  // namespace
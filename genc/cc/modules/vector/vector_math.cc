@@ -0,0 +1,498 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/vector/vector_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GENC_VECTOR_HAVE_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define GENC_VECTOR_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace genc {
+namespace {
+
+// The kernels of one instruction set. `dot_and_norm` computes the dot product
+// of `a` and `b` together with the squared norm of `b`, in a single pass.
+struct Kernels {
+  absl::string_view isa;
+  float (*dot)(const float* a, const float* b, size_t n);
+  float (*squared_l2)(const float* a, const float* b, size_t n);
+  void (*dot_and_norm)(const float* a, const float* b, size_t n, float* dot,
+                       float* norm);
+  int32_t (*dot_int8)(const int8_t* a, const int8_t* b, size_t n);
+};
+
+float ScalarDot(const float* a, const float* b, size_t n) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+float ScalarSquaredL2(const float* a, const float* b, size_t n) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    const float d = a[i] - b[i];
+    sum += d * d;
+  }
+  return sum;
+}
+
+void ScalarDotAndNorm(const float* a, const float* b, size_t n, float* dot,
+                      float* norm) {
+  float dot_sum = 0.0f;
+  float norm_sum = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    dot_sum += a[i] * b[i];
+    norm_sum += b[i] * b[i];
+  }
+  *dot = dot_sum;
+  *norm = norm_sum;
+}
+
+int32_t ScalarDotInt8(const int8_t* a, const int8_t* b, size_t n) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += static_cast<int32_t>(a[i]) * b[i];
+  }
+  return sum;
+}
+
+constexpr Kernels kScalarKernels = {"scalar", ScalarDot, ScalarSquaredL2,
+                                    ScalarDotAndNorm, ScalarDotInt8};
+
+#if GENC_VECTOR_HAVE_AVX2
+
+// Compiles the function for AVX2 regardless of the target flags, so that it
+// can be selected at runtime.
+#define GENC_AVX2 __attribute__((target("avx2,fma")))
+
+GENC_AVX2 float HorizontalSum(__m256 v) {
+  __m128 sum =
+      _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum);
+}
+
+// The float kernels use two accumulators to hide the latency of the FMAs.
+GENC_AVX2 float Avx2Dot(const float* a, const float* b, size_t n) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 =
+        _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+                           _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    acc0 =
+        _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+  }
+  float sum = HorizontalSum(_mm256_add_ps(acc0, acc1));
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+GENC_AVX2 float Avx2SquaredL2(const float* a, const float* b, size_t n) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                    _mm256_loadu_ps(b + i));
+    const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8),
+                                    _mm256_loadu_ps(b + i + 8));
+    acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+    acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                   _mm256_loadu_ps(b + i));
+    acc0 = _mm256_fmadd_ps(d, d, acc0);
+  }
+  float sum = HorizontalSum(_mm256_add_ps(acc0, acc1));
+  for (; i < n; ++i) {
+    const float d = a[i] - b[i];
+    sum += d * d;
+  }
+  return sum;
+}
+
+GENC_AVX2 void Avx2DotAndNorm(const float* a, const float* b, size_t n,
+                              float* dot, float* norm) {
+  __m256 dot_acc = _mm256_setzero_ps();
+  __m256 norm_acc = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 vb = _mm256_loadu_ps(b + i);
+    dot_acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), vb, dot_acc);
+    norm_acc = _mm256_fmadd_ps(vb, vb, norm_acc);
+  }
+  float dot_sum = HorizontalSum(dot_acc);
+  float norm_sum = HorizontalSum(norm_acc);
+  for (; i < n; ++i) {
+    dot_sum += a[i] * b[i];
+    norm_sum += b[i] * b[i];
+  }
+  *dot = dot_sum;
+  *norm = norm_sum;
+}
+
+// Sign-extends 16 bytes at a time to int16, and multiplies and adds adjacent
+// pairs into int32 lanes. A pair adds at most 2 * 128 * 128 to a lane, so the
+// lanes can't overflow for any realistic dimension.
+GENC_AVX2 int32_t Avx2DotInt8(const int8_t* a, const int8_t* b, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m256i va = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+    const __m256i vb = _mm256_cvtepi8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+  }
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                              _mm256_extracti128_si256(acc, 1));
+  sum = _mm_hadd_epi32(sum, sum);
+  sum = _mm_hadd_epi32(sum, sum);
+  int32_t result = _mm_cvtsi128_si32(sum);
+  for (; i < n; ++i) {
+    result += static_cast<int32_t>(a[i]) * b[i];
+  }
+  return result;
+}
+
+constexpr Kernels kAvx2Kernels = {"avx2", Avx2Dot, Avx2SquaredL2,
+                                  Avx2DotAndNorm, Avx2DotInt8};
+
+#endif  // GENC_VECTOR_HAVE_AVX2
+
+#if GENC_VECTOR_HAVE_NEON
+
+float NeonDot(const float* a, const float* b, size_t n) {
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; i < n; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+float NeonSquaredL2(const float* a, const float* b, size_t n) {
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+    const float32x4_t d1 =
+        vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    acc0 = vfmaq_f32(acc0, d0, d0);
+    acc1 = vfmaq_f32(acc1, d1, d1);
+  }
+  float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; i < n; ++i) {
+    const float d = a[i] - b[i];
+    sum += d * d;
+  }
+  return sum;
+}
+
+void NeonDotAndNorm(const float* a, const float* b, size_t n, float* dot,
+                    float* norm) {
+  float32x4_t dot_acc = vdupq_n_f32(0.0f);
+  float32x4_t norm_acc = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t vb = vld1q_f32(b + i);
+    dot_acc = vfmaq_f32(dot_acc, vld1q_f32(a + i), vb);
+    norm_acc = vfmaq_f32(norm_acc, vb, vb);
+  }
+  float dot_sum = vaddvq_f32(dot_acc);
+  float norm_sum = vaddvq_f32(norm_acc);
+  for (; i < n; ++i) {
+    dot_sum += a[i] * b[i];
+    norm_sum += b[i] * b[i];
+  }
+  *dot = dot_sum;
+  *norm = norm_sum;
+}
+
+// Widening multiplies 16 bytes at a time into int16 (which can't overflow for
+// int8 operands), then pairwise accumulates into int32 lanes.
+int32_t NeonDotInt8(const int8_t* a, const int8_t* b, size_t n) {
+  int32x4_t acc = vdupq_n_s32(0);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const int8x16_t va = vld1q_s8(a + i);
+    const int8x16_t vb = vld1q_s8(b + i);
+    acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+    acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+  }
+  int32_t sum = vaddvq_s32(acc);
+  for (; i < n; ++i) {
+    sum += static_cast<int32_t>(a[i]) * b[i];
+  }
+  return sum;
+}
+
+constexpr Kernels kNeonKernels = {"neon", NeonDot, NeonSquaredL2,
+                                  NeonDotAndNorm, NeonDotInt8};
+
+#endif  // GENC_VECTOR_HAVE_NEON
+
+const Kernels& GetKernels() {
+  static const Kernels& kernels = []() -> const Kernels& {
+#if GENC_VECTOR_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return kAvx2Kernels;
+    }
+#elif GENC_VECTOR_HAVE_NEON
+    return kNeonKernels;
+#endif
+    return kScalarKernels;
+  }();
+  return kernels;
+}
+
+float Cosine(float dot, float squared_norm_a, float squared_norm_b) {
+  const float denominator = std::sqrt(squared_norm_a * squared_norm_b);
+  return denominator > 0.0f ? dot / denominator : 0.0f;
+}
+
+// Whether `a` ranks before `b` in the results of `TopK`.
+bool RanksBefore(const ScoredIndex& a, const ScoredIndex& b) {
+  return a.score > b.score || (a.score == b.score && a.index < b.index);
+}
+
+// Keeps the `k` best of the scores added to it, in a heap whose top is the
+// worst of them, so that most candidates are rejected with one comparison.
+class TopKCollector {
+ public:
+  explicit TopKCollector(int k) : k_(k) { heap_.reserve(k); }
+
+  void Add(int index, float score) {
+    const ScoredIndex candidate{index, score};
+    if (heap_.size() < k_) {
+      heap_.push_back(candidate);
+      std::push_heap(heap_.begin(), heap_.end(), RanksBefore);
+    } else if (RanksBefore(candidate, heap_.front())) {
+      std::pop_heap(heap_.begin(), heap_.end(), RanksBefore);
+      heap_.back() = candidate;
+      std::push_heap(heap_.begin(), heap_.end(), RanksBefore);
+    }
+  }
+
+  std::vector<ScoredIndex> Finish() && {
+    std::sort_heap(heap_.begin(), heap_.end(), RanksBefore);
+    return std::move(heap_);
+  }
+
+ private:
+  const size_t k_;
+  std::vector<ScoredIndex> heap_;
+};
+
+}  // namespace
+
+absl::StatusOr<VectorMetric> ParseVectorMetric(absl::string_view name) {
+  if (name == "cosine") {
+    return VectorMetric::kCosine;
+  }
+  if (name == "dot") {
+    return VectorMetric::kDotProduct;
+  }
+  if (name == "l2") {
+    return VectorMetric::kL2;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unsupported metric: ", name,
+                   "; expected one of \"cosine\", \"dot\" or \"l2\"."));
+}
+
+absl::string_view VectorKernelIsa() { return GetKernels().isa; }
+
+float DotProduct(absl::Span<const float> a, absl::Span<const float> b) {
+  return GetKernels().dot(a.data(), b.data(), a.size());
+}
+
+float SquaredL2Distance(absl::Span<const float> a, absl::Span<const float> b) {
+  return GetKernels().squared_l2(a.data(), b.data(), a.size());
+}
+
+float CosineSimilarity(absl::Span<const float> a, absl::Span<const float> b) {
+  const Kernels& kernels = GetKernels();
+  float dot;
+  float squared_norm_b;
+  kernels.dot_and_norm(a.data(), b.data(), a.size(), &dot, &squared_norm_b);
+  return Cosine(dot, kernels.dot(a.data(), a.data(), a.size()),
+                squared_norm_b);
+}
+
+float Score(VectorMetric metric, absl::Span<const float> a,
+            absl::Span<const float> b) {
+  switch (metric) {
+    case VectorMetric::kCosine:
+      return CosineSimilarity(a, b);
+    case VectorMetric::kDotProduct:
+      return DotProduct(a, b);
+    case VectorMetric::kL2:
+      return -SquaredL2Distance(a, b);
+  }
+  return 0.0f;
+}
+
+void Normalize(absl::Span<float> v) {
+  const float squared_norm = DotProduct(v, v);
+  if (squared_norm <= 0.0f) {
+    return;
+  }
+  const float inv_norm = 1.0f / std::sqrt(squared_norm);
+  for (float& x : v) {
+    x *= inv_norm;
+  }
+}
+
+QuantizedVector Quantize(absl::Span<const float> v) {
+  QuantizedVector quantized;
+  quantized.values.resize(v.size());
+  float max_abs = 0.0f;
+  for (float x : v) {
+    max_abs = std::max(max_abs, std::abs(x));
+  }
+  if (max_abs == 0.0f) {
+    return quantized;
+  }
+  quantized.scale = max_abs / 127.0f;
+  const float inv_scale = 127.0f / max_abs;
+  for (size_t i = 0; i < v.size(); ++i) {
+    quantized.values[i] = static_cast<int8_t>(
+        std::clamp(std::lrint(v[i] * inv_scale), -127L, 127L));
+  }
+  quantized.squared_norm = DotProduct(quantized.values, quantized.values);
+  return quantized;
+}
+
+int32_t DotProduct(absl::Span<const int8_t> a, absl::Span<const int8_t> b) {
+  return GetKernels().dot_int8(a.data(), b.data(), a.size());
+}
+
+float Score(VectorMetric metric, const QuantizedVector& a,
+            const QuantizedVector& b) {
+  const float dot = DotProduct(a.values, b.values);
+  switch (metric) {
+    case VectorMetric::kCosine:
+      // The scales cancel out.
+      return Cosine(dot, a.squared_norm, b.squared_norm);
+    case VectorMetric::kDotProduct:
+      return a.scale * b.scale * dot;
+    case VectorMetric::kL2:
+      return 2.0f * a.scale * b.scale * dot -
+             a.scale * a.scale * a.squared_norm -
+             b.scale * b.scale * b.squared_norm;
+  }
+  return 0.0f;
+}
+
+std::vector<ScoredIndex> TopK(VectorMetric metric,
+                              absl::Span<const float> query,
+                              absl::Span<const float> matrix, int k) {
+  const size_t dim = query.size();
+  if (k <= 0 || dim == 0) {
+    return {};
+  }
+  const Kernels& kernels = GetKernels();
+  const float* const q = query.data();
+  const float squared_norm_q =
+      metric == VectorMetric::kCosine ? kernels.dot(q, q, dim) : 0.0f;
+  const int num_rows = matrix.size() / dim;
+  TopKCollector collector(std::min(k, num_rows));
+  for (int i = 0; i < num_rows; ++i) {
+    const float* const row = matrix.data() + i * dim;
+    float score;
+    switch (metric) {
+      case VectorMetric::kCosine: {
+        float squared_norm_row;
+        kernels.dot_and_norm(q, row, dim, &score, &squared_norm_row);
+        score = Cosine(score, squared_norm_q, squared_norm_row);
+        break;
+      }
+      case VectorMetric::kDotProduct:
+        score = kernels.dot(q, row, dim);
+        break;
+      case VectorMetric::kL2:
+        score = -kernels.squared_l2(q, row, dim);
+        break;
+    }
+    collector.Add(i, score);
+  }
+  return std::move(collector).Finish();
+}
+
+std::vector<ScoredIndex> TopK(VectorMetric metric,
+                              const QuantizedVector& query,
+                              absl::Span<const QuantizedVector> rows, int k) {
+  if (k <= 0) {
+    return {};
+  }
+  const int num_rows = rows.size();
+  TopKCollector collector(std::min(k, num_rows));
+  for (int i = 0; i < num_rows; ++i) {
+    collector.Add(i, Score(metric, query, rows[i]));
+  }
+  return std::move(collector).Finish();
+}
+
+namespace scalar {
+
+float DotProduct(absl::Span<const float> a, absl::Span<const float> b) {
+  return ScalarDot(a.data(), b.data(), a.size());
+}
+
+float SquaredL2Distance(absl::Span<const float> a, absl::Span<const float> b) {
+  return ScalarSquaredL2(a.data(), b.data(), a.size());
+}
+
+int32_t DotProduct(absl::Span<const int8_t> a, absl::Span<const int8_t> b) {
+  return ScalarDotInt8(a.data(), b.data(), a.size());
+}
+
+}  // namespace scalar
+}  // namespace genc
@@ -0,0 +1,114 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_MODULES_VECTOR_VECTOR_MATH_H_
+#define GENC_CC_MODULES_VECTOR_VECTOR_MATH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+// Vector similarity kernels over float32 and int8-quantized vectors.
+//
+// The kernels dispatch once per process to the widest instruction set the CPU
+// supports: AVX2 with FMA on x86-64 (detected at runtime, so the library needs
+// no special compiler flags), NEON on AArch64, and portable scalar loops
+// everywhere else. All functions expect vectors of equal length.
+
+namespace genc {
+
+// How to compare two vectors. Scores are always "higher is more similar".
+enum class VectorMetric {
+  // Cosine of the angle between the vectors, in [-1, 1].
+  kCosine,
+  // Dot product, which equals the cosine for normalized vectors.
+  kDotProduct,
+  // Negated squared Euclidean distance.
+  kL2,
+};
+
+// Parses "cosine", "dot" or "l2".
+absl::StatusOr<VectorMetric> ParseVectorMetric(absl::string_view name);
+
+// Returns the instruction set the kernels dispatch to: "avx2", "neon" or
+// "scalar".
+absl::string_view VectorKernelIsa();
+
+float DotProduct(absl::Span<const float> a, absl::Span<const float> b);
+
+float SquaredL2Distance(absl::Span<const float> a, absl::Span<const float> b);
+
+// Returns zero if either vector is zero.
+float CosineSimilarity(absl::Span<const float> a, absl::Span<const float> b);
+
+float Score(VectorMetric metric, absl::Span<const float> a,
+            absl::Span<const float> b);
+
+// Scales `v` to unit length. Leaves zero vectors unchanged.
+void Normalize(absl::Span<float> v);
+
+// A vector quantized symmetrically to int8, such that `values[i] * scale`
+// approximates the original `i`-th element. Quantizing cuts the memory (and
+// memory bandwidth) of stored vectors by 4x, at a small loss of precision.
+struct QuantizedVector {
+  std::vector<int8_t> values;
+  float scale = 0.0f;
+  // Sum of the squares of `values`, for the cosine and L2 metrics.
+  int32_t squared_norm = 0;
+};
+
+QuantizedVector Quantize(absl::Span<const float> v);
+
+int32_t DotProduct(absl::Span<const int8_t> a, absl::Span<const int8_t> b);
+
+// Approximates the score of the original vectors.
+float Score(VectorMetric metric, const QuantizedVector& a,
+            const QuantizedVector& b);
+
+struct ScoredIndex {
+  int index;
+  float score;
+};
+
+// Returns the (at most) `k` rows of the row-major `matrix` most similar to
+// `query`, most similar first. Each row has `query.size()` elements. Ties are
+// broken in favor of the lower index.
+std::vector<ScoredIndex> TopK(VectorMetric metric,
+                              absl::Span<const float> query,
+                              absl::Span<const float> matrix, int k);
+
+// Same as above, over quantized rows.
+std::vector<ScoredIndex> TopK(VectorMetric metric,
+                              const QuantizedVector& query,
+                              absl::Span<const QuantizedVector> rows, int k);
+
+// Portable implementations of the kernels above that the dispatched ones are
+// checked and benchmarked against.
+namespace scalar {
+
+float DotProduct(absl::Span<const float> a, absl::Span<const float> b);
+
+float SquaredL2Distance(absl::Span<const float> a, absl::Span<const float> b);
+
+int32_t DotProduct(absl::Span<const int8_t> a, absl::Span<const int8_t> b);
+
+}  // namespace scalar
+
+}  // namespace genc
+
+#endif  // GENC_CC_MODULES_VECTOR_VECTOR_MATH_H_
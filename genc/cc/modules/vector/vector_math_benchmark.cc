@@ -0,0 +1,144 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Compares the dispatched vector kernels against their scalar counterparts,
+// and measures batched top-k over float and int8-quantized rows, for
+// embedding-sized vectors.
+
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "genc/cc/modules/vector/vector_math.h"
+
+ABSL_FLAG(int, dim, 768, "Number of elements per vector.");
+ABSL_FLAG(int, num_rows, 10000, "Number of rows to score per query.");
+ABSL_FLAG(int, k, 10, "Number of results per top-k query.");
+ABSL_FLAG(int, num_queries, 20, "Number of queries per measurement.");
+
+namespace genc {
+namespace {
+
+// Runs `score_all` (which scores every row once) `num_queries` times, and
+// prints the time per row.
+template <typename ScoreAllFn>
+void Report(const std::string& name, int num_queries, int num_rows,
+            ScoreAllFn score_all) {
+  double checksum = 0.0;
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < num_queries; ++i) {
+    checksum += score_all();
+  }
+  const absl::Duration per_row =
+      (absl::Now() - start) / (static_cast<int64_t>(num_queries) * num_rows);
+  std::cout << name << ": " << absl::ToDoubleNanoseconds(per_row)
+            << " ns/row (checksum " << checksum << ")\n";
+}
+
+void Run() {
+  const int dim = absl::GetFlag(FLAGS_dim);
+  const int num_rows = absl::GetFlag(FLAGS_num_rows);
+  const int k = absl::GetFlag(FLAGS_k);
+  const int num_queries = absl::GetFlag(FLAGS_num_queries);
+
+  std::mt19937 rng(42);
+  std::normal_distribution<float> distribution;
+  std::vector<float> query(dim);
+  for (float& x : query) {
+    x = distribution(rng);
+  }
+  std::vector<float> matrix(static_cast<size_t>(dim) * num_rows);
+  for (float& x : matrix) {
+    x = distribution(rng);
+  }
+  const QuantizedVector quantized_query = Quantize(query);
+  std::vector<QuantizedVector> quantized_rows;
+  quantized_rows.reserve(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    quantized_rows.push_back(
+        Quantize(absl::MakeConstSpan(matrix).subspan(i * dim, dim)));
+  }
+  auto row = [&](int i) {
+    return absl::MakeConstSpan(matrix).subspan(i * dim, dim);
+  };
+
+  std::cout << "isa=" << VectorKernelIsa() << " dim=" << dim
+            << " num_rows=" << num_rows << "\n";
+  Report("scalar dot", num_queries, num_rows, [&]() {
+    float sum = 0.0f;
+    for (int i = 0; i < num_rows; ++i) {
+      sum += scalar::DotProduct(query, row(i));
+    }
+    return sum;
+  });
+  Report("simd dot", num_queries, num_rows, [&]() {
+    float sum = 0.0f;
+    for (int i = 0; i < num_rows; ++i) {
+      sum += DotProduct(query, row(i));
+    }
+    return sum;
+  });
+  Report("scalar l2", num_queries, num_rows, [&]() {
+    float sum = 0.0f;
+    for (int i = 0; i < num_rows; ++i) {
+      sum += scalar::SquaredL2Distance(query, row(i));
+    }
+    return sum;
+  });
+  Report("simd l2", num_queries, num_rows, [&]() {
+    float sum = 0.0f;
+    for (int i = 0; i < num_rows; ++i) {
+      sum += SquaredL2Distance(query, row(i));
+    }
+    return sum;
+  });
+  Report("scalar int8 dot", num_queries, num_rows, [&]() {
+    int64_t sum = 0;
+    for (const QuantizedVector& quantized_row : quantized_rows) {
+      sum += scalar::DotProduct(quantized_query.values, quantized_row.values);
+    }
+    return sum;
+  });
+  Report("simd int8 dot", num_queries, num_rows, [&]() {
+    int64_t sum = 0;
+    for (const QuantizedVector& quantized_row : quantized_rows) {
+      sum += DotProduct(quantized_query.values, quantized_row.values);
+    }
+    return sum;
+  });
+  Report("top-k cosine", num_queries, num_rows, [&]() {
+    return TopK(VectorMetric::kCosine, query, matrix, k)[0].index;
+  });
+  Report("top-k cosine int8", num_queries, num_rows, [&]() {
+    return TopK(VectorMetric::kCosine, quantized_query, quantized_rows, k)[0]
+        .index;
+  });
+}
+
+}  // namespace
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  genc::Run();
+  return 0;
+}
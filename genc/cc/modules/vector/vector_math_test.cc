@@ -0,0 +1,148 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/modules/vector/vector_math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace genc {
+namespace {
+
+std::vector<float> RandomVector(int size, std::mt19937& rng) {
+  std::normal_distribution<float> distribution;
+  std::vector<float> v(size);
+  for (float& x : v) {
+    x = distribution(rng);
+  }
+  return v;
+}
+
+TEST(VectorMathTest, KernelsMatchScalarCodeForAllSizes) {
+  std::mt19937 rng(42);
+  // Covers sizes below, at and between multiples of every vector width.
+  for (int size = 0; size <= 70; ++size) {
+    const std::vector<float> a = RandomVector(size, rng);
+    const std::vector<float> b = RandomVector(size, rng);
+    EXPECT_NEAR(DotProduct(a, b), scalar::DotProduct(a, b), 1e-3f) << size;
+    EXPECT_NEAR(SquaredL2Distance(a, b), scalar::SquaredL2Distance(a, b),
+                1e-3f)
+        << size;
+
+    std::vector<int8_t> qa(size);
+    std::vector<int8_t> qb(size);
+    for (int i = 0; i < size; ++i) {
+      qa[i] = static_cast<int8_t>(rng());
+      qb[i] = static_cast<int8_t>(rng());
+    }
+    EXPECT_EQ(DotProduct(qa, qb), scalar::DotProduct(qa, qb)) << size;
+  }
+}
+
+TEST(VectorMathTest, CosineSimilarity) {
+  const std::vector<float> a = {1.0f, 0.0f};
+  const std::vector<float> b = {1.0f, 1.0f};
+  const std::vector<float> zero = {0.0f, 0.0f};
+  EXPECT_NEAR(CosineSimilarity(a, b), std::sqrt(0.5f), 1e-6f);
+  EXPECT_NEAR(CosineSimilarity(b, b), 1.0f, 1e-6f);
+  EXPECT_EQ(CosineSimilarity(a, zero), 0.0f);
+}
+
+TEST(VectorMathTest, NormalizeScalesToUnitLength) {
+  std::vector<float> v = {3.0f, 4.0f};
+  Normalize(absl::MakeSpan(v));
+  EXPECT_THAT(v, testing::ElementsAre(testing::FloatNear(0.6f, 1e-6f),
+                                      testing::FloatNear(0.8f, 1e-6f)));
+
+  std::vector<float> zero = {0.0f, 0.0f};
+  Normalize(absl::MakeSpan(zero));
+  EXPECT_THAT(zero, testing::ElementsAre(0.0f, 0.0f));
+}
+
+TEST(VectorMathTest, QuantizedScoresApproximateFloatScores) {
+  std::mt19937 rng(7);
+  const std::vector<float> a = RandomVector(384, rng);
+  const std::vector<float> b = RandomVector(384, rng);
+  const QuantizedVector qa = Quantize(a);
+  const QuantizedVector qb = Quantize(b);
+  for (VectorMetric metric : {VectorMetric::kCosine, VectorMetric::kDotProduct,
+                              VectorMetric::kL2}) {
+    const float expected = Score(metric, a, b);
+    EXPECT_NEAR(Score(metric, qa, qb), expected,
+                0.02f * std::max(1.0f, std::abs(expected)));
+  }
+}
+
+TEST(VectorMathTest, TopKReturnsMostSimilarRowsFirst) {
+  const std::vector<float> query = {1.0f, 0.0f};
+  const std::vector<float> matrix = {
+      0.0f, 1.0f,   // 0: orthogonal
+      2.0f, 0.0f,   // 1: same direction, longer
+      1.0f, 1.0f,   // 2: 45 degrees
+      -1.0f, 0.0f,  // 3: opposite
+      1.0f, 0.0f,   // 4: identical
+  };
+  std::vector<ScoredIndex> top = TopK(VectorMetric::kCosine, query, matrix, 3);
+  ASSERT_EQ(top.size(), 3);
+  // Rows 1 and 4 tie, and the lower index wins.
+  EXPECT_EQ(top[0].index, 1);
+  EXPECT_EQ(top[1].index, 4);
+  EXPECT_EQ(top[2].index, 2);
+
+  top = TopK(VectorMetric::kL2, query, matrix, 2);
+  ASSERT_EQ(top.size(), 2);
+  EXPECT_EQ(top[0].index, 4);
+  EXPECT_EQ(top[0].score, 0.0f);
+  EXPECT_EQ(top[1].index, 1);
+
+  EXPECT_EQ(TopK(VectorMetric::kDotProduct, query, matrix, 10).size(), 5);
+  EXPECT_TRUE(TopK(VectorMetric::kDotProduct, query, matrix, 0).empty());
+}
+
+TEST(VectorMathTest, QuantizedTopKMatchesFloatTopK) {
+  std::mt19937 rng(3);
+  constexpr int kDim = 64;
+  const std::vector<float> query = RandomVector(kDim, rng);
+  std::vector<float> matrix;
+  std::vector<QuantizedVector> rows;
+  for (int i = 0; i < 100; ++i) {
+    const std::vector<float> row = RandomVector(kDim, rng);
+    matrix.insert(matrix.end(), row.begin(), row.end());
+    rows.push_back(Quantize(row));
+  }
+  const std::vector<ScoredIndex> expected =
+      TopK(VectorMetric::kCosine, query, matrix, 1);
+  const std::vector<ScoredIndex> actual =
+      TopK(VectorMetric::kCosine, Quantize(query), rows, 1);
+  ASSERT_EQ(actual.size(), 1);
+  EXPECT_EQ(actual[0].index, expected[0].index);
+}
+
+TEST(VectorMathTest, ParseVectorMetric) {
+  EXPECT_EQ(ParseVectorMetric("cosine").value(), VectorMetric::kCosine);
+  EXPECT_EQ(ParseVectorMetric("dot").value(), VectorMetric::kDotProduct);
+  EXPECT_EQ(ParseVectorMetric("l2").value(), VectorMetric::kL2);
+  EXPECT_FALSE(ParseVectorMetric("manhattan").ok());
+}
+
+}  // namespace
+}  // namespace genc
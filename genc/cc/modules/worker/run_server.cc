@@ -60,7 +60,7 @@ absl::Status RunServer(
     std::shared_ptr<Executor> executor, const RunServerOptions& options) {
   std::shared_ptr<grpc::ServerCredentials> creds = GENC_TRY(GetCreds(options));
   std::shared_ptr<v0::Executor::Service> executor_service =
-      GENC_TRY(CreateExecutorService(executor));
+      GENC_TRY(CreateExecutorService(executor, options.executor_service));
   grpc::ServerBuilder builder;
   builder.AddListeningPort(options.server_address, creds);
   std::shared_ptr<oak::session::v1::UnarySession::Service> oak_service;
@@ -21,6 +21,7 @@ limitations under the License
 
 #include "absl/status/status.h"
 #include "genc/cc/runtime/executor.h"
+#include "genc/cc/runtime/executor_service.h"
 
 namespace genc {
 namespace modules {
@@ -37,6 +38,7 @@ struct RunServerOptions {
   std::string ssl_key_path;
   bool use_oak = false;
   bool debug = false;
+  ExecutorServiceOptions executor_service;
 };
 
 absl::Status RunServer(
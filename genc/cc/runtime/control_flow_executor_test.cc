@@ -28,9 +28,11 @@ limitations under the License
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "genc/cc/authoring/constructor.h"
+#include "genc/cc/base/float_tensor.h"
 #include "genc/cc/intrinsics/custom_function.h"
 #include "genc/cc/intrinsics/handler_sets.h"
 #include "genc/cc/intrinsics/model_inference.h"
+#include "genc/cc/intrinsics/regex_router.h"
 #include "genc/cc/runtime/executor.h"
 #include "genc/cc/runtime/inline_executor.h"
 #include "genc/cc/runtime/intrinsic_handler.h"
@@ -185,6 +187,178 @@ TEST_F(ControlFlowExecutorTest, ConditionalSelectTheRightBranchForExecution) {
   EXPECT_EQ(result.str(), "call append_foo_fn:foo");
 }
 
+TEST_F(ControlFlowExecutorTest, RegexRouterDispatchesToFirstMatchingRoute) {
+  intrinsics::ModelInference::InferenceMap inference_map;
+  for (const std::string suffix : {"foo", "bar", "baz"}) {
+    inference_map[absl::StrCat("append_", suffix)] =
+        [suffix](const v0::Value& arg) {
+          v0::Value result;
+          result.set_str(absl::StrCat(arg.str(), suffix));
+          return result;
+        };
+  }
+
+  std::shared_ptr<Executor> executor =
+      CreateTestControlFlowExecutor(&inference_map).value();
+  Runner runner = Runner::Create(executor).value();
+
+  v0::Value comp_pb =
+      CreateRegexRouter(
+          {{"Action: fo+", CreateModelInference("append_foo").value()},
+           {"Action: \\w+", CreateModelInference("append_bar").value()}},
+          /*default_fn=*/CreateModelInference("append_baz").value())
+          .value();
+
+  // Both routes match, but the first one listed wins.
+  v0::Value arg;
+  arg.set_str("Action: foo:");
+  v0::Value result = runner.Run(comp_pb, arg).value();
+  EXPECT_EQ(result.str(), "Action: foo:foo");
+
+  arg.set_str("Action: search:");
+  result = runner.Run(comp_pb, arg).value();
+  EXPECT_EQ(result.str(), "Action: search:bar");
+
+  arg.set_str("Finish:");
+  result = runner.Run(comp_pb, arg).value();
+  EXPECT_EQ(result.str(), "Finish:baz");
+}
+
+TEST_F(ControlFlowExecutorTest, RegexRouterWithoutDefaultFailsWhenNoneMatch) {
+  std::shared_ptr<Executor> executor = CreateTestControlFlowExecutor().value();
+  Runner runner = Runner::Create(executor).value();
+
+  v0::Value comp_pb =
+      CreateRegexRouter({{"foo", CreateLogger().value()}}).value();
+
+  v0::Value arg;
+  arg.set_str("bar");
+  EXPECT_FALSE(runner.Run(comp_pb, arg).ok());
+}
+
+TEST_F(ControlFlowExecutorTest, RegexRouterDoesNotMixUpPatternLists) {
+  intrinsics::ModelInference::InferenceMap inference_map;
+  for (const std::string suffix : {"foo", "bar", "baz"}) {
+    inference_map[absl::StrCat("append_", suffix)] =
+        [suffix](const v0::Value& arg) {
+          v0::Value result;
+          result.set_str(absl::StrCat(arg.str(), suffix));
+          return result;
+        };
+  }
+  std::shared_ptr<Executor> executor =
+      CreateTestControlFlowExecutor(&inference_map).value();
+  Runner runner = Runner::Create(executor).value();
+
+  // The two lists have the same characters in the same order, with NUL
+  // characters in different places.
+  v0::Value first =
+      CreateRegexRouter(
+          {{std::string("a\0", 2), CreateModelInference("append_foo").value()},
+           {"b", CreateModelInference("append_bar").value()}},
+          /*default_fn=*/CreateModelInference("append_baz").value())
+          .value();
+  v0::Value second =
+      CreateRegexRouter(
+          {{"a", CreateModelInference("append_foo").value()},
+           {std::string("\0b", 2), CreateModelInference("append_bar").value()}},
+          /*default_fn=*/CreateModelInference("append_baz").value())
+          .value();
+
+  v0::Value arg;
+  arg.set_str("b:");
+  EXPECT_EQ(runner.Run(first, arg).value().str(), "b:bar");
+  EXPECT_EQ(runner.Run(second, arg).value().str(), "b:baz");
+}
+
+TEST_F(ControlFlowExecutorTest, RegexRouterRoutesMorePatternListsThanCached) {
+  intrinsics::ModelInference::InferenceMap inference_map;
+  inference_map["append_foo"] = [](const v0::Value& arg) {
+    v0::Value result;
+    result.set_str(absl::StrCat(arg.str(), "foo"));
+    return result;
+  };
+  std::shared_ptr<Executor> executor =
+      CreateTestControlFlowExecutor(&inference_map).value();
+  Runner runner = Runner::Create(executor).value();
+
+  // Each router has its own pattern list, as if built per request, so the
+  // first ones are evicted and compiled again.
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < 2 * intrinsics::RegexRouter::kMaxCompiledPatterns;
+         ++i) {
+      v0::Value comp_pb =
+          CreateRegexRouter({{absl::StrCat("route", i, "$"),
+                              CreateModelInference("append_foo").value()}})
+              .value();
+      v0::Value arg;
+      arg.set_str(absl::StrCat("route", i));
+      EXPECT_EQ(runner.Run(comp_pb, arg).value().str(),
+                absl::StrCat("route", i, "foo"));
+    }
+  }
+}
+
+TEST_F(ControlFlowExecutorTest, EmbedReturnsOneTensorPerString) {
+  std::shared_ptr<Executor> executor = CreateTestControlFlowExecutor().value();
+  Runner runner = Runner::Create(executor).value();
+  v0::Value comp_pb = CreateEmbed("test_model").value();
+
+  v0::Value arg;
+  arg.set_str("hello");
+  v0::Value result = runner.Run(comp_pb, arg).value();
+  EXPECT_EQ(GetFloatTensor(result).value().size(), 8);
+
+  v0::Value batch;
+  batch.mutable_struct_()->add_element()->set_str("hello");
+  batch.mutable_struct_()->add_element()->set_str("world");
+  result = runner.Run(comp_pb, batch).value();
+  ASSERT_EQ(result.struct_().element_size(), 2);
+  // Embeddings don't depend on the other strings in the batch.
+  EXPECT_EQ(GetFloatTensor(result.struct_().element(0)).value(),
+            GetFloatTensor(runner.Run(comp_pb, arg).value()).value());
+  EXPECT_NE(GetFloatTensor(result.struct_().element(0)).value(),
+            GetFloatTensor(result.struct_().element(1)).value());
+}
+
+TEST_F(ControlFlowExecutorTest, SimilarityScoresTwoTensors) {
+  std::shared_ptr<Executor> executor = CreateTestControlFlowExecutor().value();
+  Runner runner = Runner::Create(executor).value();
+  v0::Value arg;
+  *arg.mutable_struct_()->add_element() = CreateFloatTensor({3.0f, 4.0f});
+  *arg.mutable_struct_()->add_element() = CreateFloatTensor({3.0f, 0.0f});
+
+  v0::Value result = runner.Run(CreateSimilarity().value(), arg).value();
+  EXPECT_FLOAT_EQ(result.float_32(), 0.6f);
+  result = runner.Run(CreateSimilarity("dot").value(), arg).value();
+  EXPECT_FLOAT_EQ(result.float_32(), 9.0f);
+  result = runner.Run(CreateSimilarity("l2").value(), arg).value();
+  EXPECT_FLOAT_EQ(result.float_32(), -16.0f);
+}
+
+TEST_F(ControlFlowExecutorTest, TopKReturnsMostSimilarCandidates) {
+  std::shared_ptr<Executor> executor = CreateTestControlFlowExecutor().value();
+  Runner runner = Runner::Create(executor).value();
+  v0::Value arg;
+  *arg.mutable_struct_()->add_element() = CreateFloatTensor({1.0f, 0.0f});
+  v0::Struct* candidates =
+      arg.mutable_struct_()->add_element()->mutable_struct_();
+  *candidates->add_element() = CreateFloatTensor({0.0f, 1.0f});
+  *candidates->add_element() = CreateFloatTensor({1.0f, 0.1f});
+  *candidates->add_element() = CreateFloatTensor({1.0f, 1.0f});
+
+  v0::Value result = runner.Run(CreateTopK(2).value(), arg).value();
+  ASSERT_EQ(result.struct_().element_size(), 2);
+  EXPECT_EQ(result.struct_().element(0).struct_().element(0).int_32(), 1);
+  EXPECT_EQ(result.struct_().element(1).struct_().element(0).int_32(), 2);
+  EXPECT_GT(result.struct_().element(0).struct_().element(1).float_32(),
+            result.struct_().element(1).struct_().element(1).float_32());
+
+  // Candidates must have the size of the query.
+  *candidates->add_element() = CreateFloatTensor({1.0f});
+  EXPECT_FALSE(runner.Run(CreateTopK(2).value(), arg).ok());
+}
+
 TEST_F(ControlFlowExecutorTest, WhileLoopExecutionTest) {
   // Create a test condition_fn that pumps the while loop.
   v0::Value test_condition_fn =
@@ -57,8 +57,9 @@ absl::StatusOr<ValueId> RefToValueId(v0::ValueRef ref) {
 // maps incoming calls to an underlying implementation of C++ `Executor` API.
 class ExecutorService : public v0::Executor::Service {
  public:
-  explicit ExecutorService(std::shared_ptr<Executor> executor)
-      : executor_(executor) {}
+  ExecutorService(std::shared_ptr<Executor> executor,
+                  const ExecutorServiceOptions& options)
+      : executor_(executor), options_(options) {}
 
   ~ExecutorService() override {}
 
@@ -146,6 +147,10 @@ class ExecutorService : public v0::Executor::Service {
     }
     absl::Status status =
         executor_->Materialize(val.value(), response->mutable_value());
+    if (options_.compression != GRPC_COMPRESS_NONE &&
+        response->ByteSizeLong() >= options_.min_compressed_bytes) {
+      context->set_compression_algorithm(options_.compression);
+    }
     return AbslToGrpcStatus(status);
   }
 
@@ -175,11 +180,17 @@ class ExecutorService : public v0::Executor::Service {
 
  private:
   const std::shared_ptr<Executor> executor_;
+  const ExecutorServiceOptions options_;
 };
 
 absl::StatusOr<std::shared_ptr<v0::Executor::Service>> CreateExecutorService(
     std::shared_ptr<Executor> executor) {
-  return std::make_shared<ExecutorService>(executor);
+  return CreateExecutorService(executor, ExecutorServiceOptions());
+}
+
+absl::StatusOr<std::shared_ptr<v0::Executor::Service>> CreateExecutorService(
+    std::shared_ptr<Executor> executor, const ExecutorServiceOptions& options) {
+  return std::make_shared<ExecutorService>(executor, options);
 }
 
 }  // namespace genc
@@ -16,17 +16,30 @@ limitations under the License
 #ifndef GENC_CC_RUNTIME_EXECUTOR_SERVICE_H_
 #define GENC_CC_RUNTIME_EXECUTOR_SERVICE_H_
 
+#include <cstddef>
 #include <memory>
 
 #include "absl/status/statusor.h"
 #include "genc/cc/runtime/executor.h"
 #include "genc/proto/v0/executor.grpc.pb.h"
+#include "include/grpc/compression.h"
 
 namespace genc {
 
+struct ExecutorServiceOptions {
+  // Compresses the materialized values of at least `min_compressed_bytes`
+  // sent back to clients with this algorithm, e.g. GRPC_COMPRESS_GZIP, if
+  // they accept it, as RemoteExecutor does. Off by default.
+  grpc_compression_algorithm compression = GRPC_COMPRESS_NONE;
+  size_t min_compressed_bytes = 16 * 1024;
+};
+
 absl::StatusOr<std::shared_ptr<v0::Executor::Service>> CreateExecutorService(
      std::shared_ptr<Executor> executor);
 
+absl::StatusOr<std::shared_ptr<v0::Executor::Service>> CreateExecutorService(
+    std::shared_ptr<Executor> executor, const ExecutorServiceOptions& options);
+
 }  // namespace genc
 
 #endif  // GENC_CC_RUNTIME_EXECUTOR_SERVICE_H_
@@ -84,9 +84,11 @@ class RemoteExecutor : public ExecutorBase<ValueFuture> {
  public:
   explicit RemoteExecutor(
       std::unique_ptr<ExecutorStub> stub,
-      std::shared_ptr<ConcurrencyInterface> concurrency_interface)
+      std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+      const RemoteExecutorOptions& options)
       : executor_stub_(stub.release()),
-        concurrency_interface_(concurrency_interface) {}
+        concurrency_interface_(concurrency_interface),
+        options_(options) {}
 
   ~RemoteExecutor() override = default;
 
@@ -104,6 +106,10 @@ class RemoteExecutor : public ExecutorBase<ValueFuture> {
           v0::CreateValueRequest request;
           v0::CreateValueResponse response;
           *request.mutable_value() = val_pb;
+          if (options_.compression != GRPC_COMPRESS_NONE &&
+              request.ByteSizeLong() >= options_.min_compressed_bytes) {
+            client_context.set_compression_algorithm(options_.compression);
+          }
           grpc::Status status = executor_stub_->CreateValue(
               &client_context, request, &response);
           GENC_TRY(GrpcToAbslStatus(status));
@@ -197,6 +203,7 @@ class RemoteExecutor : public ExecutorBase<ValueFuture> {
  private:
   const std::shared_ptr<ExecutorStub> executor_stub_;
   const std::shared_ptr<ConcurrencyInterface> concurrency_interface_;
+  const RemoteExecutorOptions options_;
 };
 
 }  // namespace
@@ -204,8 +211,17 @@ class RemoteExecutor : public ExecutorBase<ValueFuture> {
 absl::StatusOr<std::shared_ptr<Executor>> CreateRemoteExecutor(
     std::unique_ptr<v0::Executor::StubInterface> executor_stub,
     std::shared_ptr<ConcurrencyInterface> concurrency_interface) {
-  return std::make_shared<RemoteExecutor>(std::move(executor_stub),
-                                          std::move(concurrency_interface));
+  return CreateRemoteExecutor(std::move(executor_stub),
+                              std::move(concurrency_interface),
+                              RemoteExecutorOptions());
+}
+
+absl::StatusOr<std::shared_ptr<Executor>> CreateRemoteExecutor(
+    std::unique_ptr<v0::Executor::StubInterface> executor_stub,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+    const RemoteExecutorOptions& options) {
+  return std::make_shared<RemoteExecutor>(
+      std::move(executor_stub), std::move(concurrency_interface), options);
 }
 
 }  // namespace genc
@@ -16,20 +16,35 @@ limitations under the License
 #ifndef GENC_CC_RUNTIME_REMOTE_EXECUTOR_H_
 #define GENC_CC_RUNTIME_REMOTE_EXECUTOR_H_
 
+#include <cstddef>
 #include <memory>
 
 #include "absl/status/statusor.h"
 #include "genc/cc/runtime/concurrency.h"
 #include "genc/cc/runtime/executor.h"
 #include "genc/proto/v0/executor.grpc.pb.h"
+#include "include/grpc/compression.h"
 
 namespace genc {
 
+struct RemoteExecutorOptions {
+  // Compresses the values of at least `min_compressed_bytes` sent to the
+  // backend with this algorithm, e.g. GRPC_COMPRESS_GZIP. The backend
+  // decompresses them on its own. Off by default.
+  grpc_compression_algorithm compression = GRPC_COMPRESS_NONE;
+  size_t min_compressed_bytes = 16 * 1024;
+};
+
 // Creates an executor that forwards all requests to a remote backend.
 absl::StatusOr<std::shared_ptr<Executor>> CreateRemoteExecutor(
     std::unique_ptr<v0::Executor::StubInterface> executor_stub,
     std::shared_ptr<ConcurrencyInterface> concurrency_interface);
 
+absl::StatusOr<std::shared_ptr<Executor>> CreateRemoteExecutor(
+    std::unique_ptr<v0::Executor::StubInterface> executor_stub,
+    std::shared_ptr<ConcurrencyInterface> concurrency_interface,
+    const RemoteExecutorOptions& options);
+
 }  // namespace genc
 
 #endif  // GENC_CC_RUNTIME_REMOTE_EXECUTOR_H_
@@ -0,0 +1,288 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/testing/fake_model_server.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/cc/testing/http_test_server.h"
+#include <nlohmann/json.hpp>
+
+namespace genc {
+namespace testing {
+
+namespace {
+
+constexpr char kGenerateContent[] = ":generateContent";
+constexpr char kStreamGenerateContent[] = ":streamGenerateContent";
+constexpr char kChatCompletions[] = "/v1/chat/completions";
+
+std::string MakeText(int num_words) {
+  static constexpr absl::string_view kWords[] = {
+      "the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog."};
+  std::string text;
+  for (int i = 0; i < num_words; ++i) {
+    absl::StrAppend(&text, i == 0 ? "" : " ",
+                    kWords[i % std::size(kWords)]);
+  }
+  return text;
+}
+
+// Splits `text` into `n` pieces of about as many words.
+std::vector<std::string> Split(absl::string_view text, int n) {
+  std::vector<size_t> spaces;
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == ' ') spaces.push_back(i);
+  }
+  n = std::clamp<int>(n, 1, spaces.size() + 1);
+  std::vector<std::string> pieces;
+  size_t start = 0;
+  for (int i = 1; i < n; ++i) {
+    // Each piece but the first starts with the space before its first word.
+    const size_t end = spaces[i * (spaces.size() + 1) / n - 1];
+    pieces.emplace_back(text.substr(start, end - start));
+    start = end;
+  }
+  pieces.emplace_back(text.substr(start));
+  return pieces;
+}
+
+// Roughly, as models count about 4 bytes of English per token.
+int NumTokens(absl::string_view text) { return (text.size() + 3) / 4; }
+
+nlohmann::json GeminiResponse(const std::string& text,
+                              const char* finish_reason) {
+  nlohmann::json candidate = {
+      {"content",
+       {{"parts", nlohmann::json::array({{{"text", text}}})},
+        {"role", "model"}}},
+      {"index", 0}};
+  if (finish_reason != nullptr) candidate["finishReason"] = finish_reason;
+  return {{"candidates", nlohmann::json::array({candidate})}};
+}
+
+nlohmann::json Usage(int prompt_tokens, int completion_tokens, bool gemini) {
+  if (gemini) {
+    return {{"promptTokenCount", prompt_tokens},
+            {"candidatesTokenCount", completion_tokens},
+            {"totalTokenCount", prompt_tokens + completion_tokens}};
+  }
+  return {{"prompt_tokens", prompt_tokens},
+          {"completion_tokens", completion_tokens},
+          {"total_tokens", prompt_tokens + completion_tokens}};
+}
+
+nlohmann::json OpenAiChoice(const char* key, nlohmann::json message,
+                            const char* finish_reason) {
+  return {{"index", 0},
+          {key, std::move(message)},
+          {"finish_reason", finish_reason != nullptr
+                                ? nlohmann::json(finish_reason)
+                                : nlohmann::json()}};
+}
+
+nlohmann::json OpenAiResponse(const std::string& model, const char* object,
+                              nlohmann::json choice) {
+  return {{"id", "chatcmpl-fake"},
+          {"object", object},
+          {"created", 0},
+          {"model", model},
+          {"choices", nlohmann::json::array({std::move(choice)})}};
+}
+
+HttpTestServer::Response JsonResponse(int status, const nlohmann::json& body) {
+  HttpTestServer::Response response;
+  response.status = status;
+  response.headers.emplace_back("Content-Type", "application/json");
+  response.body = body.dump();
+  return response;
+}
+
+HttpTestServer::Response EventStream(std::vector<std::string> events) {
+  HttpTestServer::Response response;
+  response.headers.emplace_back("Content-Type", "text/event-stream");
+  response.stream = std::move(events);
+  return response;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<FakeModelServer>> FakeModelServer::Start(
+    Options options) {
+  std::unique_ptr<FakeModelServer> server(
+      new FakeModelServer(std::move(options)));
+  HttpTestServer::Options server_options;
+  server_options.socket_path = server->options_.socket_path;
+  FakeModelServer* handler = server.get();
+  server->server_ = GENC_TRY(HttpTestServer::Start(
+      [handler](const HttpTestServer::Request& request) {
+        return handler->Handle(request);
+      },
+      server_options));
+  return server;
+}
+
+FakeModelServer::FakeModelServer(Options options)
+    : options_(std::move(options)), text_(MakeText(options_.response_words)) {}
+
+std::string FakeModelServer::GeminiUrl(absl::string_view model) const {
+  return server_->Url(absl::StrCat("/v1beta/models/", model, kGenerateContent));
+}
+
+std::string FakeModelServer::OpenAiUrl() const {
+  return server_->Url(kChatCompletions);
+}
+
+absl::Duration FakeModelServer::SampleLatency() {
+  const double mean = absl::ToDoubleSeconds(options_.mean_latency);
+  if (mean <= 0) return absl::ZeroDuration();
+  absl::MutexLock lock(&mutex_);
+  switch (options_.latency) {
+    case Latency::kFixed:
+      return options_.mean_latency;
+    case Latency::kUniform:
+      return absl::Seconds(absl::Uniform<double>(bitgen_, 0, 2 * mean));
+    case Latency::kExponential:
+      return absl::Seconds(absl::Exponential<double>(bitgen_, 1 / mean));
+    case Latency::kLogNormal: {
+      // The mean of exp(N(mu, sigma^2)) is exp(mu + sigma^2 / 2).
+      const double sigma = options_.latency_sigma;
+      const double mu = std::log(mean) - sigma * sigma / 2;
+      return absl::Seconds(
+          std::exp(absl::Gaussian<double>(bitgen_, mu, sigma)));
+    }
+  }
+  return options_.mean_latency;
+}
+
+bool FakeModelServer::SampleError() {
+  if (options_.error_rate <= 0) return false;
+  absl::MutexLock lock(&mutex_);
+  return absl::Bernoulli(bitgen_, options_.error_rate);
+}
+
+HttpTestServer::Response FakeModelServer::Handle(
+    const HttpTestServer::Request& request) {
+  ++num_requests_;
+  const absl::string_view target = request.target;
+  const absl::string_view path = target.substr(0, target.find('?'));
+  const bool gemini = absl::EndsWith(path, kGenerateContent);
+  const bool gemini_stream = absl::EndsWith(path, kStreamGenerateContent);
+  const bool openai = path == kChatCompletions;
+  if (!gemini && !gemini_stream && !openai) {
+    return JsonResponse(404, {{"error", {{"code", 404},
+                                         {"message", "Not found"}}}});
+  }
+  const nlohmann::json body = nlohmann::json::parse(
+      request.body, /*cb=*/nullptr, /*allow_exceptions=*/false);
+  if (!body.is_object()) {
+    return JsonResponse(400, {{"error", {{"code", 400},
+                                         {"message", "Invalid JSON"}}}});
+  }
+  // Checked here, as nlohmann::json::value() throws on the wrong type.
+  const auto model = body.find("model");
+  const auto stream_field = body.find("stream");
+  if ((model != body.end() && !model->is_string()) ||
+      (stream_field != body.end() && !stream_field->is_boolean())) {
+    return JsonResponse(
+        400, {{"error",
+               {{"code", 400},
+                {"message",
+                 "Expected \"model\" to be a string and \"stream\" a "
+                 "boolean"}}}});
+  }
+
+  const absl::Duration latency = SampleLatency();
+  if (SampleError()) {
+    ++num_errors_;
+    HttpTestServer::Response response = JsonResponse(
+        options_.error_status,
+        {{"error",
+          {{"code", options_.error_status},
+           {"message", "Injected failure"}}}});
+    response.delay = latency;
+    return response;
+  }
+
+  const int prompt_tokens = NumTokens(request.body);
+  const int completion_tokens = NumTokens(text_);
+  const bool stream =
+      gemini_stream || (openai && body.value("stream", false));
+  if (!stream) {
+    HttpTestServer::Response response;
+    if (gemini) {
+      nlohmann::json json = GeminiResponse(text_, "STOP");
+      json["usageMetadata"] = Usage(prompt_tokens, completion_tokens, true);
+      response = JsonResponse(200, json);
+    } else {
+      nlohmann::json json = OpenAiResponse(
+          body.value("model", ""), "chat.completion",
+          OpenAiChoice("message",
+                       {{"role", "assistant"}, {"content", text_}}, "stop"));
+      json["usage"] = Usage(prompt_tokens, completion_tokens, false);
+      response = JsonResponse(200, json);
+    }
+    response.delay =
+        latency + std::max(options_.stream_chunks - 1, 0) *
+                      options_.stream_interval;
+    return response;
+  }
+
+  const std::vector<std::string> pieces = Split(text_, options_.stream_chunks);
+  std::vector<std::string> events;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    const bool last = i + 1 == pieces.size();
+    if (gemini_stream) {
+      nlohmann::json json =
+          GeminiResponse(pieces[i], last ? "STOP" : nullptr);
+      if (last) {
+        json["usageMetadata"] = Usage(prompt_tokens, completion_tokens, true);
+      }
+      events.push_back(absl::StrCat("data: ", json.dump(), "\r\n\r\n"));
+    } else {
+      nlohmann::json delta = {{"content", pieces[i]}};
+      if (i == 0) delta["role"] = "assistant";
+      events.push_back(absl::StrCat(
+          "data: ",
+          OpenAiResponse(body.value("model", ""), "chat.completion.chunk",
+                         OpenAiChoice("delta", std::move(delta),
+                                      last ? "stop" : nullptr))
+              .dump(),
+          "\n\n"));
+    }
+  }
+  if (openai) events.back().append("data: [DONE]\n\n");
+  HttpTestServer::Response response = EventStream(std::move(events));
+  response.delay = latency;
+  response.stream_interval = options_.stream_interval;
+  return response;
+}
+
+}  // namespace testing
+}  // namespace genc
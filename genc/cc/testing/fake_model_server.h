@@ -0,0 +1,116 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_TESTING_FAKE_MODEL_SERVER_H_
+#define GENC_CC_TESTING_FAKE_MODEL_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/random/random.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "genc/cc/testing/http_test_server.h"
+
+namespace genc {
+namespace testing {
+
+// A local stand-in for the Gemini and OpenAI model APIs, for benchmarking the
+// backends that call them offline. It answers:
+//   - POST .../models/<model>:generateContent, and :streamGenerateContent
+//     with server-sent events, in the Gemini JSON shape.
+//   - POST /v1/chat/completions, streamed if the request asks for it, in the
+//     OpenAI JSON shape.
+// with made-up text, after a random latency, and fails a given fraction of
+// the requests.
+class FakeModelServer {
+ public:
+  enum class Latency {
+    // Always `mean_latency`.
+    kFixed,
+    // Uniform in [0, 2 * mean_latency].
+    kUniform,
+    kExponential,
+    // With a long tail, set by `latency_sigma`.
+    kLogNormal,
+  };
+
+  struct Options {
+    Latency latency = Latency::kFixed;
+    // Mean time before the first byte of a response.
+    absl::Duration mean_latency = absl::ZeroDuration();
+    // For kLogNormal, the standard deviation of the log of the latency.
+    double latency_sigma = 0.5;
+    // Number of words in the text of each response.
+    int response_words = 32;
+    // Fraction of requests that fail with `error_status`. Throttling statuses,
+    // 429 and 503, are retried by the HTTP clients.
+    double error_rate = 0;
+    int error_status = 500;
+    // Streamed responses send the text in this many events, this far apart.
+    // Responses that are not streamed take as long to arrive whole.
+    int stream_chunks = 8;
+    absl::Duration stream_interval = absl::ZeroDuration();
+    // Listens on this Unix domain socket, instead of a loopback TCP port.
+    std::string socket_path;
+  };
+
+  static absl::StatusOr<std::unique_ptr<FakeModelServer>> Start(
+      Options options);
+
+  FakeModelServer(const FakeModelServer&) = delete;
+  FakeModelServer& operator=(const FakeModelServer&) = delete;
+
+  // Returns the generateContent URL of `model`, as set as the endpoint of the
+  // "/cloud/gemini" models.
+  std::string GeminiUrl(absl::string_view model = "gemini-pro") const;
+  // Returns the chat completions URL, for RestCall.
+  std::string OpenAiUrl() const;
+
+  int64_t num_requests() const { return num_requests_.load(); }
+  int64_t num_errors() const { return num_errors_.load(); }
+  const HttpTestServer& http_server() const { return *server_; }
+
+  // Returns the latency of a response, drawn as `options.latency` says.
+  absl::Duration SampleLatency();
+
+ private:
+  explicit FakeModelServer(Options options);
+
+  HttpTestServer::Response Handle(const HttpTestServer::Request& request);
+  // Returns whether a response fails.
+  bool SampleError();
+
+  const Options options_;
+  // The text of every response.
+  const std::string text_;
+
+  absl::Mutex mutex_;
+  absl::BitGen bitgen_ ABSL_GUARDED_BY(mutex_);
+  std::atomic<int64_t> num_requests_ = 0;
+  std::atomic<int64_t> num_errors_ = 0;
+  // Last, so that it stops calling Handle() first.
+  std::unique_ptr<HttpTestServer> server_;
+};
+
+}  // namespace testing
+}  // namespace genc
+
+#endif  // GENC_CC_TESTING_FAKE_MODEL_SERVER_H_
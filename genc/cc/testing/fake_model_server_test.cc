@@ -0,0 +1,191 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/testing/fake_model_server.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/authoring/constructor.h"
+#include "genc/cc/interop/backends/google_ai.h"
+#include "genc/cc/intrinsics/model_inference_with_config.h"
+#include "genc/cc/intrinsics/rest_call.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/proto/v0/computation.pb.h"
+#include <nlohmann/json.hpp>
+
+namespace genc {
+namespace testing {
+
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::SizeIs;
+
+constexpr char kText[] = "the quick brown fox jumps over the lazy dog.";
+
+FakeModelServer::Options NineWords() {
+  FakeModelServer::Options options;
+  options.response_words = 9;
+  options.stream_chunks = 3;
+  return options;
+}
+
+absl::StatusOr<v0::Value> CallGemini(const std::string& model_uri,
+                                     const std::string& endpoint) {
+  intrinsics::ModelInferenceWithConfig::InferenceMap inference_map;
+  absl::Status status = GoogleAI::SetInferenceMap(inference_map);
+  if (!status.ok()) return status;
+  v0::Intrinsic intrinsic;
+  v0::Struct* parameters =
+      intrinsic.mutable_static_parameter()->mutable_struct_();
+  parameters->add_element()->set_str(model_uri);
+  v0::Struct* config = parameters->add_element()->mutable_struct_();
+  v0::Value* endpoint_pb = config->add_element();
+  endpoint_pb->set_label("endpoint");
+  endpoint_pb->set_str(endpoint);
+  v0::Value* api_key = config->add_element();
+  api_key->set_label("api_key");
+  api_key->set_str("fake");
+  v0::Value arg;
+  arg.set_str("Tell me about foxes");
+  return inference_map[model_uri](intrinsic, arg);
+}
+
+absl::StatusOr<std::string> CallRest(const std::string& url,
+                                     const std::string& json_request) {
+  v0::Value rest_call = GENC_TRY(CreateRestCall(url, "fake"));
+  v0::Value arg;
+  arg.set_str(json_request);
+  v0::Value result;
+  absl::Status status = intrinsics::RestCall().ExecuteCall(
+      rest_call.intrinsic(), arg, &result, /*context=*/nullptr);
+  if (!status.ok()) return status;
+  return result.str();
+}
+
+TEST(FakeModelServerTest, ServesGemini) {
+  auto server = FakeModelServer::Start(NineWords()).value();
+  EXPECT_EQ(CallGemini("/cloud/gemini", server->GeminiUrl()).value().str(),
+            kText);
+  EXPECT_EQ(
+      CallGemini("/cloud/gemini/stream", server->GeminiUrl()).value().str(),
+      kText);
+  EXPECT_EQ(server->num_requests(), 2);
+}
+
+TEST(FakeModelServerTest, StreamsGeminiInChunks) {
+  FakeModelServer::Options options = NineWords();
+  options.stream_interval = absl::Milliseconds(50);
+  auto server = FakeModelServer::Start(options).value();
+  std::vector<std::string> deltas;
+  const absl::Time start = absl::Now();
+  std::string text = GoogleAI::StreamGenerateContent(
+                         server->GeminiUrl(), "fake", "{}",
+                         [&](absl::string_view delta) {
+                           deltas.emplace_back(delta);
+                           return true;
+                         })
+                         .value();
+  EXPECT_EQ(text, kText);
+  EXPECT_THAT(deltas, SizeIs(3));
+  EXPECT_EQ(absl::StrJoin(deltas, ""), kText);
+  EXPECT_GE(absl::Now() - start, 2 * options.stream_interval);
+}
+
+TEST(FakeModelServerTest, ServesOpenAiChatCompletions) {
+  auto server = FakeModelServer::Start(NineWords()).value();
+  nlohmann::json request = {
+      {"model", "gpt-4o"},
+      {"messages", {{{"role", "user"}, {"content", "Tell me about foxes"}}}}};
+
+  nlohmann::json response =
+      nlohmann::json::parse(CallRest(server->OpenAiUrl(), request.dump())
+                                .value());
+  EXPECT_EQ(response["choices"][0]["message"]["content"], kText);
+  EXPECT_EQ(response["model"], "gpt-4o");
+  EXPECT_GT(response["usage"]["total_tokens"].get<int>(), 0);
+
+  request["stream"] = true;
+  std::string events = CallRest(server->OpenAiUrl(), request.dump()).value();
+  EXPECT_THAT(events, HasSubstr("\"chat.completion.chunk\""));
+  EXPECT_THAT(events,
+              HasSubstr("\"delta\":{\"content\":\" fox jumps over\"}"));
+  EXPECT_THAT(events, HasSubstr("data: [DONE]\n\n"));
+}
+
+TEST(FakeModelServerTest, InjectsLatencyAndErrors) {
+  FakeModelServer::Options options = NineWords();
+  options.mean_latency = absl::Milliseconds(100);
+  options.error_rate = 1;
+  auto server = FakeModelServer::Start(options).value();
+  const absl::Time start = absl::Now();
+  // RestCall returns the bodies of failed calls as is.
+  EXPECT_THAT(CallRest(server->OpenAiUrl(), "{}").value(),
+              HasSubstr("Injected failure"));
+  EXPECT_GE(absl::Now() - start, options.mean_latency);
+  EXPECT_EQ(CallGemini("/cloud/gemini", server->GeminiUrl()).value().str(),
+            "");
+  EXPECT_EQ(server->num_errors(), 2);
+  EXPECT_THAT(CallRest(server->OpenAiUrl() + "/missing", "{}").value(),
+              HasSubstr("Not found"));
+}
+
+TEST(FakeModelServerTest, RejectsBadRequests) {
+  auto server = FakeModelServer::Start(NineWords()).value();
+  EXPECT_THAT(CallRest(server->OpenAiUrl(), "[]").value(),
+              HasSubstr("Invalid JSON"));
+  EXPECT_THAT(CallRest(server->OpenAiUrl(), "{\"model\": 4}").value(),
+              HasSubstr("\"code\":400"));
+  EXPECT_THAT(CallRest(server->OpenAiUrl(), "{\"stream\": \"yes\"}").value(),
+              HasSubstr("\"code\":400"));
+  EXPECT_EQ(server->num_requests(), 3);
+}
+
+TEST(FakeModelServerTest, SamplesLatencies) {
+  for (FakeModelServer::Latency latency :
+       {FakeModelServer::Latency::kFixed, FakeModelServer::Latency::kUniform,
+        FakeModelServer::Latency::kExponential,
+        FakeModelServer::Latency::kLogNormal}) {
+    FakeModelServer::Options options = NineWords();
+    options.latency = latency;
+    options.mean_latency = absl::Milliseconds(5);
+    auto server = FakeModelServer::Start(options).value();
+    // Enough samples that their mean is within a few percent of the
+    // distribution's.
+    const int kNumSamples = 10000;
+    absl::Duration sum;
+    for (int i = 0; i < kNumSamples; ++i) {
+      const absl::Duration sample = server->SampleLatency();
+      ASSERT_GE(sample, absl::ZeroDuration());
+      sum += sample;
+    }
+    const absl::Duration mean = sum / kNumSamples;
+    EXPECT_GT(mean, options.mean_latency * 0.9);
+    EXPECT_LT(mean, options.mean_latency * 1.1);
+  }
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace genc
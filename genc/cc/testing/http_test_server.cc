@@ -0,0 +1,290 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#include "genc/cc/testing/http_test_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace genc {
+namespace testing {
+
+namespace {
+
+absl::string_view ReasonPhrase(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 429:
+      return "Too Many Requests";
+    case 500:
+      return "Internal Server Error";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Status";
+  }
+}
+
+absl::Status ErrnoError(absl::string_view what) {
+  return absl::InternalError(absl::StrCat(what, ": ", std::strerror(errno)));
+}
+
+bool SendAll(int connection, absl::string_view data) {
+  while (!data.empty()) {
+    ssize_t sent = send(connection, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent <= 0) return false;
+    data.remove_prefix(sent);
+  }
+  return true;
+}
+
+// Frames `data` for chunked transfer encoding.
+std::string ChunkOf(absl::string_view data) {
+  return absl::StrCat(absl::Hex(data.size()), "\r\n", data, "\r\n");
+}
+
+}  // namespace
+
+absl::string_view HttpTestServer::Request::header(
+    absl::string_view name) const {
+  for (const auto& [key, value] : headers) {
+    if (absl::EqualsIgnoreCase(key, name)) return value;
+  }
+  return "";
+}
+
+absl::StatusOr<std::unique_ptr<HttpTestServer>> HttpTestServer::Start(
+    Handler handler, Options options) {
+  int listener;
+  int port = 0;
+  if (options.socket_path.empty()) {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) return ErrnoError("socket");
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), size) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &size) !=
+            0) {
+      close(listener);
+      return ErrnoError("bind");
+    }
+    port = ntohs(address.sin_port);
+  } else {
+    sockaddr_un address = {};
+    if (options.socket_path.size() >= sizeof(address.sun_path)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Socket path is too long: ", options.socket_path));
+    }
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return ErrnoError("socket");
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, options.socket_path.c_str(),
+                 sizeof(address.sun_path) - 1);
+    unlink(options.socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0) {
+      close(listener);
+      return ErrnoError("bind");
+    }
+  }
+  if (listen(listener, SOMAXCONN) != 0) {
+    close(listener);
+    return ErrnoError("listen");
+  }
+  return absl::WrapUnique(
+      new HttpTestServer(std::move(handler), std::move(options), listener,
+                         port));
+}
+
+HttpTestServer::HttpTestServer(Handler handler, Options options, int listener,
+                               int port)
+    : handler_(std::move(handler)),
+      options_(std::move(options)),
+      listener_(listener),
+      port_(port),
+      acceptor_([this]() { Accept(); }) {}
+
+HttpTestServer::~HttpTestServer() {
+  stop_.Notify();
+  shutdown(listener_, SHUT_RDWR);
+  acceptor_.join();
+  std::vector<std::thread> threads;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (int connection : connections_) {
+      shutdown(connection, SHUT_RDWR);
+    }
+    threads.swap(threads_);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  close(listener_);
+  if (!options_.socket_path.empty()) {
+    unlink(options_.socket_path.c_str());
+  }
+}
+
+std::string HttpTestServer::Url(absl::string_view target) const {
+  if (!options_.socket_path.empty()) {
+    return absl::StrCat("http://localhost", target);
+  }
+  return absl::StrCat("http://127.0.0.1:", port_, target);
+}
+
+void HttpTestServer::Accept() {
+  while (!stop_.HasBeenNotified()) {
+    int connection = accept(listener_, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;
+    }
+    ++num_connections_;
+    // Streamed chunks go out as soon as they are written.
+    const int no_delay = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &no_delay,
+               sizeof(no_delay));
+    absl::MutexLock lock(&mutex_);
+    connections_.push_back(connection);
+    threads_.emplace_back([this, connection]() { Serve(connection); });
+  }
+}
+
+bool HttpTestServer::Sleep(absl::Duration delay) {
+  return delay <= absl::ZeroDuration() ||
+         !stop_.WaitForNotificationWithTimeout(delay);
+}
+
+void HttpTestServer::Serve(int connection) {
+  std::string buffer;
+  char chunk[16384];
+  bool keep_alive = true;
+  while (keep_alive && !stop_.HasBeenNotified()) {
+    // Reads until the buffer holds a whole request.
+    const size_t end = buffer.find("\r\n\r\n");
+    size_t content_length = 0;
+    Request request;
+    if (end != std::string::npos) {
+      std::vector<absl::string_view> lines =
+          absl::StrSplit(absl::string_view(buffer).substr(0, end), "\r\n");
+      std::vector<absl::string_view> request_line =
+          absl::StrSplit(lines[0], absl::MaxSplits(' ', 2));
+      request.method = std::string(request_line[0]);
+      if (request_line.size() > 1) {
+        request.target = std::string(request_line[1]);
+      }
+      for (size_t i = 1; i < lines.size(); ++i) {
+        std::pair<absl::string_view, absl::string_view> header =
+            absl::StrSplit(lines[i], absl::MaxSplits(':', 1));
+        request.headers.emplace_back(
+            std::string(header.first),
+            std::string(absl::StripAsciiWhitespace(header.second)));
+      }
+      if (!absl::SimpleAtoi(request.header("Content-Length"),
+                            &content_length)) {
+        content_length = 0;
+      }
+    }
+    if (end == std::string::npos ||
+        buffer.size() < end + 4 + content_length) {
+      ssize_t size = recv(connection, chunk, sizeof(chunk), 0);
+      if (size <= 0) break;
+      buffer.append(chunk, size);
+      continue;
+    }
+    request.body = buffer.substr(end + 4, content_length);
+    buffer.erase(0, end + 4 + content_length);
+    keep_alive =
+        !absl::EqualsIgnoreCase(request.header("Connection"), "close");
+    ++num_requests_;
+
+    Response response = handler_(request);
+    if (!Sleep(response.delay)) break;
+    const bool streaming = !response.stream.empty();
+    std::string head =
+        absl::StrCat("HTTP/1.1 ", response.status, " ",
+                     ReasonPhrase(response.status), "\r\n");
+    if (streaming) {
+      absl::StrAppend(&head, "Transfer-Encoding: chunked\r\n");
+    } else {
+      absl::StrAppend(&head, "Content-Length: ", response.body.size(),
+                      "\r\n");
+    }
+    for (const auto& [key, value] : response.headers) {
+      absl::StrAppend(&head, key, ": ", value, "\r\n");
+    }
+    if (!keep_alive) {
+      absl::StrAppend(&head, "Connection: close\r\n");
+    }
+    absl::StrAppend(&head, "\r\n");
+    if (!streaming) {
+      // One write, so that the body doesn't wait for an ACK of the head.
+      absl::StrAppend(&head, response.body);
+      if (!SendAll(connection, head)) break;
+      continue;
+    }
+    bool sent = SendAll(connection, head) &&
+                (response.body.empty() ||
+                 SendAll(connection, ChunkOf(response.body)));
+    for (size_t i = 0; sent && i < response.stream.size(); ++i) {
+      // An empty chunk would end the response.
+      sent = (i == 0 || Sleep(response.stream_interval)) &&
+             (response.stream[i].empty() ||
+              SendAll(connection, ChunkOf(response.stream[i])));
+    }
+    if (!sent || !SendAll(connection, "0\r\n\r\n")) break;
+  }
+  absl::MutexLock lock(&mutex_);
+  connections_.erase(
+      std::find(connections_.begin(), connections_.end(), connection));
+  close(connection);
+}
+
+}  // namespace testing
+}  // namespace genc
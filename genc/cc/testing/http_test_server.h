@@ -0,0 +1,122 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+#ifndef GENC_CC_TESTING_HTTP_TEST_SERVER_H_
+#define GENC_CC_TESTING_HTTP_TEST_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace genc {
+namespace testing {
+
+// A local HTTP/1.1 server that stands in for remote endpoints in tests and
+// benchmarks. It listens on a loopback TCP port, or on a Unix domain socket,
+// keeps connections alive, and serves each connection on its own thread.
+class HttpTestServer {
+ public:
+  struct Request {
+    std::string method;
+    // Including the query, e.g. "/v1/models?key=x".
+    std::string target;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    // Returns the value of the first header named `name`, ignoring case, or
+    // an empty string.
+    absl::string_view header(absl::string_view name) const;
+  };
+
+  struct Response {
+    int status = 200;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    // How long the server waits before it replies.
+    absl::Duration delay = absl::ZeroDuration();
+    // If not empty, the response is streamed with chunked transfer encoding:
+    // `body`, then each of these `stream_interval` apart, e.g. for
+    // server-sent events.
+    std::vector<std::string> stream;
+    absl::Duration stream_interval = absl::ZeroDuration();
+  };
+
+  using Handler = std::function<Response(const Request& request)>;
+
+  struct Options {
+    // Listens on this Unix domain socket, instead of a loopback TCP port.
+    std::string socket_path;
+  };
+
+  // Starts serving requests with `handler`, which may be called from many
+  // threads at once.
+  static absl::StatusOr<std::unique_ptr<HttpTestServer>> Start(
+      Handler handler, Options options = {});
+
+  // Closes every connection, cutting short the delays of pending responses.
+  ~HttpTestServer();
+
+  HttpTestServer(const HttpTestServer&) = delete;
+  HttpTestServer& operator=(const HttpTestServer&) = delete;
+
+  // Returns the URL of `target` on this server. Over a Unix domain socket
+  // the host is ignored, and is "localhost".
+  std::string Url(absl::string_view target) const;
+
+  int port() const { return port_; }
+  const std::string& socket_path() const { return options_.socket_path; }
+
+  int64_t num_connections() const { return num_connections_.load(); }
+  int64_t num_requests() const { return num_requests_.load(); }
+
+ private:
+  HttpTestServer(Handler handler, Options options, int listener, int port);
+
+  void Accept();
+  void Serve(int connection);
+  // Sleeps for `delay`, or until the server stops. Returns false if it did.
+  bool Sleep(absl::Duration delay);
+
+  const Handler handler_;
+  const Options options_;
+  const int listener_;
+  const int port_;
+
+  absl::Notification stop_;
+  std::atomic<int64_t> num_connections_ = 0;
+  std::atomic<int64_t> num_requests_ = 0;
+
+  absl::Mutex mutex_;
+  std::vector<int> connections_ ABSL_GUARDED_BY(mutex_);
+  std::vector<std::thread> threads_ ABSL_GUARDED_BY(mutex_);
+  std::thread acceptor_;
+};
+
+}  // namespace testing
+}  // namespace genc
+
+#endif  // GENC_CC_TESTING_HTTP_TEST_SERVER_H_
@@ -0,0 +1,301 @@
+/* Copyright 2024, The GenC Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License
+==============================================================================*/
+
+// Drives a Runner at target rates of calls against a local FakeModelServer,
+// through the Gemini backend or a RestCall to the OpenAI chat API, and
+// reports the throughput and latency percentiles at each rate.
+//
+// Calls start on a fixed schedule, whether or not earlier calls are done, and
+// their latency counts from when they were due to start, so that a backend
+// that falls behind shows in the tail rather than slowing the load down.
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "genc/cc/authoring/constructor.h"
+#include "genc/cc/interop/backends/google_ai.h"
+#include "genc/cc/interop/networking/endpoint_limiter.h"
+#include "genc/cc/intrinsics/handler_sets.h"
+#include "genc/cc/runtime/executor.h"
+#include "genc/cc/runtime/executor_stacks.h"
+#include "genc/cc/runtime/runner.h"
+#include "genc/cc/runtime/status_macros.h"
+#include "genc/cc/runtime/threading.h"
+#include "genc/cc/testing/fake_model_server.h"
+#include "genc/proto/v0/computation.pb.h"
+#include <nlohmann/json.hpp>
+
+ABSL_FLAG(std::string, backend, "gemini",
+          "One of gemini, gemini_stream, openai or openai_stream.");
+ABSL_FLAG(std::vector<std::string>, qps,
+          std::vector<std::string>({"10", "50", "100"}),
+          "Rates of calls to measure, in calls per second.");
+ABSL_FLAG(double, duration_seconds, 10, "How long to measure each rate for.");
+ABSL_FLAG(int, max_in_flight, 256,
+          "Number of threads making calls. Calls wait for a free thread.");
+ABSL_FLAG(int, endpoint_concurrency, 0,
+          "If set, the most calls in flight to the server at once. Otherwise "
+          "the HTTP clients adapt it.");
+ABSL_FLAG(int, prompt_words, 32, "Number of words in each prompt.");
+ABSL_FLAG(std::string, latency, "fixed",
+          "Distribution of the server latency: fixed, uniform, exponential "
+          "or lognormal.");
+ABSL_FLAG(int, latency_ms, 50, "Mean server latency to the first byte.");
+ABSL_FLAG(double, latency_sigma, 0.5,
+          "Standard deviation of the log of a lognormal latency.");
+ABSL_FLAG(int, response_words, 64, "Number of words in each response.");
+ABSL_FLAG(double, error_rate, 0, "Fraction of calls the server fails.");
+ABSL_FLAG(int, error_status, 500, "HTTP status of the failed calls.");
+ABSL_FLAG(int, stream_chunks, 8, "Number of events of streamed responses.");
+ABSL_FLAG(int, stream_interval_ms, 10, "Time between streamed events.");
+
+namespace genc {
+namespace testing {
+namespace {
+
+using interop::networking::EndpointLimiter;
+
+absl::StatusOr<FakeModelServer::Latency> ParseLatency(
+    absl::string_view name) {
+  if (name == "fixed") return FakeModelServer::Latency::kFixed;
+  if (name == "uniform") return FakeModelServer::Latency::kUniform;
+  if (name == "exponential") return FakeModelServer::Latency::kExponential;
+  if (name == "lognormal") return FakeModelServer::Latency::kLogNormal;
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown latency distribution: ", name));
+}
+
+absl::StatusOr<std::unique_ptr<FakeModelServer>> StartServer() {
+  FakeModelServer::Options options;
+  options.latency = GENC_TRY(ParseLatency(absl::GetFlag(FLAGS_latency)));
+  options.mean_latency = absl::Milliseconds(absl::GetFlag(FLAGS_latency_ms));
+  options.latency_sigma = absl::GetFlag(FLAGS_latency_sigma);
+  options.response_words = absl::GetFlag(FLAGS_response_words);
+  options.error_rate = absl::GetFlag(FLAGS_error_rate);
+  options.error_status = absl::GetFlag(FLAGS_error_status);
+  options.stream_chunks = absl::GetFlag(FLAGS_stream_chunks);
+  options.stream_interval =
+      absl::Milliseconds(absl::GetFlag(FLAGS_stream_interval_ms));
+  return FakeModelServer::Start(options);
+}
+
+// Returns an executor with the Gemini backends and the default intrinsics,
+// and none of the on-device models, which are not needed here.
+absl::StatusOr<std::shared_ptr<Executor>> CreateExecutor() {
+  intrinsics::HandlerSetConfig config;
+  GENC_TRY(
+      GoogleAI::SetInferenceMap(config.model_inference_with_config_map));
+  return CreateLocalExecutor(intrinsics::CreateCompleteHandlerSet(config),
+                             CreateThreadBasedConcurrencyManager());
+}
+
+struct Workload {
+  v0::Value computation;
+  v0::Value arg;
+  // The endpoint the calls are limited by.
+  std::string endpoint;
+};
+
+absl::StatusOr<Workload> CreateWorkload(const FakeModelServer& server) {
+  const std::string backend = absl::GetFlag(FLAGS_backend);
+  std::string prompt;
+  for (int i = 0; i < absl::GetFlag(FLAGS_prompt_words); ++i) {
+    absl::StrAppend(&prompt, i == 0 ? "" : " ", "word");
+  }
+  Workload workload;
+  if (backend == "gemini" || backend == "gemini_stream") {
+    v0::Value config;
+    v0::Value* endpoint = config.mutable_struct_()->add_element();
+    endpoint->set_label("endpoint");
+    endpoint->set_str(server.GeminiUrl());
+    v0::Value* api_key = config.mutable_struct_()->add_element();
+    api_key->set_label("api_key");
+    api_key->set_str("fake");
+    workload.computation = GENC_TRY(CreateModelInferenceWithConfig(
+        backend == "gemini" ? "/cloud/gemini" : "/cloud/gemini/stream",
+        config));
+    workload.arg.set_str(prompt);
+    workload.endpoint = EndpointLimiter::EndpointOf(server.GeminiUrl());
+    return workload;
+  }
+  if (backend == "openai" || backend == "openai_stream") {
+    workload.computation =
+        GENC_TRY(CreateRestCall(server.OpenAiUrl(), /*api_key=*/"fake"));
+    nlohmann::json request = {
+        {"model", "gpt-4o"},
+        {"messages", {{{"role", "user"}, {"content", prompt}}}},
+        {"stream", backend == "openai_stream"}};
+    workload.arg.set_str(request.dump());
+    workload.endpoint = EndpointLimiter::EndpointOf(server.OpenAiUrl());
+    return workload;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown backend: ", backend));
+}
+
+// The HTTP backends return the bodies of failed calls, rather than errors.
+bool Failed(const absl::StatusOr<v0::Value>& result) {
+  return !result.ok() || result->str().empty() ||
+         absl::StartsWith(result->str(), "{\"error\"");
+}
+
+absl::Duration Percentile(const std::vector<absl::Duration>& sorted,
+                          double p) {
+  if (sorted.empty()) return absl::ZeroDuration();
+  return sorted[std::min<size_t>(sorted.size() - 1, sorted.size() * p)];
+}
+
+// The calls due to start, shared by the threads that make them.
+struct Schedule {
+  bool HasWork() const { return !due.empty() || done; }
+
+  // When each call that has not started yet was due to.
+  std::deque<absl::Time> due;
+  // Set once every call is due.
+  bool done = false;
+};
+
+absl::Status Measure(Runner& runner, const Workload& workload, double qps) {
+  const absl::Duration duration =
+      absl::Seconds(absl::GetFlag(FLAGS_duration_seconds));
+  const int64_t num_calls = absl::ToDoubleSeconds(duration) * qps;
+  const absl::Duration interval = absl::Seconds(1 / qps);
+
+  absl::Mutex mutex;
+  Schedule schedule;
+  std::vector<absl::Duration> latencies;
+  int64_t num_errors = 0;
+  absl::Duration max_start_delay;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < absl::GetFlag(FLAGS_max_in_flight); ++t) {
+    threads.emplace_back([&, runner]() mutable {
+      while (true) {
+        absl::Time scheduled;
+        {
+          absl::MutexLock lock(&mutex);
+          mutex.Await(absl::Condition(&schedule, &Schedule::HasWork));
+          if (schedule.due.empty()) return;
+          scheduled = schedule.due.front();
+          schedule.due.pop_front();
+          max_start_delay = std::max(max_start_delay, absl::Now() - scheduled);
+        }
+        const absl::StatusOr<v0::Value> result = runner.Run(workload.arg);
+        const absl::Duration latency = absl::Now() - scheduled;
+        absl::MutexLock lock(&mutex);
+        latencies.push_back(latency);
+        num_errors += Failed(result);
+      }
+    });
+  }
+
+  const absl::Time start = absl::Now();
+  for (int64_t i = 0; i < num_calls; ++i) {
+    const absl::Time scheduled = start + i * interval;
+    absl::SleepFor(scheduled - absl::Now());
+    absl::MutexLock lock(&mutex);
+    schedule.due.push_back(scheduled);
+  }
+  {
+    absl::MutexLock lock(&mutex);
+    schedule.done = true;
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << "qps=" << qps << ": " << latencies.size() << " calls, "
+            << latencies.size() / absl::ToDoubleSeconds(elapsed)
+            << " calls/s, p50 " << Percentile(latencies, 0.5) << ", p95 "
+            << Percentile(latencies, 0.95) << ", p99 "
+            << Percentile(latencies, 0.99) << ", max "
+            << Percentile(latencies, 1) << ", " << num_errors
+            << " errors, started up to " << max_start_delay << " late\n";
+  return absl::OkStatus();
+}
+
+absl::Status Run() {
+  std::unique_ptr<FakeModelServer> server = GENC_TRY(StartServer());
+  const Workload workload = GENC_TRY(CreateWorkload(*server));
+  if (const int concurrency = absl::GetFlag(FLAGS_endpoint_concurrency);
+      concurrency > 0) {
+    EndpointLimiter::Options options;
+    options.initial_concurrency = concurrency;
+    options.max_concurrency = concurrency;
+    GENC_TRY(EndpointLimiter::Default().SetOptions(workload.endpoint, options));
+  }
+  std::shared_ptr<Executor> executor = GENC_TRY(CreateExecutor());
+  Runner runner =
+      GENC_TRY(Runner::Create(workload.computation, std::move(executor)));
+
+  std::cout << "backend=" << absl::GetFlag(FLAGS_backend)
+            << " latency=" << absl::GetFlag(FLAGS_latency) << "("
+            << absl::GetFlag(FLAGS_latency_ms) << "ms)"
+            << " response_words=" << absl::GetFlag(FLAGS_response_words)
+            << " error_rate=" << absl::GetFlag(FLAGS_error_rate)
+            << " max_in_flight=" << absl::GetFlag(FLAGS_max_in_flight)
+            << "\n";
+  for (const std::string& qps_flag : absl::GetFlag(FLAGS_qps)) {
+    double qps = 0;
+    if (!absl::SimpleAtod(qps_flag, &qps) || qps <= 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid rate: ", qps_flag));
+    }
+    GENC_TRY(Measure(runner, workload, qps));
+  }
+
+  const EndpointLimiter::Metrics metrics =
+      EndpointLimiter::Default().metrics(workload.endpoint);
+  std::cout << "server: " << server->num_requests() << " requests, "
+            << server->num_errors() << " failed; client: "
+            << metrics.attempts - metrics.calls << " retries, concurrency "
+            << "limit " << metrics.concurrency_limit << ", max queue wait "
+            << metrics.max_queue_wait << "\n";
+  return absl::OkStatus();
+}
+
+}  // namespace
+}  // namespace testing
+}  // namespace genc
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  absl::Status status = genc::testing::Run();
+  if (!status.ok()) {
+    std::cerr << status << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -17,6 +17,7 @@ from genc.python.authoring.constructors import create_breakable_chain
 from genc.python.authoring.constructors import create_call
 from genc.python.authoring.constructors import create_conditional
 from genc.python.authoring.constructors import create_custom_function
+from genc.python.authoring.constructors import create_embed
 from genc.python.authoring.constructors import create_fallback
 from genc.python.authoring.constructors import create_inja_template
 from genc.python.authoring.constructors import create_lambda
@@ -32,13 +33,16 @@ from genc.python.authoring.constructors import create_prompt_template
 from genc.python.authoring.constructors import create_prompt_template_with_parameters
 from genc.python.authoring.constructors import create_reference
 from genc.python.authoring.constructors import create_regex_partial_match
+from genc.python.authoring.constructors import create_regex_router
 from genc.python.authoring.constructors import create_repeat
 from genc.python.authoring.constructors import create_repeated_conditional_chain
 from genc.python.authoring.constructors import create_rest_call
 from genc.python.authoring.constructors import create_rest_model_config
 from genc.python.authoring.constructors import create_selection
 from genc.python.authoring.constructors import create_serial_chain
+from genc.python.authoring.constructors import create_similarity
 from genc.python.authoring.constructors import create_struct
+from genc.python.authoring.constructors import create_top_k
 from genc.python.authoring.constructors import create_while
 from genc.python.authoring.constructors import create_wolfram_alpha
 from genc.python.authoring.tracing_decorator import traced_computation
@@ -44,6 +44,52 @@ def create_model_with_config(model_uri, model_config):
   return constructor_bindings.create_model_with_config(model_uri, model_config)
 
 
+def create_embed(model_uri, model_config=None):
+  """Creates an embedding computation with the given model URI and config.
+
+  The computation maps a string to a float tensor, or a struct of strings to a
+  struct of float tensors, which backends may embed in a single batch.
+
+  Args:
+    model_uri: The URI of the embedding model.
+    model_config: An optional config for the model.
+
+  Returns:
+    A computation that represents the embedding.
+  """
+  if model_config is None:
+    return constructor_bindings.create_embed(model_uri)
+  return constructor_bindings.create_embed(model_uri, model_config)
+
+
+def create_similarity(metric="cosine"):
+  """Creates a computation that scores the similarity of two float tensors.
+
+  Args:
+    metric: One of "cosine", "dot" (the dot product) or "l2" (the negated
+      squared Euclidean distance). Higher scores are always more similar.
+
+  Returns:
+    A computation that maps a struct of two tensors to a float score.
+  """
+  return constructor_bindings.create_similarity(metric)
+
+
+def create_top_k(k, metric="cosine"):
+  """Creates a computation that finds the tensors most similar to a query.
+
+  Args:
+    k: The maximum number of results.
+    metric: The similarity metric, as in `create_similarity`.
+
+  Returns:
+    A computation that maps a struct of a query tensor and a struct of
+    candidate tensors to a struct of up to k (index, score) structs, most
+    similar first.
+  """
+  return constructor_bindings.create_top_k(k, metric)
+
+
 def create_rest_model_config(endpoint, api_key="", json_request_template=""):
   """Creates a model computation with the given model URI and model config.
 
@@ -57,7 +103,8 @@ def create_rest_model_config(endpoint, api_key="", json_request_template=""):
     with create_model_with_config.
   """
   if json_request_template:
-    return constructor_bindings.create_rest_model_config_with_json_request_template(
+    bindings = constructor_bindings
+    return bindings.create_rest_model_config_with_json_request_template(
         endpoint, api_key, json_request_template)
   else:
     return constructor_bindings.create_rest_model_config(endpoint, api_key)
@@ -108,6 +155,22 @@ def create_regex_partial_match(pattern_string):
   return constructor_bindings.create_regex_partial_match(pattern_string)
 
 
+def create_regex_router(routes, default_fn=None):
+  """Creates a router that dispatches a string to the first matching branch.
+
+  All patterns are compiled together and matched in a single pass over the
+  input, which is cheaper than a chain of conditionals over partial matches.
+
+  Args:
+    routes: A list of (pattern_string, branch_fn) pairs, tried in order.
+    default_fn: An optional function to apply when no pattern matches.
+
+  Returns:
+    A computation that represents the regex router intrinsic.
+  """
+  return constructor_bindings.create_regex_router(routes, default_fn)
+
+
 def create_reference(name):
   """Constructs a reference to `name`.
 
@@ -20,7 +20,14 @@ def create_config(model_path, **kwargs):
   Args:
     model_path: The path to the model.
     **kwargs: Optional keyword arguments to pass to LlamaCpp, such as the
-      number of threads or max number of tokens.
+      number of threads or max number of generated tokens, the context size
+      per request and batch sizes (n_ctx, n_batch, n_ubatch), and sampling
+      parameters (temperature, top_k, top_p, repetition_penalty,
+      repetition_last_n, seed). `draft_model_path` enables speculative
+      decoding with a smaller model that proposes `num_draft_tokens` tokens
+      per step.
+      `memory_budget_mb` caps the total size of the models loaded in the
+      process, evicting the least recently used idle ones.
 
   Returns:
     An instance of the `dict` object.